@@ -20,6 +20,11 @@
 #include <netdb.h>
 
 #include "../tools/tools-utils.c"
+#include "../tools/slip-decode.c"
+#include "../tools/slip-queue.c"
+#include "../tools/slip-dev.c"
+#include "../tools/tcp-framing.c"
+#include "../tools/pcapng-tap.c"
 
 #ifndef BAUDRATE
 #define BAUDRATE B115200
@@ -32,22 +37,31 @@
 #define MIN_DEVMTU 1500
 // #define WIRESHARK_IMPORT_FORMAT 1
 
-#define SLIP_END      0300
-#define SLIP_ESC      0333
-#define SLIP_ESC_END  0334
-#define SLIP_ESC_ESC  0335
-
 speed_t b_rate = BAUDRATE;
 
-unsigned char slip_buf[BUFSIZE];
-unsigned int slip_end=0;
-unsigned int slip_begin=0;
+struct slip_queue slip_queue; /* pre-escaped frames waiting for the serial line */
+int queue_depth = SLIP_QUEUE_DEFAULT_DEPTH;
+int queue_low = -1, queue_high = -1;
+int queue_policy = SLIP_QUEUE_BACKPRESSURE;
 int timestamp=0;
 int verbose=0;
 
-int slipfd = 0, tunfd=0, socketfd=0;
+int slipfd = 0, tunfd=-1, socketfd=0;
 int is_server=-1;
 
+struct slip_queue tcp_queue; /* framed packets waiting for the TCP peer */
+struct tcp_frame_decoder tcp_decoder;
+int frame_flags = 0;         /* TCP_FRAME_SEQ and/or TCP_FRAME_TIME */
+uint32_t frame_seq = 0;
+int coalesce = 1;            /* several packets per TCP segment */
+int tcp_connected = 0;
+int tcp_connecting = 0;
+time_t tcp_retry = 0;
+struct addrinfo *peer_info = NULL;
+
+struct pcapng_tap capture; /* -w: packets to and from serial in a pcapng ring file */
+struct pcapng_tap *capture_tap = NULL;
+
 /* prints the current time*/
 void
 stamptime(void)
@@ -77,16 +91,6 @@ stamptime(void)
 	}
 }
 
-/* opens a device */
-int
-devopen(const char *dev, int flags)
-{
-  char t[1024];
-  strcpy(t, "/dev/");
-  strncat(t, dev, sizeof(t) - 5);
-  return open(t, flags);
-}
-
 /* checks if the string only contains alfanumeric characters, '0', '\r', '\n', or '\t' */
 int
 is_sensible_string(const unsigned char *s, int len)
@@ -112,79 +116,18 @@ get_in_addr(struct sockaddr *sa)
 	return &(((struct sockaddr_in6*)sa)->sin6_addr);
 }
 
-/* Configuration of SLIP communications (a.o. baudrate) */
-void
-stty_telos(int fd)
-{
-	struct termios tty;
-	speed_t speed = b_rate;
-
-	if(tcflush(fd, TCIOFLUSH) == -1) err(1, "tcflush"); /* flush data received but not read, and data written but not send */
-
-	if(tcgetattr(fd, &tty) == -1) err(1, "tcgetattr"); /* store properties of fd in tty */
-
-	cfmakeraw(&tty); /* set attributes in tty to raw mode */
-
-	/* Nonblocking read without flow control */
-	tty.c_cc[VTIME] = 0;
-	tty.c_cc[VMIN] = 0;
-	tty.c_cflag &= ~CRTSCTS;
-	tty.c_iflag &= ~IXON;
-	tty.c_iflag &= ~IXOFF & ~IXANY;
-	tty.c_cflag &= ~HUPCL;
-	tty.c_cflag &= ~CLOCAL;
-
-	cfsetispeed(&tty, speed);
-	cfsetospeed(&tty, speed);
-
-	tty.c_cflag |= CLOCAL;
-	if(tcsetattr(fd, TCSAFLUSH, &tty) == -1) err(1, "tcsetattr");
-
-	int i = TIOCM_DTR;
-    if(ioctl(fd, TIOCMBIS, &i) == -1) err(1, "ioctl"); /* flush data received but not read, and data written but not send */
-
-	usleep(10*1000);		/* Wait for hardware 10ms. */
-
-	/* Flush input and output buffers. */
-	if(tcflush(fd, TCIOFLUSH) == -1) err(1, "tcflush");
-}
-
-/* Add character to SLIP-buffer, file descriptor is passed for readability of code but is not used in this method */
-void
-slip_send(unsigned char c)
-{
-	if(slip_end >= sizeof(slip_buf)) {
-		err(1, "slip_send overflow");
-	}
-	slip_buf[slip_end] = c;
-	slip_end++;
-}
-
 int
 slip_empty()
 {
-	return slip_end == 0;
+	return slip_queue_empty(&slip_queue);
 }
 
-/* empties slip_buf to the given fd */
+/* writes as many queued frames as possible to the given fd */
 void
 slip_flushbuf(int fd)
 {
-	int n;
-
-	if(slip_empty()) { /* nothing to flush */
-		return;
-	}
-
-	n = write(fd, slip_buf + slip_begin, (slip_end - slip_begin));
-
-	if(n == -1 && errno != EAGAIN) { /* Write would block while in non-blocking mode */
+	if(slip_queue_flush(&slip_queue, fd, 0) == -1) {
 		err(1, "slip_flushbuf write failed");
-	} else {
-		slip_begin += n;
-		if(slip_begin == slip_end) { /* all data is written, reset begin and end */
-			slip_begin = slip_end = 0;
-		}
 	}
 }
 
@@ -193,10 +136,22 @@ void
 cleanup(void)
 {
 	close(slipfd);
-	close(tunfd);
+	if(tunfd >= 0) {
+		close(tunfd);
+	}
     if(is_server){
         close(socketfd);
     }
+	if(verbose>0) {
+		slip_queue_print_stats(&slip_queue, "slip queue", stderr);
+		slip_queue_print_stats(&tcp_queue, "tcp queue", stderr);
+		if(capture_tap != NULL) {
+			pcapng_tap_print_stats(capture_tap, stderr);
+		}
+		fprintf(stderr, "tcp received %lu packets %lu bytes, lost %lu, duplicates %lu\n",
+				tcp_decoder.frames, tcp_decoder.bytes, tcp_decoder.lost, tcp_decoder.duplicates);
+	}
+	pcapng_tap_close(capture_tap);
 	printf("exiting program\n");
 	exit(0);
 }
@@ -209,214 +164,241 @@ sigcleanup(int signal)
 	cleanup();
 }
 
-/* Read from serial, write to tunnel.  */
+/* prints a packet in hex for verbose level 5 and up */
 void
-serial_to_tun(FILE *inslip, int outfd)
+print_packet(const unsigned char *p, int len)
 {
-	static union {
-		unsigned char inbuf[BUFSIZE];
-	} uip;
-
-    static int inbufptr = 0;
-	int ret,i;
-	unsigned char c;
+	int i;
+	#if WIRESHARK_IMPORT_FORMAT
+		printf("0000");
+		for(i = 0; i < len; i++) printf(" %02x", p[i]);
+	#else
+		printf("         ");
+		for(i = 0; i < len; i++) {
+			printf("%02x", p[i]);
+			if((i & 3) == 3) printf(" ");
+			if((i & 15) == 15) printf("\n         ");
+		}
+	#endif
+	printf("\n");
+}
 
-	/* read 1 character from serial connection */
-	ret = fread(&c, 1, 1, inslip);
-	if(ret == -1 || ret == 0) err(1, "serial_to_tun: read"); /* problem reading or no data*/
-	goto after_fread;
+/* connection to the TCP peer is lost, keep everything else running */
+void
+tcp_disconnect(const char *why)
+{
+	if(timestamp) stamptime();
+	printf("Connection terminated (%s), starting reconnect.\n", why);
+	close(tunfd);
+	tunfd = -1;
+	tcp_connected = 0;
+	tcp_connecting = 0;
+	/* a partially sent packet is sent again in full on the next connection */
+	slip_queue_rewind(&tcp_queue);
+	tcp_frame_decoder_reset(&tcp_decoder);
+	tcp_retry = time(NULL) + 1;
+}
 
-	read_more:
-	if(inbufptr >= sizeof(uip.inbuf)) {
-		if(timestamp) stamptime();
-		fprintf(stderr, "*** dropping large %d byte packet\n",inbufptr);
-		inbufptr = 0;
+/* writes as many queued packets as possible to the TCP peer */
+void
+tcp_flush(void)
+{
+	if(!tcp_connected || slip_queue_empty(&tcp_queue)) {
+		return;
 	}
-	ret = fread(&c, 1, 1, inslip);
-
-	after_fread:
-	if(ret == -1) {
-		err(1, "serial_to_tun: read");
+	if(coalesce) {
+		tcp_frame_cork(tunfd, 1);
 	}
-	if(ret == 0) { /* end of packet*/
-        clearerr(inslip); /* reset input state */
-		return; /* */
+	if(slip_queue_flush(&tcp_queue, tunfd, 0) == -1) {
+		tcp_disconnect(strerror(errno));
+		return;
 	}
-	switch(c) { /* process byte */
-		case SLIP_END: /* end of slip message, process tasks about message here */
-		if(inbufptr > 0) { /* buffer is not empty */
-			if(uip.inbuf[0] == '!') { /* SLIP command response */
-				printf("command response received: %s\n",uip.inbuf);
-			} else if(uip.inbuf[0] == '?') { /* SLIP command request */
-				printf("command request received: %s\n",uip.inbuf);
-			} else if(uip.inbuf[0] == DEBUG_LINE_MARKER) { /* SLIP debug line, print buffer to stdout */
-				fwrite(uip.inbuf + 1, inbufptr - 1, 1, stdout);
-			} else if(uip.inbuf[0] == IPV6_VERSION_CHAR){
-				printf("IPv6 packet received:\n");
-				if(verbose>4){
-					#if WIRESHARK_IMPORT_FORMAT
-						printf("0000");
-						for(i = 0; i < inbufptr; i++) printf(" %02x",uip.inbuf[i]);
-					#else
-						printf("         ");
-						for(i = 0; i < inbufptr; i++) {
-							printf("%02x", uip.inbuf[i]);
-							if((i & 3) == 3) printf(" ");
-							if((i & 15) == 15) printf("\n         ");
-						}
-					#endif
-					printf("\n");
-				}
-                if(write(outfd, uip.inbuf, inbufptr) != inbufptr) { /* write packet to output file descriptor */
-                    err(1, "serial_to_tun: write");
-                }
-			
-			} else { /* normal packet */
-				printf("\n\n%x\n\n",uip.inbuf[0]);
-				if(verbose>2) { /* write some info about packet */
-					if (timestamp) stamptime();
-					printf("Packet from SLIP of length %d.\n", inbufptr);
-					if (verbose>4) { /* print whole packet */
-						#if WIRESHARK_IMPORT_FORMAT
-							printf("0000");
-							for(i = 0; i < inbufptr; i++) printf(" %02x",uip.inbuf[i]);
-						#else
-							printf("         ");
-							for(i = 0; i < inbufptr; i++) {
-								printf("%02x", uip.inbuf[i]);
-								if((i & 3) == 3) printf(" ");
-								if((i & 15) == 15) printf("\n         ");
-							}
-						#endif
-						printf("\n");
-					}
-				}
-				if(write(outfd, uip.inbuf, inbufptr) != inbufptr) { /* write packet to output file descriptor */
-					err(1, "serial_to_tun: write");
-				}
-			}
-			inbufptr = 0;
-		}
-		break;
+	if(coalesce) {
+		tcp_frame_cork(tunfd, 0); /* push out the last partial segment */
+	}
+}
 
-		case SLIP_ESC: /* escape char found, next char needs to be taken litteraly*/
+/* frames a packet and queues it for the TCP peer
+ * packets are kept while the connection is down and sent after reconnecting */
+void
+tcp_send(const unsigned char *inbuf, int len)
+{
+	unsigned char frame[TCP_FRAME_HDR_MAX + BUFSIZE];
+	int framelen;
 
-		/* try reading the escaped character 
-		 * if reading fails, the method returns
-		 */
-		if(fread(&c, 1, 1, inslip) != 1) { 
-			clearerr(inslip);
-			/* Put ESC back and give up! */
-			ungetc(SLIP_ESC, inslip);
-			return;
-		}
-		switch(c) { /* translate escape sequence to escaped character */
-			case SLIP_ESC_END:
-			c = SLIP_END;
-			break;
-			case SLIP_ESC_ESC:
-			c = SLIP_ESC;
-			break;
-		}
+	framelen = tcp_frame_encode(frame, inbuf, len, frame_flags, frame_seq++);
+	if(slip_queue_count(&tcp_queue) == tcp_queue.depth) {
+		tcp_flush(); /* make room before the oldest packet is dropped */
+	}
+	slip_queue_put_raw(&tcp_queue, frame, framelen);
+	if(!coalesce) {
+		tcp_flush();
+	}
+}
 
-		/* FALLTHROUGH */
-		default:
-		uip.inbuf[inbufptr++] = c;
+/* Called by the SLIP decoder for every complete frame from serial */
+void
+serial_frame(struct slip_decoder *d, unsigned char *inbuf, int len)
+{
+	int i;
 
-		/* Echo lines as they are received for verbose=2,3,5+ */
-		/* Echo all printable characters for verbose==4 */
-		if((verbose==2) || (verbose==3) || (verbose>4)) {
-			if(c=='\n') {
-				if(is_sensible_string(uip.inbuf, inbufptr)) {
-					if (timestamp) stamptime();
-					fwrite(uip.inbuf, inbufptr, 1, stdout);
-					inbufptr=0;
-				}
-			}
-		} else if(verbose==4) {
+	(void)d;
+
+	if(verbose==4) { /* echo all printable characters */
+		for(i = 0; i < len; i++) {
+			unsigned char c = inbuf[i];
 			if(c == 0 || c == '\r' || c == '\n' || c == '\t' || (c >= ' ' && c <= '~')) {
 				fwrite(&c, 1, 1, stdout);
 				if(c=='\n') if(timestamp) stamptime();
 			}
 		}
-		break;
 	}
-	goto read_more;
+
+	if(inbuf[0] == '!') { /* SLIP command response */
+		printf("command response received: %.*s\n", len, inbuf);
+	} else if(inbuf[0] == '?') { /* SLIP command request */
+		printf("command request received: %.*s\n", len, inbuf);
+	} else if(inbuf[0] == DEBUG_LINE_MARKER) { /* SLIP debug line, print buffer to stdout */
+		fwrite(inbuf + 1, len - 1, 1, stdout);
+	} else if(inbuf[0] == IPV6_VERSION_CHAR){
+		printf("IPv6 packet received:\n");
+		if(verbose>4){
+			print_packet(inbuf, len);
+		}
+		pcapng_tap_packet(capture_tap, PCAPNG_TAP_IN, inbuf, len);
+		tcp_send(inbuf, len); /* queue packet for the TCP peer */
+	} else { /* normal packet */
+		printf("\n\n%x\n\n",inbuf[0]);
+		if(verbose>2) { /* write some info about packet */
+			if (timestamp) stamptime();
+			printf("Packet from SLIP of length %d.\n", len);
+			if (verbose>4) { /* print whole packet */
+				print_packet(inbuf, len);
+			}
+		}
+		pcapng_tap_packet(capture_tap, PCAPNG_TAP_IN, inbuf, len);
+		tcp_send(inbuf, len); /* queue packet for the TCP peer */
+	}
+}
+
+/* Called by the SLIP decoder for printable lines outside of SLIP frames */
+void
+serial_line(struct slip_decoder *d, unsigned char *inbuf, int len)
+{
+	(void)d;
+
+	if (timestamp) stamptime();
+	fwrite(inbuf, len, 1, stdout);
+}
+
+/* Read from serial, write to tunnel.
+ * Everything available on the serial line is read in blocks and decoded
+ * at once, partial frames are kept in the decoder until the next call. */
+void
+serial_to_tun(struct slip_decoder *dec)
+{
+	unsigned long dropped = dec->dropped;
+	ssize_t ret;
+
+	ret = slip_decoder_read(dec, slipfd);
+	if(ret == 0 || (ret == -1 && errno != EAGAIN)) {
+		err(1, "serial_to_tun: read"); /* problem reading or end of file */
+	}
+	if(dec->dropped != dropped) {
+		if(timestamp) stamptime();
+		fprintf(stderr, "*** dropping large packet (%lu dropped so far)\n", dec->dropped);
+	}
+	tcp_flush(); /* all packets of this read in as few segments as possible */
 }
 
-/* escapes special characters and does the actual writing */
+/* escapes special characters and queues the packet for writing */
 void
 write_to_serial(void *inbuf, int len)
 {
 	u_int8_t *p = inbuf;
-	int i;
 
 	if(verbose>2) { /* write some info about packet */
 		if (timestamp) stamptime();
 		printf("Packet from TUN of length %d - write SLIP\n", len);
 		if (verbose>4) { /* print whole packet */
-			#if WIRESHARK_IMPORT_FORMAT
-				printf("0000");
-				for(i = 0; i < len; i++) printf(" %02x", p[i]);
-			#else
-				printf("         ");
-				for(i = 0; i < len; i++) {
-					printf("%02x", p[i]);
-					if((i & 3) == 3) printf(" ");
-					if((i & 15) == 15) printf("\n         ");
-				}
-			#endif
-			printf("\n");
+			print_packet(p, len);
 		}
 	}
 
-	for(i = 0; i < len; i++) { /* add escape for special characters */
-		switch(p[i]) {
-			case SLIP_END:
-            slip_send(SLIP_ESC);
-            slip_send(SLIP_ESC_END);
-			break;
-			case SLIP_ESC:
-            slip_send(SLIP_ESC);
-            slip_send(SLIP_ESC_ESC);
-			break;
-			default:
-            slip_send(p[i]);
-			break;
-		}
+	pcapng_tap_packet(capture_tap, PCAPNG_TAP_OUT, p, len);
+
+	/* escape special characters and queue the frame for the serial line */
+	if(slip_queue_count(&slip_queue) == slip_queue.depth) {
+		slip_flushbuf(slipfd); /* make room before the packet is dropped */
+	}
+	if(slip_queue_put(&slip_queue, p, len, 0) == -1 && verbose>2) {
+		if (timestamp) stamptime();
+		printf("Packet from TUN of length %d dropped, %d packets queued\n", len, slip_queue_count(&slip_queue));
 	}
+}
 
-    slip_send(SLIP_END); /* append real end of message */
+/* Called by the frame decoder for every packet from the TCP peer */
+void
+tcp_packet(struct tcp_frame_decoder *d, unsigned char *packet, int len)
+{
+	if(verbose>2 && (d->flags & TCP_FRAME_TIME)) {
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		if (timestamp) stamptime();
+		printf("Packet %lu from TCP, %lld us in transit\n", (unsigned long)d->seq,
+				(long long)((uint64_t)tv.tv_sec * 1000000 + tv.tv_usec - d->usec));
+	}
+	write_to_serial(packet, len);
 }
 
 /* Read from tunnel, write to serial. */
-int
-tun_to_serial(int infd)
+void
+tun_to_serial(void)
 {
-	struct {
-		unsigned char inbuf[BUFSIZE];
-	} uip;
-	int size;
-
-	if((size = read(infd, uip.inbuf, BUFSIZE)) == -1) err(1, "tun_to_serial: read");
+	unsigned long lost = tcp_decoder.lost;
+	ssize_t ret;
+
+	ret = tcp_frame_decoder_read(&tcp_decoder, tunfd);
+	if(ret == 0) {
+		tcp_disconnect("closed by peer");
+	} else if(ret == -2) {
+		tcp_disconnect("bad framing");
+	} else if(ret == -1 && errno != EAGAIN) {
+		tcp_disconnect(strerror(errno));
+	} else if(tcp_decoder.lost != lost && verbose>0) {
+		if (timestamp) stamptime();
+		fprintf(stderr, "*** %lu packets lost on the TCP link\n", tcp_decoder.lost - lost);
+	}
+}
 
-    write_to_serial(uip.inbuf, size);
-	return size;
+/* a connection to the TCP peer has been set up */
+void
+tcp_established(void)
+{
+	fcntl(tunfd, F_SETFL, O_NONBLOCK);
+	tcp_frame_cork(tunfd, 0);
+	tcp_connected = 1;
+	tcp_connecting = 0;
+	if (timestamp) stamptime();
+	printf("%s connected, %d packets waiting\n", is_server ? "client" : "server",
+			slip_queue_count(&tcp_queue));
+	tcp_flush();
 }
 
 void
 start_server(int socket_type, int *socketfd, const char* TCP_address, struct sockaddr_in *server_address){
+    int on = 1;
     /* AF_UNSPEC in this context means no preference for IPv4 or IPv6, default is currently IPv4 */
     if(socket_type == AF_UNSPEC){
         socket_type = AF_INET;
     }
     *socketfd = socket(socket_type, SOCK_STREAM, 0);
-    //fcntl(*socketfd, F_SETFL, O_NONBLOCK);
 
     if(*socketfd<0){
         err(1, "cannot open TCP-socket");
     }
     printf("opened socket\n");
+    setsockopt(*socketfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
     memset(server_address,0,sizeof(*server_address));
     int port = htons(atoi(TCP_address));
     (*server_address).sin_family = AF_INET;
@@ -427,20 +409,84 @@ start_server(int socket_type, int *socketfd, const char* TCP_address, struct soc
     }
     printf("bound to port\n");
     listen(*socketfd,1);
+    /* connections are accepted from the main loop, also after the client went away */
+    fcntl(*socketfd, F_SETFL, O_NONBLOCK);
     printf("started listening\n");
 }
 
+/* server accepts a (new) client, the serial side keeps running while it waits */
+void
+tcp_accept(void)
+{
+	struct sockaddr_in client_address;
+	socklen_t length = sizeof(client_address);
+
+	tunfd = accept(socketfd, (struct sockaddr *) &client_address, &length);
+	if(tunfd == -1) {
+		return;
+	}
+	printf("accepted connection\n");
+	tcp_established();
+}
+
+/* starts a non-blocking connection attempt to the server */
+void
+tcp_connect_start(void)
+{
+	struct addrinfo *p;
+
+	for(p = peer_info; p != NULL; p = p->ai_next) {
+		if((tunfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+			perror("client: socket");
+			continue;
+		}
+		fcntl(tunfd, F_SETFL, O_NONBLOCK);
+		if(connect(tunfd, p->ai_addr, p->ai_addrlen) == 0) {
+			tcp_established();
+			return;
+		}
+		if(errno == EINPROGRESS) {
+			tcp_connecting = 1;
+			return;
+		}
+		close(tunfd);
+		tunfd = -1;
+	}
+	tcp_retry = time(NULL) + 5; /* wait 5 seconds to retry */
+}
+
+/* a non-blocking connection attempt finished */
+void
+tcp_connect_done(void)
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+
+	if(getsockopt(tunfd, SOL_SOCKET, SO_ERROR, &error, &length) == -1 || error != 0) {
+		printf("client: connect: %s\n", strerror(error));
+		close(tunfd);
+		tunfd = -1;
+		tcp_connecting = 0;
+		tcp_retry = time(NULL) + 5; /* wait 5 seconds to retry */
+		return;
+	}
+	tcp_established();
+}
+
 void
-start_client_count(int trycount, const char* TCP_address, const char* host){
-    char * separator = strchr(TCP_address,':');
+start_client(const char* TCP_address){
+    char * separator = strrchr(TCP_address,':');
+    if(separator == NULL){
+        err(1, "address ``%s'' is not IP-address:port", TCP_address);
+    }
     int separator_position = (int)(separator - TCP_address);
     char address[separator_position+1];
     memcpy(address,TCP_address,separator_position);
     address[separator_position] = '\0' ;
     char * port = (separator+1);
-    /* create client socket and get server info via getaddrinfo */
+    /* get server info via getaddrinfo once, connections are made from the main loop */
     printf("Client trying to connect to: %s:%s\n", address, port);
-    struct addrinfo hints, *servinfo, *p;
+    struct addrinfo hints;
 
     memset(&hints, 0, sizeof hints);
     hints.ai_family = AF_UNSPEC;
@@ -448,60 +494,10 @@ start_client_count(int trycount, const char* TCP_address, const char* host){
 
     int rv;
     /* get all possible server info about host and port */
-    if((rv = getaddrinfo(address, port, &hints, &servinfo)) != 0) {
+    if((rv = getaddrinfo(address, port, &hints, &peer_info)) != 0) {
         err(1, "getaddrinfo: %s", gai_strerror(rv));
     }
-    int count = 0;
-    while(count<trycount){
-        /* loop through all the results and connect to the first we can */
-        for(p = servinfo; p != NULL; p = p->ai_next) {
-            if((tunfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
-                perror("client: socket");
-                continue;
-            }
-            if(connect(tunfd, p->ai_addr, p->ai_addrlen) == -1) {
-                close(tunfd);
-                perror("client: connect");
-                continue;
-            }
-            count=trycount;
-            break;
-        }
-        count++;
-        int sleepRemaining = usleep(5*1000*1000);/*wait 5 seconds to retry*/
-        if(sleepRemaining){
-            printf("did not sleep\n");
-        }
-
-    }
-    /* tried all services returned by getaddrinfo but failed to connect */
-    if(p == NULL) {
-        err(1, "can't connect to ``%s:%s''", host, port);
-    }
-
-    printf("Client connected\n");
-    /* all done with this structure */
-    freeaddrinfo(servinfo);
-}
-
-void reconnect_server(struct sockaddr_in client_address){
-    /* server has to wait for client to reconnect, needs no extra setup because server is still listening on socketfd */
-    socklen_t length = sizeof(client_address);
-
-    printf("waiting for connection\n");
-    tunfd = accept(socketfd, (struct sockaddr *) &client_address, &length);
-    printf("accepted connection\n");
-}
-
-void
-start_client(const char* TCP_address, const char* host){
-    start_client_count(1,TCP_address,host);
-}
-
-void
-reconnect_client (const char* TCP_address, const char* host){
-    /* client tries 5 times to reconnect to server, this has to be restarted completely */
-    start_client_count(5,TCP_address, host);
+    tcp_connect_start();
 }
 
 int
@@ -511,14 +507,16 @@ main(int argc, char **argv)
 	int devmtu = MIN_DEVMTU;
     int socket_type = AF_UNSPEC;
 
-	struct sockaddr_in server_address, client_address;
+	struct sockaddr_in server_address;
+	static unsigned char tcp_buf[TCP_FRAME_HDR_MAX + BUFSIZE];
 
 	const char *TCP_address = NULL;
 	const char *siodev = NULL;
 	const char *host = NULL;
 	const char *port = NULL;
 	const char *prog = argv[0];
-	FILE *inslip;
+	static unsigned char frame_buf[BUFSIZE];
+	struct slip_decoder dec;
 
 	int c;
 	int ret;
@@ -526,7 +524,7 @@ main(int argc, char **argv)
 	setvbuf(stdout, NULL, _IOLBF, 0); /* Line buffered output. */
 
 	/* process arguments */
-	while((c = getopt(argc, argv, "B:M:LSCT:s:a:p:v::h")) != -1) {
+	while((c = getopt(argc, argv, "B:M:LSCT:s:a:p:q:Df:Nw:v::h")) != -1) {
 		switch(c) {
 			case 'B':
 			baudrate = atoi(optarg);
@@ -575,6 +573,32 @@ main(int argc, char **argv)
 			TCP_address = optarg;
 			break;
 
+			case 'q':
+			if(sscanf(optarg, "%d,%d,%d", &queue_depth, &queue_low, &queue_high) < 1) {
+				err(1, "bad queue size ``%s''", optarg);
+			}
+			break;
+
+			case 'D':
+			queue_policy = SLIP_QUEUE_DROP_OLDEST;
+			break;
+
+			case 'f':
+			if(strstr(optarg, "seq") != NULL) frame_flags |= TCP_FRAME_SEQ;
+			if(strstr(optarg, "time") != NULL) frame_flags |= TCP_FRAME_TIME;
+			break;
+
+			case 'N':
+			coalesce = 0;
+			break;
+
+			case 'w':
+			if(pcapng_tap_open(&capture, optarg) == -1) {
+				exit(1);
+			}
+			capture_tap = &capture;
+			break;
+
 			case '?':
 			case 'h':
 			default:
@@ -594,6 +618,19 @@ main(int argc, char **argv)
 			fprintf(stderr," -T address     When endpoint is a client, specifies the address of the \n");
 			fprintf(stderr,"                server-endpoint (IP-address:port), when endpoint is a server,\n");
 			fprintf(stderr,"                specifies the port to listen to (port).\n");
+			fprintf(stderr," -q depth[,low,high]\n");
+			fprintf(stderr,"                Packets queued for the serial line (default %d) and the\n", SLIP_QUEUE_DEFAULT_DEPTH);
+			fprintf(stderr,"                watermarks between which reading from the tunnel pauses\n");
+			fprintf(stderr," -D             Drop the oldest queued packet when the queue is full\n");
+			fprintf(stderr,"                instead of pausing the tunnel\n");
+			fprintf(stderr," -f seq,time    Add sequence numbers and/or timestamps to the packets\n");
+			fprintf(stderr,"                sent to the other endpoint\n");
+			fprintf(stderr," -N             Send every packet in its own TCP segment instead of\n");
+			fprintf(stderr,"                coalescing the packets of one serial read\n");
+			fprintf(stderr," -w file[,size=MB][,snap=bytes][,rate=pps][,wpan]\n");
+			fprintf(stderr,"                Capture packets to and from serial in a pcapng ring file\n");
+			fprintf(stderr,"                (default 16 MB), cut at snap bytes, at most pps packets/s\n");
+			fprintf(stderr,"                per direction, as raw IPv6 or as IEEE 802.15.4 frames\n");
 			exit(1);
 			break;
 		}
@@ -675,16 +712,25 @@ main(int argc, char **argv)
 		}
 		if (timestamp) stamptime();
 		fprintf(stderr, "********SLIP started on ``/dev/%s''\n", siodev);
-		stty_telos(slipfd);
+		if(stty_telos(slipfd, b_rate, 0) == -1) exit(1); /* configuration of SLIP communications (a.o. baudrate) */
 	}
 
 	/* start of communication */
-    slip_send(SLIP_END);
-	/* stream for reading */
-	inslip = fdopen(slipfd, "r");
-	if(inslip == NULL) err(1, "main: fdopen");
+	slip_queue_init(&slip_queue, queue_depth, BUFSIZE, queue_low, queue_high, queue_policy);
+	slip_queue_put_raw(&slip_queue, "\300", 1); /* SLIP_END */
+	/* decoder for reading, frames are queued for the TCP peer */
+	slip_decoder_init(&dec, frame_buf, sizeof(frame_buf), serial_frame, NULL);
+	if((verbose==2) || (verbose==3) || (verbose>4)) {
+		/* Echo lines as they are received for verbose=2,3,5+ */
+		dec.flags |= SLIP_DECODE_LINES;
+		dec.line = serial_line;
+	}
 
 
+	/* packets for the TCP peer are kept while it is (re)connecting, oldest dropped first */
+	slip_queue_init(&tcp_queue, queue_depth, BUFSIZE, -1, -1, SLIP_QUEUE_DROP_OLDEST);
+	tcp_frame_decoder_init(&tcp_decoder, tcp_buf, sizeof(tcp_buf), tcp_packet, NULL);
+
 	if(is_server==-1){
 		err(1,"Server or client role not set");
 		tunfd = STDOUT_FILENO;
@@ -692,18 +738,14 @@ main(int argc, char **argv)
 		err(1,"address not set");
 	}
 	else if(is_server){
-        /* setup TCP server and listen for connection of other end */
+        /* setup TCP server, the connection of the other end is accepted in the main loop */
 		printf("server: %s\n",TCP_address);
         start_server(socket_type, &socketfd, TCP_address, &server_address);
-        __socklen_t length = sizeof(client_address);
-
 		printf("waiting for connection\n");
-        tunfd = accept(socketfd, (struct sockaddr *) &client_address, &(length));
-		printf("accepted connection\n");
 	} else {
-        /* setup TCP client and try to connect to server */
+        /* setup TCP client and start connecting to server */
 		printf("client: %s\n",TCP_address);
-        start_client(TCP_address, host);
+        start_client(TCP_address);
 	}
 
 	/* set signaling functions */
@@ -711,6 +753,7 @@ main(int argc, char **argv)
 	signal(SIGHUP, sigcleanup);
 	signal(SIGTERM, sigcleanup);
 	signal(SIGINT, sigcleanup);
+	signal(SIGPIPE, SIG_IGN); /* a lost TCP peer is noticed by write() */
 
 	/* Processing info to and from the SLIP connection */
 	
@@ -725,6 +768,7 @@ main(int argc, char **argv)
 
   	fd_set rset, wset;
 	while(1) {
+		struct timeval timeout, *tvp = NULL;
 		int maxfd = 0;
 		/* clear sets */
 		FD_ZERO(&rset);
@@ -738,43 +782,60 @@ main(int argc, char **argv)
 		FD_SET(slipfd, &rset);	/* Read from slip ASAP! */
 		if(slipfd > maxfd) maxfd = slipfd; /* update maxfd if current fd is bigger */
 
-        /* We only have one packet at a time queued for slip output. */
-		if(slip_empty()) {
-			FD_SET(tunfd, &rset);
+		if(tcp_connected) {
+			/* Read from the TCP peer as long as the slip queue accepts packets. */
+			if(slip_queue_accepting(&slip_queue)) {
+				FD_SET(tunfd, &rset);
+			}
+			if(!slip_queue_empty(&tcp_queue)) {
+				FD_SET(tunfd, &wset);
+			}
+			if(tunfd > maxfd) maxfd = tunfd;
+		} else if(tcp_connecting) {
+			FD_SET(tunfd, &wset); /* writable when the connection attempt finishes */
 			if(tunfd > maxfd) maxfd = tunfd;
+		} else if(is_server) {
+			FD_SET(socketfd, &rset); /* wait for the client to (re)connect */
+			if(socketfd > maxfd) maxfd = socketfd;
+		} else {
+			timeout.tv_sec = 1; /* wait to retry connecting to the server */
+			timeout.tv_usec = 0;
+			tvp = &timeout;
 		}
 
-        ret = select(maxfd + 1, &rset, &wset, NULL, NULL);
-        /* Will continue to select the fd of the socket-connection (tunfd) for reading (&rset)
-         * if a zero-byte message has been sent to this socket
-         * this is expected behaviour
-         * TODO: check for closure of the socket */
-		
+        ret = select(maxfd + 1, &rset, &wset, NULL, tvp);
+
 		if(ret == -1 && errno != EINTR) {
 			err(1, "select");
-		} else if(ret > 0) {
+		}
+
+		if(!is_server && !tcp_connected && !tcp_connecting && time(NULL) >= tcp_retry) {
+			tcp_connect_start();
+			continue;
+		}
+
+		if(ret > 0) {
 
 			if(FD_ISSET(slipfd, &rset)) { /* read from SLIP */
-                serial_to_tun(inslip, tunfd);
+                serial_to_tun(&dec);
 			}
 
 			if(FD_ISSET(slipfd, &wset)) { /* write buffer to SLIP */
 				slip_flushbuf(slipfd);
 			}
 
-			if(slip_empty() && FD_ISSET(tunfd, &rset)) { /* write if buffer empty and read necessary from tunnel */
-                int size;
-                size = tun_to_serial(tunfd); /* method can return an int with size of the data that was read from the tunnel */
-                if(size==0){
-                    printf("Connection terminated, starting reconnect.\n");
-                    if(is_server){
-                        reconnect_server(client_address);
-                    } else {
-                        reconnect_client(TCP_address,host);
-                    }
-                } else {
-                    slip_flushbuf(slipfd);
-                }
+			if(is_server && !tcp_connected && FD_ISSET(socketfd, &rset)) {
+				tcp_accept();
+			} else if(tcp_connecting && FD_ISSET(tunfd, &wset)) {
+				tcp_connect_done();
+			} else if(tcp_connected) {
+				if(FD_ISSET(tunfd, &wset)) { /* write queued packets to TCP */
+					tcp_flush();
+				}
+				if(tcp_connected && slip_queue_accepting(&slip_queue) && FD_ISSET(tunfd, &rset)) { /* queue packets from TCP for SLIP */
+					tun_to_serial();
+					slip_flushbuf(slipfd);
+				}
 			}
 		}
 	}
@@ -91,6 +91,7 @@ static const struct keyword keywords[] = {
   {"WHERE", WHERE},
   {"COUNT", COUNT},
   {"INDEX", INDEX},
+  {"BTREE", BTREE},
 
   {"INSERT", INSERT},
   {"SELECT", SELECT},
@@ -111,7 +112,7 @@ static const struct keyword keywords[] = {
 };
 
 /* Provides a pointer to the first keyword of a specific length. */
-static const int8_t skip_hint[] = {0, 13, 21, 27, 33, 36, 44, 47, 48};
+static const int8_t skip_hint[] = {0, 13, 21, 27, 33, 37, 45, 48, 49};
 
 static char separators[] = "#.;,() \t\n";
 
@@ -152,6 +152,38 @@
 #define DB_MAX_CHAR_SIZE_PER_ROW	64
 #endif /* DB_MAX_CHAR_SIZE_PER_ROW */
 
+/* The size of each of the two buffers that rows are read into when
+   scanning a relation. Set to 0 to read one row at a time. */
+#ifndef DB_ROW_BUFFER_SIZE
+#define DB_ROW_BUFFER_SIZE		0
+#endif /* DB_ROW_BUFFER_SIZE */
+
+/* The number of buffered rows that a scan evaluates a compiled predicate
+   for at a time. Used when both DB_ROW_BUFFER_SIZE and LVM_PLAN_SIZE are
+   set. */
+#ifndef DB_SELECT_BATCH_SIZE
+#define DB_SELECT_BATCH_SIZE		32
+#endif /* DB_SELECT_BATCH_SIZE */
+
+/* The number of rows that relation_insert_batch() writes at a time. */
+#ifndef DB_INSERT_BATCH_SIZE
+#define DB_INSERT_BATCH_SIZE		8
+#endif /* DB_INSERT_BATCH_SIZE */
+
+/* The number of bytes used for the hash table of a hash join, which
+   joins relations on attributes without an index. Set to 0 to allow
+   joins only on indexed attributes. */
+#ifndef DB_JOIN_HASH_SIZE
+#define DB_JOIN_HASH_SIZE		0
+#endif /* DB_JOIN_HASH_SIZE */
+
+/* The maximum number of files that each relation is partitioned into
+   when the smaller one of the relations to join does not fit in the
+   hash table. */
+#ifndef DB_JOIN_PARTITIONS
+#define DB_JOIN_PARTITIONS		2
+#endif /* DB_JOIN_PARTITIONS */
+
 /* The maximum file name length to use for creating various database file. */
 #ifndef DB_MAX_FILENAME_LENGTH
 #define DB_MAX_FILENAME_LENGTH		16
@@ -206,6 +238,23 @@
 #define DB_HEAP_CACHE_LIMIT		1
 #endif /* DB_HEAP_CACHE_LIMIT */
 
+/* The maximum number of B+-tree indexes. Setting it to zero leaves
+   the B+-tree index out. */
+#ifndef DB_BTREE_INDEX_LIMIT
+#define DB_BTREE_INDEX_LIMIT		0
+#endif /* DB_BTREE_INDEX_LIMIT */
+
+/* The number of node slots in the file of a B+-tree index. Nodes are
+   never rewritten in place, so a split uses up new slots. */
+#ifndef DB_BTREE_NODE_LIMIT
+#define DB_BTREE_NODE_LIMIT		256
+#endif /* DB_BTREE_NODE_LIMIT */
+
+/* The maximum number of B+-tree nodes cached in memory. */
+#ifndef DB_BTREE_CACHE_LIMIT
+#define DB_BTREE_CACHE_LIMIT		4
+#endif /* DB_BTREE_CACHE_LIMIT */
+
 /*----------------------------------------------------------------------------*/
 
 /* LVM options. */
@@ -227,5 +276,12 @@
 #define LVM_USE_FLOATS			DB_FEATURE_FLOATS
 #endif /* LVM_USE_FLOATS */
 
+/* The maximum number of nodes in the evaluation plan that a predicate
+   is compiled into before a selection. Set to 0 to interpret the LVM
+   bytecode for each row instead. */
+#ifndef LVM_PLAN_SIZE
+#define LVM_PLAN_SIZE			0
+#endif /* LVM_PLAN_SIZE */
+
 
 #endif /* !DB_OPTIONS_H */
@@ -0,0 +1,746 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *     A B+-tree index for flash memory.
+ *
+ *     Entries are appended to the free slots of the leaf that they
+ *     belong in, so that an insert writes a single (key, value) pair.
+ *     Nodes are never rewritten in place: a node that splits gets its
+ *     new contents written to a free slot further into the index file,
+ *     and a table in RAM maps the logical node IDs used within the tree
+ *     to the slots holding their latest copies. If the new key is the
+ *     largest one of a full node, which is the common case for time
+ *     series, the node is left as it is and the key starts a new node.
+ *
+ *     Nodes read from storage are kept sorted in a small cache. A range
+ *     query descends to the first leaf that can hold the lower bound,
+ *     and then walks the leaves in key order up to the upper bound.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lib/memb.h"
+
+#include "db-options.h"
+#include "index.h"
+#include "result.h"
+#include "storage.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+#if DB_BTREE_INDEX_LIMIT > 0
+
+#define NODE_SIZE	32
+#define MAX_DEPTH	8
+#define ROOT		0
+#define FILL_UNKNOWN	0xff
+
+/* Node IDs and tuple IDs are stored plus one, so that zeroes mark the
+   parts of a node that have not been written yet. */
+#define ENCODE(id)	((uint32_t)(id) + 1)
+#define DECODE(value)	((value) - 1)
+
+/* Keys are compared as the long values that the predicates derive
+   their ranges in, so that no attribute value is truncated. */
+typedef long btree_key_t;
+typedef uint16_t node_id_t;
+
+struct pair {
+  btree_key_t key;
+  uint32_t value;
+};
+
+struct node_header {
+  node_id_t id;
+  /* The child for keys below the first key of an internal node. */
+  node_id_t link;
+  uint8_t leaf;
+  uint8_t unused[3];
+};
+
+struct node {
+  struct node_header header;
+  struct pair pairs[NODE_SIZE];
+};
+
+struct btree {
+  db_storage_id_t storage;
+  node_id_t nodes;
+  node_id_t slots;
+  /* The file slot of the latest copy of each node. */
+  node_id_t slot[DB_BTREE_NODE_LIMIT];
+  uint8_t fill[DB_BTREE_NODE_LIMIT];
+};
+typedef struct btree btree_t;
+
+/* A path from the root to a leaf, and a position within the leaf. */
+struct walk {
+  node_id_t path[MAX_DEPTH];
+  int8_t position[MAX_DEPTH];
+  uint8_t depth;
+  uint8_t slot;
+};
+
+struct node_cache {
+  btree_t *tree;
+  node_id_t id;
+  uint16_t age;
+  struct node node;
+};
+
+static struct node_cache node_cache[DB_BTREE_CACHE_LIMIT];
+static uint16_t cache_clock;
+static struct node scratch;
+static struct pair split_pairs[NODE_SIZE + 1];
+MEMB(btrees, btree_t, DB_BTREE_INDEX_LIMIT);
+
+static struct node_cache *get_cache(btree_t *, node_id_t);
+static struct node_cache *get_cache_free(void);
+static void invalidate_cache(btree_t *);
+static void sort_pairs(struct pair *, int);
+static struct node *node_load(btree_t *, node_id_t);
+static int node_write(btree_t *, node_id_t, int, node_id_t,
+                      struct pair *, int);
+static int node_append(btree_t *, node_id_t, struct pair *);
+static int descend(btree_t *, struct walk *, long, int);
+static int next_leaf(btree_t *, struct walk *);
+static int insert_pair(btree_t *, long, uint32_t);
+
+static db_result_t create(index_t *);
+static db_result_t destroy(index_t *);
+static db_result_t load(index_t *);
+static db_result_t release(index_t *);
+static db_result_t insert(index_t *, attribute_value_t *, tuple_id_t);
+static db_result_t delete(index_t *, attribute_value_t *);
+static tuple_id_t get_next(index_iterator_t *);
+
+index_api_t index_btree = {
+  INDEX_BTREE,
+  INDEX_API_EXTERNAL | INDEX_API_RANGE_QUERIES,
+  create,
+  destroy,
+  load,
+  release,
+  insert,
+  delete,
+  get_next
+};
+
+static struct node_cache *
+get_cache(btree_t *tree, node_id_t id)
+{
+  int i;
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree && node_cache[i].id == id) {
+      node_cache[i].age = ++cache_clock;
+      return &node_cache[i];
+    }
+  }
+  return NULL;
+}
+
+static struct node_cache *
+get_cache_free(void)
+{
+  struct node_cache *oldest;
+  int i;
+
+  /* Take a free entry, or else the least recently used one. */
+  oldest = &node_cache[0];
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == NULL) {
+      return &node_cache[i];
+    }
+    if((uint16_t)(cache_clock - node_cache[i].age) >
+       (uint16_t)(cache_clock - oldest->age)) {
+      oldest = &node_cache[i];
+    }
+  }
+  oldest->tree = NULL;
+  return oldest;
+}
+
+static void
+invalidate_cache(btree_t *tree)
+{
+  int i;
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree) {
+      node_cache[i].tree = NULL;
+    }
+  }
+}
+
+static void
+sort_pairs(struct pair *pairs, int count)
+{
+  struct pair pair;
+  int i, j;
+
+  /* Leaves are mostly filled in key order, so an insertion sort has
+     little to do. Equal keys stay in the order they were written. */
+  for(i = 1; i < count; i++) {
+    pair = pairs[i];
+    for(j = i; j > 0 && pairs[j - 1].key > pair.key; j--) {
+      pairs[j] = pairs[j - 1];
+    }
+    pairs[j] = pair;
+  }
+}
+
+static struct node *
+node_load(btree_t *tree, node_id_t id)
+{
+  struct node_cache *cache;
+  int i;
+
+  cache = get_cache(tree, id);
+  if(cache != NULL) {
+    return &cache->node;
+  }
+
+  if(id >= tree->nodes) {
+    return NULL;
+  }
+
+  cache = get_cache_free();
+  if(DB_ERROR(storage_read(tree->storage, &cache->node,
+                           (unsigned long)tree->slot[id] * sizeof(struct node),
+                           sizeof(struct node)))) {
+    PRINTF("DB: Failed to read B+-tree node %u\n", (unsigned)id);
+    return NULL;
+  }
+
+  if(tree->fill[id] == FILL_UNKNOWN) {
+    for(i = 0; i < NODE_SIZE; i++) {
+      if(cache->node.pairs[i].value == 0) {
+        break;
+      }
+    }
+    tree->fill[id] = i;
+  }
+  sort_pairs(cache->node.pairs, tree->fill[id]);
+
+  cache->tree = tree;
+  cache->id = id;
+  cache->age = ++cache_clock;
+
+  return &cache->node;
+}
+
+static int
+node_write(btree_t *tree, node_id_t id, int leaf, node_id_t link,
+           struct pair *pairs, int count)
+{
+  struct node_cache *cache;
+
+  if(tree->slots >= DB_BTREE_NODE_LIMIT) {
+    PRINTF("DB: No more slots in the B+-tree file\n");
+    return 0;
+  }
+
+  /* The pairs may come from the cache, so copy them first. */
+  memset(&scratch, 0, sizeof(scratch));
+  scratch.header.id = ENCODE(id);
+  scratch.header.link = leaf ? 0 : ENCODE(link);
+  scratch.header.leaf = leaf;
+  memcpy(scratch.pairs, pairs, count * sizeof(struct pair));
+
+  if(DB_ERROR(storage_write(tree->storage, &scratch,
+                            (unsigned long)tree->slots * sizeof(struct node),
+                            sizeof(struct node)))) {
+    return 0;
+  }
+
+  PRINTF("DB: Wrote B+-tree node %u with %d pairs to slot %u\n",
+         (unsigned)id, count, (unsigned)tree->slots);
+
+  tree->slot[id] = tree->slots++;
+  tree->fill[id] = count;
+  if(id >= tree->nodes) {
+    tree->nodes = id + 1;
+  }
+
+  cache = get_cache(tree, id);
+  if(cache == NULL) {
+    cache = get_cache_free();
+  }
+  memcpy(&cache->node, &scratch, sizeof(scratch));
+  cache->tree = tree;
+  cache->id = id;
+  cache->age = ++cache_clock;
+
+  return 1;
+}
+
+static int
+node_append(btree_t *tree, node_id_t id, struct pair *pair)
+{
+  struct node *node;
+  unsigned long offset;
+  int i;
+
+  node = node_load(tree, id);
+  if(node == NULL) {
+    return 0;
+  }
+
+  i = tree->fill[id];
+  offset = (unsigned long)tree->slot[id] * sizeof(struct node) +
+    offsetof(struct node, pairs) + i * sizeof(struct pair);
+  if(DB_ERROR(storage_write(tree->storage, pair, offset, sizeof(*pair)))) {
+    return 0;
+  }
+
+  /* Keep the cached copy sorted. */
+  for(; i > 0 && node->pairs[i - 1].key > pair->key; i--) {
+    node->pairs[i] = node->pairs[i - 1];
+  }
+  node->pairs[i] = *pair;
+  tree->fill[id]++;
+
+  return 1;
+}
+
+/*
+ * Find the leaf for a key. Inserts go to the last leaf that can hold
+ * the key, whereas searches start from the first one, because equal
+ * keys may end up on both sides of a split.
+ */
+static int
+descend(btree_t *tree, struct walk *walk, long key, int first)
+{
+  struct node *node;
+  node_id_t id;
+  int depth;
+  int i;
+
+  for(id = ROOT, depth = 0; depth < MAX_DEPTH; depth++) {
+    walk->path[depth] = id;
+    node = node_load(tree, id);
+    if(node == NULL) {
+      return 0;
+    }
+    if(node->header.leaf) {
+      walk->depth = depth;
+      walk->slot = 0;
+      return 1;
+    }
+
+    for(i = 0; i < tree->fill[id]; i++) {
+      if(first ? node->pairs[i].key >= key : node->pairs[i].key > key) {
+        break;
+      }
+    }
+    walk->position[depth] = i - 1;
+    id = i == 0 ? DECODE(node->header.link) : DECODE(node->pairs[i - 1].value);
+  }
+
+  return 0;
+}
+
+static int
+next_leaf(btree_t *tree, struct walk *walk)
+{
+  struct node *node;
+  node_id_t id;
+  int depth;
+  int position;
+
+  /* Go up to the first node with children left, and from there down
+     to the leftmost leaf. */
+  for(depth = walk->depth; depth > 0;) {
+    depth--;
+    node = node_load(tree, walk->path[depth]);
+    if(node == NULL) {
+      return 0;
+    }
+    position = walk->position[depth] + 1;
+    if(position >= tree->fill[walk->path[depth]]) {
+      continue;
+    }
+
+    walk->position[depth] = position;
+    id = DECODE(node->pairs[position].value);
+    for(depth++; depth < MAX_DEPTH; depth++) {
+      walk->path[depth] = id;
+      node = node_load(tree, id);
+      if(node == NULL) {
+        return 0;
+      }
+      if(node->header.leaf) {
+        walk->depth = depth;
+        walk->slot = 0;
+        return 1;
+      }
+      walk->position[depth] = -1;
+      id = DECODE(node->header.link);
+    }
+    return 0;
+  }
+
+  return 0;
+}
+
+static int
+insert_pair(btree_t *tree, long key, uint32_t value)
+{
+  struct walk walk;
+  struct node *node;
+  struct pair pair;
+  node_id_t id;
+  node_id_t link;
+  node_id_t left;
+  node_id_t right;
+  int depth;
+  int fill;
+  int leaf;
+  int half;
+  int i;
+
+  if(!descend(tree, &walk, key, 0)) {
+    return 0;
+  }
+
+  pair.key = key;
+  pair.value = value;
+
+  for(depth = walk.depth;; depth--) {
+    id = walk.path[depth];
+    node = node_load(tree, id);
+    if(node == NULL) {
+      return 0;
+    }
+
+    fill = tree->fill[id];
+    if(fill < NODE_SIZE) {
+      return node_append(tree, id, &pair);
+    }
+
+    if(depth == walk.depth &&
+       tree->slots + 2 * walk.depth + 3 > DB_BTREE_NODE_LIMIT) {
+      /* Do not start a split that cannot be completed. */
+      PRINTF("DB: The B+-tree index is full\n");
+      return 0;
+    }
+
+    leaf = node->header.leaf;
+    link = DECODE(node->header.link);
+
+    if(pair.key >= node->pairs[fill - 1].key) {
+      /* The node can stay as it is, and the new pair starts
+         a node of its own. */
+      half = fill;
+    } else {
+      half = (NODE_SIZE + 1) / 2;
+    }
+
+    for(i = fill; i > 0 && node->pairs[i - 1].key > pair.key; i--) {
+      split_pairs[i] = node->pairs[i - 1];
+    }
+    split_pairs[i] = pair;
+    memcpy(split_pairs, node->pairs, i * sizeof(struct pair));
+
+    PRINTF("DB: Split B+-tree node %u at %d\n", (unsigned)id, half);
+
+    /* Leaves keep the middle pair in the right node, whereas internal
+       nodes move it up to their parent. */
+    right = tree->nodes;
+    pair.key = split_pairs[half].key;
+    pair.value = ENCODE(right);
+    if(leaf) {
+      if(!node_write(tree, right, 1, 0, &split_pairs[half],
+                     NODE_SIZE + 1 - half)) {
+        return 0;
+      }
+    } else if(!node_write(tree, right, 0, DECODE(split_pairs[half].value),
+                          &split_pairs[half + 1], NODE_SIZE - half)) {
+      return 0;
+    }
+
+    if(depth == 0) {
+      /* The root keeps its ID, so its old contents move to a new node. */
+      left = tree->nodes;
+      if(!node_write(tree, left, leaf, link, split_pairs, half)) {
+        return 0;
+      }
+      return node_write(tree, ROOT, 0, left, &pair, 1);
+    }
+
+    if(half < fill && !node_write(tree, id, leaf, link, split_pairs, half)) {
+      return 0;
+    }
+  }
+}
+
+static db_result_t
+create(index_t *index)
+{
+  btree_t *tree;
+  char *filename;
+
+  filename = storage_generate_file("btree",
+                                   (unsigned long)DB_BTREE_NODE_LIMIT *
+                                   sizeof(struct node));
+  if(filename == NULL) {
+    PRINTF("DB: Failed to generate a B+-tree file\n");
+    return DB_INDEX_ERROR;
+  }
+
+  memcpy(index->descriptor_file, filename, sizeof(index->descriptor_file));
+
+  index->opaque_data = tree = memb_alloc(&btrees);
+  if(tree == NULL) {
+    PRINTF("DB: Failed to allocate a B+-tree\n");
+    storage_remove(index->descriptor_file);
+    index->descriptor_file[0] = '\0';
+    return DB_ALLOCATION_ERROR;
+  }
+
+  tree->nodes = tree->slots = 0;
+  memset(tree->fill, FILL_UNKNOWN, sizeof(tree->fill));
+
+  tree->storage = storage_open(index->descriptor_file);
+  if(tree->storage < 0 || !node_write(tree, ROOT, 1, 0, split_pairs, 0)) {
+    if(tree->storage >= 0) {
+      storage_close(tree->storage);
+    }
+    memb_free(&btrees, tree);
+    storage_remove(index->descriptor_file);
+    index->descriptor_file[0] = '\0';
+    return DB_STORAGE_ERROR;
+  }
+
+  PRINTF("DB: Created a B+-tree index in %s\n", index->descriptor_file);
+
+  return DB_OK;
+}
+
+static db_result_t
+destroy(index_t *index)
+{
+  storage_remove(index->descriptor_file);
+  return DB_OK;
+}
+
+static db_result_t
+load(index_t *index)
+{
+  btree_t *tree;
+  struct node_header header;
+  node_id_t id;
+  node_id_t slot;
+
+  index->opaque_data = tree = memb_alloc(&btrees);
+  if(tree == NULL) {
+    PRINTF("DB: Failed to allocate a B+-tree\n");
+    return DB_ALLOCATION_ERROR;
+  }
+
+  tree->storage = storage_open(index->descriptor_file);
+  if(tree->storage < 0) {
+    memb_free(&btrees, tree);
+    return DB_STORAGE_ERROR;
+  }
+
+  /* Slots are used in order, so the last copy of a node is the one
+     that counts. */
+  tree->nodes = 0;
+  for(slot = 0; slot < DB_BTREE_NODE_LIMIT; slot++) {
+    if(DB_ERROR(storage_read(tree->storage, &header,
+                             (unsigned long)slot * sizeof(struct node),
+                             sizeof(header))) ||
+       header.id == 0) {
+      break;
+    }
+    id = DECODE(header.id);
+    if(id >= DB_BTREE_NODE_LIMIT) {
+      break;
+    }
+    tree->slot[id] = slot;
+    if(id >= tree->nodes) {
+      tree->nodes = id + 1;
+    }
+  }
+  tree->slots = slot;
+  memset(tree->fill, FILL_UNKNOWN, sizeof(tree->fill));
+
+  if(tree->nodes == 0) {
+    storage_close(tree->storage);
+    memb_free(&btrees, tree);
+    return DB_INDEX_ERROR;
+  }
+
+  PRINTF("DB: Loaded a B+-tree index with %u nodes from %s\n",
+         (unsigned)tree->nodes, index->descriptor_file);
+
+  return DB_OK;
+}
+
+static db_result_t
+release(index_t *index)
+{
+  btree_t *tree;
+
+  tree = index->opaque_data;
+
+  invalidate_cache(tree);
+  storage_close(tree->storage);
+  memb_free(&btrees, tree);
+  return DB_OK;
+}
+
+static db_result_t
+insert(index_t *index, attribute_value_t *key, tuple_id_t value)
+{
+  long long_key;
+
+  long_key = db_value_to_long(key);
+
+  if(insert_pair(index->opaque_data, long_key, ENCODE(value)) == 0) {
+    PRINTF("DB: Failed to insert key %ld into a B+-tree index\n", long_key);
+    return DB_INDEX_ERROR;
+  }
+  return DB_OK;
+}
+
+static db_result_t
+delete(index_t *index, attribute_value_t *value)
+{
+  btree_t *tree;
+  struct walk walk;
+  struct node *node;
+  node_id_t id;
+  long key;
+  int fill;
+  int more;
+  int found;
+  int count;
+  int i;
+
+  tree = index->opaque_data;
+  key = db_value_to_long(value);
+
+  if(!descend(tree, &walk, key, 1)) {
+    return DB_INDEX_ERROR;
+  }
+
+  /* Write new copies of the leaves without the key. */
+  for(found = 0;;) {
+    id = walk.path[walk.depth];
+    node = node_load(tree, id);
+    if(node == NULL) {
+      return DB_INDEX_ERROR;
+    }
+
+    fill = tree->fill[id];
+    more = fill == 0 || node->pairs[fill - 1].key <= key;
+    for(i = count = 0; i < fill; i++) {
+      if(node->pairs[i].key != key) {
+        split_pairs[count++] = node->pairs[i];
+      }
+    }
+    if(count < fill) {
+      if(!node_write(tree, id, 1, 0, split_pairs, count)) {
+        return DB_INDEX_ERROR;
+      }
+      found = 1;
+    }
+
+    if(!more || !next_leaf(tree, &walk)) {
+      break;
+    }
+  }
+
+  return found ? DB_OK : DB_INDEX_ERROR;
+}
+
+static tuple_id_t
+get_next(index_iterator_t *iterator)
+{
+  static struct {
+    index_iterator_t *index_iterator;
+    struct walk walk;
+    uint8_t done;
+  } scan;
+  btree_t *tree;
+  struct node *node;
+  struct pair *pair;
+  node_id_t id;
+  long min;
+  long max;
+
+  tree = iterator->index->opaque_data;
+  min = db_value_to_long(&iterator->min_value);
+  max = db_value_to_long(&iterator->max_value);
+
+  if(scan.index_iterator != iterator || iterator->next_item_no == 0) {
+    /* Start a new search from the first leaf that may hold min. */
+    scan.index_iterator = iterator;
+    scan.done = !descend(tree, &scan.walk, min, 1);
+  }
+
+  while(!scan.done) {
+    id = scan.walk.path[scan.walk.depth];
+    node = node_load(tree, id);
+    if(node == NULL) {
+      break;
+    }
+
+    while(scan.walk.slot < tree->fill[id]) {
+      pair = &node->pairs[scan.walk.slot++];
+      if(pair->key > max) {
+        scan.done = 1;
+        return INVALID_TUPLE;
+      }
+      if(pair->key >= min) {
+        iterator->next_item_no++;
+        return DECODE(pair->value);
+      }
+    }
+
+    if(!next_leaf(tree, &scan.walk)) {
+      scan.done = 1;
+    }
+  }
+
+  return INVALID_TUPLE;
+}
+
+#endif /* DB_BTREE_INDEX_LIMIT > 0 */
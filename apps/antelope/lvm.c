@@ -70,6 +70,11 @@ struct variable {
   operand_type_t type;
   operand_value_t value;
   char name[LVM_MAX_NAME_LENGTH + 1];
+#if LVM_PLAN_SIZE > 0
+  /* Where a compiled predicate finds the value in a row. */
+  uint16_t offset;
+  uint8_t size;
+#endif /* LVM_PLAN_SIZE > 0 */
 };
 typedef struct variable variable_t;
 
@@ -87,6 +92,58 @@ static variable_t variables[LVM_MAX_VARIABLE_ID - 1];
 /* Range derivations of variables that are used for index searches. */
 static derivation_t derivations[LVM_MAX_VARIABLE_ID - 1];
 
+#if LVM_PLAN_SIZE > 0
+/*
+ * A predicate can be compiled into a plan of nodes in postfix order,
+ * which is evaluated directly on rows. Variables are loaded from their
+ * bound offsets in the row by type-specific nodes, arithmetic on
+ * constants is folded, and a comparison between a variable and a
+ * constant becomes a range test. A plan that is a conjunction of range
+ * tests only is reduced to one range per variable and evaluated
+ * without a stack.
+ */
+enum plan_op {
+  PLAN_RANGE_INT,
+  PLAN_RANGE_LONG,
+  PLAN_OUTSIDE_INT,
+  PLAN_OUTSIDE_LONG,
+  PLAN_LOAD_INT,
+  PLAN_LOAD_LONG,
+  PLAN_CONST,
+  PLAN_ADD,
+  PLAN_SUB,
+  PLAN_MUL,
+  PLAN_DIV,
+  PLAN_EQ,
+  PLAN_NEQ,
+  PLAN_GE,
+  PLAN_GEQ,
+  PLAN_LE,
+  PLAN_LEQ,
+  PLAN_AND,
+  PLAN_OR,
+  PLAN_NOT
+};
+
+struct plan_node {
+  uint8_t op;
+  uint16_t offset;
+  long min;
+  long max;
+};
+
+/* Rows store integers in big-endian order, as in relation.c. */
+#define INT_AT(ptr)	((long)((ptr)[0] << 8 | (ptr)[1]))
+#define LONG_AT(ptr)	((long)((uint32_t)(ptr)[0] << 24 | \
+			        (uint32_t)(ptr)[1] << 16 | \
+			        (uint32_t)(ptr)[2] << 8 | (ptr)[3]))
+
+static struct plan_node plan[LVM_PLAN_SIZE];
+static unsigned plan_length;
+static uint8_t plan_conjunctive;
+static lvm_instance_t *plan_instance;
+#endif /* LVM_PLAN_SIZE > 0 */
+
 #if DEBUG
 static void
 print_derivations(derivation_t *d)
@@ -309,6 +366,9 @@ lvm_reset(lvm_instance_t *p, unsigned char *code, lvm_ip_t size)
 
   memset(variables, 0, sizeof(variables));
   memset(derivations, 0, sizeof(derivations));
+#if LVM_PLAN_SIZE > 0
+  plan_instance = NULL;
+#endif
 }
 
 lvm_ip_t
@@ -708,6 +768,506 @@ lvm_get_derived_range(lvm_instance_t *p, char *name,
   return INVALID_IDENTIFIER;
 }
 
+#if LVM_PLAN_SIZE > 0
+lvm_status_t
+lvm_bind_variable(char *name, unsigned offset, unsigned size)
+{
+  variable_id_t id;
+
+  id = lookup(name);
+  if(id >= LVM_MAX_VARIABLE_ID - 1 || variables[id].name[0] == '\0') {
+    return INVALID_IDENTIFIER;
+  }
+  if(size != 2 && size != 4) {
+    return TYPE_ERROR;
+  }
+
+  variables[id].offset = offset;
+  variables[id].size = size;
+  return TRUE;
+}
+
+static lvm_status_t
+emit(uint8_t op, uint16_t offset, long min, long max)
+{
+  if(plan_length == LVM_PLAN_SIZE) {
+    return STACK_OVERFLOW;
+  }
+
+  plan[plan_length].op = op;
+  plan[plan_length].offset = offset;
+  plan[plan_length].min = min;
+  plan[plan_length].max = max;
+  plan_length++;
+
+  return TRUE;
+}
+
+static lvm_status_t
+compile_operand(lvm_instance_t *p)
+{
+  operator_t *operator;
+  operand_t operand;
+  variable_t *var;
+  unsigned left;
+  unsigned right;
+  long a, b;
+  lvm_status_t r;
+  static const uint8_t arith_ops[] = { PLAN_ADD, PLAN_SUB, PLAN_MUL, PLAN_DIV };
+
+  switch(get_type(p)) {
+  case LVM_ARITH_OP:
+    operator = get_operator(p);
+    if(*operator < LVM_ADD || *operator > LVM_DIV) {
+      return SEMANTIC_ERROR;
+    }
+    left = plan_length;
+    r = compile_operand(p);
+    if(LVM_ERROR(r)) {
+      return r;
+    }
+    right = plan_length;
+    r = compile_operand(p);
+    if(LVM_ERROR(r)) {
+      return r;
+    }
+
+    if(right - left == 1 && plan_length - right == 1 &&
+       plan[left].op == PLAN_CONST && plan[right].op == PLAN_CONST) {
+      /* Fold the operation on two constants. */
+      a = plan[left].min;
+      b = plan[right].min;
+      switch(*operator) {
+      case LVM_ADD:
+        a += b;
+        break;
+      case LVM_SUB:
+        a -= b;
+        break;
+      case LVM_MUL:
+        a *= b;
+        break;
+      default:
+        if(b == 0) {
+          return MATH_ERROR;
+        }
+        a /= b;
+        break;
+      }
+      plan_length = left;
+      return emit(PLAN_CONST, 0, a, a);
+    }
+    return emit(arith_ops[*operator - LVM_ADD], 0, 0, 0);
+
+  case LVM_OPERAND:
+    get_operand(p, &operand);
+    switch(operand.type) {
+    case LVM_LONG:
+      return emit(PLAN_CONST, 0, operand.value.l, operand.value.l);
+    case LVM_VARIABLE:
+      if(operand.value.id >= LVM_MAX_VARIABLE_ID - 1) {
+        return INVALID_IDENTIFIER;
+      }
+      var = &variables[operand.value.id];
+      if(var->size == 0) {
+        /* The variable has not been bound to a place in the row. */
+        return INVALID_IDENTIFIER;
+      }
+      return emit(var->size == 2 ? PLAN_LOAD_INT : PLAN_LOAD_LONG,
+                  var->offset, 0, 0);
+    default:
+      return TYPE_ERROR;
+    }
+
+  default:
+    return SEMANTIC_ERROR;
+  }
+}
+
+/* Turn "variable op constant" into a range test on the variable. */
+static lvm_status_t
+fold_comparison(operator_t op, unsigned variable, unsigned constant)
+{
+  struct plan_node *var;
+  long c;
+  long min;
+  long max;
+  uint8_t outside;
+
+  var = &plan[variable];
+  c = plan[constant].min;
+  min = LONG_MIN;
+  max = LONG_MAX;
+  outside = 0;
+
+  if(variable > constant) {
+    /* The constant is on the left side; mirror the comparison. */
+    switch(op) {
+    case LVM_GE:
+      op = LVM_LE;
+      break;
+    case LVM_GEQ:
+      op = LVM_LEQ;
+      break;
+    case LVM_LE:
+      op = LVM_GE;
+      break;
+    case LVM_LEQ:
+      op = LVM_GEQ;
+      break;
+    default:
+      break;
+    }
+  }
+
+  switch(op) {
+  case LVM_EQ:
+    min = max = c;
+    break;
+  case LVM_NEQ:
+    min = max = c;
+    outside = 1;
+    break;
+  case LVM_GE:
+    if(c == LONG_MAX) {
+      /* Nothing is greater. */
+      min = 1;
+      max = 0;
+    } else {
+      min = c + 1;
+    }
+    break;
+  case LVM_GEQ:
+    min = c;
+    break;
+  case LVM_LE:
+    if(c == LONG_MIN) {
+      min = 1;
+      max = 0;
+    } else {
+      max = c - 1;
+    }
+    break;
+  case LVM_LEQ:
+    max = c;
+    break;
+  default:
+    return EXECUTION_ERROR;
+  }
+
+  plan_length = variable < constant ? variable : constant;
+  if(var->op == PLAN_LOAD_INT) {
+    return emit(outside ? PLAN_OUTSIDE_INT : PLAN_RANGE_INT,
+                var->offset, min, max);
+  }
+  return emit(outside ? PLAN_OUTSIDE_LONG : PLAN_RANGE_LONG,
+              var->offset, min, max);
+}
+
+static lvm_status_t
+compile_logic(lvm_instance_t *p, operator_t *op)
+{
+  operator_t *operator;
+  unsigned arguments;
+  unsigned left;
+  unsigned right;
+  int i;
+  lvm_status_t r;
+  static const uint8_t cmp_ops[] = {
+    PLAN_EQ, PLAN_NEQ, PLAN_GE, PLAN_GEQ, PLAN_LE, PLAN_LEQ
+  };
+
+  if(IS_CONNECTIVE(*op)) {
+    arguments = *op == LVM_NOT ? 1 : 2;
+    for(i = 0; i < arguments; i++) {
+      if(get_type(p) != LVM_CMP_OP) {
+        return SEMANTIC_ERROR;
+      }
+      operator = get_operator(p);
+      r = compile_logic(p, operator);
+      if(LVM_ERROR(r)) {
+        return r;
+      }
+    }
+
+    switch(*op) {
+    case LVM_AND:
+      return emit(PLAN_AND, 0, 0, 0);
+    case LVM_OR:
+      return emit(PLAN_OR, 0, 0, 0);
+    case LVM_NOT:
+      return emit(PLAN_NOT, 0, 0, 0);
+    default:
+      return SEMANTIC_ERROR;
+    }
+  }
+
+  if(*op < LVM_EQ || *op > LVM_LEQ) {
+    return SEMANTIC_ERROR;
+  }
+
+  left = plan_length;
+  r = compile_operand(p);
+  if(LVM_ERROR(r)) {
+    return r;
+  }
+  right = plan_length;
+  r = compile_operand(p);
+  if(LVM_ERROR(r)) {
+    return r;
+  }
+
+  if(right - left == 1 && plan_length - right == 1) {
+    if((plan[left].op == PLAN_LOAD_INT || plan[left].op == PLAN_LOAD_LONG) &&
+       plan[right].op == PLAN_CONST) {
+      return fold_comparison(*op, left, right);
+    }
+    if((plan[right].op == PLAN_LOAD_INT || plan[right].op == PLAN_LOAD_LONG) &&
+       plan[left].op == PLAN_CONST) {
+      return fold_comparison(*op, right, left);
+    }
+  }
+
+  return emit(cmp_ops[*op - LVM_EQ], 0, 0, 0);
+}
+
+/*
+ * If the plan consists of range tests combined by conjunctions only,
+ * intersect the ranges of each variable, as lvm_derive() does, and
+ * keep one range test per variable.
+ */
+static void
+fold_conjunction(void)
+{
+  unsigned i;
+  unsigned j;
+  unsigned ranges;
+
+  for(i = 0; i < plan_length; i++) {
+    if(plan[i].op != PLAN_RANGE_INT && plan[i].op != PLAN_RANGE_LONG &&
+       plan[i].op != PLAN_AND) {
+      return;
+    }
+  }
+
+  ranges = 0;
+  for(i = 0; i < plan_length; i++) {
+    if(plan[i].op == PLAN_AND) {
+      continue;
+    }
+    for(j = 0; j < ranges; j++) {
+      if(plan[j].op == plan[i].op && plan[j].offset == plan[i].offset) {
+        if(plan[i].min > plan[j].min) {
+          plan[j].min = plan[i].min;
+        }
+        if(plan[i].max < plan[j].max) {
+          plan[j].max = plan[i].max;
+        }
+        break;
+      }
+    }
+    if(j == ranges) {
+      plan[ranges++] = plan[i];
+    }
+  }
+
+  plan_length = ranges;
+  plan_conjunctive = 1;
+}
+
+lvm_status_t
+lvm_compile(lvm_instance_t *p)
+{
+  operator_t *operator;
+  lvm_status_t r;
+
+  plan_instance = NULL;
+  plan_length = 0;
+  plan_conjunctive = 0;
+
+  p->ip = 0;
+  if(get_type(p) != LVM_CMP_OP) {
+    return SEMANTIC_ERROR;
+  }
+  operator = get_operator(p);
+  r = compile_logic(p, operator);
+  if(LVM_ERROR(r)) {
+    PRINTF("Unable to compile the predicate: %d\n", (int)r);
+    return r;
+  }
+
+  fold_conjunction();
+  plan_instance = p;
+
+  PRINTF("Compiled the predicate into %u nodes\n", plan_length);
+
+  return TRUE;
+}
+
+lvm_status_t
+lvm_execute_row(lvm_instance_t *p, const unsigned char *row)
+{
+  const struct plan_node *node;
+  const struct plan_node *end;
+  long stack[LVM_PLAN_SIZE];
+  long *sp;
+  long v;
+
+  if(p != plan_instance) {
+    return EXECUTION_ERROR;
+  }
+
+  end = plan + plan_length;
+
+  if(plan_conjunctive) {
+    for(node = plan; node < end; node++) {
+      if(node->op == PLAN_RANGE_INT) {
+        v = INT_AT(row + node->offset);
+      } else {
+        v = LONG_AT(row + node->offset);
+      }
+      if(v < node->min || v > node->max) {
+        return FALSE;
+      }
+    }
+    return TRUE;
+  }
+
+  sp = stack;
+  for(node = plan; node < end; node++) {
+    switch(node->op) {
+    case PLAN_RANGE_INT:
+      v = INT_AT(row + node->offset);
+      *sp++ = v >= node->min && v <= node->max;
+      break;
+    case PLAN_RANGE_LONG:
+      v = LONG_AT(row + node->offset);
+      *sp++ = v >= node->min && v <= node->max;
+      break;
+    case PLAN_OUTSIDE_INT:
+      v = INT_AT(row + node->offset);
+      *sp++ = v < node->min || v > node->max;
+      break;
+    case PLAN_OUTSIDE_LONG:
+      v = LONG_AT(row + node->offset);
+      *sp++ = v < node->min || v > node->max;
+      break;
+    case PLAN_LOAD_INT:
+      *sp++ = INT_AT(row + node->offset);
+      break;
+    case PLAN_LOAD_LONG:
+      *sp++ = LONG_AT(row + node->offset);
+      break;
+    case PLAN_CONST:
+      *sp++ = node->min;
+      break;
+    case PLAN_ADD:
+      sp--;
+      sp[-1] += sp[0];
+      break;
+    case PLAN_SUB:
+      sp--;
+      sp[-1] -= sp[0];
+      break;
+    case PLAN_MUL:
+      sp--;
+      sp[-1] *= sp[0];
+      break;
+    case PLAN_DIV:
+      sp--;
+      if(sp[0] == 0) {
+        return MATH_ERROR;
+      }
+      sp[-1] /= sp[0];
+      break;
+    case PLAN_EQ:
+      sp--;
+      sp[-1] = sp[-1] == sp[0];
+      break;
+    case PLAN_NEQ:
+      sp--;
+      sp[-1] = sp[-1] != sp[0];
+      break;
+    case PLAN_GE:
+      sp--;
+      sp[-1] = sp[-1] > sp[0];
+      break;
+    case PLAN_GEQ:
+      sp--;
+      sp[-1] = sp[-1] >= sp[0];
+      break;
+    case PLAN_LE:
+      sp--;
+      sp[-1] = sp[-1] < sp[0];
+      break;
+    case PLAN_LEQ:
+      sp--;
+      sp[-1] = sp[-1] <= sp[0];
+      break;
+    case PLAN_AND:
+      sp--;
+      sp[-1] = sp[-1] && sp[0];
+      break;
+    case PLAN_OR:
+      sp--;
+      sp[-1] = sp[-1] || sp[0];
+      break;
+    case PLAN_NOT:
+      sp[-1] = !sp[-1];
+      break;
+    default:
+      return EXECUTION_ERROR;
+    }
+  }
+
+  return stack[0] ? TRUE : FALSE;
+}
+
+/*
+ * Evaluate the compiled predicate for count consecutive rows, setting
+ * matches[i] to 1 for each row i that fulfills it. A conjunctive plan
+ * is evaluated one range test at a time over all rows, in loops that
+ * the compiler can vectorize. Returns the number of matching rows.
+ */
+unsigned
+lvm_execute_rows(lvm_instance_t *p, const unsigned char *rows,
+                 unsigned count, unsigned row_length, unsigned char *matches)
+{
+  const struct plan_node *node;
+  const unsigned char *row;
+  unsigned i;
+  unsigned n;
+  long v;
+
+  if(plan_conjunctive && p == plan_instance) {
+    memset(matches, 1, count);
+    for(node = plan; node < plan + plan_length; node++) {
+      row = rows + node->offset;
+      if(node->op == PLAN_RANGE_INT) {
+        for(i = 0; i < count; i++, row += row_length) {
+          v = INT_AT(row);
+          matches[i] &= (v >= node->min) & (v <= node->max);
+        }
+      } else {
+        for(i = 0; i < count; i++, row += row_length) {
+          v = LONG_AT(row);
+          matches[i] &= (v >= node->min) & (v <= node->max);
+        }
+      }
+    }
+  } else {
+    for(i = 0; i < count; i++) {
+      matches[i] = lvm_execute_row(p, rows + i * row_length) == TRUE;
+    }
+  }
+
+  for(i = n = 0; i < count; i++) {
+    n += matches[i];
+  }
+  return n;
+}
+#endif /* LVM_PLAN_SIZE > 0 */
+
 #if DEBUG
 static lvm_ip_t
 print_operator(lvm_instance_t *p, lvm_ip_t index)
@@ -141,4 +141,13 @@ void lvm_set_operand(lvm_instance_t *p, operand_t *op);
 void lvm_set_long(lvm_instance_t *p, long l);
 void lvm_set_variable(lvm_instance_t *p, char *name);
 
+#if LVM_PLAN_SIZE > 0
+lvm_status_t lvm_bind_variable(char *name, unsigned offset, unsigned size);
+lvm_status_t lvm_compile(lvm_instance_t *p);
+lvm_status_t lvm_execute_row(lvm_instance_t *p, const unsigned char *row);
+unsigned lvm_execute_rows(lvm_instance_t *p, const unsigned char *rows,
+                          unsigned count, unsigned row_length,
+                          unsigned char *matches);
+#endif /* LVM_PLAN_SIZE > 0 */
+
 #endif /* LVM_H */
@@ -79,6 +79,79 @@ struct source_map {
 };
 
 static struct source_map source_map[AQL_ATTRIBUTE_LIMIT];
+
+/*
+ * The state of a sort-merge join. Both relations are sorted on the
+ * join attribute, so the right rows matching a left row form a run
+ * that starts at run_start, and the run of the next left row cannot
+ * start before it.
+ */
+static struct {
+  tuple_id_t left_id;
+  tuple_id_t right_id;
+  tuple_id_t run_start;
+  unsigned left_offset;
+  unsigned right_offset;
+  long key;
+  uint8_t in_run;
+} merge_join;
+
+#if DB_JOIN_HASH_SIZE > 0
+/*
+ * The state of a hash join. The rows of the smaller relation, the build
+ * side, are put in a hash table, and the rows of the other relation,
+ * the probe side, are looked up in it. If the build side does not fit,
+ * both relations are first partitioned into files on the hash of the
+ * join attribute, and the partitions are joined pairwise. A partition
+ * that still does not fit is built in chunks, with one scan of the
+ * probe partition per chunk.
+ */
+#define HASH_BUILD		0
+#define HASH_PROBE		1
+
+#define HASH_STATE_PARTITION	0
+#define HASH_STATE_BUILD	1
+#define HASH_STATE_PROBE	2
+
+#define HASH_BUCKETS		64
+
+#define HASH_VALUE(key)		((uint32_t)((uint32_t)(key) * 2654435761UL))
+#define HASH_BUCKET(hash)	(((hash) >> 16) % HASH_BUCKETS)
+#define HASH_PARTITION(hash)	(((hash) >> 8) % hash_join.partitions)
+
+/* An entry is followed in the pool by a copy of its row. */
+struct hash_entry {
+  struct hash_entry *next;
+  long key;
+};
+
+#define HASH_POOL_SLOTS	(DB_JOIN_HASH_SIZE / sizeof(struct hash_entry))
+#define HASH_ENTRY_SLOTS(row_length) \
+  (1 + ((row_length) + sizeof(struct hash_entry) - 1) / \
+   sizeof(struct hash_entry))
+
+static struct hash_entry hash_pool[HASH_POOL_SLOTS];
+static struct hash_entry *hash_buckets[HASH_BUCKETS];
+
+static struct {
+  relation_t *rel[2];
+  attribute_t *attr[2];
+  unsigned offset[2];
+  unsigned char *row[2];
+  db_storage_id_t fd[2][DB_JOIN_PARTITIONS];
+  char filename[2][DB_JOIN_PARTITIONS][DB_MAX_FILENAME_LENGTH];
+  tuple_id_t count[2][DB_JOIN_PARTITIONS];
+  tuple_id_t build_id;
+  tuple_id_t probe_id;
+  struct hash_entry *match;
+  long key;
+  uint8_t state;
+  uint8_t side;
+  uint8_t partitions;
+  uint8_t partition;
+  uint8_t last_chunk;
+} hash_join;
+#endif /* DB_JOIN_HASH_SIZE > 0 */
 #endif /* DB_FEATURE_JOIN */
 
 static unsigned char row[DB_MAX_ATTRIBUTES_PER_RELATION * DB_MAX_ELEMENT_SIZE];
@@ -88,6 +161,15 @@ static unsigned char * const left_row = row;
 static unsigned char * const right_row = extra_row;
 static unsigned char * const join_row = result_row;
 
+#if LVM_PLAN_SIZE > 0 && DB_ROW_BUFFER_SIZE > 0
+/* Whether each of the match_count rows from match_first fulfills the
+   compiled predicate of the scan by match_handle. */
+static db_handle_t *match_handle;
+static tuple_id_t match_first;
+static tuple_id_t match_count;
+static unsigned char matches[DB_SELECT_BATCH_SIZE];
+#endif
+
 LIST(relations);
 MEMB(relations_memb, relation_t, DB_RELATION_POOL_SIZE);
 MEMB(attributes_memb, attribute_t, DB_ATTRIBUTE_POOL_SIZE);
@@ -472,11 +554,10 @@ relation_remove(char *name, int remove_tuples)
   return result;
 }
 
-db_result_t
-relation_insert(relation_t *rel, attribute_value_t *values)
+static db_result_t
+prepare_row(relation_t *rel, attribute_value_t *values, unsigned char *record)
 {
   attribute_t *attr;
-  unsigned char record[rel->row_length];
   unsigned char *ptr;
   attribute_value_t *value;
   db_result_t result;
@@ -544,9 +625,57 @@ relation_insert(relation_t *rel, attribute_value_t *values)
 
   rel->cardinality++;
   rel->next_row++;
+  return DB_OK;
+}
+
+db_result_t
+relation_insert(relation_t *rel, attribute_value_t *values)
+{
+  unsigned char record[rel->row_length];
+  db_result_t result;
+
+  result = prepare_row(rel, values, record);
+  if(DB_ERROR(result)) {
+    return result;
+  }
+
   return storage_put_row(rel, record);
 }
 
+/*
+ * Insert count rows, given as attribute_count values each, writing
+ * DB_INSERT_BATCH_SIZE rows at a time. If a row cannot be inserted,
+ * the rows before it are.
+ */
+db_result_t
+relation_insert_batch(relation_t *rel, attribute_value_t *values,
+                      unsigned count)
+{
+  unsigned char block[DB_INSERT_BATCH_SIZE * rel->row_length];
+  unsigned rows;
+  db_result_t result;
+
+  result = DB_OK;
+  for(rows = 0; count > 0; count--, values += rel->attribute_count) {
+    result = prepare_row(rel, values, block + rows * rel->row_length);
+    if(DB_ERROR(result)) {
+      break;
+    }
+    if(++rows == DB_INSERT_BATCH_SIZE) {
+      if(DB_ERROR(storage_put_rows(rel, block, rows))) {
+        return DB_STORAGE_ERROR;
+      }
+      rows = 0;
+    }
+  }
+
+  if(rows > 0 && DB_ERROR(storage_put_rows(rel, block, rows))) {
+    return DB_STORAGE_ERROR;
+  }
+
+  return result;
+}
+
 static void
 aggregate(attribute_t *attr, attribute_value_t *value)
 {
@@ -655,7 +784,7 @@ select_index(db_handle_t *handle, lvm_instance_t *lvm_instance)
 
       if(range <= min_range) {
         index = attr->index;
-        av_min.domain = av_max.domain = DOMAIN_INT;
+        av_min.domain = av_max.domain = DOMAIN_LONG;
         VALUE_LONG(&av_min) = min.l;
         VALUE_LONG(&av_max) = max.l;
       }
@@ -671,6 +800,76 @@ select_index(db_handle_t *handle, lvm_instance_t *lvm_instance)
   }
 }
 
+#if LVM_PLAN_SIZE > 0
+static void
+compile_predicate(db_handle_t *handle, lvm_instance_t *lvm_instance)
+{
+  struct source_dest_map *attr_map_ptr;
+  attribute_t *attr;
+
+  for(attr_map_ptr = attr_map;
+      attr_map_ptr < attr_map + handle->result_rel->attribute_count;
+      attr_map_ptr++) {
+    attr = attr_map_ptr->from_attr;
+    if(attr->domain == DOMAIN_INT || attr->domain == DOMAIN_LONG) {
+      lvm_bind_variable(attr->name, attr_map_ptr->from_offset,
+                        attr->domain == DOMAIN_INT ? 2 : 4);
+    }
+  }
+
+  if(!LVM_ERROR(lvm_compile(lvm_instance))) {
+    handle->flags |= DB_HANDLE_FLAG_LVM_PLAN;
+#if DB_ROW_BUFFER_SIZE > 0
+    if(!(handle->flags & DB_HANDLE_FLAG_SEARCH_INDEX) &&
+       handle->rel->row_length <= DB_ROW_BUFFER_SIZE) {
+      /* A scan evaluates it for many buffered rows at a time. */
+      handle->flags |= DB_HANDLE_FLAG_LVM_BATCH;
+      match_handle = NULL;
+    }
+#endif
+  }
+}
+
+#if DB_ROW_BUFFER_SIZE > 0
+/* Moves handle->tuple_id to the next row in its block for which the
+   predicate gives wanted_result. Returns DB_GOT_ROW when there is one,
+   and DB_OK when the rest of the block has been skipped. */
+static db_result_t
+skip_unwanted_rows(db_handle_t *handle, aql_adt_t *adt,
+                   lvm_status_t wanted_result)
+{
+  const unsigned char *rows;
+  tuple_id_t count;
+  db_result_t result;
+
+  if(match_handle != handle || handle->tuple_id < match_first ||
+     handle->tuple_id >= match_first + match_count) {
+    match_handle = NULL;
+    result = storage_get_rows(handle->rel, handle->tuple_id, &rows, &count);
+    if(result != DB_OK) {
+      return result;
+    }
+    if(count > sizeof(matches)) {
+      count = sizeof(matches);
+    }
+    lvm_execute_rows(adt->lvm_instance, rows, count,
+                     handle->rel->row_length, matches);
+    match_handle = handle;
+    match_first = handle->tuple_id;
+    match_count = count;
+  }
+
+  for(; handle->tuple_id < match_first + match_count; handle->tuple_id++) {
+    if((matches[handle->tuple_id - match_first] ? TRUE : FALSE) ==
+       wanted_result) {
+      return DB_GOT_ROW;
+    }
+  }
+  return DB_OK;
+}
+#endif /* DB_ROW_BUFFER_SIZE > 0 */
+#endif /* LVM_PLAN_SIZE > 0 */
+
 static db_result_t
 generate_selection_result(db_handle_t *handle, relation_t *rel, aql_adt_t *adt)
 {
@@ -701,6 +900,11 @@ generate_selection_result(db_handle_t *handle, relation_t *rel, aql_adt_t *adt)
     if(!LVM_ERROR(lvm_derive(adt->lvm_instance))) {
       select_index(handle, adt->lvm_instance);
     }
+
+#if LVM_PLAN_SIZE > 0
+    /* Compile the predicate to be evaluated directly on the rows. */
+    compile_predicate(handle, adt->lvm_instance);
+#endif
   }
 
   handle->flags |= DB_HANDLE_FLAG_PROCESSING;
@@ -746,6 +950,7 @@ relation_process_select(void *handle_ptr)
   uint8_t intbuf[2];
   attribute_value_t value;
   lvm_status_t wanted_result;
+  lvm_status_t status;
 
   handle = (db_handle_t *)handle_ptr;
   adt = (aql_adt_t *)handle->adt;
@@ -769,6 +974,25 @@ relation_process_select(void *handle_ptr)
     }
   }
 
+  wanted_result = TRUE;
+  if(AQL_GET_FLAGS(adt) & AQL_FLAG_INVERSE_LOGIC) {
+    wanted_result = FALSE;
+  }
+
+#if LVM_PLAN_SIZE > 0 && DB_ROW_BUFFER_SIZE > 0
+  if(handle->flags & DB_HANDLE_FLAG_LVM_BATCH) {
+    result = skip_unwanted_rows(handle, adt, wanted_result);
+    if(result == DB_FINISHED) {
+      if(AQL_GET_FLAGS(adt) & AQL_FLAG_AGGREGATE) {
+        goto end_aggregation;
+      }
+      return DB_FINISHED;
+    } else if(result != DB_GOT_ROW) {
+      return result;
+    }
+  }
+#endif
+
   /* Put the tuples fulfilling the given condition into a new relation.
      The tuples may be projected. */
   result = storage_get_row(handle->rel, &handle->tuple_id, row);
@@ -788,8 +1012,11 @@ relation_process_select(void *handle_ptr)
     from_ptr = row + attr_map_ptr->from_offset;
     result_attr = attr_map_ptr->to_attr;
 
-    /* Update the internal state of the PLE. */
-    if(result_attr->domain == DOMAIN_INT) {
+    /* Update the internal state of the PLE, unless the predicate
+       has been compiled to read the row by itself. */
+    if(handle->flags & DB_HANDLE_FLAG_LVM_PLAN) {
+      /* Nothing to update. */
+    } else if(result_attr->domain == DOMAIN_INT) {
       operand_value.l = from_ptr[0] << 8 | from_ptr[1];
       lvm_set_variable_value(result_attr->name, operand_value);
     } else if(result_attr->domain == DOMAIN_LONG) {
@@ -813,14 +1040,21 @@ relation_process_select(void *handle_ptr)
     }
   }
 
-  wanted_result = TRUE;
-  if(AQL_GET_FLAGS(adt) & AQL_FLAG_INVERSE_LOGIC) {
-    wanted_result = FALSE;
+  /* Check whether the given predicate is true for this tuple. */
+  if(adt->lvm_instance == NULL) {
+    status = wanted_result;
+#if LVM_PLAN_SIZE > 0
+  } else if(handle->flags & DB_HANDLE_FLAG_LVM_BATCH) {
+    /* Checked with the rest of its block. */
+    status = wanted_result;
+  } else if(handle->flags & DB_HANDLE_FLAG_LVM_PLAN) {
+    status = lvm_execute_row(adt->lvm_instance, row);
+#endif
+  } else {
+    status = lvm_execute(adt->lvm_instance);
   }
 
-  /* Check whether the given predicate is true for this tuple. */
-  if(adt->lvm_instance == NULL ||
-     lvm_execute(adt->lvm_instance) == wanted_result) {
+  if(status == wanted_result) {
     if(AQL_GET_FLAGS(adt) & AQL_FLAG_AGGREGATE) {
       for(attr_map_ptr = attr_map; attr_map_ptr < attr_map_end; attr_map_ptr++) {
         from_ptr = row + attr_map_ptr->from_offset;
@@ -880,6 +1114,7 @@ relation_select(void *handle_ptr, relation_t *rel, void *adt_ptr)
   attribute_t *attr;
   int i;
   int normal_attributes;
+  int processing_attributes;
 
   adt = (aql_adt_t *)adt_ptr;
 
@@ -903,7 +1138,8 @@ relation_select(void *handle_ptr, relation_t *rel, void *adt_ptr)
     return DB_ALLOCATION_ERROR;
   }
 
-  for(i = normal_attributes = 0; i < AQL_ATTRIBUTE_COUNT(adt); i++) {
+  normal_attributes = processing_attributes = 0;
+  for(i = 0; i < AQL_ATTRIBUTE_COUNT(adt); i++) {
     attribute_name = adt->attributes[i].name;
 
     attr = relation_attribute_get(rel, attribute_name);
@@ -932,6 +1168,8 @@ relation_select(void *handle_ptr, relation_t *rel, void *adt_ptr)
       if(!(adt->attributes[i].flags & ATTRIBUTE_FLAG_NO_STORE)) {
         /* Only count attributes projected into the result set. */
         normal_attributes++;
+      } else {
+        processing_attributes++;
       }
       break;
     case AQL_MAX:
@@ -951,7 +1189,8 @@ relation_select(void *handle_ptr, relation_t *rel, void *adt_ptr)
   /* Preclude mixes of normal attributes and aggregated ones in 
      selection results. */
   if(normal_attributes > 0 &&
-     handle->result_rel->attribute_count > normal_attributes) {
+     handle->result_rel->attribute_count >
+     normal_attributes + processing_attributes) {
      return DB_RELATIONAL_ERROR;
   }
 
@@ -959,6 +1198,382 @@ relation_select(void *handle_ptr, relation_t *rel, void *adt_ptr)
 }
 
 #if DB_FEATURE_JOIN
+static long
+join_key(attribute_t *attr, unsigned offset, unsigned char *row)
+{
+  attribute_value_t value;
+
+  if(DB_ERROR(db_phy_to_value(&value, attr, row + offset))) {
+    return 0;
+  }
+  return db_value_to_long(&value);
+}
+
+static db_result_t
+emit_join_row(db_handle_t *handle)
+{
+  unsigned char *join_next_attribute_ptr;
+  size_t element_size;
+  int i;
+
+  /* Use the source attribute map to fill in the physical representation
+     of the resulting tuple. */
+  join_next_attribute_ptr = join_row;
+
+  for(i = 0; i < handle->join_rel->attribute_count; i++) {
+    element_size = source_map[i].attr->element_size;
+
+    memcpy(join_next_attribute_ptr, source_map[i].from_ptr, element_size);
+    join_next_attribute_ptr += element_size;
+  }
+
+  if(((aql_adt_t *)handle->adt)->flags & AQL_FLAG_ASSIGN) {
+    if(DB_ERROR(storage_put_row(handle->join_rel, join_row))) {
+      return DB_STORAGE_ERROR;
+    }
+  }
+
+  handle->current_row++;
+  return DB_GOT_ROW;
+}
+
+static void
+merge_join_init(db_handle_t *handle)
+{
+  memset(&merge_join, 0, sizeof(merge_join));
+  merge_join.left_offset = get_attribute_value_offset(handle->left_rel,
+                                                      handle->left_join_attr);
+  merge_join.right_offset = get_attribute_value_offset(handle->right_rel,
+                                                       handle->right_join_attr);
+  handle->flags |= DB_HANDLE_FLAG_MERGE_JOIN;
+}
+
+/* Each call reads at most one row of each relation. */
+static db_result_t
+process_merge_join(db_handle_t *handle)
+{
+  db_result_t result;
+  long key;
+
+  if(!merge_join.in_run) {
+    result = storage_get_row(handle->left_rel, &merge_join.left_id, left_row);
+    if(DB_ERROR(result)) {
+      PRINTF("DB: Failed to get a row in left relation %s!\n",
+             handle->left_rel->name);
+      return result;
+    } else if(result == DB_FINISHED) {
+      return DB_FINISHED;
+    }
+    merge_join.left_id++;
+    merge_join.key = join_key(handle->left_join_attr, merge_join.left_offset,
+                              left_row);
+    merge_join.right_id = merge_join.run_start;
+    merge_join.in_run = 1;
+  }
+
+  result = storage_get_row(handle->right_rel, &merge_join.right_id, right_row);
+  if(DB_ERROR(result)) {
+    PRINTF("DB: Failed to get a row in right relation %s!\n",
+           handle->right_rel->name);
+    return result;
+  } else if(result == DB_FINISHED) {
+    if(merge_join.right_id == merge_join.run_start) {
+      /* All right rows are smaller than the remaining left rows. */
+      return DB_FINISHED;
+    }
+    merge_join.in_run = 0;
+    return DB_OK;
+  }
+
+  key = join_key(handle->right_join_attr, merge_join.right_offset, right_row);
+  if(key < merge_join.key) {
+    merge_join.run_start = ++merge_join.right_id;
+    return DB_OK;
+  } else if(key > merge_join.key) {
+    merge_join.in_run = 0;
+    return DB_OK;
+  }
+
+  merge_join.right_id++;
+  return emit_join_row(handle);
+}
+
+#if DB_JOIN_HASH_SIZE > 0
+static tuple_id_t
+hash_join_capacity(relation_t *rel)
+{
+  return HASH_POOL_SLOTS / HASH_ENTRY_SLOTS(rel->row_length);
+}
+
+static void
+hash_join_close(void)
+{
+  int side;
+  int i;
+
+  if(hash_join.partitions > 1) {
+    for(side = HASH_BUILD; side <= HASH_PROBE; side++) {
+      for(i = 0; i < hash_join.partitions; i++) {
+        if(hash_join.filename[side][i][0] != '\0') {
+          storage_close(hash_join.fd[side][i]);
+          storage_remove(hash_join.filename[side][i]);
+          hash_join.filename[side][i][0] = '\0';
+        }
+      }
+    }
+  }
+  hash_join.partitions = 0;
+}
+
+static db_result_t
+hash_join_init(db_handle_t *handle)
+{
+  tuple_id_t left_cardinality;
+  tuple_id_t right_cardinality;
+  tuple_id_t cardinality;
+  tuple_id_t capacity;
+  int build;
+  int side;
+  int i;
+  char *filename;
+
+  hash_join_close();
+  memset(&hash_join, 0, sizeof(hash_join));
+
+  /* Build the hash table from the smaller relation. */
+  left_cardinality = relation_cardinality(handle->left_rel);
+  right_cardinality = relation_cardinality(handle->right_rel);
+  build = left_cardinality < right_cardinality;
+
+  hash_join.rel[build ? HASH_BUILD : HASH_PROBE] = handle->left_rel;
+  hash_join.attr[build ? HASH_BUILD : HASH_PROBE] = handle->left_join_attr;
+  hash_join.row[build ? HASH_BUILD : HASH_PROBE] = left_row;
+  hash_join.rel[build ? HASH_PROBE : HASH_BUILD] = handle->right_rel;
+  hash_join.attr[build ? HASH_PROBE : HASH_BUILD] = handle->right_join_attr;
+  hash_join.row[build ? HASH_PROBE : HASH_BUILD] = right_row;
+  for(side = HASH_BUILD; side <= HASH_PROBE; side++) {
+    hash_join.offset[side] = get_attribute_value_offset(hash_join.rel[side],
+                                                        hash_join.attr[side]);
+  }
+
+  capacity = hash_join_capacity(hash_join.rel[HASH_BUILD]);
+  if(capacity == 0) {
+    return DB_ALLOCATION_ERROR;
+  }
+  cardinality = build ? left_cardinality : right_cardinality;
+  if(cardinality == INVALID_TUPLE ||
+     cardinality / capacity >= DB_JOIN_PARTITIONS) {
+    hash_join.partitions = DB_JOIN_PARTITIONS;
+  } else {
+    hash_join.partitions = (cardinality + capacity - 1) / capacity;
+  }
+
+  if(hash_join.partitions > 1) {
+    PRINTF("DB: Partitioning the relations to join into %d files each\n",
+           hash_join.partitions);
+    for(side = HASH_BUILD; side <= HASH_PROBE; side++) {
+      for(i = 0; i < hash_join.partitions; i++) {
+        filename = storage_generate_file("join",
+                                         DB_COFFEE_RESERVE_SIZE / DB_JOIN_PARTITIONS);
+        if(filename == NULL) {
+          hash_join_close();
+          return DB_STORAGE_ERROR;
+        }
+        strncpy(hash_join.filename[side][i], filename,
+                sizeof(hash_join.filename[side][i]) - 1);
+        hash_join.fd[side][i] = storage_open(filename);
+        if(hash_join.fd[side][i] < 0) {
+          storage_remove(hash_join.filename[side][i]);
+          hash_join.filename[side][i][0] = '\0';
+          hash_join_close();
+          return DB_STORAGE_ERROR;
+        }
+      }
+    }
+    hash_join.state = HASH_STATE_PARTITION;
+  } else {
+    hash_join.partitions = 1;
+    hash_join.state = HASH_STATE_BUILD;
+  }
+
+  handle->flags |= DB_HANDLE_FLAG_HASH_JOIN;
+  return DB_OK;
+}
+
+static db_result_t
+hash_join_read(int side, tuple_id_t tuple_id)
+{
+  relation_t *rel;
+
+  rel = hash_join.rel[side];
+  if(hash_join.partitions == 1) {
+    return storage_get_row(rel, &tuple_id, hash_join.row[side]);
+  }
+
+  if(tuple_id >= hash_join.count[side][hash_join.partition]) {
+    return DB_FINISHED;
+  }
+  return storage_read(hash_join.fd[side][hash_join.partition],
+                      hash_join.row[side],
+                      (unsigned long)tuple_id * rel->row_length,
+                      rel->row_length);
+}
+
+/* Put the next chunk of build rows of the partition in the hash table. */
+static db_result_t
+hash_join_build(tuple_id_t *count)
+{
+  struct hash_entry *entry;
+  unsigned row_length;
+  unsigned slots;
+  unsigned used;
+  uint32_t hash;
+  db_result_t result;
+
+  row_length = hash_join.rel[HASH_BUILD]->row_length;
+  slots = HASH_ENTRY_SLOTS(row_length);
+  memset(hash_buckets, 0, sizeof(hash_buckets));
+  hash_join.last_chunk = 0;
+
+  for(used = 0, *count = 0; used + slots <= HASH_POOL_SLOTS; used += slots) {
+    result = hash_join_read(HASH_BUILD, hash_join.build_id);
+    if(DB_ERROR(result)) {
+      return result;
+    } else if(result == DB_FINISHED) {
+      hash_join.last_chunk = 1;
+      break;
+    }
+    hash_join.build_id++;
+    (*count)++;
+
+    entry = &hash_pool[used];
+    entry->key = join_key(hash_join.attr[HASH_BUILD],
+                          hash_join.offset[HASH_BUILD],
+                          hash_join.row[HASH_BUILD]);
+    memcpy(entry + 1, hash_join.row[HASH_BUILD], row_length);
+
+    hash = HASH_VALUE(entry->key);
+    entry->next = hash_buckets[HASH_BUCKET(hash)];
+    hash_buckets[HASH_BUCKET(hash)] = entry;
+  }
+
+  return DB_OK;
+}
+
+/* Each call reads at most one row, except for when a chunk is built. */
+static db_result_t
+process_hash_join(db_handle_t *handle)
+{
+  relation_t *rel;
+  unsigned char *row;
+  db_result_t result;
+  tuple_id_t count;
+  uint32_t hash;
+  int partition;
+
+  switch(hash_join.state) {
+  case HASH_STATE_PARTITION:
+    rel = hash_join.rel[hash_join.side];
+    row = hash_join.row[hash_join.side];
+    result = storage_get_row(rel, &hash_join.probe_id, row);
+    if(DB_ERROR(result)) {
+      break;
+    } else if(result == DB_FINISHED) {
+      if(hash_join.side == HASH_BUILD) {
+        hash_join.side = HASH_PROBE;
+      } else {
+        hash_join.state = HASH_STATE_BUILD;
+      }
+      hash_join.probe_id = 0;
+      return DB_OK;
+    }
+    hash_join.probe_id++;
+
+    hash = HASH_VALUE(join_key(hash_join.attr[hash_join.side],
+                               hash_join.offset[hash_join.side], row));
+    partition = HASH_PARTITION(hash);
+    result = storage_write(hash_join.fd[hash_join.side][partition], row,
+                           (unsigned long)hash_join.count[hash_join.side][partition] *
+                           rel->row_length, rel->row_length);
+    hash_join.count[hash_join.side][partition]++;
+    if(DB_ERROR(result)) {
+      break;
+    }
+    return DB_OK;
+
+  case HASH_STATE_BUILD:
+    result = hash_join_build(&count);
+    if(DB_ERROR(result)) {
+      break;
+    }
+    if(count == 0) {
+      goto next_partition;
+    }
+    hash_join.state = HASH_STATE_PROBE;
+    hash_join.probe_id = 0;
+    hash_join.match = NULL;
+    return DB_OK;
+
+  case HASH_STATE_PROBE:
+    if(hash_join.match == NULL) {
+      result = hash_join_read(HASH_PROBE, hash_join.probe_id);
+      if(DB_ERROR(result)) {
+        break;
+      } else if(result == DB_FINISHED) {
+        if(!hash_join.last_chunk) {
+          hash_join.state = HASH_STATE_BUILD;
+          return DB_OK;
+        }
+        goto next_partition;
+      }
+      hash_join.probe_id++;
+
+      hash_join.key = join_key(hash_join.attr[HASH_PROBE],
+                               hash_join.offset[HASH_PROBE],
+                               hash_join.row[HASH_PROBE]);
+      hash_join.match = hash_buckets[HASH_BUCKET(HASH_VALUE(hash_join.key))];
+    }
+
+    while(hash_join.match != NULL && hash_join.match->key != hash_join.key) {
+      hash_join.match = hash_join.match->next;
+    }
+    if(hash_join.match == NULL) {
+      return DB_OK;
+    }
+
+    memcpy(hash_join.row[HASH_BUILD], hash_join.match + 1,
+           hash_join.rel[HASH_BUILD]->row_length);
+    hash_join.match = hash_join.match->next;
+    return emit_join_row(handle);
+
+  default:
+    return DB_IMPLEMENTATION_ERROR;
+  }
+
+  PRINTF("DB: The hash join failed\n");
+  hash_join_close();
+  return result;
+
+next_partition:
+  if(++hash_join.partition >= hash_join.partitions) {
+    hash_join_close();
+    return DB_FINISHED;
+  }
+  hash_join.build_id = 0;
+  hash_join.state = HASH_STATE_BUILD;
+  return DB_OK;
+}
+#endif /* DB_JOIN_HASH_SIZE > 0 */
+
+void
+relation_join_free(void *handle_ptr)
+{
+#if DB_JOIN_HASH_SIZE > 0
+  hash_join_close();
+#endif
+  ((db_handle_t *)handle_ptr)->flags &= ~DB_HANDLE_FLAG_HASH_JOIN;
+}
+
 db_result_t
 relation_process_join(void *handle_ptr)
 {
@@ -966,17 +1581,21 @@ relation_process_join(void *handle_ptr)
   db_result_t result;
   relation_t *left_rel;
   relation_t *right_rel;
-  relation_t *join_rel;
-  unsigned char *join_next_attribute_ptr;
-  size_t element_size;
   tuple_id_t right_tuple_id;
   attribute_value_t value;
-  int i;
 
   handle = (db_handle_t *)handle_ptr;
   left_rel = handle->left_rel;
   right_rel = handle->right_rel;
-  join_rel = handle->join_rel;
+
+  if(handle->flags & DB_HANDLE_FLAG_MERGE_JOIN) {
+    return process_merge_join(handle);
+  }
+#if DB_JOIN_HASH_SIZE > 0
+  if(handle->flags & DB_HANDLE_FLAG_HASH_JOIN) {
+    return process_hash_join(handle);
+  }
+#endif
 
   if(!(handle->flags & DB_HANDLE_FLAG_INDEX_STEP)) {
     goto inner_loop;
@@ -1030,25 +1649,7 @@ inner_loop:
         return DB_IMPLEMENTATION_ERROR;
       }
 
-      /* Use the source attribute map to fill in the physical representation
-	 of the resulting tuple. */
-      join_next_attribute_ptr = join_row;
-
-      for(i = 0; i < join_rel->attribute_count; i++) {
-	element_size = source_map[i].attr->element_size;
-
-	memcpy(join_next_attribute_ptr, source_map[i].from_ptr, element_size);
-	join_next_attribute_ptr += element_size;
-      }
-
-      if(((aql_adt_t *)handle->adt)->flags & AQL_FLAG_ASSIGN) {
-        if(DB_ERROR(storage_put_row(join_rel, join_row))) {
-          return DB_STORAGE_ERROR;
-        }
-      }
-
-      handle->current_row++;
-      return DB_GOT_ROW;
+      return emit_join_row(handle);
     }
   }
 
@@ -1107,6 +1708,81 @@ generate_join_result(db_handle_t *handle)
   return DB_OK;
 }
 
+static int
+is_sorted_on(attribute_t *attr)
+{
+  return index_exists(attr) &&
+         ((index_t *)attr->index)->type == INDEX_INLINE;
+}
+
+/*
+ * Choose how to join the relations. When both are sorted on the join
+ * attribute, i.e., the attribute has an inline index in both, a
+ * sort-merge join reads them sequentially. Otherwise, an index
+ * nested-loop join probes the index of the right relation once per
+ * left row, which is cheap for an index kept in memory. A hash join
+ * reads each relation once if the smaller one fits in the hash table,
+ * and needs no index. If the smaller relation does not fit, the
+ * relations are partitioned into files, which only pays off when there
+ * is no index to use.
+ */
+static db_result_t
+plan_join(db_handle_t *handle)
+{
+  attribute_t *left_attr;
+  attribute_t *right_attr;
+  int indexed;
+  int integers;
+#if DB_JOIN_HASH_SIZE > 0
+  tuple_id_t cardinality;
+  relation_t *smaller;
+#endif
+
+  left_attr = handle->left_join_attr;
+  right_attr = handle->right_join_attr;
+  integers = (left_attr->domain == DOMAIN_INT ||
+              left_attr->domain == DOMAIN_LONG) &&
+             (right_attr->domain == DOMAIN_INT ||
+              right_attr->domain == DOMAIN_LONG);
+  indexed = index_exists(right_attr);
+
+  if(integers && is_sorted_on(left_attr) && is_sorted_on(right_attr)) {
+    PRINTF("DB: Sort-merge join\n");
+    merge_join_init(handle);
+    return DB_OK;
+  }
+
+  if(indexed &&
+     (((index_t *)right_attr->index)->api->flags & INDEX_API_INTERNAL)) {
+    PRINTF("DB: Index nested-loop join\n");
+    return DB_OK;
+  }
+
+#if DB_JOIN_HASH_SIZE > 0
+  if(integers) {
+    smaller = handle->left_rel;
+    cardinality = relation_cardinality(handle->left_rel);
+    if(relation_cardinality(handle->right_rel) <= cardinality) {
+      smaller = handle->right_rel;
+      cardinality = relation_cardinality(handle->right_rel);
+    }
+    if(hash_join_capacity(smaller) > 0 &&
+       (!indexed || cardinality <= hash_join_capacity(smaller))) {
+      PRINTF("DB: Hash join\n");
+      return hash_join_init(handle);
+    }
+  }
+#endif /* DB_JOIN_HASH_SIZE > 0 */
+
+  if(!indexed) {
+    PRINTF("DB: The attribute to join on is not indexed\n");
+    return DB_INDEX_ERROR;
+  }
+
+  PRINTF("DB: Index nested-loop join\n");
+  return DB_OK;
+}
+
 db_result_t
 relation_join(void *query_result, void *adt_ptr)
 {
@@ -1120,6 +1796,7 @@ relation_join(void *query_result, void *adt_ptr)
   int i;
   char *attribute_name;
   attribute_t *attr;
+  db_result_t result;
 
   adt = (aql_adt_t *)adt_ptr;
 
@@ -1158,11 +1835,6 @@ relation_join(void *query_result, void *adt_ptr)
     return DB_RELATIONAL_ERROR;
   }
 
-  if(!index_exists(handle->right_join_attr)) {
-    PRINTF("DB: The attribute to join on is not indexed\n");
-    return DB_INDEX_ERROR;
-  }
-
   /*
    * Define the resulting relation. We start from 1 when counting attributes
    * because the first attribute is only the one to join, and is not included
@@ -1189,6 +1861,11 @@ relation_join(void *query_result, void *adt_ptr)
     handle->ncolumns++;
   }
 
+  result = plan_join(handle);
+  if(DB_ERROR(result)) {
+    return result;
+  }
+
   return generate_join_result(handle);
 }
 #endif /* DB_FEATURE_JOIN */
@@ -95,8 +95,10 @@ db_result_t relation_attribute_remove(relation_t *, char *);
 db_result_t relation_set_primary_key(relation_t *, char *);
 db_result_t relation_remove(char *, int);
 db_result_t relation_insert(relation_t *, attribute_value_t *);
+db_result_t relation_insert_batch(relation_t *, attribute_value_t *, unsigned);
 db_result_t relation_select(void *, relation_t *, void *);
 db_result_t relation_join(void *, void *);
+void relation_join_free(void *);
 tuple_id_t relation_cardinality(relation_t *);
 
 #endif /* RELATION_H */
@@ -179,6 +179,12 @@ db_free(db_handle_t *handle)
     relation_release(handle->right_rel);
   }
 
+#if DB_FEATURE_JOIN
+  if(handle->flags & DB_HANDLE_FLAG_HASH_JOIN) {
+    relation_join_free(handle);
+  }
+#endif /* DB_FEATURE_JOIN */
+
   handle->flags = 0;
 
   return DB_OK;
@@ -68,6 +68,28 @@ struct index_record {
 
 #define ROW_XOR 0xf6U
 
+#if DB_ROW_BUFFER_SIZE > 0
+/*
+ * Rows of a relation are read a block at a time into one of two
+ * buffers, so that a scan, or the two relations of a join, cost one
+ * cfs_read() per block instead of a seek and a read per row. Blocks
+ * start at a multiple of the number of rows that fit in a buffer. The
+ * rows are kept decoded, so that selections can read them in place.
+ */
+#define ROW_BUFFERS 2
+
+struct row_buffer {
+  relation_t *rel;
+  tuple_id_t first;
+  tuple_id_t count;
+  uint8_t used;
+  unsigned char rows[DB_ROW_BUFFER_SIZE];
+};
+
+static struct row_buffer row_buffers[ROW_BUFFERS];
+static uint8_t row_buffer_clock;
+#endif /* DB_ROW_BUFFER_SIZE > 0 */
+
 static void
 merge_strings(char *dest, char *prefix, char *suffix)
 {
@@ -75,6 +97,109 @@ merge_strings(char *dest, char *prefix, char *suffix)
   strcat(dest, suffix);
 }
 
+#if DB_ROW_BUFFER_SIZE > 0
+static void
+invalidate_rows(relation_t *rel)
+{
+  int i;
+
+  for(i = 0; i < ROW_BUFFERS; i++) {
+    if(rel == NULL || row_buffers[i].rel == rel) {
+      row_buffers[i].rel = NULL;
+    }
+  }
+}
+
+static struct row_buffer *
+find_rows(relation_t *rel, tuple_id_t tuple_id)
+{
+  struct row_buffer *buffer;
+  int i;
+
+  for(i = 0; i < ROW_BUFFERS; i++) {
+    buffer = &row_buffers[i];
+    if(buffer->rel == rel && tuple_id >= buffer->first &&
+       tuple_id < buffer->first + buffer->count) {
+      buffer->used = ++row_buffer_clock;
+      return buffer;
+    }
+  }
+  return NULL;
+}
+
+static db_result_t
+load_rows(relation_t *rel, tuple_id_t tuple_id, tuple_id_t nrows,
+          struct row_buffer **bufferp)
+{
+  struct row_buffer *buffer;
+  tuple_id_t per_buffer;
+  unsigned length;
+  int i, r;
+
+  /* Replace the buffer of the relation, or the least recently used one */
+  buffer = &row_buffers[0];
+  for(i = 0; i < ROW_BUFFERS; i++) {
+    if(row_buffers[i].rel == rel) {
+      buffer = &row_buffers[i];
+      break;
+    }
+    if((uint8_t)(row_buffer_clock - row_buffers[i].used) >
+       (uint8_t)(row_buffer_clock - buffer->used)) {
+      buffer = &row_buffers[i];
+    }
+  }
+
+  per_buffer = sizeof(buffer->rows) / rel->row_length;
+  buffer->rel = NULL;
+  buffer->first = tuple_id - tuple_id % per_buffer;
+  buffer->count = nrows - buffer->first;
+  if(buffer->count > per_buffer) {
+    buffer->count = per_buffer;
+  }
+
+  if(cfs_seek(rel->tuple_storage, buffer->first * rel->row_length,
+              CFS_SEEK_SET) == (cfs_offset_t)-1) {
+    return DB_STORAGE_ERROR;
+  }
+
+  length = buffer->count * rel->row_length;
+  for(i = 0; i < length; i += r) {
+    r = cfs_read(rel->tuple_storage, buffer->rows + i, length - i);
+    if(r <= 0) {
+      PRINTF("DB: Reading failed on fd %d\n", rel->tuple_storage);
+      return DB_STORAGE_ERROR;
+    }
+  }
+  for(i = rel->row_length - 1; i < length; i += rel->row_length) {
+    buffer->rows[i] ^= ROW_XOR;
+  }
+
+  buffer->rel = rel;
+  buffer->used = ++row_buffer_clock;
+  *bufferp = buffer;
+
+  return DB_OK;
+}
+
+static db_result_t
+get_rows(relation_t *rel, tuple_id_t tuple_id, struct row_buffer **bufferp)
+{
+  tuple_id_t nrows;
+
+  *bufferp = find_rows(rel, tuple_id);
+  if(*bufferp == NULL && rel->row_length <= DB_ROW_BUFFER_SIZE) {
+    if(DB_ERROR(storage_get_row_amount(rel, &nrows))) {
+      return DB_STORAGE_ERROR;
+    }
+    if(tuple_id >= nrows) {
+      return DB_FINISHED;
+    }
+    return load_rows(rel, tuple_id, nrows, bufferp);
+  }
+  return DB_OK;
+}
+#endif /* DB_ROW_BUFFER_SIZE > 0 */
+
 char *
 storage_generate_file(char *prefix, unsigned long size)
 {
@@ -103,6 +228,10 @@ storage_generate_file(char *prefix, unsigned long size)
 db_result_t
 storage_load(relation_t *rel)
 {
+#if DB_ROW_BUFFER_SIZE > 0
+  invalidate_rows(rel);
+#endif
+
   PRINTF("DB: Opening the tuple file %s\n", rel->tuple_filename);
   rel->tuple_storage = cfs_open(rel->tuple_filename,
                                 CFS_READ | CFS_WRITE | CFS_APPEND);
@@ -117,6 +246,10 @@ storage_load(relation_t *rel)
 void
 storage_unload(relation_t *rel)
 {
+#if DB_ROW_BUFFER_SIZE > 0
+  invalidate_rows(rel);
+#endif
+
   if(RELATION_HAS_TUPLES(rel)) {
     PRINTF("DB: Unload tuple file %s\n", rel->tuple_filename);
 
@@ -279,6 +412,10 @@ storage_put_attribute(relation_t *rel, attribute_t *attr)
 db_result_t
 storage_drop_relation(relation_t *rel, int remove_tuples)
 {
+#if DB_ROW_BUFFER_SIZE > 0
+  invalidate_rows(rel);
+#endif
+
   if(remove_tuples && RELATION_HAS_TUPLES(rel)) {
     cfs_remove(rel->tuple_filename);
   }
@@ -295,6 +432,10 @@ storage_rename_relation(char *old_name, char *new_name)
   int r;
   char buf[64];
 
+#if DB_ROW_BUFFER_SIZE > 0
+  invalidate_rows(NULL);
+#endif
+
   result = DB_STORAGE_ERROR;
   old_fd = new_fd = -1;
 
@@ -405,6 +546,21 @@ storage_get_row(relation_t *rel, tuple_id_t *tuple_id, storage_row_t row)
 {
   int r;
   tuple_id_t nrows;
+#if DB_ROW_BUFFER_SIZE > 0
+  struct row_buffer *buffer;
+  db_result_t result;
+
+  result = get_rows(rel, *tuple_id, &buffer);
+  if(result != DB_OK) {
+    return result;
+  }
+
+  if(buffer != NULL) {
+    memcpy(row, buffer->rows + (*tuple_id - buffer->first) * rel->row_length,
+           rel->row_length);
+    return DB_OK;
+  }
+#endif /* DB_ROW_BUFFER_SIZE > 0 */
 
   if(DB_ERROR(storage_get_row_amount(rel, &nrows))) {
     return DB_STORAGE_ERROR;
@@ -437,6 +593,29 @@ storage_get_row(relation_t *rel, tuple_id_t *tuple_id, storage_row_t row)
   return DB_OK;
 }
 
+#if DB_ROW_BUFFER_SIZE > 0
+/*
+ * Points *rows to the buffered, decoded rows from tuple_id to the end of
+ * their block, and sets *count to their number. *count is 0 if the rows
+ * of the relation are too long to be buffered.
+ */
+db_result_t
+storage_get_rows(relation_t *rel, tuple_id_t tuple_id,
+                 const unsigned char **rows, tuple_id_t *count)
+{
+  struct row_buffer *buffer;
+  db_result_t result;
+
+  *count = 0;
+  result = get_rows(rel, tuple_id, &buffer);
+  if(result == DB_OK && buffer != NULL) {
+    *rows = buffer->rows + (tuple_id - buffer->first) * rel->row_length;
+    *count = buffer->first + buffer->count - tuple_id;
+  }
+  return result;
+}
+#endif /* DB_ROW_BUFFER_SIZE > 0 */
+
 db_result_t
 storage_put_row(relation_t *rel, storage_row_t row)
 {
@@ -489,6 +668,40 @@ storage_put_row(relation_t *rel, storage_row_t row)
   return DB_OK;
 }
 
+db_result_t
+storage_put_rows(relation_t *rel, storage_row_t rows, unsigned count)
+{
+  unsigned length;
+  unsigned written;
+  unsigned i;
+  int r;
+
+  if(cfs_seek(rel->tuple_storage, 0, CFS_SEEK_END) == (cfs_offset_t)-1) {
+    return DB_STORAGE_ERROR;
+  }
+
+  /* Separate the last byte of each row from 0, as storage_put_row()
+     does, and write all rows at once. */
+  length = count * rel->row_length;
+  for(i = rel->row_length - 1; i < length; i += rel->row_length) {
+    rows[i] ^= ROW_XOR;
+  }
+
+  for(written = 0; written < length; written += r) {
+    r = cfs_write(rel->tuple_storage, rows + written, length - written);
+    if(r <= 0) {
+      PRINTF("DB: Failed to store %u rows\n", count);
+      break;
+    }
+  }
+
+  for(i = rel->row_length - 1; i < length; i += rel->row_length) {
+    rows[i] ^= ROW_XOR;
+  }
+
+  return written < length ? DB_STORAGE_ERROR : DB_OK;
+}
+
 db_result_t
 storage_get_row_amount(relation_t *rel, tuple_id_t *amount)
 {
@@ -528,6 +741,12 @@ storage_close(db_storage_id_t fd)
   cfs_close(fd);
 }
 
+void
+storage_remove(const char *filename)
+{
+  cfs_remove(filename);
+}
+
 db_result_t
 storage_read(db_storage_id_t fd,
 	     void *buffer, unsigned long offset, unsigned length)
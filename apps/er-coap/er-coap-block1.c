@@ -62,7 +62,10 @@
  *        error handling and response configuration is active. On return
  *        value 0, the last block was recived, while on return value 1
  *        more blocks will follow. With target, len and maxlen this
- *        function will assemble the blocks.
+ *        function will assemble the blocks. Blocks of a pipelined
+ *        upload may arrive out of order; each is copied to its own
+ *        offset, and len is complete once the last block has arrived,
+ *        which such clients send after all others were acknowledged.
  *
  *        You can find an example in:
  *        examples/er-rest-example/resources/res-b1-sep-b2.c
@@ -88,28 +91,33 @@ coap_block1_handler(void *request, void *response, uint8_t *target, size_t *len,
     return -1;
   }
 
-  coap_packet_t *packet = (coap_packet_t *)request;
+  uint32_t block_num = 0;
+  uint8_t block_more = 0;
+  uint16_t block_size = 0;
+  uint32_t block_offset = 0;
+  int has_block1 = coap_get_header_block1(request, &block_num, &block_more,
+                                          &block_size, &block_offset);
 
-  if(packet->block1_offset + pay_len > max_len) {
+  if(block_offset + pay_len > max_len) {
     erbium_status_code = REST.status.REQUEST_ENTITY_TOO_LARGE;
     coap_error_message = "Message to big";
     return -1;
   }
 
   if(target && len) {
-    memcpy(target + packet->block1_offset, payload, pay_len);
-    *len = packet->block1_offset + pay_len;
+    memcpy(target + block_offset, payload, pay_len);
+    *len = block_offset + pay_len;
   }
 
-  if(IS_OPTION(packet, COAP_OPTION_BLOCK1)) {
+  if(has_block1) {
     PRINTF("Blockwise: block 1 request: Num: %u, More: %u, Size: %u, Offset: %u\n",
-           packet->block1_num,
-           packet->block1_more,
-           packet->block1_size,
-           packet->block1_offset);
+           block_num,
+           block_more,
+           block_size,
+           block_offset);
 
-    coap_set_header_block1(response, packet->block1_num, packet->block1_more, packet->block1_size);
-    if(packet->block1_more) {
+    coap_set_header_block1(response, block_num, block_more, block_size);
+    if(block_more) {
       coap_set_status_code(response, CONTINUE_2_31);
       return 1;
     }
@@ -43,6 +43,11 @@
 #define COAP_LINK_FORMAT_FILTERING     0
 #define COAP_PROXY_OPTION_PROCESSING   0
 
+/* Decode received options when they are first read rather than while parsing */
+#ifndef COAP_LAZY_PARSING
+#define COAP_LAZY_PARSING              0
+#endif /* COAP_LAZY_PARSING */
+
 /* Listening port for the CoAP REST Engine */
 #ifndef COAP_SERVER_PORT
 #define COAP_SERVER_PORT               COAP_DEFAULT_PORT
@@ -53,6 +58,31 @@
 #define COAP_MAX_OPEN_TRANSACTIONS     4
 #endif /* COAP_MAX_OPEN_TRANSACTIONS */
 
+/* Buckets of the MID hash for open transactions, a power of two; 0 keeps a plain list */
+#ifndef COAP_TRANSACTION_HASH_SIZE
+#define COAP_TRANSACTION_HASH_SIZE     0
+#endif /* COAP_TRANSACTION_HASH_SIZE */
+
+/* CoCoA retransmission timeouts and the NSTART limit for confirmable messages */
+#ifndef COAP_CONGESTION_CONTROL
+#define COAP_CONGESTION_CONTROL        0
+#endif /* COAP_CONGESTION_CONTROL */
+
+/* Confirmable exchanges outstanding per destination with congestion control */
+#ifndef COAP_NSTART
+#define COAP_NSTART                    1
+#endif /* COAP_NSTART */
+
+/* Destinations with RTO estimators, at least one per open transaction */
+#ifndef COAP_CONGESTION_DESTINATIONS
+#define COAP_CONGESTION_DESTINATIONS   COAP_MAX_OPEN_TRANSACTIONS
+#endif /* COAP_CONGESTION_DESTINATIONS */
+
+/* Blocks a pipelined block-wise request keeps in flight; 0 leaves out the pipelined client */
+#ifndef COAP_BLOCKWISE_WINDOW
+#define COAP_BLOCKWISE_WINDOW          0
+#endif /* COAP_BLOCKWISE_WINDOW */
+
 /* Maximum number of failed request attempts before action */
 #ifndef COAP_MAX_ATTEMPTS
 #define COAP_MAX_ATTEMPTS              4
@@ -68,6 +98,16 @@
 #define COAP_MAX_OBSERVERS    COAP_MAX_OPEN_TRANSACTIONS - 1
 #endif /* COAP_MAX_OBSERVERS */
 
+/* Buckets of the observer hashes by client, token and URI, a power of two; 0 keeps a plain list */
+#ifndef COAP_OBSERVER_HASH_SIZE
+#define COAP_OBSERVER_HASH_SIZE        0
+#endif /* COAP_OBSERVER_HASH_SIZE */
+
+/* Run the resource handler and serialize a notification once for all of its observers */
+#ifndef COAP_OBSERVE_FANOUT
+#define COAP_OBSERVE_FANOUT            0
+#endif /* COAP_OBSERVE_FANOUT */
+
 /* Interval in notifies in which NON notifies are changed to CON notifies to check client. */
 #define COAP_OBSERVE_REFRESH_INTERVAL  20
 
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *      CoAP congestion control: CoCoA retransmission timeouts and NSTART
+ */
+
+#include <string.h>
+
+#include "er-coap.h"
+#include "er-coap-congestion.h"
+
+#if COAP_CONGESTION_CONTROL
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define DEFAULT_RTO   (CLOCK_SECOND * COAP_RESPONSE_TIMEOUT)
+#define MAX_RTO       (CLOCK_SECOND * 60)
+
+/* RFC 6298 estimator; the strong one uses K = 4, the weak one K = 1 */
+struct estimator {
+  clock_time_t srtt;
+  clock_time_t rttvar;
+};
+
+struct destination {
+  uip_ipaddr_t addr;
+  struct estimator strong;
+  struct estimator weak;
+  clock_time_t rto;             /* overall RTO, 0 for an unused entry */
+  clock_time_t updated;         /* last change of the RTO, for aging */
+  clock_time_t used;            /* last lookup, for replacement */
+  uint8_t samples;              /* which estimators have a sample */
+  uint8_t outstanding;          /* confirmable exchanges in flight */
+};
+
+#define STRONG_SAMPLED 0x01
+#define WEAK_SAMPLED   0x02
+
+static struct destination destinations[COAP_CONGESTION_DESTINATIONS];
+/*---------------------------------------------------------------------------*/
+static struct destination *
+lookup(const uip_ipaddr_t *addr, int create)
+{
+  struct destination *d;
+  struct destination *victim = NULL;
+  clock_time_t now = clock_time();
+
+  for(d = destinations; d < destinations + COAP_CONGESTION_DESTINATIONS; d++) {
+    if(d->rto == 0) {
+      if(victim == NULL || victim->rto != 0) {
+        victim = d;
+      }
+    } else if(uip_ipaddr_cmp(&d->addr, addr)) {
+      d->used = now;
+      return d;
+    } else if(d->outstanding == 0
+              && (victim == NULL
+                  || (victim->rto != 0 && now - d->used > now - victim->used))) {
+      /* least recently used destination with nothing in flight */
+      victim = d;
+    }
+  }
+
+  if(!create || victim == NULL) {
+    return NULL;
+  }
+
+  memset(victim, 0, sizeof(*victim));
+  uip_ipaddr_copy(&victim->addr, addr);
+  victim->rto = DEFAULT_RTO;
+  victim->updated = now;
+  victim->used = now;
+  return victim;
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+estimate(struct estimator *e, int sampled, clock_time_t rtt, int k)
+{
+  clock_time_t delta;
+
+  if(!sampled) {
+    e->srtt = rtt;
+    e->rttvar = rtt / 2;
+  } else {
+    delta = e->srtt > rtt ? e->srtt - rtt : rtt - e->srtt;
+    e->rttvar = (3 * e->rttvar + delta) / 4;
+    e->srtt = (7 * e->srtt + rtt) / 8;
+  }
+  return e->srtt + k * e->rttvar;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+coap_congestion_rto(const uip_ipaddr_t *addr)
+{
+  struct destination *d = lookup(addr, 1);
+  clock_time_t age;
+
+  if(d == NULL) {
+    return DEFAULT_RTO;
+  }
+
+  /* Age RTOs that have not been updated for a while towards the default */
+  age = clock_time() - d->updated;
+  if(d->rto < CLOCK_SECOND && age > 16 * d->rto) {
+    d->rto *= 2;
+    d->updated = clock_time();
+  } else if(d->rto > 3 * CLOCK_SECOND && age > 4 * d->rto) {
+    d->rto = CLOCK_SECOND + d->rto / 2;
+    d->updated = clock_time();
+  }
+  return d->rto;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+coap_congestion_backoff(const uip_ipaddr_t *addr, clock_time_t timeout)
+{
+  struct destination *d = lookup(addr, 0);
+  clock_time_t rto = d != NULL ? d->rto : DEFAULT_RTO;
+
+  /* Variable backoff factor: back off faster from small RTOs */
+  if(rto < CLOCK_SECOND) {
+    timeout *= 3;
+  } else if(rto > 3 * CLOCK_SECOND) {
+    timeout += timeout / 2;
+  } else {
+    timeout *= 2;
+  }
+  return MIN(timeout, MAX_RTO);
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_congestion_update(const uip_ipaddr_t *addr, clock_time_t rtt,
+                       uint8_t retransmissions)
+{
+  struct destination *d;
+  clock_time_t rto;
+
+  if(retransmissions > 2) {
+    /* Too ambiguous which transmission was answered */
+    return;
+  }
+  d = lookup(addr, 1);
+  if(d == NULL) {
+    return;
+  }
+
+  if(retransmissions == 0) {
+    rto = estimate(&d->strong, d->samples & STRONG_SAMPLED, rtt, 4);
+    d->samples |= STRONG_SAMPLED;
+    d->rto = (d->rto + rto) / 2;
+  } else {
+    rto = estimate(&d->weak, d->samples & WEAK_SAMPLED, rtt, 1);
+    d->samples |= WEAK_SAMPLED;
+    d->rto = (3 * d->rto + rto) / 4;
+  }
+  d->rto = MAX(1, MIN(d->rto, MAX_RTO));
+  d->updated = clock_time();
+
+  PRINTF("CoCoA: RTT %lu (%u retransmissions), RTO %lu\n",
+         (unsigned long)rtt, retransmissions, (unsigned long)d->rto);
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_congestion_start(const uip_ipaddr_t *addr)
+{
+  struct destination *d = lookup(addr, 1);
+
+  if(d == NULL) {
+    /* Every entry has exchanges in flight; do not hold this one back */
+    return 1;
+  }
+  if(d->outstanding >= COAP_NSTART) {
+    return 0;
+  }
+  ++d->outstanding;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_congestion_done(const uip_ipaddr_t *addr)
+{
+  struct destination *d = lookup(addr, 0);
+
+  if(d != NULL && d->outstanding > 0) {
+    --d->outstanding;
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* COAP_CONGESTION_CONTROL */
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *      CoAP congestion control: CoCoA retransmission timeouts and NSTART
+ *
+ *      Every destination keeps a strong RTO estimator, fed with the RTT
+ *      of exchanges that were answered without retransmission, and a
+ *      weak one, fed with those answered after one or two
+ *      retransmissions and measured from the first transmission. Both
+ *      are blended into the overall RTO that starts the next exchange.
+ *      Retransmissions back off by a factor that depends on that RTO,
+ *      and RTOs that have not been updated for a while age back towards
+ *      the default.
+ *
+ *      The number of confirmable exchanges outstanding to a destination
+ *      is limited to COAP_NSTART; the transaction layer holds further
+ *      messages back until one of them completes.
+ */
+
+#ifndef ER_COAP_CONGESTION_H_
+#define ER_COAP_CONGESTION_H_
+
+#include "contiki.h"
+#include "contiki-net.h"
+
+/**
+ * \brief      Initial retransmission timeout for a new exchange
+ * \param addr The destination
+ * \return     The overall RTO of the destination, in clock ticks
+ */
+clock_time_t coap_congestion_rto(const uip_ipaddr_t *addr);
+
+/**
+ * \brief      Back off the retransmission timeout of an exchange
+ * \param addr The destination
+ * \param timeout The timeout of the previous transmission
+ * \return     The timeout of the next transmission
+ */
+clock_time_t coap_congestion_backoff(const uip_ipaddr_t *addr,
+                                     clock_time_t timeout);
+
+/**
+ * \brief      Feed an RTT sample to the estimators of a destination
+ * \param addr The destination
+ * \param rtt  Time from the first transmission to the answer
+ * \param retransmissions Number of retransmissions before the answer
+ */
+void coap_congestion_update(const uip_ipaddr_t *addr, clock_time_t rtt,
+                            uint8_t retransmissions);
+
+/**
+ * \brief      Start a confirmable exchange with a destination
+ * \param addr The destination
+ * \return     1 if it may be sent now, 0 if COAP_NSTART exchanges
+ *             are outstanding already
+ */
+int coap_congestion_start(const uip_ipaddr_t *addr);
+
+/**
+ * \brief      End an exchange started with coap_congestion_start()
+ * \param addr The destination
+ */
+void coap_congestion_done(const uip_ipaddr_t *addr);
+
+#endif /* ER_COAP_CONGESTION_H_ */
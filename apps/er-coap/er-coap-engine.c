@@ -93,7 +93,13 @@ coap_receive(void)
 
       PRINTF("  Parsed: v %u, t %u, tkl %u, c %u, mid %u\n", message->version,
              message->type, message->token_len, message->code, message->mid);
-      PRINTF("  URL: %.*s\n", message->uri_path_len, message->uri_path);
+#if DEBUG
+      {
+        const char *url = "";
+        int url_len = coap_get_header_uri_path(message, &url);
+        PRINTF("  URL: %.*s\n", url_len, url);
+      }
+#endif
       PRINTF("  Payload: %.*s\n", message->payload_len, message->payload);
 
       /* handle requests */
@@ -241,6 +247,13 @@ coap_receive(void)
         }
 
         if((transaction = coap_get_transaction_by_mid(message->mid))) {
+#if COAP_CONGESTION_CONTROL
+          if(transaction->started) {
+            coap_congestion_update(&transaction->addr,
+                                   clock_time() - transaction->start,
+                                   transaction->retrans_counter);
+          }
+#endif /* COAP_CONGESTION_CONTROL */
           /* free transaction memory before callback, as it may create a new transaction */
           restful_response_handler callback = transaction->callback;
           void *callback_data = transaction->callback_data;
@@ -350,6 +363,11 @@ PROCESS_THREAD(coap_engine, ev, data)
     } else if(ev == PROCESS_EVENT_TIMER) {
       /* retransmissions are handled here */
       coap_check_transactions();
+#if COAP_CONGESTION_CONTROL
+    } else if(ev == PROCESS_EVENT_POLL) {
+      /* exchanges completed, send what NSTART held back */
+      coap_send_waiting_transactions();
+#endif /* COAP_CONGESTION_CONTROL */
     }
   } /* while (1) */
 
@@ -433,6 +451,218 @@ PT_THREAD(coap_blocking_request
 
   PT_END(&state->pt);
 }
+#if COAP_BLOCKWISE_WINDOW
+/*---------------------------------------------------------------------------*/
+#define UNKNOWN_LAST_BLOCK 0xFFFFFFFF
+
+static void
+coap_pipelined_request_callback(void *callback_data, void *response)
+{
+  struct pipelined_request_slot_t *slot =
+    (struct pipelined_request_slot_t *)callback_data;
+  struct pipelined_request_state_t *state = slot->state;
+  coap_packet_t *const res = (coap_packet_t *)response;
+  uint32_t num = 0;
+  uint8_t more = 0;
+  uint16_t size = 0;
+  uint32_t size2 = 0;
+
+  slot->busy = 0;
+  --(state->in_flight);
+  process_poll(state->process);
+
+  if(res == NULL) {
+    PRINTF("Block %lu timed out\n", slot->block_num);
+    state->failed = 1;
+    return;
+  }
+
+  if(state->payload_len > 0) {
+    /* Block1 upload: intermediate blocks are answered with 2.31 */
+    if(res->code == CONTINUE_2_31) {
+      if(!state->negotiated) {
+        state->negotiated = 1;
+        if(coap_get_header_block1(res, NULL, NULL, &size, NULL)
+           && size < state->block_size) {
+          /* The server wants smaller blocks; it has the first one already */
+          state->next_block = state->block_size / size;
+          state->block_size = size;
+          state->last_block = (state->payload_len - 1) / size;
+        }
+      }
+      return;
+    }
+    if(slot->block_num != state->last_block) {
+      state->failed = 1;
+    }
+    state->callback(res);
+    return;
+  }
+
+  /* Block2 download */
+  if(!coap_get_header_block2(res, &num, &more, &size, NULL)) {
+    if(slot->block_num == 0) {
+      /* Not a block-wise resource, or an error */
+      state->last_block = 0;
+      state->callback(res);
+    }
+    /* Otherwise a speculative request beyond the last block */
+    return;
+  }
+
+  if(num != slot->block_num) {
+    PRINTF("WRONG BLOCK %lu/%lu\n", num, slot->block_num);
+    if(++(state->errors) >= COAP_MAX_ATTEMPTS) {
+      state->failed = 1;
+    } else {
+      slot->busy = 1;
+      slot->resend = 1;
+    }
+    return;
+  }
+
+  if(!state->negotiated) {
+    state->negotiated = 1;
+    if(size < state->block_size) {
+      state->block_size = size;
+    } else {
+      /* The first block covers several of ours */
+      state->next_block = size / state->block_size;
+    }
+    if(coap_get_header_size2(res, &size2) && size2 > 0) {
+      state->last_block = (size2 - 1) / state->block_size;
+    }
+  }
+  if(!more && num < state->last_block) {
+    state->last_block = num;
+  }
+  if(num <= state->last_block) {
+    state->callback(res);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+coap_pipelined_request_send(struct pipelined_request_state_t *state,
+                            struct pipelined_request_slot_t *slot,
+                            uint32_t num, uip_ipaddr_t *remote_ipaddr,
+                            uint16_t remote_port, coap_packet_t *request,
+                            const uint8_t *payload)
+{
+  coap_transaction_t *t;
+  uint32_t offset;
+
+  request->mid = coap_get_mid();
+  if(!(t = coap_new_transaction(request->mid, remote_ipaddr, remote_port))) {
+    return 0;
+  }
+  t->callback = coap_pipelined_request_callback;
+  t->callback_data = slot;
+
+  if(state->payload_len > 0) {
+    offset = num * state->block_size;
+    if(num > 0 || state->last_block > 0) {
+      coap_set_header_block1(request, num, num < state->last_block,
+                             state->block_size);
+    }
+    coap_set_payload(request, payload + offset,
+                     MIN(state->block_size, state->payload_len - offset));
+  } else if(num > 0) {
+    coap_set_header_block2(request, num, 0, state->block_size);
+  }
+  t->packet_len = coap_serialize_message(request, t->packet);
+
+  slot->block_num = num;
+  slot->busy = 1;
+  slot->resend = 0;
+  ++(state->in_flight);
+
+  coap_send_transaction(t);
+  PRINTF("Requested #%lu (MID %u)\n", num, request->mid);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PT_THREAD(coap_pipelined_request
+            (struct pipelined_request_state_t *state, process_event_t ev,
+            uip_ipaddr_t *remote_ipaddr, uint16_t remote_port,
+            coap_packet_t *request, const uint8_t *payload,
+            size_t payload_len, blocking_response_handler request_callback))
+{
+  struct pipelined_request_slot_t *slot;
+  int window;
+
+  PT_BEGIN(&state->pt);
+
+  state->process = PROCESS_CURRENT();
+  state->callback = request_callback;
+  state->payload_len = payload != NULL ? payload_len : 0;
+  state->block_size = REST_MAX_CHUNK_SIZE;
+  state->next_block = 0;
+  state->last_block = state->payload_len > 0
+    ? (state->payload_len - 1) / state->block_size : UNKNOWN_LAST_BLOCK;
+  state->in_flight = 0;
+  state->negotiated = 0;
+  state->errors = 0;
+  state->failed = 0;
+  for(slot = state->slots; slot < state->slots + COAP_BLOCKWISE_WINDOW;
+      slot++) {
+    slot->state = state;
+    slot->busy = 0;
+    slot->resend = 0;
+  }
+
+  while(!state->failed) {
+    /* The first block goes alone to settle the block size */
+    window = state->negotiated ? COAP_BLOCKWISE_WINDOW : 1;
+
+    for(slot = state->slots; slot < state->slots + COAP_BLOCKWISE_WINDOW;
+        slot++) {
+      if(slot->resend
+         && !coap_pipelined_request_send(state, slot, slot->block_num,
+                                         remote_ipaddr, remote_port,
+                                         request, payload)) {
+        break;
+      }
+    }
+
+    for(slot = state->slots; slot < state->slots + COAP_BLOCKWISE_WINDOW
+        && state->in_flight < window
+        && state->next_block <= state->last_block; slot++) {
+      if(slot->busy) {
+        continue;
+      }
+      if(state->payload_len > 0 && state->next_block == state->last_block
+         && state->in_flight > 0) {
+        /* The last block of an upload completes it, so it goes last */
+        break;
+      }
+      if(!coap_pipelined_request_send(state, slot, state->next_block,
+                                      remote_ipaddr, remote_port,
+                                      request, payload)) {
+        /* No transaction buffer; wait for one in flight to finish */
+        break;
+      }
+      ++(state->next_block);
+    }
+
+    if(state->in_flight == 0) {
+      for(slot = state->slots; slot < state->slots + COAP_BLOCKWISE_WINDOW
+          && !slot->resend; slot++);
+      if(state->next_block <= state->last_block
+         || slot < state->slots + COAP_BLOCKWISE_WINDOW) {
+        PRINTF("Could not allocate transaction buffer");
+        state->failed = 1;
+      }
+      break;
+    }
+    PT_YIELD_UNTIL(&state->pt, ev == PROCESS_EVENT_POLL);
+  }
+
+  /* Blocks still in flight call back into the state */
+  PT_WAIT_UNTIL(&state->pt, state->in_flight == 0);
+
+  PT_END(&state->pt);
+}
+#endif /* COAP_BLOCKWISE_WINDOW */
 /*---------------------------------------------------------------------------*/
 /*- REST Engine Interface ---------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
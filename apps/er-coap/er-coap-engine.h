@@ -45,6 +45,7 @@
 #include "er-coap-observe.h"
 #include "er-coap-separate.h"
 #include "er-coap-observe-client.h"
+#include "er-coap-congestion.h"
 
 #define SERVER_LISTEN_PORT      UIP_HTONS(COAP_SERVER_PORT)
 
@@ -81,6 +82,58 @@ PT_THREAD(coap_blocking_request
                                    request, chunk_handler) \
              ); \
   }
+
+#if COAP_BLOCKWISE_WINDOW
+struct pipelined_request_state_t;
+
+struct pipelined_request_slot_t {
+  struct pipelined_request_state_t *state;
+  uint32_t block_num;
+  uint8_t busy;
+  uint8_t resend;
+};
+
+struct pipelined_request_state_t {
+  struct pt pt;
+  struct process *process;
+  struct pipelined_request_slot_t slots[COAP_BLOCKWISE_WINDOW];
+  blocking_response_handler callback;
+  size_t payload_len;
+  uint32_t next_block;
+  uint32_t last_block;
+  uint16_t block_size;
+  uint8_t in_flight;
+  uint8_t negotiated;
+  uint8_t errors;
+  uint8_t failed;
+};
+
+/*
+ * Block-wise request that keeps up to COAP_BLOCKWISE_WINDOW blocks in
+ * flight. Without payload, the response is downloaded with Block2 and
+ * request_callback is called for every block, possibly out of order;
+ * use coap_get_header_block2() for the offset. With payload, it is
+ * uploaded with Block1 and request_callback gets the final response.
+ * COAP_NSTART must allow the window with congestion control.
+ */
+PT_THREAD(coap_pipelined_request
+            (struct pipelined_request_state_t *state, process_event_t ev,
+            uip_ipaddr_t *remote_ipaddr, uint16_t remote_port,
+            coap_packet_t *request, const uint8_t *payload,
+            size_t payload_len, blocking_response_handler request_callback));
+
+#define COAP_PIPELINED_REQUEST(server_addr, server_port, request, payload, \
+                               payload_len, chunk_handler) \
+  { \
+    static struct pipelined_request_state_t request_state; \
+    PT_SPAWN(process_pt, &request_state.pt, \
+             coap_pipelined_request(&request_state, ev, \
+                                    server_addr, server_port, \
+                                    request, payload, payload_len, \
+                                    chunk_handler) \
+             ); \
+  }
+#endif /* COAP_BLOCKWISE_WINDOW */
 /*---------------------------------------------------------------------------*/
 
 #endif /* ER_COAP_ENGINE_H_ */
@@ -54,7 +54,134 @@
 
 /*---------------------------------------------------------------------------*/
 MEMB(observers_memb, coap_observer_t, COAP_MAX_OBSERVERS);
+#if COAP_OBSERVER_HASH_SIZE
+#if COAP_OBSERVER_HASH_SIZE & (COAP_OBSERVER_HASH_SIZE - 1)
+#error "COAP_OBSERVER_HASH_SIZE must be a power of two"
+#endif
+/*
+ * Observers are chained in four hashes instead of a list: by client, by
+ * client and token, by URL for notifications of plain resources, and by
+ * the first URL segment for notifications of resources with sub-resources
+ * (an observer of a sub-resource shares it with its parent). The rare
+ * walks over all observers go through the pool.
+ */
+static coap_observer_t *client_hash[COAP_OBSERVER_HASH_SIZE];
+static coap_observer_t *token_hash[COAP_OBSERVER_HASH_SIZE];
+static coap_observer_t *url_hash[COAP_OBSERVER_HASH_SIZE];
+static coap_observer_t *root_hash[COAP_OBSERVER_HASH_SIZE];
+
+#define BUCKET(table, hash) (&(table)[(hash) & (COAP_OBSERVER_HASH_SIZE - 1)])
+
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME  16777619UL
+
+#define CHAIN_ADD(head, o, field) do { \
+    (o)->field = *(head);              \
+    *(head) = (o);                     \
+  } while(0)
+
+#define CHAIN_REMOVE(head, o, field) do {                    \
+    coap_observer_t **op_;                                   \
+    for(op_ = (head); *op_ != NULL; op_ = &(*op_)->field) {  \
+      if(*op_ == (o)) {                                      \
+        *op_ = (o)->field;                                   \
+        break;                                               \
+      }                                                      \
+    }                                                        \
+  } while(0)
+
+#define FIRST_OBSERVER()        pool_next(NULL)
+#define NEXT_OBSERVER(o)        pool_next(o)
+#define FIRST_BY_CLIENT(a, p)   (*BUCKET(client_hash, client_hash_of(a, p)))
+#define NEXT_BY_CLIENT(o)       ((o)->client_next)
+#define FIRST_BY_TOKEN(a, p, t, l) \
+  (*BUCKET(token_hash, fnv(client_hash_of(a, p), t, l)))
+#define NEXT_BY_TOKEN(o)        ((o)->token_next)
+#define FIRST_BY_URL(u, l)      (*BUCKET(url_hash, fnv(FNV_OFFSET, u, l)))
+#define NEXT_BY_URL(o)          ((o)->url_next)
+#define FIRST_BY_ROOT(u, l) \
+  (*BUCKET(root_hash, fnv(FNV_OFFSET, u, root_len(u, l))))
+#define NEXT_BY_ROOT(o)         ((o)->root_next)
+#else /* COAP_OBSERVER_HASH_SIZE */
 LIST(observers_list);
+
+#define FIRST_OBSERVER()        ((coap_observer_t *)list_head(observers_list))
+#define NEXT_OBSERVER(o)        ((o)->next)
+#define FIRST_BY_CLIENT(a, p)   FIRST_OBSERVER()
+#define NEXT_BY_CLIENT(o)       NEXT_OBSERVER(o)
+#define FIRST_BY_TOKEN(a, p, t, l) FIRST_OBSERVER()
+#define NEXT_BY_TOKEN(o)        NEXT_OBSERVER(o)
+#define FIRST_BY_URL(u, l)      FIRST_OBSERVER()
+#define NEXT_BY_URL(o)          NEXT_OBSERVER(o)
+#define FIRST_BY_ROOT(u, l)     FIRST_OBSERVER()
+#define NEXT_BY_ROOT(o)         NEXT_OBSERVER(o)
+#endif /* COAP_OBSERVER_HASH_SIZE */
+/*---------------------------------------------------------------------------*/
+#if COAP_OBSERVER_HASH_SIZE
+static uint32_t
+fnv(uint32_t hash, const void *data, int len)
+{
+  const uint8_t *p = data;
+
+  while(len-- > 0) {
+    hash = (hash ^ *p++) * FNV_PRIME;
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+client_hash_of(const uip_ipaddr_t *addr, uint16_t port)
+{
+  return fnv(fnv(FNV_OFFSET, addr, sizeof(uip_ipaddr_t)), &port, sizeof(port));
+}
+/*---------------------------------------------------------------------------*/
+static int
+root_len(const char *url, int len)
+{
+  int i;
+
+  for(i = 0; i < len && url[i] != '/'; i++);
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+static coap_observer_t *
+pool_next(coap_observer_t *o)
+{
+  int i;
+
+  for(i = o == NULL ? 0 : o - (coap_observer_t *)observers_memb.mem + 1;
+      i < observers_memb.num; i++) {
+    if(observers_memb.count[i] != 0) {
+      return &((coap_observer_t *)observers_memb.mem)[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_add(coap_observer_t *o)
+{
+  int len = strlen(o->url);
+
+  CHAIN_ADD(&FIRST_BY_CLIENT(&o->addr, o->port), o, client_next);
+  CHAIN_ADD(&FIRST_BY_TOKEN(&o->addr, o->port, o->token, o->token_len), o,
+            token_next);
+  CHAIN_ADD(&FIRST_BY_URL(o->url, len), o, url_next);
+  CHAIN_ADD(&FIRST_BY_ROOT(o->url, len), o, root_next);
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_remove(coap_observer_t *o)
+{
+  int len = strlen(o->url);
+
+  CHAIN_REMOVE(&FIRST_BY_CLIENT(&o->addr, o->port), o, client_next);
+  CHAIN_REMOVE(&FIRST_BY_TOKEN(&o->addr, o->port, o->token, o->token_len), o,
+               token_next);
+  CHAIN_REMOVE(&FIRST_BY_URL(o->url, len), o, url_next);
+  CHAIN_REMOVE(&FIRST_BY_ROOT(o->url, len), o, root_next);
+}
+#endif /* COAP_OBSERVER_HASH_SIZE */
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -81,9 +208,13 @@ add_observer(uip_ipaddr_t *addr, uint16_t port, const uint8_t *token,
     o->last_mid = 0;
 
     PRINTF("Adding observer (%u/%u) for /%s [0x%02X%02X]\n",
-           list_length(observers_list) + 1, COAP_MAX_OBSERVERS,
-           o->url, o->token[0], o->token[1]);
+           COAP_MAX_OBSERVERS - memb_numfree(&observers_memb),
+           COAP_MAX_OBSERVERS, o->url, o->token[0], o->token[1]);
+#if COAP_OBSERVER_HASH_SIZE
+    index_add(o);
+#else /* COAP_OBSERVER_HASH_SIZE */
     list_add(observers_list, o);
+#endif /* COAP_OBSERVER_HASH_SIZE */
   }
 
   return o;
@@ -97,8 +228,12 @@ coap_remove_observer(coap_observer_t *o)
   PRINTF("Removing observer for /%s [0x%02X%02X]\n", o->url, o->token[0],
          o->token[1]);
 
-  memb_free(&observers_memb, o);
+#if COAP_OBSERVER_HASH_SIZE
+  index_remove(o);
+#else /* COAP_OBSERVER_HASH_SIZE */
   list_remove(observers_list, o);
+#endif /* COAP_OBSERVER_HASH_SIZE */
+  memb_free(&observers_memb, o);
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -106,9 +241,10 @@ coap_remove_observer_by_client(uip_ipaddr_t *addr, uint16_t port)
 {
   int removed = 0;
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
 
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
+  for(obs = FIRST_BY_CLIENT(addr, port); obs; obs = next) {
+    next = NEXT_BY_CLIENT(obs);
     PRINTF("Remove check client ");
     PRINT6ADDR(addr);
     PRINTF(":%u\n", port);
@@ -126,9 +262,10 @@ coap_remove_observer_by_token(uip_ipaddr_t *addr, uint16_t port,
 {
   int removed = 0;
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
 
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
+  for(obs = FIRST_BY_TOKEN(addr, port, token, token_len); obs; obs = next) {
+    next = NEXT_BY_TOKEN(obs);
     PRINTF("Remove check Token 0x%02X%02X\n", token[0], token[1]);
     if(uip_ipaddr_cmp(&obs->addr, addr) && obs->port == port
        && obs->token_len == token_len
@@ -146,9 +283,11 @@ coap_remove_observer_by_uri(uip_ipaddr_t *addr, uint16_t port,
 {
   int removed = 0;
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
 
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
+  for(obs = addr != NULL ? FIRST_BY_CLIENT(addr, port) : FIRST_OBSERVER();
+      obs; obs = next) {
+    next = addr != NULL ? NEXT_BY_CLIENT(obs) : NEXT_OBSERVER(obs);
     PRINTF("Remove check URL %p\n", uri);
     if((addr == NULL
         || (uip_ipaddr_cmp(&obs->addr, addr) && obs->port == port))
@@ -165,9 +304,10 @@ coap_remove_observer_by_mid(uip_ipaddr_t *addr, uint16_t port, uint16_t mid)
 {
   int removed = 0;
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
 
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
+  for(obs = FIRST_BY_CLIENT(addr, port); obs; obs = next) {
+    next = NEXT_BY_CLIENT(obs);
     PRINTF("Remove check MID %u\n", mid);
     if(uip_ipaddr_cmp(&obs->addr, addr) && obs->port == port
        && obs->last_mid == mid) {
@@ -180,6 +320,105 @@ coap_remove_observer_by_mid(uip_ipaddr_t *addr, uint16_t port, uint16_t mid)
 /*---------------------------------------------------------------------------*/
 /*- Notification ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
+#if COAP_OBSERVE_FANOUT
+/*
+ * The notification is built by the resource handler and serialized once,
+ * with an empty token and Observe 0. Each observer's copy only differs in
+ * type, MID, token and Observe value, which are patched in while copying.
+ */
+static uint8_t fanout_buffer[COAP_MAX_PACKET_SIZE + 1];
+static uint16_t fanout_len;
+/* Offset of the (empty) Observe option, 0 for error responses without one */
+static uint16_t fanout_observe;
+/*---------------------------------------------------------------------------*/
+static uint16_t
+find_observe(const uint8_t *msg, uint16_t len)
+{
+  uint16_t pos = COAP_HEADER_LEN + (msg[0] & COAP_HEADER_TOKEN_LEN_MASK);
+  unsigned int number = 0;
+  unsigned int delta, length;
+  uint16_t start;
+
+  while(pos < len && msg[pos] != 0xFF) {
+    start = pos;
+    delta = msg[pos] >> 4;
+    length = msg[pos] & 0x0F;
+    pos++;
+    if(delta == 13) {
+      delta = 13 + msg[pos++];
+    } else if(delta == 14) {
+      delta = 269 + (msg[pos] << 8) + msg[pos + 1];
+      pos += 2;
+    }
+    if(length == 13) {
+      length = 13 + msg[pos++];
+    } else if(length == 14) {
+      length = 269 + (msg[pos] << 8) + msg[pos + 1];
+      pos += 2;
+    }
+    number += delta;
+    if(number == COAP_OPTION_OBSERVE) {
+      return start;
+    } else if(number > COAP_OPTION_OBSERVE) {
+      break;
+    }
+    pos += length;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fanout_prepare(resource_t *resource, coap_packet_t *request,
+               coap_packet_t *notification)
+{
+  resource->get_handler(request, notification,
+                        fanout_buffer + COAP_MAX_HEADER_SIZE,
+                        REST_MAX_CHUNK_SIZE, NULL);
+  if(notification->code < BAD_REQUEST_4_00) {
+    coap_set_header_observe(notification, 0);
+  }
+  fanout_len = coap_serialize_message(notification, fanout_buffer);
+  fanout_observe = notification->code < BAD_REQUEST_4_00
+    ? find_observe(fanout_buffer, fanout_len) : 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+fanout_copy(uint8_t *buffer, coap_message_type_t type, uint16_t mid,
+            const uint8_t *token, uint8_t token_len, uint32_t observe)
+{
+  const uint8_t *rest = fanout_buffer + COAP_HEADER_LEN;
+  uint8_t *p = buffer;
+  uint8_t n;
+
+  *p++ = (fanout_buffer[0]
+          & ~(COAP_HEADER_TYPE_MASK | COAP_HEADER_TOKEN_LEN_MASK))
+    | (COAP_HEADER_TYPE_MASK & type << COAP_HEADER_TYPE_POSITION)
+    | (COAP_HEADER_TOKEN_LEN_MASK & token_len);
+  *p++ = fanout_buffer[1];
+  *p++ = (uint8_t)(mid >> 8);
+  *p++ = (uint8_t)mid;
+  memcpy(p, token, token_len);
+  p += token_len;
+
+  if(fanout_observe) {
+    memcpy(p, rest, fanout_buffer + fanout_observe - rest);
+    p += fanout_buffer + fanout_observe - rest;
+    /* Same delta as the empty option, with the minimal value length */
+    n = (observe & 0xFF000000) ? 4 : (observe & 0xFFFF0000) ? 3
+      : (observe & 0xFFFFFF00) ? 2 : (observe & 0xFF) ? 1 : 0;
+    *p++ = (fanout_buffer[fanout_observe] & 0xF0) | n;
+    while(n-- > 0) {
+      *p++ = (uint8_t)(observe >> (8 * n));
+    }
+    rest = fanout_buffer + fanout_observe + 1;
+  }
+  memcpy(p, rest, fanout_buffer + fanout_len - rest);
+  p += fanout_buffer + fanout_len - rest;
+
+  return p - buffer;
+}
+#endif /* COAP_OBSERVE_FANOUT */
+/*---------------------------------------------------------------------------*/
 void
 coap_notify_observers(resource_t *resource)
 {
@@ -192,8 +431,12 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
   coap_packet_t notification[1]; /* this way the packet can be treated as pointer as usual */
   coap_packet_t request[1]; /* this way the packet can be treated as pointer as usual */
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
   int url_len, obs_url_len;
   char url[COAP_OBSERVER_URL_LEN];
+#if COAP_OBSERVE_FANOUT
+  int prepared = 0;
+#endif /* COAP_OBSERVE_FANOUT */
 
   url_len = strlen(resource->url);
   strncpy(url, resource->url, COAP_OBSERVER_URL_LEN - 1);
@@ -212,8 +455,11 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
 
   /* iterate over observers */
   url_len = strlen(url);
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
+  for(obs = (resource->flags & HAS_SUB_RESOURCES) ? FIRST_BY_ROOT(url, url_len)
+        : FIRST_BY_URL(url, url_len);
+      obs; obs = next) {
+    next = (resource->flags & HAS_SUB_RESOURCES) ? NEXT_BY_ROOT(obs)
+      : NEXT_BY_URL(obs);
     obs_url_len = strlen(obs->url);
 
     /* Do a match based on the parent/sub-resource match so that it is
@@ -228,11 +474,6 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
       /*TODO implement special transaction for CON, sharing the same buffer to allow for more observers */
 
       if((transaction = coap_new_transaction(coap_get_mid(), &obs->addr, obs->port))) {
-        if(obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0) {
-          PRINTF("           Force Confirmable for\n");
-          notification->type = COAP_TYPE_CON;
-        }
-
         PRINTF("           Observer ");
         PRINT6ADDR(&obs->addr);
         PRINTF(":%u\n", obs->port);
@@ -240,6 +481,26 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
         /* update last MID for RST matching */
         obs->last_mid = transaction->mid;
 
+#if COAP_OBSERVE_FANOUT
+        if(!prepared) {
+          fanout_prepare(resource, request, notification);
+          prepared = 1;
+        }
+        transaction->packet_len =
+          fanout_copy(transaction->packet,
+                      obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0
+                      ? COAP_TYPE_CON : COAP_TYPE_NON,
+                      transaction->mid, obs->token, obs->token_len,
+                      obs->obs_counter);
+        if(fanout_observe) {
+          obs->obs_counter++;
+        }
+#else /* COAP_OBSERVE_FANOUT */
+        if(obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0) {
+          PRINTF("           Force Confirmable for\n");
+          notification->type = COAP_TYPE_CON;
+        }
+
         /* prepare response */
         notification->mid = transaction->mid;
 
@@ -254,6 +515,7 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
 
         transaction->packet_len =
           coap_serialize_message(notification, transaction->packet);
+#endif /* COAP_OBSERVE_FANOUT */
 
         coap_send_transaction(transaction);
       }
@@ -267,13 +529,17 @@ coap_observe_handler(resource_t *resource, void *request, void *response)
   coap_packet_t *const coap_req = (coap_packet_t *)request;
   coap_packet_t *const coap_res = (coap_packet_t *)response;
   coap_observer_t * obs;
+  uint32_t observe;
+  const char *uri = NULL;
+  int uri_len;
 
   if(coap_req->code == COAP_GET && coap_res->code < 128) { /* GET request and response without error code */
-    if(IS_OPTION(coap_req, COAP_OPTION_OBSERVE)) {
-      if(coap_req->observe == 0) {
+    if(coap_get_header_observe(coap_req, &observe)) {
+      if(observe == 0) {
+        uri_len = coap_get_header_uri_path(coap_req, &uri);
         obs = add_observer(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport,
                            coap_req->token, coap_req->token_len,
-                           coap_req->uri_path, coap_req->uri_path_len);
+                           uri, uri_len);
        if(obs) {
           coap_set_header_observe(coap_res, (obs->obs_counter)++);
           /*
@@ -293,7 +559,7 @@ coap_observe_handler(resource_t *resource, void *request, void *response)
           coap_res->code = SERVICE_UNAVAILABLE_5_03;
           coap_set_payload(coap_res, "TooManyObservers", 16);
         }
-      } else if(coap_req->observe == 1) {
+      } else if(observe == 1) {
 
         /* remove client if it is currently observe */
         coap_remove_observer_by_token(&UIP_IP_BUF->srcipaddr,
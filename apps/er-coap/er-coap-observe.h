@@ -55,6 +55,12 @@ typedef struct coap_observable {
 
 typedef struct coap_observer {
   struct coap_observer *next;   /* for LIST */
+#if COAP_OBSERVER_HASH_SIZE
+  struct coap_observer *client_next;    /* same address and port */
+  struct coap_observer *token_next;     /* same address, port and token */
+  struct coap_observer *url_next;       /* same URL */
+  struct coap_observer *root_next;      /* same first URL segment */
+#endif /* COAP_OBSERVER_HASH_SIZE */
 
   char url[COAP_OBSERVER_URL_LEN];
   uip_ipaddr_t addr;
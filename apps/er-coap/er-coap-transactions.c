@@ -40,6 +40,7 @@
 #include "contiki-net.h"
 #include "er-coap-transactions.h"
 #include "er-coap-observe.h"
+#include "er-coap-congestion.h"
 
 #define DEBUG 0
 #if DEBUG
@@ -55,7 +56,19 @@
 
 /*---------------------------------------------------------------------------*/
 MEMB(transactions_memb, coap_transaction_t, COAP_MAX_OPEN_TRANSACTIONS);
+#if COAP_TRANSACTION_HASH_SIZE
+#if COAP_TRANSACTION_HASH_SIZE & (COAP_TRANSACTION_HASH_SIZE - 1)
+#error "COAP_TRANSACTION_HASH_SIZE must be a power of two"
+#endif
+/* Open transactions chained by MID; MIDs are handed out sequentially, so
+   the low bits spread them evenly. Transactions are not kept on a list,
+   whose insertion and removal are linear; the retransmission check walks
+   the pool instead. */
+static coap_transaction_t *mid_hash[COAP_TRANSACTION_HASH_SIZE];
+#define MID_BUCKET(mid) (&mid_hash[(mid) & (COAP_TRANSACTION_HASH_SIZE - 1)])
+#else /* COAP_TRANSACTION_HASH_SIZE */
 LIST(transactions_list);
+#endif /* COAP_TRANSACTION_HASH_SIZE */
 
 static struct process *transaction_handler_process = NULL;
 
@@ -75,12 +88,27 @@ coap_new_transaction(uint16_t mid, uip_ipaddr_t *addr, uint16_t port)
   if(t) {
     t->mid = mid;
     t->retrans_counter = 0;
+#if COAP_CONGESTION_CONTROL
+    t->started = 0;
+    t->waiting = 0;
+#endif /* COAP_CONGESTION_CONTROL */
 
     /* save client address */
     uip_ipaddr_copy(&t->addr, addr);
     t->port = port;
 
+#if COAP_TRANSACTION_HASH_SIZE
+    {
+      coap_transaction_t **tp;
+
+      /* Append, so that the oldest transaction for a MID is found first */
+      for(tp = MID_BUCKET(mid); *tp != NULL; tp = &(*tp)->mid_next);
+      t->mid_next = NULL;
+      *tp = t;
+    }
+#else /* COAP_TRANSACTION_HASH_SIZE */
     list_add(transactions_list, t); /* list itself makes sure same element is not added twice */
+#endif /* COAP_TRANSACTION_HASH_SIZE */
   }
 
   return t;
@@ -91,6 +119,21 @@ coap_send_transaction(coap_transaction_t *t)
 {
   PRINTF("Sending transaction %u\n", t->mid);
 
+#if COAP_CONGESTION_CONTROL
+  if(!t->started && COAP_TYPE_CON ==
+     ((COAP_HEADER_TYPE_MASK & t->packet[0]) >> COAP_HEADER_TYPE_POSITION)) {
+    if(!coap_congestion_start(&t->addr)) {
+      /* sent by coap_send_waiting_transactions() once an exchange completes */
+      PRINTF("Holding back transaction %u\n", t->mid);
+      t->waiting = 1;
+      return;
+    }
+    t->started = 1;
+    t->waiting = 0;
+    t->start = clock_time();
+  }
+#endif /* COAP_CONGESTION_CONTROL */
+
   coap_send_message(&t->addr, t->port, t->packet, t->packet_len);
 
   if(COAP_TYPE_CON ==
@@ -100,15 +143,28 @@ coap_send_transaction(coap_transaction_t *t)
       PRINTF("Keeping transaction %u\n", t->mid);
 
       if(t->retrans_counter == 0) {
+#if COAP_CONGESTION_CONTROL
+        clock_time_t rto = coap_congestion_rto(&t->addr);
+
+        /* dithered between RTO and 1.5 RTO */
+        t->retrans_timer.timer.interval =
+          rto + random_rand() % (rto / 2 + 1);
+#else /* COAP_CONGESTION_CONTROL */
         t->retrans_timer.timer.interval =
           COAP_RESPONSE_TIMEOUT_TICKS + (random_rand()
                                          %
                                          (clock_time_t)
                                          COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
+#endif /* COAP_CONGESTION_CONTROL */
         PRINTF("Initial interval %f\n",
                (float)t->retrans_timer.timer.interval / CLOCK_SECOND);
       } else {
+#if COAP_CONGESTION_CONTROL
+        t->retrans_timer.timer.interval =
+          coap_congestion_backoff(&t->addr, t->retrans_timer.timer.interval);
+#else /* COAP_CONGESTION_CONTROL */
         t->retrans_timer.timer.interval <<= 1;  /* double */
+#endif /* COAP_CONGESTION_CONTROL */
         PRINTF("Doubled (%u) interval %f\n", t->retrans_counter,
                (float)t->retrans_timer.timer.interval / CLOCK_SECOND);
       }
@@ -138,14 +194,62 @@ coap_send_transaction(coap_transaction_t *t)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if COAP_CONGESTION_CONTROL
+void
+coap_send_waiting_transactions(void)
+{
+  coap_transaction_t *t = NULL;
+
+#if COAP_TRANSACTION_HASH_SIZE
+  int i;
+
+  for(i = 0; i < transactions_memb.num; i++) {
+    if(transactions_memb.count[i] == 0) {
+      continue;
+    }
+    t = &((coap_transaction_t *)transactions_memb.mem)[i];
+#else /* COAP_TRANSACTION_HASH_SIZE */
+  for(t = (coap_transaction_t *)list_head(transactions_list); t; t = t->next) {
+#endif /* COAP_TRANSACTION_HASH_SIZE */
+    if(t->waiting) {
+      /* held back again if its destination is still busy */
+      coap_send_transaction(t);
+    }
+  }
+}
+#endif /* COAP_CONGESTION_CONTROL */
+/*---------------------------------------------------------------------------*/
 void
 coap_clear_transaction(coap_transaction_t *t)
 {
   if(t) {
+#if COAP_CONGESTION_CONTROL
+    if(t->started) {
+      /* The exchange is over, which lets the next one to the peer go.
+         It is sent from the transaction handler, as the caller may
+         still need the received message in uip_buf. */
+      coap_congestion_done(&t->addr);
+      process_poll(transaction_handler_process);
+    }
+#endif /* COAP_CONGESTION_CONTROL */
+
     PRINTF("Freeing transaction %u: %p\n", t->mid, t);
 
     etimer_stop(&t->retrans_timer);
+#if COAP_TRANSACTION_HASH_SIZE
+    {
+      coap_transaction_t **tp;
+
+      for(tp = MID_BUCKET(t->mid); *tp != NULL; tp = &(*tp)->mid_next) {
+        if(*tp == t) {
+          *tp = t->mid_next;
+          break;
+        }
+      }
+    }
+#else /* COAP_TRANSACTION_HASH_SIZE */
     list_remove(transactions_list, t);
+#endif /* COAP_TRANSACTION_HASH_SIZE */
     memb_free(&transactions_memb, t);
   }
 }
@@ -154,7 +258,11 @@ coap_get_transaction_by_mid(uint16_t mid)
 {
   coap_transaction_t *t = NULL;
 
+#if COAP_TRANSACTION_HASH_SIZE
+  for(t = *MID_BUCKET(mid); t; t = t->mid_next) {
+#else /* COAP_TRANSACTION_HASH_SIZE */
   for(t = (coap_transaction_t *)list_head(transactions_list); t; t = t->next) {
+#endif /* COAP_TRANSACTION_HASH_SIZE */
     if(t->mid == mid) {
       PRINTF("Found transaction for MID %u: %p\n", t->mid, t);
       return t;
@@ -168,7 +276,22 @@ coap_check_transactions()
 {
   coap_transaction_t *t = NULL;
 
+#if COAP_TRANSACTION_HASH_SIZE
+  int i;
+
+  for(i = 0; i < transactions_memb.num; i++) {
+    if(transactions_memb.count[i] == 0) {
+      continue;
+    }
+    t = &((coap_transaction_t *)transactions_memb.mem)[i];
+#else /* COAP_TRANSACTION_HASH_SIZE */
   for(t = (coap_transaction_t *)list_head(transactions_list); t; t = t->next) {
+#endif /* COAP_TRANSACTION_HASH_SIZE */
+#if COAP_CONGESTION_CONTROL
+    if(t->waiting) {
+      continue;
+    }
+#endif /* COAP_CONGESTION_CONTROL */
     if(etimer_expired(&t->retrans_timer)) {
       ++(t->retrans_counter);
       PRINTF("Retransmitting %u (%u)\n", t->mid, t->retrans_counter);
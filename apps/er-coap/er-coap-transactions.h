@@ -51,10 +51,18 @@
 /* container for transactions with message buffer and retransmission info */
 typedef struct coap_transaction {
   struct coap_transaction *next;        /* for LIST */
+#if COAP_TRANSACTION_HASH_SIZE
+  struct coap_transaction *mid_next;    /* next in the same MID hash bucket */
+#endif /* COAP_TRANSACTION_HASH_SIZE */
 
   uint16_t mid;
   struct etimer retrans_timer;
   uint8_t retrans_counter;
+#if COAP_CONGESTION_CONTROL
+  uint8_t started;              /* counted against NSTART */
+  uint8_t waiting;              /* held back by NSTART */
+  clock_time_t start;           /* first transmission, for RTT samples */
+#endif /* COAP_CONGESTION_CONTROL */
 
   uip_ipaddr_t addr;
   uint16_t port;
@@ -76,5 +84,8 @@ void coap_clear_transaction(coap_transaction_t *t);
 coap_transaction_t *coap_get_transaction_by_mid(uint16_t mid);
 
 void coap_check_transactions(void);
+#if COAP_CONGESTION_CONTROL
+void coap_send_waiting_transactions(void);
+#endif /* COAP_CONGESTION_CONTROL */
 
 #endif /* COAP_TRANSACTIONS_H_ */
@@ -181,30 +181,29 @@ coap_serialize_array_option(unsigned int number, unsigned int current_number,
 	 (int)length, array);
 
   if(split_char != '\0') {
-    int j;
     uint8_t *part_start = array;
-    uint8_t *part_end = NULL;
+    uint8_t *end = array + length;
+    uint8_t *part_end;
     size_t temp_length;
 
-    for(j = 0; j <= length + 1; ++j) {
-      PRINTF("STEP %u/%zu (%c)\n", j, length, array[j]);
-      if(array[j] == split_char || j == length) {
-        part_end = array + j;
-        temp_length = part_end - part_start;
+    do {
+      part_end = memchr(part_start, split_char, end - part_start);
+      if(part_end == NULL) {
+        part_end = end;
+      }
+      temp_length = part_end - part_start;
 
-        i += coap_set_option_header(number - current_number, temp_length,
-                                    &buffer[i]);
-        memcpy(&buffer[i], part_start, temp_length);
-        i += temp_length;
+      i += coap_set_option_header(number - current_number, temp_length,
+                                  &buffer[i]);
+      memcpy(&buffer[i], part_start, temp_length);
+      i += temp_length;
 
-        PRINTF("OPTION type %u, delta %u, len %zu, part [%.*s]\n", number,
-               number - current_number, i, (int)temp_length, part_start);
+      PRINTF("OPTION type %u, delta %u, len %zu, part [%.*s]\n", number,
+             number - current_number, i, (int)temp_length, part_start);
 
-        ++j;                    /* skip the splitter */
-        current_number = number;
-        part_start = array + j;
-      }
-    }                           /* for */
+      current_number = number;
+      part_start = part_end + 1; /* skip the splitter */
+    } while(part_end < end);
   } else {
     i += coap_set_option_header(number - current_number, length, &buffer[i]);
     memcpy(&buffer[i], array, length);
@@ -218,7 +217,7 @@ coap_serialize_array_option(unsigned int number, unsigned int current_number,
 }
 /*---------------------------------------------------------------------------*/
 static void
-coap_merge_multi_option(char **dst, size_t *dst_len, uint8_t *option,
+coap_merge_multi_option(char **dst, uint16_t *dst_len, uint8_t *option,
                         size_t option_len, char separator)
 {
   /* merge multiple options */
@@ -439,13 +438,257 @@ coap_send_message(uip_ipaddr_t *addr, uint16_t port, uint8_t *data,
   udp_conn->rport = 0;
 }
 /*---------------------------------------------------------------------------*/
+static inline uint8_t *
+coap_parse_option_header(uint8_t *option, unsigned int *delta, size_t *length)
+{
+  *delta = option[0] >> 4;
+  *length = option[0] & 0x0F;
+  ++option;
+
+  if(*delta == 13) {
+    *delta += option[0];
+    ++option;
+  } else if(*delta == 14) {
+    *delta += 255;
+    *delta += option[0] << 8;
+    ++option;
+    *delta += option[0];
+    ++option;
+  }
+
+  if(*length == 13) {
+    *length += option[0];
+    ++option;
+  } else if(*length == 14) {
+    *length += 255;
+    *length += option[0] << 8;
+    ++option;
+    *length += option[0];
+    ++option;
+  }
+  return option;
+}
+/*---------------------------------------------------------------------------*/
+static coap_status_t
+coap_parse_option(coap_packet_t *coap_pkt, unsigned int number,
+                  uint8_t *value, size_t length)
+{
+  switch(number) {
+  case COAP_OPTION_CONTENT_FORMAT:
+    coap_pkt->content_format = coap_parse_int_option(value, length);
+    PRINTF("Content-Format [%u]\n", coap_pkt->content_format);
+    break;
+  case COAP_OPTION_MAX_AGE:
+    coap_pkt->max_age = coap_parse_int_option(value, length);
+    PRINTF("Max-Age [%lu]\n", (unsigned long)coap_pkt->max_age);
+    break;
+  case COAP_OPTION_ETAG:
+    coap_pkt->etag_len = MIN(COAP_ETAG_LEN, length);
+    memcpy(coap_pkt->etag, value, coap_pkt->etag_len);
+    PRINTF("ETag %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n",
+           coap_pkt->etag_len, coap_pkt->etag[0], coap_pkt->etag[1],
+           coap_pkt->etag[2], coap_pkt->etag[3], coap_pkt->etag[4],
+           coap_pkt->etag[5], coap_pkt->etag[6], coap_pkt->etag[7]
+           );                 /*FIXME always prints 8 bytes */
+    break;
+  case COAP_OPTION_ACCEPT:
+    coap_pkt->accept = coap_parse_int_option(value, length);
+    PRINTF("Accept [%u]\n", coap_pkt->accept);
+    break;
+  case COAP_OPTION_IF_MATCH:
+    /* TODO support multiple ETags */
+    coap_pkt->if_match_len = MIN(COAP_ETAG_LEN, length);
+    memcpy(coap_pkt->if_match, value, coap_pkt->if_match_len);
+    PRINTF("If-Match %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n",
+           coap_pkt->if_match_len, coap_pkt->if_match[0],
+           coap_pkt->if_match[1], coap_pkt->if_match[2],
+           coap_pkt->if_match[3], coap_pkt->if_match[4],
+           coap_pkt->if_match[5], coap_pkt->if_match[6],
+           coap_pkt->if_match[7]
+           ); /* FIXME always prints 8 bytes */
+    break;
+  case COAP_OPTION_IF_NONE_MATCH:
+    coap_pkt->if_none_match = 1;
+    PRINTF("If-None-Match\n");
+    break;
+
+  case COAP_OPTION_PROXY_URI:
+#if COAP_PROXY_OPTION_PROCESSING
+    coap_pkt->proxy_uri = (char *)value;
+    coap_pkt->proxy_uri_len = length;
+#endif
+    PRINTF("Proxy-Uri NOT IMPLEMENTED [%.*s]\n", (int)coap_pkt->proxy_uri_len,
+           coap_pkt->proxy_uri);
+    coap_error_message = "This is a constrained server (Contiki)";
+    return PROXYING_NOT_SUPPORTED_5_05;
+    break;
+  case COAP_OPTION_PROXY_SCHEME:
+#if COAP_PROXY_OPTION_PROCESSING
+    coap_pkt->proxy_scheme = (char *)value;
+    coap_pkt->proxy_scheme_len = length;
+#endif
+    PRINTF("Proxy-Scheme NOT IMPLEMENTED [%.*s]\n",
+           (int)coap_pkt->proxy_scheme_len, coap_pkt->proxy_scheme);
+    coap_error_message = "This is a constrained server (Contiki)";
+    return PROXYING_NOT_SUPPORTED_5_05;
+    break;
+
+  case COAP_OPTION_URI_HOST:
+    coap_pkt->uri_host = (char *)value;
+    coap_pkt->uri_host_len = length;
+    PRINTF("Uri-Host [%.*s]\n", (int)coap_pkt->uri_host_len,
+	     coap_pkt->uri_host);
+    break;
+  case COAP_OPTION_URI_PORT:
+    coap_pkt->uri_port = coap_parse_int_option(value, length);
+    PRINTF("Uri-Port [%u]\n", coap_pkt->uri_port);
+    break;
+  case COAP_OPTION_URI_PATH:
+    /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
+    coap_merge_multi_option((char **)&(coap_pkt->uri_path),
+                            &(coap_pkt->uri_path_len), value,
+                            length, '/');
+    PRINTF("Uri-Path [%.*s]\n", (int)coap_pkt->uri_path_len, coap_pkt->uri_path);
+    break;
+  case COAP_OPTION_URI_QUERY:
+    /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
+    coap_merge_multi_option((char **)&(coap_pkt->uri_query),
+                            &(coap_pkt->uri_query_len), value,
+                            length, '&');
+    PRINTF("Uri-Query [%.*s]\n", (int)coap_pkt->uri_query_len,
+           coap_pkt->uri_query);
+    break;
+
+  case COAP_OPTION_LOCATION_PATH:
+    /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
+    coap_merge_multi_option((char **)&(coap_pkt->location_path),
+                            &(coap_pkt->location_path_len), value,
+                            length, '/');
+    PRINTF("Location-Path [%.*s]\n", (int)coap_pkt->location_path_len,
+           coap_pkt->location_path);
+    break;
+  case COAP_OPTION_LOCATION_QUERY:
+    /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
+    coap_merge_multi_option((char **)&(coap_pkt->location_query),
+                            &(coap_pkt->location_query_len), value,
+                            length, '&');
+    PRINTF("Location-Query [%.*s]\n", (int)coap_pkt->location_query_len,
+           coap_pkt->location_query);
+    break;
+
+  case COAP_OPTION_OBSERVE:
+    coap_pkt->observe = coap_parse_int_option(value, length);
+    PRINTF("Observe [%lu]\n", (unsigned long)coap_pkt->observe);
+    break;
+  case COAP_OPTION_BLOCK2:
+    coap_pkt->block2_num = coap_parse_int_option(value, length);
+    coap_pkt->block2_more = (coap_pkt->block2_num & 0x08) >> 3;
+    coap_pkt->block2_size = 16 << (coap_pkt->block2_num & 0x07);
+    coap_pkt->block2_num >>= 4;
+    PRINTF("Block2 [%lu%s (%u B/blk)]\n",
+           (unsigned long)coap_pkt->block2_num,
+           coap_pkt->block2_more ? "+" : "", coap_pkt->block2_size);
+    break;
+  case COAP_OPTION_BLOCK1:
+    coap_pkt->block1_num = coap_parse_int_option(value, length);
+    coap_pkt->block1_more = (coap_pkt->block1_num & 0x08) >> 3;
+    coap_pkt->block1_size = 16 << (coap_pkt->block1_num & 0x07);
+    coap_pkt->block1_num >>= 4;
+    PRINTF("Block1 [%lu%s (%u B/blk)]\n",
+           (unsigned long)coap_pkt->block1_num,
+           coap_pkt->block1_more ? "+" : "", coap_pkt->block1_size);
+    break;
+  case COAP_OPTION_SIZE2:
+    coap_pkt->size2 = coap_parse_int_option(value, length);
+    PRINTF("Size2 [%lu]\n", (unsigned long)coap_pkt->size2);
+    break;
+  case COAP_OPTION_SIZE1:
+    coap_pkt->size1 = coap_parse_int_option(value, length);
+    PRINTF("Size1 [%lu]\n", (unsigned long)coap_pkt->size1);
+    break;
+  default:
+    PRINTF("unknown (%u)\n", number);
+    /* check if critical (odd) */
+    if(number & 1) {
+      coap_error_message = "Unsupported critical option";
+      return BAD_OPTION_4_02;
+    }
+  }
+
+  return NO_ERROR;
+}
+/*---------------------------------------------------------------------------*/
+#if COAP_LAZY_PARSING
+/* Index into undecoded[] of the options that are decoded on first access,
+   0 for those that are always handled while parsing */
+static const uint8_t option_slot[COAP_OPTION_SIZE1 + 1] = {
+  [COAP_OPTION_IF_MATCH] = 1,
+  [COAP_OPTION_URI_HOST] = 2,
+  [COAP_OPTION_ETAG] = 3,
+  [COAP_OPTION_OBSERVE] = 4,
+  [COAP_OPTION_URI_PORT] = 5,
+  [COAP_OPTION_LOCATION_PATH] = 6,
+  [COAP_OPTION_URI_PATH] = 7,
+  [COAP_OPTION_CONTENT_FORMAT] = 8,
+  [COAP_OPTION_MAX_AGE] = 9,
+  [COAP_OPTION_URI_QUERY] = 10,
+  [COAP_OPTION_ACCEPT] = 11,
+  [COAP_OPTION_LOCATION_QUERY] = 12,
+  [COAP_OPTION_BLOCK2] = 13,
+  [COAP_OPTION_BLOCK1] = 14,
+  [COAP_OPTION_SIZE2] = 15,
+  [COAP_OPTION_SIZE1] = 16,
+};
+/*---------------------------------------------------------------------------*/
+/* Decode a received option, and any repetitions of it, on first access */
+static void
+coap_decode_option(coap_packet_t *coap_pkt, unsigned int number)
+{
+  uint8_t *current_option;
+  unsigned int option_delta;
+  size_t option_length;
+
+  current_option = coap_pkt->buffer + COAP_HEADER_LEN + coap_pkt->token_len
+    + coap_pkt->undecoded[option_slot[number]] - 1;
+  coap_pkt->undecoded[option_slot[number]] = 0;
+
+  /* The option list always ends with a payload marker, see the parser */
+  do {
+    current_option = coap_parse_option_header(current_option, &option_delta,
+                                              &option_length);
+    coap_parse_option(coap_pkt, number, current_option, option_length);
+    current_option += option_length;
+  } while((current_option[0] & 0xF0) == 0x00);
+}
+#define DECODE_OPTION(packet, opt) \
+  if((packet)->undecoded[option_slot[opt]]) { \
+    coap_decode_option(packet, opt); \
+  }
+#else /* COAP_LAZY_PARSING */
+#define DECODE_OPTION(packet, opt)
+#endif /* COAP_LAZY_PARSING */
+/*---------------------------------------------------------------------------*/
 coap_status_t
 coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
 {
   coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+  coap_status_t status;
 
   /* initialize packet */
+#if COAP_LAZY_PARSING
+  /* Option fields are only read once their option is set and decoded, so
+     only reset what decoding and the payload getters rely on */
+  memset(coap_pkt->options, 0, sizeof(coap_pkt->options));
+  memset(coap_pkt->undecoded, 0, sizeof(coap_pkt->undecoded));
+  coap_pkt->uri_path_len = 0;
+  coap_pkt->uri_query_len = 0;
+  coap_pkt->location_path_len = 0;
+  coap_pkt->location_query_len = 0;
+  coap_pkt->payload = NULL;
+  coap_pkt->payload_len = 0;
+#else /* COAP_LAZY_PARSING */
   memset(coap_pkt, 0, sizeof(coap_packet_t));
+#endif /* COAP_LAZY_PARSING */
 
   /* pointer to packet bytes */
   coap_pkt->buffer = data;
@@ -480,12 +723,16 @@ coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
          );                     /*FIXME always prints 8 bytes */
 
   /* parse options */
-  memset(coap_pkt->options, 0, sizeof(coap_pkt->options));
   current_option += coap_pkt->token_len;
 
   unsigned int option_number = 0;
   unsigned int option_delta = 0;
   size_t option_length = 0;
+#if COAP_LAZY_PARSING
+  uint8_t *first_option = current_option;
+  uint8_t *option_header;
+  int slot;
+#endif /* COAP_LAZY_PARSING */
 
   while(current_option < data + data_len) {
     /* payload marker 0xFF, currently only checking for 0xF* because rest is reserved */
@@ -503,193 +750,50 @@ coap_parse_message(void *packet, uint8_t *data, uint16_t data_len)
       break;
     }
 
-    option_delta = current_option[0] >> 4;
-    option_length = current_option[0] & 0x0F;
-    ++current_option;
-
-    if(option_delta == 13) {
-      option_delta += current_option[0];
-      ++current_option;
-    } else if(option_delta == 14) {
-      option_delta += 255;
-      option_delta += current_option[0] << 8;
-      ++current_option;
-      option_delta += current_option[0];
-      ++current_option;
-    }
-
-    if(option_length == 13) {
-      option_length += current_option[0];
-      ++current_option;
-    } else if(option_length == 14) {
-      option_length += 255;
-      option_length += current_option[0] << 8;
-      ++current_option;
-      option_length += current_option[0];
-      ++current_option;
-    }
-
+#if COAP_LAZY_PARSING
+    option_header = current_option;
+#endif /* COAP_LAZY_PARSING */
+    current_option = coap_parse_option_header(current_option, &option_delta,
+                                              &option_length);
     option_number += option_delta;
 
     PRINTF("OPTION %u (delta %u, len %zu): ", option_number, option_delta,
            option_length);
 
-    SET_OPTION(coap_pkt, option_number);
-
-    switch(option_number) {
-    case COAP_OPTION_CONTENT_FORMAT:
-      coap_pkt->content_format = coap_parse_int_option(current_option,
-                                                       option_length);
-      PRINTF("Content-Format [%u]\n", coap_pkt->content_format);
-      break;
-    case COAP_OPTION_MAX_AGE:
-      coap_pkt->max_age = coap_parse_int_option(current_option,
-                                                option_length);
-      PRINTF("Max-Age [%lu]\n", (unsigned long)coap_pkt->max_age);
-      break;
-    case COAP_OPTION_ETAG:
-      coap_pkt->etag_len = MIN(COAP_ETAG_LEN, option_length);
-      memcpy(coap_pkt->etag, current_option, coap_pkt->etag_len);
-      PRINTF("ETag %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n",
-             coap_pkt->etag_len, coap_pkt->etag[0], coap_pkt->etag[1],
-             coap_pkt->etag[2], coap_pkt->etag[3], coap_pkt->etag[4],
-             coap_pkt->etag[5], coap_pkt->etag[6], coap_pkt->etag[7]
-             );                 /*FIXME always prints 8 bytes */
-      break;
-    case COAP_OPTION_ACCEPT:
-      coap_pkt->accept = coap_parse_int_option(current_option, option_length);
-      PRINTF("Accept [%u]\n", coap_pkt->accept);
-      break;
-    case COAP_OPTION_IF_MATCH:
-      /* TODO support multiple ETags */
-      coap_pkt->if_match_len = MIN(COAP_ETAG_LEN, option_length);
-      memcpy(coap_pkt->if_match, current_option, coap_pkt->if_match_len);
-      PRINTF("If-Match %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n",
-             coap_pkt->if_match_len, coap_pkt->if_match[0],
-             coap_pkt->if_match[1], coap_pkt->if_match[2],
-             coap_pkt->if_match[3], coap_pkt->if_match[4],
-             coap_pkt->if_match[5], coap_pkt->if_match[6],
-             coap_pkt->if_match[7]
-             ); /* FIXME always prints 8 bytes */
-      break;
-    case COAP_OPTION_IF_NONE_MATCH:
-      coap_pkt->if_none_match = 1;
-      PRINTF("If-None-Match\n");
-      break;
-
-    case COAP_OPTION_PROXY_URI:
-#if COAP_PROXY_OPTION_PROCESSING
-      coap_pkt->proxy_uri = (char *)current_option;
-      coap_pkt->proxy_uri_len = option_length;
-#endif
-      PRINTF("Proxy-Uri NOT IMPLEMENTED [%.*s]\n", (int)coap_pkt->proxy_uri_len,
-             coap_pkt->proxy_uri);
-      coap_error_message = "This is a constrained server (Contiki)";
-      return PROXYING_NOT_SUPPORTED_5_05;
-      break;
-    case COAP_OPTION_PROXY_SCHEME:
-#if COAP_PROXY_OPTION_PROCESSING
-      coap_pkt->proxy_scheme = (char *)current_option;
-      coap_pkt->proxy_scheme_len = option_length;
-#endif
-      PRINTF("Proxy-Scheme NOT IMPLEMENTED [%.*s]\n",
-             (int)coap_pkt->proxy_scheme_len, coap_pkt->proxy_scheme);
-      coap_error_message = "This is a constrained server (Contiki)";
-      return PROXYING_NOT_SUPPORTED_5_05;
-      break;
-
-    case COAP_OPTION_URI_HOST:
-      coap_pkt->uri_host = (char *)current_option;
-      coap_pkt->uri_host_len = option_length;
-      PRINTF("Uri-Host [%.*s]\n", (int)coap_pkt->uri_host_len,
-	     coap_pkt->uri_host);
-      break;
-    case COAP_OPTION_URI_PORT:
-      coap_pkt->uri_port = coap_parse_int_option(current_option,
-                                                 option_length);
-      PRINTF("Uri-Port [%u]\n", coap_pkt->uri_port);
-      break;
-    case COAP_OPTION_URI_PATH:
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->uri_path),
-                              &(coap_pkt->uri_path_len), current_option,
-                              option_length, '/');
-      PRINTF("Uri-Path [%.*s]\n", (int)coap_pkt->uri_path_len, coap_pkt->uri_path);
-      break;
-    case COAP_OPTION_URI_QUERY:
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->uri_query),
-                              &(coap_pkt->uri_query_len), current_option,
-                              option_length, '&');
-      PRINTF("Uri-Query [%.*s]\n", (int)coap_pkt->uri_query_len,
-             coap_pkt->uri_query);
-      break;
-
-    case COAP_OPTION_LOCATION_PATH:
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->location_path),
-                              &(coap_pkt->location_path_len), current_option,
-                              option_length, '/');
-      PRINTF("Location-Path [%.*s]\n", (int)coap_pkt->location_path_len,
-             coap_pkt->location_path);
-      break;
-    case COAP_OPTION_LOCATION_QUERY:
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->location_query),
-                              &(coap_pkt->location_query_len), current_option,
-                              option_length, '&');
-      PRINTF("Location-Query [%.*s]\n", (int)coap_pkt->location_query_len,
-             coap_pkt->location_query);
-      break;
-
-    case COAP_OPTION_OBSERVE:
-      coap_pkt->observe = coap_parse_int_option(current_option,
-                                                option_length);
-      PRINTF("Observe [%lu]\n", (unsigned long)coap_pkt->observe);
-      break;
-    case COAP_OPTION_BLOCK2:
-      coap_pkt->block2_num = coap_parse_int_option(current_option,
-                                                   option_length);
-      coap_pkt->block2_more = (coap_pkt->block2_num & 0x08) >> 3;
-      coap_pkt->block2_size = 16 << (coap_pkt->block2_num & 0x07);
-      coap_pkt->block2_offset = (coap_pkt->block2_num & ~0x0000000F)
-        << (coap_pkt->block2_num & 0x07);
-      coap_pkt->block2_num >>= 4;
-      PRINTF("Block2 [%lu%s (%u B/blk)]\n",
-             (unsigned long)coap_pkt->block2_num,
-             coap_pkt->block2_more ? "+" : "", coap_pkt->block2_size);
-      break;
-    case COAP_OPTION_BLOCK1:
-      coap_pkt->block1_num = coap_parse_int_option(current_option,
-                                                   option_length);
-      coap_pkt->block1_more = (coap_pkt->block1_num & 0x08) >> 3;
-      coap_pkt->block1_size = 16 << (coap_pkt->block1_num & 0x07);
-      coap_pkt->block1_offset = (coap_pkt->block1_num & ~0x0000000F)
-        << (coap_pkt->block1_num & 0x07);
-      coap_pkt->block1_num >>= 4;
-      PRINTF("Block1 [%lu%s (%u B/blk)]\n",
-             (unsigned long)coap_pkt->block1_num,
-             coap_pkt->block1_more ? "+" : "", coap_pkt->block1_size);
-      break;
-    case COAP_OPTION_SIZE2:
-      coap_pkt->size2 = coap_parse_int_option(current_option, option_length);
-      PRINTF("Size2 [%lu]\n", (unsigned long)coap_pkt->size2);
-      break;
-    case COAP_OPTION_SIZE1:
-      coap_pkt->size1 = coap_parse_int_option(current_option, option_length);
-      PRINTF("Size1 [%lu]\n", (unsigned long)coap_pkt->size1);
-      break;
-    default:
-      PRINTF("unknown (%u)\n", option_number);
-      /* check if critical (odd) */
-      if(option_number & 1) {
-        coap_error_message = "Unsupported critical option";
-        return BAD_OPTION_4_02;
+#if COAP_LAZY_PARSING
+    /* Only note where the first of each known option is, and decode it
+       with its repetitions when it is read */
+    slot = option_number <= COAP_OPTION_SIZE1 ? option_slot[option_number] : 0;
+    if(slot > 0 && !IS_OPTION(coap_pkt, option_number)
+       && option_header - first_option < 0xFF) {
+      coap_pkt->undecoded[slot] = option_header - first_option + 1;
+      PRINTF("deferred\n");
+    } else if(coap_pkt->undecoded[slot] == 0) {
+      status = coap_parse_option(coap_pkt, option_number, current_option,
+                                 option_length);
+      if(status != NO_ERROR) {
+        return status;
       }
     }
+#else /* COAP_LAZY_PARSING */
+    status = coap_parse_option(coap_pkt, option_number, current_option,
+                               option_length);
+    if(status != NO_ERROR) {
+      return status;
+    }
+#endif /* COAP_LAZY_PARSING */
+
+    SET_OPTION(coap_pkt, option_number);
 
     current_option += option_length;
   }                             /* for */
+#if COAP_LAZY_PARSING
+  if(coap_pkt->payload == NULL) {
+    /* Terminate the options like the payload is terminated above, so
+       that decoding repeated options stops at the end */
+    data[data_len] = 0xFF;
+  }
+#endif /* COAP_LAZY_PARSING */
   PRINTF("-Done parsing-------\n");
 
   return NO_ERROR;
@@ -703,6 +807,7 @@ coap_get_query_variable(void *packet, const char *name, const char **output)
   coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
 
   if(IS_OPTION(coap_pkt, COAP_OPTION_URI_QUERY)) {
+    DECODE_OPTION(coap_pkt, COAP_OPTION_URI_QUERY);
     return coap_get_variable(coap_pkt->uri_query, coap_pkt->uri_query_len,
                              name, output);
   }
@@ -752,6 +857,7 @@ coap_get_header_content_format(void *packet, unsigned int *format)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_CONTENT_FORMAT)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_CONTENT_FORMAT);
   *format = coap_pkt->content_format;
   return 1;
 }
@@ -773,6 +879,7 @@ coap_get_header_accept(void *packet, unsigned int *accept)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_ACCEPT)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_ACCEPT);
   *accept = coap_pkt->accept;
   return 1;
 }
@@ -794,6 +901,7 @@ coap_get_header_max_age(void *packet, uint32_t *age)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_MAX_AGE)) {
     *age = COAP_DEFAULT_MAX_AGE;
   } else {
+    DECODE_OPTION(coap_pkt, COAP_OPTION_MAX_AGE);
     *age = coap_pkt->max_age;
   } return 1;
 }
@@ -815,6 +923,7 @@ coap_get_header_etag(void *packet, const uint8_t **etag)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_ETAG)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_ETAG);
   *etag = coap_pkt->etag;
   return coap_pkt->etag_len;
 }
@@ -839,6 +948,7 @@ coap_get_header_if_match(void *packet, const uint8_t **etag)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_IF_MATCH)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_IF_MATCH);
   *etag = coap_pkt->if_match;
   return coap_pkt->if_match_len;
 }
@@ -875,6 +985,7 @@ coap_get_header_proxy_uri(void *packet, const char **uri)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_PROXY_URI)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_PROXY_URI);
   *uri = coap_pkt->proxy_uri;
   return coap_pkt->proxy_uri_len;
 }
@@ -900,6 +1011,7 @@ coap_get_header_uri_host(void *packet, const char **host)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_URI_HOST)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_URI_HOST);
   *host = coap_pkt->uri_host;
   return coap_pkt->uri_host_len;
 }
@@ -923,6 +1035,7 @@ coap_get_header_uri_path(void *packet, const char **path)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_URI_PATH)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_URI_PATH);
   *path = coap_pkt->uri_path;
   return coap_pkt->uri_path_len;
 }
@@ -949,6 +1062,7 @@ coap_get_header_uri_query(void *packet, const char **query)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_URI_QUERY)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_URI_QUERY);
   *query = coap_pkt->uri_query;
   return coap_pkt->uri_query_len;
 }
@@ -975,6 +1089,7 @@ coap_get_header_location_path(void *packet, const char **path)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_LOCATION_PATH)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_LOCATION_PATH);
   *path = coap_pkt->location_path;
   return coap_pkt->location_path_len;
 }
@@ -1009,6 +1124,7 @@ coap_get_header_location_query(void *packet, const char **query)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_LOCATION_QUERY)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_LOCATION_QUERY);
   *query = coap_pkt->location_query;
   return coap_pkt->location_query_len;
 }
@@ -1035,6 +1151,7 @@ coap_get_header_observe(void *packet, uint32_t *observe)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_OBSERVE);
   *observe = coap_pkt->observe;
   return 1;
 }
@@ -1057,6 +1174,7 @@ coap_get_header_block2(void *packet, uint32_t *num, uint8_t *more,
   if(!IS_OPTION(coap_pkt, COAP_OPTION_BLOCK2)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_BLOCK2);
   /* pointers may be NULL to get only specific block parameters */
   if(num != NULL) {
     *num = coap_pkt->block2_num;
@@ -1068,7 +1186,7 @@ coap_get_header_block2(void *packet, uint32_t *num, uint8_t *more,
     *size = coap_pkt->block2_size;
   }
   if(offset != NULL) {
-    *offset = coap_pkt->block2_offset;
+    *offset = coap_pkt->block2_num * coap_pkt->block2_size;
   }
   return 1;
 }
@@ -1104,6 +1222,7 @@ coap_get_header_block1(void *packet, uint32_t *num, uint8_t *more,
   if(!IS_OPTION(coap_pkt, COAP_OPTION_BLOCK1)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_BLOCK1);
   /* pointers may be NULL to get only specific block parameters */
   if(num != NULL) {
     *num = coap_pkt->block1_num;
@@ -1115,7 +1234,7 @@ coap_get_header_block1(void *packet, uint32_t *num, uint8_t *more,
     *size = coap_pkt->block1_size;
   }
   if(offset != NULL) {
-    *offset = coap_pkt->block1_offset;
+    *offset = coap_pkt->block1_num * coap_pkt->block1_size;
   }
   return 1;
 }
@@ -1150,6 +1269,7 @@ coap_get_header_size2(void *packet, uint32_t *size)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_SIZE2)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_SIZE2);
   *size = coap_pkt->size2;
   return 1;
 }
@@ -1171,6 +1291,7 @@ coap_get_header_size1(void *packet, uint32_t *size)
   if(!IS_OPTION(coap_pkt, COAP_OPTION_SIZE1)) {
     return 0;
   }
+  DECODE_OPTION(coap_pkt, COAP_OPTION_SIZE1);
   *size = coap_pkt->size1;
   return 1;
 }
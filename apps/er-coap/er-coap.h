@@ -79,57 +79,66 @@ enum { OPTION_MAP_SIZE = sizeof(uint8_t) * 8 };
 #define SET_OPTION(packet, opt) ((packet)->options[opt / OPTION_MAP_SIZE] |= 1 << (opt % OPTION_MAP_SIZE))
 #define IS_OPTION(packet, opt) ((packet)->options[opt / OPTION_MAP_SIZE] & (1 << (opt % OPTION_MAP_SIZE)))
 
+/* options that are decoded on first access with COAP_LAZY_PARSING */
+enum { COAP_LAZY_OPTIONS = 16 };
+
 /* parsed message struct */
 typedef struct {
   uint8_t *buffer; /* pointer to CoAP header / incoming packet buffer / memory to serialize packet */
 
-  uint8_t version;
+  /* parse options once and store; allows setting options in random order  */
+  const char *proxy_uri;
+  const char *proxy_scheme;
+  const char *uri_host;
+  const char *location_path;
+  const char *location_query;
+  const char *uri_path;
+  const char *uri_query;
+  uint8_t *payload;
+
+  uint32_t max_age;
+  int32_t observe;
+  uint32_t block2_num;
+  uint32_t block1_num;
+  uint32_t size2;
+  uint32_t size1;
   coap_message_type_t type;
-  uint8_t code;
+
   uint16_t mid;
+  uint16_t content_format;
+  uint16_t proxy_uri_len;
+  uint16_t proxy_scheme_len;
+  uint16_t uri_host_len;
+  uint16_t location_path_len;
+  uint16_t uri_port;
+  uint16_t location_query_len;
+  uint16_t uri_path_len;
+  uint16_t accept;
+  uint16_t block2_size;
+  uint16_t block1_size;
+  uint16_t uri_query_len;
+  uint16_t payload_len;
+
+  uint8_t version;
+  uint8_t code;
 
   uint8_t token_len;
   uint8_t token[COAP_TOKEN_LEN];
 
   uint8_t options[COAP_OPTION_SIZE1 / OPTION_MAP_SIZE + 1]; /* bitmap to check if option is set */
+#if COAP_LAZY_PARSING
+  /* 1 + offset of each option not decoded yet from the first option, or 0;
+     the first entry is unused */
+  uint8_t undecoded[COAP_LAZY_OPTIONS + 1];
+#endif /* COAP_LAZY_PARSING */
 
-  uint16_t content_format; /* parse options once and store; allows setting options in random order  */
-  uint32_t max_age;
   uint8_t etag_len;
   uint8_t etag[COAP_ETAG_LEN];
-  size_t proxy_uri_len;
-  const char *proxy_uri;
-  size_t proxy_scheme_len;
-  const char *proxy_scheme;
-  size_t uri_host_len;
-  const char *uri_host;
-  size_t location_path_len;
-  const char *location_path;
-  uint16_t uri_port;
-  size_t location_query_len;
-  const char *location_query;
-  size_t uri_path_len;
-  const char *uri_path;
-  int32_t observe;
-  uint16_t accept;
   uint8_t if_match_len;
   uint8_t if_match[COAP_ETAG_LEN];
-  uint32_t block2_num;
   uint8_t block2_more;
-  uint16_t block2_size;
-  uint32_t block2_offset;
-  uint32_t block1_num;
   uint8_t block1_more;
-  uint16_t block1_size;
-  uint32_t block1_offset;
-  uint32_t size2;
-  uint32_t size1;
-  size_t uri_query_len;
-  const char *uri_query;
   uint8_t if_none_match;
-
-  uint16_t payload_len;
-  uint8_t *payload;
 } coap_packet_t;
 
 /* option format serialization */
@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Streaming JSON tokenizer and writer
+ */
+
+#include "jsonstream.h"
+#include "sys/cc.h"
+#include <string.h>
+
+/* What the parser is in the middle of */
+enum {
+  LEX_NONE,
+  LEX_STRING,
+  LEX_STRING_ESCAPE,
+  LEX_NUMBER,
+  LEX_LITERAL
+};
+
+/* What may come next */
+enum {
+  EXPECT_VALUE,
+  EXPECT_VALUE_OR_END,
+  EXPECT_NAME,
+  EXPECT_NAME_OR_END,
+  EXPECT_COLON,
+  EXPECT_COMMA_OR_END,
+  EXPECT_NOTHING
+};
+/*--------------------------------------------------------------------*/
+static int
+error(struct jsonstream_parser *p, int error)
+{
+  p->error = error;
+  return error;
+}
+/*--------------------------------------------------------------------*/
+static int
+is_number_char(char c)
+{
+  return (c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' ||
+    c == 'e' || c == 'E';
+}
+/*--------------------------------------------------------------------*/
+/* After a complete value */
+static void
+value_done(struct jsonstream_parser *p)
+{
+  p->expect = p->depth == 0 ? EXPECT_NOTHING : EXPECT_COMMA_OR_END;
+}
+/*--------------------------------------------------------------------*/
+/* Hands over the token ending at data[end], which started at start */
+static int
+token_done(struct jsonstream_parser *p, const char *data, int start, int end)
+{
+  const char *value = &data[start];
+  int len = end - start;
+  char type = p->vtype;
+
+  if(p->len > 0) {
+    /* The start of the token came in an earlier block */
+    if(p->len + len > p->size) {
+      return error(p, JSON_ERROR_VALUE_TOO_LONG);
+    }
+    memcpy(&p->buf[p->len], value, len);
+    value = p->buf;
+    len += p->len;
+    p->len = 0;
+  }
+  p->lex = LEX_NONE;
+
+  if(type == JSON_TYPE_TRUE) {
+    if(len == 4 && memcmp(value, "true", 4) == 0) {
+      type = JSON_TYPE_TRUE;
+    } else if(len == 5 && memcmp(value, "false", 5) == 0) {
+      type = JSON_TYPE_FALSE;
+    } else if(len == 4 && memcmp(value, "null", 4) == 0) {
+      type = JSON_TYPE_NULL;
+    } else {
+      return error(p, JSON_ERROR_SYNTAX);
+    }
+  }
+
+  p->callback(p, type, value, len);
+
+  if(type == JSON_TYPE_PAIR_NAME) {
+    p->expect = EXPECT_COLON;
+  } else {
+    value_done(p);
+  }
+  return JSON_ERROR_OK;
+}
+/*--------------------------------------------------------------------*/
+/* Keeps the part of a token that is in this block for the next one */
+static int
+token_split(struct jsonstream_parser *p, const char *data, int start, int end)
+{
+  if(p->len + end - start > p->size) {
+    return error(p, JSON_ERROR_VALUE_TOO_LONG);
+  }
+  memcpy(&p->buf[p->len], &data[start], end - start);
+  p->len += end - start;
+  return JSON_ERROR_OK;
+}
+/*--------------------------------------------------------------------*/
+/* Reads on in the current token, returns where it stopped */
+static int
+lex(struct jsonstream_parser *p, const char *data, int start, int pos,
+    int len)
+{
+  char c;
+
+  switch(p->lex) {
+  case LEX_STRING_ESCAPE:
+    p->lex = LEX_STRING;
+    pos++;
+    /* Fall through */
+  case LEX_STRING:
+    while(pos < len) {
+      c = data[pos];
+      if(c == '"') {
+        if(token_done(p, data, start, pos) == JSON_ERROR_OK) {
+          pos++;
+        }
+        return pos;
+      }
+      if(c == '\\') {
+        if(pos + 1 == len) {
+          p->lex = LEX_STRING_ESCAPE;
+          pos++;
+          break;
+        }
+        pos += 2;
+      } else {
+        pos++;
+      }
+    }
+    break;
+  case LEX_NUMBER:
+    while(pos < len && is_number_char(data[pos])) {
+      pos++;
+    }
+    if(pos < len) {
+      token_done(p, data, start, pos);
+      return pos;
+    }
+    break;
+  case LEX_LITERAL:
+    while(pos < len && data[pos] >= 'a' && data[pos] <= 'z') {
+      pos++;
+    }
+    if(pos < len) {
+      token_done(p, data, start, pos);
+      return pos;
+    }
+    break;
+  }
+
+  /* The token goes on in the next block */
+  pos = MIN(pos, len);
+  token_split(p, data, start, pos);
+  return pos;
+}
+/*--------------------------------------------------------------------*/
+static int
+expects_value(struct jsonstream_parser *p)
+{
+  return p->expect == EXPECT_VALUE || p->expect == EXPECT_VALUE_OR_END;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_parser_init(struct jsonstream_parser *p, char *buf, int size,
+                       jsonstream_callback_t callback, void *ptr)
+{
+  memset(p, 0, sizeof(*p));
+  p->buf = buf;
+  p->size = size;
+  p->callback = callback;
+  p->ptr = ptr;
+  p->expect = EXPECT_VALUE;
+}
+/*--------------------------------------------------------------------*/
+int
+jsonstream_parse(struct jsonstream_parser *p, const char *data, int len)
+{
+  int pos = 0;
+  char c;
+
+  if(p->error) {
+    return p->error;
+  }
+
+  if(p->lex != LEX_NONE && len > 0) {
+    /* Finish the token left over from the last block */
+    pos = lex(p, data, 0, 0, len);
+  }
+
+  while(pos < len && !p->error) {
+    c = data[pos];
+    switch(c) {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+      pos++;
+      break;
+
+    case '{':
+    case '[':
+      if(!expects_value(p)) {
+        return error(p, c == '{' ? JSON_ERROR_UNEXPECTED_OBJECT :
+                     JSON_ERROR_UNEXPECTED_ARRAY);
+      }
+      if(p->depth == JSONSTREAM_MAX_DEPTH) {
+        return error(p, JSON_ERROR_TOO_DEEP);
+      }
+      p->stack[p->depth++] = c;
+      p->expect = c == '{' ? EXPECT_NAME_OR_END : EXPECT_VALUE_OR_END;
+      p->callback(p, c, &data[pos], 1);
+      pos++;
+      break;
+
+    case '}':
+    case ']':
+      /* The opening character is two below the closing one */
+      if(p->depth == 0 || p->stack[p->depth - 1] != c - 2 ||
+         (p->expect != EXPECT_COMMA_OR_END &&
+          p->expect != EXPECT_NAME_OR_END &&
+          p->expect != EXPECT_VALUE_OR_END)) {
+        return error(p, c == '}' ? JSON_ERROR_UNEXPECTED_END_OF_OBJECT :
+                     JSON_ERROR_UNEXPECTED_END_OF_ARRAY);
+      }
+      p->depth--;
+      p->callback(p, c, &data[pos], 1);
+      value_done(p);
+      pos++;
+      break;
+
+    case ':':
+      if(p->expect != EXPECT_COLON) {
+        return error(p, JSON_ERROR_SYNTAX);
+      }
+      p->expect = EXPECT_VALUE;
+      pos++;
+      break;
+
+    case ',':
+      if(p->expect != EXPECT_COMMA_OR_END) {
+        return error(p, JSON_ERROR_SYNTAX);
+      }
+      p->expect = p->stack[p->depth - 1] == '{' ? EXPECT_NAME : EXPECT_VALUE;
+      pos++;
+      break;
+
+    case '"':
+      if(p->expect == EXPECT_NAME || p->expect == EXPECT_NAME_OR_END) {
+        p->vtype = JSON_TYPE_PAIR_NAME;
+      } else if(expects_value(p)) {
+        p->vtype = JSON_TYPE_STRING;
+      } else {
+        return error(p, JSON_ERROR_UNEXPECTED_STRING);
+      }
+      p->lex = LEX_STRING;
+      pos++;
+      pos = lex(p, data, pos, pos, len);
+      break;
+
+    default:
+      if(!expects_value(p)) {
+        return error(p, JSON_ERROR_SYNTAX);
+      }
+      if(c == '-' || (c >= '0' && c <= '9')) {
+        p->vtype = JSON_TYPE_NUMBER;
+        p->lex = LEX_NUMBER;
+      } else if(c == 't' || c == 'f' || c == 'n') {
+        /* Told apart once the whole word has been read */
+        p->vtype = JSON_TYPE_TRUE;
+        p->lex = LEX_LITERAL;
+      } else {
+        return error(p, JSON_ERROR_SYNTAX);
+      }
+      pos = lex(p, data, pos, pos + 1, len);
+      break;
+    }
+  }
+
+  return p->error;
+}
+/*--------------------------------------------------------------------*/
+int
+jsonstream_end(struct jsonstream_parser *p)
+{
+  if(p->error) {
+    return p->error;
+  }
+  if((p->lex == LEX_NUMBER || p->lex == LEX_LITERAL) && p->depth == 0) {
+    /* A bare number or word is a document of its own */
+    token_done(p, p->buf, 0, 0);
+  }
+  if(p->error == JSON_ERROR_OK &&
+     (p->lex != LEX_NONE || p->expect != EXPECT_NOTHING)) {
+    p->error = JSON_ERROR_SYNTAX;
+  }
+  return p->error;
+}
+/*--------------------------------------------------------------------*/
+int
+jsonstream_copy_string(const char *value, int len, char *buf, int size)
+{
+  int i, o;
+  char c;
+
+  for(i = 0, o = 0; i < len && o < size - 1; i++) {
+    c = value[i];
+    if(c == '\\' && i + 1 < len) {
+      switch(value[++i]) {
+      case 'b': c = '\b'; break;
+      case 'f': c = '\f'; break;
+      case 'n': c = '\n'; break;
+      case 'r': c = '\r'; break;
+      case 't': c = '\t'; break;
+      case 'u':
+        /* Kept as it is */
+        i--;
+        break;
+      default:  c = value[i]; break;
+      }
+    }
+    buf[o++] = c;
+  }
+  if(size > 0) {
+    buf[o] = '\0';
+  }
+  return o;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_writer_init(struct jsonstream_writer *w, char *buf, int size,
+                       jsonstream_flush_t flush, void *ptr)
+{
+  memset(w, 0, sizeof(*w));
+  w->buf = buf;
+  w->size = size;
+  w->flush = flush;
+  w->ptr = ptr;
+}
+/*--------------------------------------------------------------------*/
+int
+jsonstream_writer_flush(struct jsonstream_writer *w)
+{
+  if(w->error == JSON_ERROR_OK && w->len > 0 && w->flush != NULL) {
+    if(w->flush(w, w->buf, w->len) < 0) {
+      w->error = JSON_ERROR_OUTPUT;
+    }
+    w->len = 0;
+  }
+  return w->error;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_raw(struct jsonstream_writer *w, const char *text, int len)
+{
+  int n;
+
+  while(len > 0 && w->error == JSON_ERROR_OK) {
+    if(w->len == w->size) {
+      if(w->flush == NULL) {
+        w->error = JSON_ERROR_OUTPUT;
+        return;
+      }
+      jsonstream_writer_flush(w);
+    }
+    n = MIN(len, w->size - w->len);
+    memcpy(&w->buf[w->len], text, n);
+    w->len += n;
+    text += n;
+    len -= n;
+  }
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_char(struct jsonstream_writer *w, char c)
+{
+  if(w->len < w->size) {
+    w->buf[w->len++] = c;
+  } else {
+    jsonstream_write_raw(w, &c, 1);
+  }
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_escaped(struct jsonstream_writer *w, const char *text,
+                         int len)
+{
+  static const char hex[] = "0123456789abcdef";
+  char escape[6];
+  int start, i;
+  unsigned char c;
+
+  /* Copy runs of plain characters in one go */
+  for(start = 0, i = 0; i < len; i++) {
+    c = text[i];
+    if(c >= ' ' && c != '"' && c != '\\') {
+      continue;
+    }
+    jsonstream_write_raw(w, &text[start], i - start);
+    escape[0] = '\\';
+    switch(c) {
+    case '"':  escape[1] = '"';  break;
+    case '\\': escape[1] = '\\'; break;
+    case '\n': escape[1] = 'n';  break;
+    case '\r': escape[1] = 'r';  break;
+    case '\t': escape[1] = 't';  break;
+    case '\b': escape[1] = 'b';  break;
+    case '\f': escape[1] = 'f';  break;
+    default:
+      escape[1] = 'u';
+      escape[2] = '0';
+      escape[3] = '0';
+      escape[4] = hex[c >> 4];
+      escape[5] = hex[c & 0xf];
+      jsonstream_write_raw(w, escape, 6);
+      start = i + 1;
+      continue;
+    }
+    jsonstream_write_raw(w, escape, 2);
+    start = i + 1;
+  }
+  jsonstream_write_raw(w, &text[start], len - start);
+}
+/*--------------------------------------------------------------------*/
+static void
+comma(struct jsonstream_writer *w)
+{
+  if(w->comma) {
+    jsonstream_write_char(w, ',');
+  }
+  w->comma = 1;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_object_start(struct jsonstream_writer *w)
+{
+  comma(w);
+  jsonstream_write_char(w, '{');
+  w->comma = 0;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_object_end(struct jsonstream_writer *w)
+{
+  jsonstream_write_char(w, '}');
+  w->comma = 1;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_array_start(struct jsonstream_writer *w)
+{
+  comma(w);
+  jsonstream_write_char(w, '[');
+  w->comma = 0;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_array_end(struct jsonstream_writer *w)
+{
+  jsonstream_write_char(w, ']');
+  w->comma = 1;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_name(struct jsonstream_writer *w, const char *name)
+{
+  comma(w);
+  jsonstream_write_char(w, '"');
+  jsonstream_write_escaped(w, name, strlen(name));
+  jsonstream_write_raw(w, "\":", 2);
+  w->comma = 0;
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_string(struct jsonstream_writer *w, const char *text)
+{
+  comma(w);
+  jsonstream_write_char(w, '"');
+  jsonstream_write_escaped(w, text, strlen(text));
+  jsonstream_write_char(w, '"');
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_uint(struct jsonstream_writer *w, unsigned long value)
+{
+  char buf[20];
+  int l;
+
+  comma(w);
+  l = sizeof(buf);
+  do {
+    buf[--l] = '0' + (value % 10);
+    value /= 10;
+  } while(value > 0);
+  jsonstream_write_raw(w, &buf[l], sizeof(buf) - l);
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_int(struct jsonstream_writer *w, long value)
+{
+  if(value < 0) {
+    comma(w);
+    jsonstream_write_char(w, '-');
+    w->comma = 0;
+    jsonstream_write_uint(w, -(unsigned long)value);
+  } else {
+    jsonstream_write_uint(w, value);
+  }
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_write_atom(struct jsonstream_writer *w, const char *text)
+{
+  comma(w);
+  jsonstream_write_raw(w, text, strlen(text));
+}
+/*--------------------------------------------------------------------*/
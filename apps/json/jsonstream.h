@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Streaming JSON tokenizer and writer
+ *
+ *         The parser takes a document in blocks of any size, as they
+ *         arrive, and reports each token to a callback as soon as it is
+ *         complete. Tokens that lie within one block are handed over in
+ *         place; only one that is split between blocks is collected in a
+ *         buffer given by the caller.
+ *
+ *         The writer collects output in a buffer given by the caller and
+ *         hands it on in blocks, adding the commas between values itself.
+ */
+
+#ifndef JSONSTREAM_H_
+#define JSONSTREAM_H_
+
+#include "contiki-conf.h"
+#include "json.h"
+
+#ifdef JSONSTREAM_CONF_MAX_DEPTH
+#define JSONSTREAM_MAX_DEPTH JSONSTREAM_CONF_MAX_DEPTH
+#else
+#define JSONSTREAM_MAX_DEPTH 16
+#endif
+
+struct jsonstream_parser;
+
+/*
+ * Called for every token: JSON_TYPE_OBJECT, JSON_TYPE_ARRAY and their
+ * closing characters, JSON_TYPE_PAIR_NAME and the values JSON_TYPE_STRING,
+ * JSON_TYPE_NUMBER, JSON_TYPE_TRUE, JSON_TYPE_FALSE and JSON_TYPE_NULL.
+ * Strings and names are passed as they appear between the quotes, with
+ * escapes left in, see jsonstream_copy_string(). value is not terminated.
+ */
+typedef void (* jsonstream_callback_t)(struct jsonstream_parser *p, int type,
+                                       const char *value, int len);
+
+struct jsonstream_parser {
+  jsonstream_callback_t callback;
+  void *ptr;
+
+  /* For tokens split between blocks */
+  char *buf;
+  int size;
+  int len;
+
+  uint8_t lex;
+  uint8_t expect;
+  uint8_t depth;
+  char vtype;
+  char error;
+  char stack[JSONSTREAM_MAX_DEPTH];
+};
+
+struct jsonstream_writer;
+
+/* Gets the output; returns len, or -1 to stop the writer */
+typedef int (* jsonstream_flush_t)(struct jsonstream_writer *w,
+                                   const char *data, int len);
+
+struct jsonstream_writer {
+  jsonstream_flush_t flush;
+  void *ptr;
+
+  char *buf;
+  int size;
+  int len;
+
+  uint8_t comma;
+  char error;
+};
+
+/**
+ * \brief      Initialize a streaming parser
+ * \param p    The parser
+ * \param buf  Buffer for tokens split between blocks, must hold the
+ *             longest string or number in the document
+ * \param size Size of buf
+ * \param callback Called for each token
+ * \param ptr  Opaque pointer for the caller, stored in p->ptr
+ */
+void jsonstream_parser_init(struct jsonstream_parser *p, char *buf, int size,
+                            jsonstream_callback_t callback, void *ptr);
+
+/**
+ * \brief      Parse the next block of a document
+ * \param p    The parser
+ * \param data The block
+ * \param len  Length of the block
+ * \return     JSON_ERROR_OK, or the error that stopped the parser
+ */
+int jsonstream_parse(struct jsonstream_parser *p, const char *data, int len);
+
+/**
+ * \brief      Tell the parser that the document has ended
+ * \param p    The parser
+ * \return     JSON_ERROR_OK if a complete document has been parsed
+ *
+ *             A number at the very end of a document is only known to be
+ *             complete here.
+ */
+int jsonstream_end(struct jsonstream_parser *p);
+
+/**
+ * \brief      Copy a string value from the callback, decoding escapes
+ *             other than \uXXXX, which is left as it is
+ * \param value The value
+ * \param len  Its length
+ * \param buf  Where to put the string, it is always terminated
+ * \param size Size of buf
+ * \return     The length of the decoded string
+ */
+int jsonstream_copy_string(const char *value, int len, char *buf, int size);
+
+/**
+ * \brief      Initialize a writer
+ * \param w    The writer
+ * \param buf  Output buffer
+ * \param size Size of buf
+ * \param flush Called with the contents of buf whenever it is full, and by
+ *             jsonstream_writer_flush(). If NULL, output that does not fit
+ *             in buf is an error.
+ * \param ptr  Opaque pointer for the caller, stored in w->ptr
+ */
+void jsonstream_writer_init(struct jsonstream_writer *w, char *buf, int size,
+                            jsonstream_flush_t flush, void *ptr);
+
+/**
+ * \brief      Hand what is left in the buffer to the flush callback
+ * \return     JSON_ERROR_OK, or the error that stopped the writer
+ */
+int jsonstream_writer_flush(struct jsonstream_writer *w);
+
+/* Write a single character as it is, without any comma */
+void jsonstream_write_char(struct jsonstream_writer *w, char c);
+
+/* Write text as it is, without any comma */
+void jsonstream_write_raw(struct jsonstream_writer *w, const char *text,
+                          int len);
+
+/* Write text as the inside of a JSON string, escaping what needs it */
+void jsonstream_write_escaped(struct jsonstream_writer *w, const char *text,
+                              int len);
+
+void jsonstream_write_object_start(struct jsonstream_writer *w);
+void jsonstream_write_object_end(struct jsonstream_writer *w);
+void jsonstream_write_array_start(struct jsonstream_writer *w);
+void jsonstream_write_array_end(struct jsonstream_writer *w);
+
+/* Write the name of the next pair in an object */
+void jsonstream_write_name(struct jsonstream_writer *w, const char *name);
+
+void jsonstream_write_string(struct jsonstream_writer *w, const char *text);
+void jsonstream_write_int(struct jsonstream_writer *w, long value);
+void jsonstream_write_uint(struct jsonstream_writer *w, unsigned long value);
+
+/* Write a value given as text, e.g. true or 21.5 */
+void jsonstream_write_atom(struct jsonstream_writer *w, const char *text);
+
+#endif /* JSONSTREAM_H_ */
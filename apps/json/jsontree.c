@@ -50,15 +50,27 @@
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+put(const struct jsontree_context *js_ctx, int c)
+{
+  if(js_ctx->putchar != NULL) {
+    js_ctx->putchar(c);
+  } else {
+    jsonstream_write_char(js_ctx->writer, c);
+  }
+}
 /*---------------------------------------------------------------------------*/
 void
 jsontree_write_atom(const struct jsontree_context *js_ctx, const char *text)
 {
   if(text == NULL) {
-    js_ctx->putchar('0');
+    put(js_ctx, '0');
+  } else if(js_ctx->putchar == NULL) {
+    jsonstream_write_raw(js_ctx->writer, text, strlen(text));
   } else {
     while(*text != '\0') {
-      js_ctx->putchar(*text++);
+      put(js_ctx, *text++);
     }
   }
 }
@@ -66,16 +78,20 @@ jsontree_write_atom(const struct jsontree_context *js_ctx, const char *text)
 void
 jsontree_write_string(const struct jsontree_context *js_ctx, const char *text)
 {
-  js_ctx->putchar('"');
-  if(text != NULL) {
+  put(js_ctx, '"');
+  if(text == NULL) {
+    /* Nothing */
+  } else if(js_ctx->putchar == NULL) {
+    jsonstream_write_escaped(js_ctx->writer, text, strlen(text));
+  } else {
     while(*text != '\0') {
       if(*text == '"') {
-        js_ctx->putchar('\\');
+        put(js_ctx, '\\');
       }
-      js_ctx->putchar(*text++);
+      put(js_ctx, *text++);
     }
   }
-  js_ctx->putchar('"');
+  put(js_ctx, '"');
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -90,8 +106,12 @@ jsontree_write_uint(const struct jsontree_context *js_ctx, unsigned int value)
     value /= 10;
   } while(value > 0 && l >= 0);
 
+  if(js_ctx->putchar == NULL) {
+    jsonstream_write_raw(js_ctx->writer, &buf[l + 1], sizeof(buf) - l - 1);
+    return;
+  }
   while(++l < sizeof(buf)) {
-    js_ctx->putchar(buf[l]);
+    put(js_ctx, buf[l]);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -99,7 +119,7 @@ void
 jsontree_write_int(const struct jsontree_context *js_ctx, int value)
 {
   if(value < 0) {
-    js_ctx->putchar('-');
+    put(js_ctx, '-');
     value = -value;
   }
 
@@ -117,6 +137,15 @@ jsontree_setup(struct jsontree_context *js_ctx, struct jsontree_value *root,
 }
 /*---------------------------------------------------------------------------*/
 void
+jsontree_setup_writer(struct jsontree_context *js_ctx,
+                      struct jsontree_value *root,
+                      struct jsonstream_writer *writer)
+{
+  jsontree_setup(js_ctx, root, NULL);
+  js_ctx->writer = writer;
+}
+/*---------------------------------------------------------------------------*/
+void
 jsontree_reset(struct jsontree_context *js_ctx)
 {
   js_ctx->depth = 0;
@@ -153,46 +182,46 @@ jsontree_print_next(struct jsontree_context *js_ctx)
 
     index = js_ctx->index[js_ctx->depth];
     if(index == 0) {
-      js_ctx->putchar(v->type);
+      put(js_ctx, v->type);
 #if JSONTREE_PRETTY
-      js_ctx->putchar('\n');
+      put(js_ctx, '\n');
 #endif
     }
     if(index >= o->count) {
 #if JSONTREE_PRETTY
-      js_ctx->putchar('\n');
+      put(js_ctx, '\n');
       indent = js_ctx->depth;
       while (indent--) {
-        js_ctx->putchar(' ');
-        js_ctx->putchar(' ');
+        put(js_ctx, ' ');
+        put(js_ctx, ' ');
       }
 #endif
-      js_ctx->putchar(v->type + 2);
+      put(js_ctx, v->type + 2);
       /* Default operation: back up one level! */
       break;
     }
 
     if(index > 0) {
-      js_ctx->putchar(',');
+      put(js_ctx, ',');
 #if JSONTREE_PRETTY
-      js_ctx->putchar('\n');
+      put(js_ctx, '\n');
 #endif
     }
 
 #if JSONTREE_PRETTY
     indent = js_ctx->depth + 1;
     while (indent--) {
-      js_ctx->putchar(' ');
-      js_ctx->putchar(' ');
+      put(js_ctx, ' ');
+      put(js_ctx, ' ');
     }
 #endif
 
     if(v->type == JSON_TYPE_OBJECT) {
       jsontree_write_string(js_ctx,
                             ((struct jsontree_object *)o)->pairs[index].name);
-      js_ctx->putchar(':');
+      put(js_ctx, ':');
 #if JSONTREE_PRETTY
-      js_ctx->putchar(' ');
+      put(js_ctx, ' ');
 #endif
       ov = ((struct jsontree_object *)o)->pairs[index].value;
     } else {
@@ -42,6 +42,7 @@
 
 #include "contiki-conf.h"
 #include "json.h"
+#include "jsonstream.h"
 
 #ifdef JSONTREE_CONF_MAX_DEPTH
 #define JSONTREE_MAX_DEPTH JSONTREE_CONF_MAX_DEPTH
@@ -59,6 +60,8 @@ struct jsontree_context {
   struct jsontree_value *values[JSONTREE_MAX_DEPTH];
   uint16_t index[JSONTREE_MAX_DEPTH];
   int (* putchar)(int);
+  /* Used instead of putchar when that is NULL */
+  struct jsonstream_writer *writer;
   uint8_t depth;
   uint8_t path;
   int callback_state;
@@ -141,6 +144,10 @@ struct jsontree_ptr {
 
 void jsontree_setup(struct jsontree_context *js_ctx,
                     struct jsontree_value *root, int (* putchar)(int));
+/* Output goes to writer in blocks rather than through putchar */
+void jsontree_setup_writer(struct jsontree_context *js_ctx,
+                           struct jsontree_value *root,
+                           struct jsonstream_writer *writer);
 void jsontree_reset(struct jsontree_context *js_ctx);
 
 const char *jsontree_path_name(const struct jsontree_context *js_ctx,
@@ -117,6 +117,18 @@ typedef enum {
   MQTT_VHDR_CONN_REJECTED_UNAUTHORIZED,
 } mqtt_vhdr_connack_fields_t;
 /*---------------------------------------------------------------------------*/
+/* States of the input parser, see input_packet() */
+typedef enum {
+  MQTT_IN_STATE_FHDR,
+  MQTT_IN_STATE_REMAINING_LENGTH,
+  MQTT_IN_STATE_TOPIC_LENGTH,
+  MQTT_IN_STATE_TOPIC,
+  MQTT_IN_STATE_MID,
+  MQTT_IN_STATE_PAYLOAD,
+  MQTT_IN_STATE_BODY,
+  MQTT_IN_STATE_SKIP,
+} mqtt_in_state_t;
+/*---------------------------------------------------------------------------*/
 #define MQTT_CONNECT_VHDR_FLAGS_SIZE 12
 
 #define MQTT_STRING_LEN_SIZE 2
@@ -127,6 +139,15 @@ typedef enum {
 /*---------------------------------------------------------------------------*/
 #define INCREMENT_MID(conn)   (conn)->mid_counter += 2
 #define MQTT_STRING_LENGTH(s) (((s)->length) == 0 ? 0 : (MQTT_STRING_LEN_SIZE + (s)->length))
+
+/*---------------------------------------------------------------------------*/
+#if MQTT_MAX_INFLIGHT
+/* The i:th oldest message in the outbound queue */
+#define QUEUED(conn, i)                                                        \
+  (&(conn)->out_queue[((conn)->out_queue_head + (i)) % MQTT_MAX_INFLIGHT])
+/* The message publish_queue_pt() is writing */
+#define OUT_QUEUED(conn) QUEUED(conn, (conn)->out_queue_pos)
+#endif
 /*---------------------------------------------------------------------------*/
 /* Protothread send macros */
 #define PT_MQTT_WRITE_BYTES(conn, data, len)                                   \
@@ -151,7 +172,7 @@ typedef enum {
     PROCESS_WAIT_EVENT();                                                      \
     if(ev == mqtt_abort_now_event) {                                           \
       conn->state = MQTT_CONN_STATE_ABORT_IMMEDIATE;                           \
-      PT_EXIT(&conn->out_proto_thread);                                        \
+      PT_INIT(&conn->out_proto_thread);                                        \
       process_post(PROCESS_CURRENT(), ev, data);                               \
     } else if(ev >= mqtt_event_min && ev <= mqtt_event_max) {                  \
       process_post(PROCESS_CURRENT(), ev, data);                               \
@@ -203,7 +224,14 @@ call_event(struct mqtt_connection *conn,
 static void
 reset_defaults(struct mqtt_connection *conn)
 {
+#if MQTT_MAX_INFLIGHT
+  /* Queued messages keep their MIDs when they are resent after a reconnect */
+  if(conn->out_queue_count == 0) {
+    conn->mid_counter = 1;
+  }
+#else
   conn->mid_counter = 1;
+#endif
   PT_INIT(&conn->out_proto_thread);
   conn->waiting_for_pingresp = 0;
 
@@ -215,7 +243,11 @@ static void
 abort_connection(struct mqtt_connection *conn)
 {
   conn->out_buffer_ptr = conn->out_buffer;
+  conn->out_write_pos = 0;
   conn->out_queue_full = 0;
+#if MQTT_MAX_INFLIGHT == 0
+  conn->out_publish_waiting = 0;
+#endif
 
   /* Reset outgoing packet */
   memset(&conn->out_packet, 0, sizeof(conn->out_packet));
@@ -375,6 +407,47 @@ reset_packet(struct mqtt_in_packet *packet)
   packet->remaining_multiplier = 1;
 }
 /*---------------------------------------------------------------------------*/
+#if MQTT_MAX_INFLIGHT
+static void
+post_publish(struct mqtt_connection *conn)
+{
+  /* One pending event is enough, publish_queue_pt() writes the whole queue */
+  if(!conn->out_publish_posted &&
+     process_post(&mqtt_process, mqtt_do_publish_event, conn) ==
+     PROCESS_ERR_OK) {
+    conn->out_publish_posted = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+queue_has_pending(struct mqtt_connection *conn)
+{
+  uint8_t i;
+
+  for(i = 0; i < conn->out_queue_count; i++) {
+    if(QUEUED(conn, i)->state == MQTT_QUEUED_PENDING) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Frees the completed messages at the head of the outbound queue */
+static void
+queue_pop_done(struct mqtt_connection *conn)
+{
+  while(conn->out_queue_count > 0 &&
+        QUEUED(conn, 0)->state == MQTT_QUEUED_DONE) {
+    conn->out_queue_head = (conn->out_queue_head + 1) % MQTT_MAX_INFLIGHT;
+    conn->out_queue_count--;
+    /* Keep publish_queue_pt() on the message it is writing */
+    if(conn->out_queue_pos > 0) {
+      conn->out_queue_pos--;
+    }
+  }
+}
+#endif /* MQTT_MAX_INFLIGHT */
+/*---------------------------------------------------------------------------*/
 static
 PT_THREAD(connect_pt(struct pt *pt, struct mqtt_connection *conn))
 {
@@ -453,7 +526,6 @@ PT_THREAD(connect_pt(struct pt *pt, struct mqtt_connection *conn))
   timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
   /* Wait for CONNACK */
-  reset_packet(&conn->in_packet);
   PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
                 timer_expired(&conn->t));
   if(timer_expired(&conn->t)) {
@@ -461,7 +533,6 @@ PT_THREAD(connect_pt(struct pt *pt, struct mqtt_connection *conn))
     /* We stick to the letter of the spec here: Tear the connection down */
     mqtt_disconnect(conn);
   }
-  reset_packet(&conn->in_packet);
 
   DBG("MQTT - Done sending CONNECT\n");
 
@@ -530,7 +601,7 @@ PT_THREAD(subscribe_pt(struct pt *pt, struct mqtt_connection *conn))
                       conn->out_packet.remaining_length_enc,
                       conn->out_packet.remaining_length_enc_bytes);
   /* Write Variable Header */
-  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   /* Write Payload */
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.topic_length >> 8));
@@ -544,14 +615,12 @@ PT_THREAD(subscribe_pt(struct pt *pt, struct mqtt_connection *conn))
   timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
   /* Wait for SUBACK. */
-  reset_packet(&conn->in_packet);
   PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
                 timer_expired(&conn->t));
 
   if(timer_expired(&conn->t)) {
     DBG("Timeout waiting for SUBACK\n");
   }
-  reset_packet(&conn->in_packet);
 
   /* This is clear after the entire transaction is complete */
   conn->out_queue_full = 0;
@@ -592,7 +661,7 @@ PT_THREAD(unsubscribe_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->out_packet.remaining_length_enc,
                       conn->out_packet.remaining_length_enc_bytes);
   /* Write Variable Header */
-  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   /* Write Payload */
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.topic_length >> 8));
@@ -605,7 +674,6 @@ PT_THREAD(unsubscribe_pt(struct pt *pt, struct mqtt_connection *conn))
   timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
   /* Wait for UNSUBACK */
-  reset_packet(&conn->in_packet);
   PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
                 timer_expired(&conn->t));
 
@@ -613,8 +681,6 @@ PT_THREAD(unsubscribe_pt(struct pt *pt, struct mqtt_connection *conn))
     DBG("Timeout waiting for UNSUBACK\n");
   }
 
-  reset_packet(&conn->in_packet);
-
   /* This is clear after the entire transaction is complete */
   conn->out_queue_full = 0;
 
@@ -623,6 +689,7 @@ PT_THREAD(unsubscribe_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_END(pt);
 }
 /*---------------------------------------------------------------------------*/
+#if MQTT_MAX_INFLIGHT == 0
 static
 PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
 {
@@ -665,7 +732,7 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->out_packet.topic,
                       conn->out_packet.topic_length);
   if(conn->out_packet.qos > MQTT_QOS_LEVEL_0) {
-    PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+    PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
     PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   }
   /* Write Payload */
@@ -686,7 +753,6 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
     process_post(conn->app_process, mqtt_update_event, NULL);
   } else if(conn->out_packet.qos == 1) {
     /* Wait for PUBACK */
-    reset_packet(&conn->in_packet);
     PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
                   timer_expired(&conn->t));
     if(timer_expired(&conn->t)) {
@@ -701,8 +767,6 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
     /* Should wait for PUBREC, send PUBREL and then wait for PUBCOMP */
   }
 
-  reset_packet(&conn->in_packet);
-
   /* This is clear after the entire transaction is complete */
   conn->out_queue_full = 0;
 
@@ -710,6 +774,94 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
 
   PT_END(pt);
 }
+#else /* MQTT_MAX_INFLIGHT == 0 */
+/*
+ * Writes every queued PUBLISH that has not been sent yet into the output
+ * buffer, oldest first, and sends them together. Messages queued while this
+ * is running are picked up as well. PUBACKs are matched by handle_puback(),
+ * so nothing is waited for here.
+ */
+static
+PT_THREAD(publish_queue_pt(struct pt *pt, struct mqtt_connection *conn))
+{
+  uint8_t queued;
+
+  PT_BEGIN(pt);
+
+  for(conn->out_queue_pos = 0; conn->out_queue_pos < conn->out_queue_count;
+      conn->out_queue_pos++) {
+    if(OUT_QUEUED(conn)->state != MQTT_QUEUED_PENDING) {
+      continue;
+    }
+
+    DBG("MQTT - Sending queued publish MID %u topic %s\n",
+        OUT_QUEUED(conn)->mid, OUT_QUEUED(conn)->topic);
+
+    /* Set up FHDR */
+    conn->out_packet.fhdr = MQTT_FHDR_MSG_TYPE_PUBLISH |
+      OUT_QUEUED(conn)->qos << 1;
+    if(OUT_QUEUED(conn)->retain == MQTT_RETAIN_ON) {
+      conn->out_packet.fhdr |= MQTT_FHDR_RETAIN_FLAG;
+    }
+    if(OUT_QUEUED(conn)->dup) {
+      conn->out_packet.fhdr |= MQTT_FHDR_DUP_FLAG;
+    }
+    conn->out_packet.remaining_length = MQTT_STRING_LEN_SIZE +
+      OUT_QUEUED(conn)->topic_length +
+      OUT_QUEUED(conn)->payload_size;
+    if(OUT_QUEUED(conn)->qos > MQTT_QOS_LEVEL_0) {
+      conn->out_packet.remaining_length += MQTT_MID_SIZE;
+    }
+    encode_remaining_length(conn->out_packet.remaining_length_enc,
+                            &conn->out_packet.remaining_length_enc_bytes,
+                            conn->out_packet.remaining_length);
+    if(conn->out_packet.remaining_length_enc_bytes > 4) {
+      call_event(conn, MQTT_EVENT_PROTOCOL_ERROR, NULL);
+      PRINTF("MQTT - Error, remaining length > 4 bytes\n");
+      OUT_QUEUED(conn)->state = MQTT_QUEUED_DONE;
+      continue;
+    }
+
+    /* Write Fixed Header */
+    PT_MQTT_WRITE_BYTE(conn, conn->out_packet.fhdr);
+    PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->out_packet.remaining_length_enc,
+                        conn->out_packet.remaining_length_enc_bytes);
+    /* Write Variable Header */
+    PT_MQTT_WRITE_BYTE(conn, (OUT_QUEUED(conn)->topic_length >> 8));
+    PT_MQTT_WRITE_BYTE(conn, (OUT_QUEUED(conn)->topic_length & 0x00FF));
+    PT_MQTT_WRITE_BYTES(conn, (uint8_t *)OUT_QUEUED(conn)->topic,
+                        OUT_QUEUED(conn)->topic_length);
+    if(OUT_QUEUED(conn)->qos > MQTT_QOS_LEVEL_0) {
+      PT_MQTT_WRITE_BYTE(conn, (OUT_QUEUED(conn)->mid >> 8));
+      PT_MQTT_WRITE_BYTE(conn, (OUT_QUEUED(conn)->mid & 0x00FF));
+    }
+    /* Write Payload */
+    PT_MQTT_WRITE_BYTES(conn,
+                        OUT_QUEUED(conn)->payload,
+                        OUT_QUEUED(conn)->payload_size);
+
+    if(OUT_QUEUED(conn)->qos == MQTT_QOS_LEVEL_1) {
+      OUT_QUEUED(conn)->state = MQTT_QUEUED_SENT;
+    } else {
+      if(OUT_QUEUED(conn)->qos == MQTT_QOS_LEVEL_2) {
+        DBG("MQTT - QoS not implemented yet.\n");
+      }
+      OUT_QUEUED(conn)->state = MQTT_QUEUED_DONE;
+    }
+  }
+
+  send_out_buffer(conn);
+
+  /* QoS 0 messages are done once written, tell the app there is room */
+  queued = conn->out_queue_count;
+  queue_pop_done(conn);
+  if(conn->out_queue_count < queued) {
+    process_post(conn->app_process, mqtt_update_event, NULL);
+  }
+
+  PT_END(pt);
+}
+#endif /* MQTT_MAX_INFLIGHT == 0 */
 /*---------------------------------------------------------------------------*/
 static
 PT_THREAD(pingreq_pt(struct pt *pt, struct mqtt_connection *conn))
@@ -728,12 +880,13 @@ PT_THREAD(pingreq_pt(struct pt *pt, struct mqtt_connection *conn))
   conn->waiting_for_pingresp = 1;
 
   /* Wait for PINGRESP or timeout */
-  reset_packet(&conn->in_packet);
   timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
-  PT_WAIT_UNTIL(pt, conn->in_packet.packet_received || timer_expired(&conn->t));
-
-  reset_packet(&conn->in_packet);
+  /*
+   * handle_pingresp() clears the flag. Do not wait for just any packet, as
+   * the parser may be in the middle of a long PUBLISH.
+   */
+  PT_WAIT_UNTIL(pt, !conn->waiting_for_pingresp || timer_expired(&conn->t));
 
   conn->waiting_for_pingresp = 0;
 
@@ -743,6 +896,10 @@ PT_THREAD(pingreq_pt(struct pt *pt, struct mqtt_connection *conn))
 static void
 handle_connack(struct mqtt_connection *conn)
 {
+#if MQTT_MAX_INFLIGHT
+  uint8_t i;
+#endif
+
   DBG("MQTT - Got CONNACK\n");
 
   if(conn->in_packet.payload[1] != 0) {
@@ -763,12 +920,27 @@ handle_connack(struct mqtt_connection *conn)
   /* Always reset packet before callback since it might be used directly */
   conn->state = MQTT_CONN_STATE_CONNECTED_TO_BROKER;
   call_event(conn, MQTT_EVENT_CONNECTED, NULL);
+
+#if MQTT_MAX_INFLIGHT
+  /* Resend what the broker had not acknowledged when the connection broke */
+  for(i = 0; i < conn->out_queue_count; i++) {
+    if(QUEUED(conn, i)->state == MQTT_QUEUED_SENT) {
+      QUEUED(conn, i)->state = MQTT_QUEUED_PENDING;
+      QUEUED(conn, i)->dup = 1;
+    }
+  }
+  if(queue_has_pending(conn)) {
+    post_publish(conn);
+  }
+#endif
 }
 /*---------------------------------------------------------------------------*/
 static void
 handle_pingresp(struct mqtt_connection *conn)
 {
   DBG("MQTT - Got RINGRESP\n");
+
+  conn->waiting_for_pingresp = 0;
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -820,244 +992,126 @@ handle_unsuback(struct mqtt_connection *conn)
 static void
 handle_puback(struct mqtt_connection *conn)
 {
+#if MQTT_MAX_INFLIGHT
+  uint8_t i;
+#endif
+
   DBG("MQTT - Got PUBACK\n");
 
-  conn->out_packet.qos_state = MQTT_QOS_STATE_GOT_ACK;
   conn->in_packet.mid = (conn->in_packet.payload[0] << 8) |
     (conn->in_packet.payload[1]);
 
+#if MQTT_MAX_INFLIGHT
+  /*
+   * Leave out_packet alone, it may belong to a SUBSCRIBE or UNSUBSCRIBE
+   * that is waiting for its own ACK.
+   */
+  for(i = 0; i < conn->out_queue_count; i++) {
+    if(QUEUED(conn, i)->state == MQTT_QUEUED_SENT &&
+       QUEUED(conn, i)->mid == conn->in_packet.mid) {
+      QUEUED(conn, i)->state = MQTT_QUEUED_DONE;
+      break;
+    }
+  }
+  if(i == conn->out_queue_count) {
+    DBG("MQTT - Warning, got PUBACK with unknown MID %u\n",
+        conn->in_packet.mid);
+  }
+  queue_pop_done(conn);
+#else
+  conn->out_packet.qos_state = MQTT_QOS_STATE_GOT_ACK;
+#endif
+
   call_event(conn, MQTT_EVENT_PUBACK, &conn->in_packet.mid);
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Hands the current chunk of an incoming PUBLISH to every matching topic
+ * handler, or to the event callback if there is none.
+ */
 static void
-handle_publish(struct mqtt_connection *conn)
+deliver_publish(struct mqtt_connection *conn)
 {
-  DBG("MQTT - Got PUBLISH, called once per manageable chunk of message.\n");
-  DBG("MQTT - Handling publish on topic '%s'\n", conn->in_publish_msg.topic);
-
-  DBG("MQTT - This chunk is %i bytes\n", conn->in_packet.payload_pos);
-
-  if(((conn->in_packet.fhdr & 0x09) >> 1) > 0) {
-    PRINTF("MQTT - Error, got incoming PUBLISH with QoS > 0, not supported atm!\n");
-  }
-
-  call_event(conn, MQTT_EVENT_PUBLISH, &conn->in_publish_msg);
-
-  if(conn->in_publish_msg.first_chunk == 1) {
-    conn->in_publish_msg.first_chunk = 0;
+  struct mqtt_topic_handler *h;
+  uint8_t first_chunk = conn->in_publish_msg.first_chunk;
+  uint8_t handled = 0;
+
+  DBG("MQTT - PUBLISH chunk of %u bytes on topic '%s', %lu bytes left\n",
+      conn->in_publish_msg.payload_chunk_length, conn->in_publish_msg.topic,
+      (unsigned long)conn->in_publish_msg.payload_left);
+
+  for(h = list_head(conn->topic_handlers); h != NULL; h = list_item_next(h)) {
+    if(h->matched) {
+      /* Each handler gets to see the first chunk as such */
+      conn->in_publish_msg.first_chunk = first_chunk;
+      h->callback(conn, &conn->in_publish_msg);
+      handled = 1;
+    }
   }
-
-  /* If this is the last time handle_publish will be called, reset packet. */
-  if(conn->in_publish_msg.payload_left == 0) {
-
-    /* Check for QoS and initiate the reply, do not rely on the data in the
-     * in_packet being untouched. */
-
-    DBG("MQTT - (handle_publish) resetting packet.\n");
-    reset_packet(&conn->in_packet);
+  if(!handled) {
+    conn->in_publish_msg.first_chunk = first_chunk;
+    call_event(conn, MQTT_EVENT_PUBLISH, &conn->in_publish_msg);
   }
+  conn->in_publish_msg.first_chunk = 0;
 }
 /*---------------------------------------------------------------------------*/
 static void
-parse_publish_vhdr(struct mqtt_connection *conn,
-                   uint32_t *pos,
-                   const uint8_t *input_data_ptr,
-                   int input_data_len)
+start_publish_payload(struct mqtt_connection *conn)
 {
-  uint16_t copy_bytes;
-
-  /* Read out topic length */
-  if(conn->in_packet.topic_len_received == 0) {
-    conn->in_packet.topic_len = (input_data_ptr[(*pos)++] << 8);
-    conn->in_packet.byte_counter++;
-    if(*pos >= input_data_len) {
-      return;
-    }
-    conn->in_packet.topic_len |= input_data_ptr[(*pos)++];
-    conn->in_packet.byte_counter++;
-    conn->in_packet.topic_len_received = 1;
-
-    DBG("MQTT - Read PUBLISH topic len %i\n", conn->in_packet.topic_len);
-    /* WARNING: Check here if TOPIC fits in payload area, otherwise error */
-  }
-
-  /* Read out topic */
-  if(conn->in_packet.topic_len_received == 1 &&
-     conn->in_packet.topic_received == 0) {
-    copy_bytes = MIN(conn->in_packet.topic_len - conn->in_packet.topic_pos,
-                     input_data_len - *pos);
-    DBG("MQTT - topic_pos: %i copy_bytes: %i", conn->in_packet.topic_pos,
-        copy_bytes);
-    memcpy(&conn->in_publish_msg.topic[conn->in_packet.topic_pos],
-           &input_data_ptr[*pos],
-           copy_bytes);
-    (*pos) += copy_bytes;
-    conn->in_packet.byte_counter += copy_bytes;
-    conn->in_packet.topic_pos += copy_bytes;
-
-    if(conn->in_packet.topic_len - conn->in_packet.topic_pos == 0) {
-      DBG("MQTT - Got topic '%s'", conn->in_publish_msg.topic);
-      conn->in_packet.topic_received = 1;
-      conn->in_publish_msg.topic[conn->in_packet.topic_pos] = '\0';
-      conn->in_publish_msg.payload_length =
-        conn->in_packet.remaining_length - conn->in_packet.topic_len - 2;
-      conn->in_publish_msg.payload_left = conn->in_publish_msg.payload_length;
-    }
-
-    /* Set this once per incomming publish message */
-    conn->in_publish_msg.first_chunk = 1;
+  struct mqtt_in_packet *in = &conn->in_packet;
+
+  conn->in_publish_msg.payload_length = in->remaining;
+  conn->in_publish_msg.payload_left = in->remaining;
+  conn->in_publish_msg.first_chunk = 1;
+  in->payload_pos = 0;
+  in->state = MQTT_IN_STATE_PAYLOAD;
+
+  if(in->remaining == 0) {
+    conn->in_publish_msg.payload_chunk = in->payload;
+    conn->in_publish_msg.payload_chunk_length = 0;
+    deliver_publish(conn);
+    in->packet_received = 1;
   }
 }
 /*---------------------------------------------------------------------------*/
-static int
-tcp_input(struct tcp_socket *s,
-          void *ptr,
-          const uint8_t *input_data_ptr,
-          int input_data_len)
+static void
+publish_topic_received(struct mqtt_connection *conn)
 {
-  struct mqtt_connection *conn = ptr;
-  uint32_t pos = 0;
-  uint32_t copy_bytes = 0;
-  uint8_t byte;
-
-  if(input_data_len == 0) {
-    return 0;
-  }
-
-  if(conn->in_packet.packet_received) {
-    reset_packet(&conn->in_packet);
-  }
-
-  DBG("tcp_input with %i bytes of data:\n", input_data_len);
-
-  /* Read the fixed header field, if we do not have it */
-  if(!conn->in_packet.fhdr) {
-    conn->in_packet.fhdr = input_data_ptr[pos++];
-    conn->in_packet.byte_counter++;
-
-    DBG("MQTT - Read VHDR '%02X'\n", conn->in_packet.fhdr);
-
-    if(pos >= input_data_len) {
-      return 0;
-    }
-  }
-
-  /* Read the Remaining Length field, if we do not have it */
-  if(!conn->in_packet.has_remaining_length) {
-    do {
-      if(pos >= input_data_len) {
-        return 0;
-      }
-
-      byte = input_data_ptr[pos++];
-      conn->in_packet.byte_counter++;
-      conn->in_packet.remaining_length_bytes++;
-      DBG("MQTT - Read Remaining Length byte\n");
-
-      if(conn->in_packet.byte_counter > 5) {
-        call_event(conn, MQTT_EVENT_ERROR, NULL);
-        DBG("Received more then 4 byte 'remaining lenght'.");
-        return 0;
-      }
+  struct mqtt_in_packet *in = &conn->in_packet;
+  struct mqtt_topic_handler *h;
 
-      conn->in_packet.remaining_length +=
-        (byte & 127) * conn->in_packet.remaining_multiplier;
-      conn->in_packet.remaining_multiplier *= 128;
-    } while((byte & 128) != 0);
+  conn->in_publish_msg.topic[in->topic_len] = '\0';
+  DBG("MQTT - Got topic '%s'\n", conn->in_publish_msg.topic);
 
-    DBG("MQTT - Finished reading remaining length byte\n");
-    conn->in_packet.has_remaining_length = 1;
+  /* Match once per message rather than once per chunk */
+  for(h = list_head(conn->topic_handlers); h != NULL; h = list_item_next(h)) {
+    h->matched = mqtt_topic_match(h->filter, conn->in_publish_msg.topic);
   }
 
-  /*
-   * Check for unsupported payload length. Will read all incoming data from the
-   * server in any case and then reset the packet.
-   *
-   * TODO: Decide if we, for example, want to disconnect instead.
-   */
-  if((conn->in_packet.remaining_length > MQTT_INPUT_BUFF_SIZE) &&
-     (conn->in_packet.fhdr & 0xF0) != MQTT_FHDR_MSG_TYPE_PUBLISH) {
-
-    PRINTF("MQTT - Error, unsupported payload size for non-PUBLISH message\n");
-
-    conn->in_packet.byte_counter += input_data_len;
-    if(conn->in_packet.byte_counter >=
-       (MQTT_FHDR_SIZE + conn->in_packet.remaining_length)) {
-      conn->in_packet.packet_received = 1;
-    }
-    return 0;
-  }
-
-  /*
-   * Supported payload, reads out both VHDR and Payload of all packets.
-   *
-   * Note: There will always be at least one byte left to read when we enter
-   *       this loop.
-   */
-  while(conn->in_packet.byte_counter <
-        (MQTT_FHDR_SIZE + conn->in_packet.remaining_length)) {
-
-    if((conn->in_packet.fhdr & 0xF0) == MQTT_FHDR_MSG_TYPE_PUBLISH &&
-       conn->in_packet.topic_received == 0) {
-      parse_publish_vhdr(conn, &pos, input_data_ptr, input_data_len);
-    }
-
-    /* Read in as much as we can into the packet payload */
-    copy_bytes = MIN(input_data_len - pos,
-                     MQTT_INPUT_BUFF_SIZE - conn->in_packet.payload_pos);
-    DBG("- Copied %lu payload bytes\n", copy_bytes);
-    memcpy(&conn->in_packet.payload[conn->in_packet.payload_pos],
-           &input_data_ptr[pos],
-           copy_bytes);
-    conn->in_packet.byte_counter += copy_bytes;
-    conn->in_packet.payload_pos += copy_bytes;
-    pos += copy_bytes;
-
-    uint8_t i;
-    DBG("MQTT - Copied bytes: \n");
-    for(i = 0; i < copy_bytes; i++) {
-      DBG("%02X ", conn->in_packet.payload[i]);
-    }
-    DBG("\n");
-
-    /* Full buffer, shall only happen to PUBLISH messages. */
-    if(MQTT_INPUT_BUFF_SIZE - conn->in_packet.payload_pos == 0) {
-      conn->in_publish_msg.payload_chunk = conn->in_packet.payload;
-      conn->in_publish_msg.payload_chunk_length = MQTT_INPUT_BUFF_SIZE;
-      conn->in_publish_msg.payload_left -= MQTT_INPUT_BUFF_SIZE;
-
-      handle_publish(conn);
-
-      conn->in_publish_msg.payload_chunk = conn->in_packet.payload;
-      conn->in_packet.payload_pos = 0;
-    }
-
-    if(pos >= input_data_len &&
-       (conn->in_packet.byte_counter < (MQTT_FHDR_SIZE + conn->in_packet.remaining_length))) {
-      return 0;
-    }
+  if((in->fhdr & (MQTT_FHDR_QOS_LEVEL_1 | MQTT_FHDR_QOS_LEVEL_2)) == 0) {
+    conn->in_publish_msg.mid = 0;
+    start_publish_payload(conn);
+  } else if(in->remaining < MQTT_MID_SIZE) {
+    in->state = MQTT_IN_STATE_SKIP;
+  } else {
+    PRINTF("MQTT - Error, got incoming PUBLISH with QoS > 0, it will not be "
+           "acknowledged!\n");
+    in->field_pos = 0;
+    in->state = MQTT_IN_STATE_MID;
   }
+}
+/*---------------------------------------------------------------------------*/
+/* Handles a complete packet other than PUBLISH */
+static void
+handle_packet(struct mqtt_connection *conn)
+{
+  DBG("MQTT - Finished reading packet of %lu bytes\n",
+      (unsigned long)conn->in_packet.remaining_length);
 
-  /* Debug information */
-  DBG("\n");
-  /* Take care of input */
-  DBG("MQTT - Finished reading packet!\n");
-  /* What to return? */
-  DBG("MQTT - total data was %i bytes of data. \n",
-      (MQTT_FHDR_SIZE + conn->in_packet.remaining_length));
-
-  /* Handle packet here. */
   switch(conn->in_packet.fhdr & 0xF0) {
   case MQTT_FHDR_MSG_TYPE_CONNACK:
     handle_connack(conn);
     break;
-  case MQTT_FHDR_MSG_TYPE_PUBLISH:
-    /* This is the only or the last chunk of publish payload */
-    conn->in_publish_msg.payload_chunk = conn->in_packet.payload;
-    conn->in_publish_msg.payload_chunk_length = conn->in_packet.payload_pos;
-    conn->in_publish_msg.payload_left = 0;
-    handle_publish(conn);
-    break;
   case MQTT_FHDR_MSG_TYPE_PUBACK:
     handle_puback(conn);
     break;
@@ -1087,6 +1141,197 @@ tcp_input(struct tcp_socket *s,
   }
 
   conn->in_packet.packet_received = 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Picks the state for the rest of the packet once its length is known */
+static void
+start_packet(struct mqtt_connection *conn)
+{
+  struct mqtt_in_packet *in = &conn->in_packet;
+
+  in->remaining = in->remaining_length;
+
+  if((in->fhdr & 0xF0) == MQTT_FHDR_MSG_TYPE_PUBLISH) {
+    in->topic_len = 0;
+    in->topic_pos = 0;
+    in->field_pos = 0;
+    in->state = MQTT_IN_STATE_TOPIC_LENGTH;
+    if(in->remaining < MQTT_STRING_LEN_SIZE) {
+      PRINTF("MQTT - Error, PUBLISH without a topic\n");
+      in->state = MQTT_IN_STATE_SKIP;
+    }
+  } else if(in->remaining > MQTT_INPUT_BUFF_SIZE) {
+    /* Read all of it from the server in any case, then carry on */
+    PRINTF("MQTT - Error, unsupported payload size for non-PUBLISH message\n");
+    in->state = MQTT_IN_STATE_SKIP;
+  } else {
+    in->payload_pos = 0;
+    in->state = MQTT_IN_STATE_BODY;
+    if(in->remaining == 0) {
+      handle_packet(conn);
+    }
+  }
+
+  if(in->state == MQTT_IN_STATE_SKIP && in->remaining == 0) {
+    in->packet_received = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads one MQTT packet, or as much of it as the input holds, and returns
+ * the number of bytes used. The parser keeps its state in conn->in_packet,
+ * so packets may be split over any number of TCP segments.
+ *
+ * Only the topic of a PUBLISH is copied. Its payload is handed on as it
+ * comes in, see MQTT_STREAM_PAYLOAD, so it is never held in full. Other
+ * packets are collected in in_packet.payload before being handled.
+ */
+static uint32_t
+input_packet(struct mqtt_connection *conn,
+             const uint8_t *input_data_ptr,
+             int input_data_len)
+{
+  struct mqtt_in_packet *in = &conn->in_packet;
+  uint32_t pos = 0;
+  uint32_t copy_bytes;
+  uint8_t byte;
+
+  if(in->packet_received) {
+    reset_packet(in);
+  }
+
+  while(pos < input_data_len && !in->packet_received) {
+    switch(in->state) {
+    case MQTT_IN_STATE_FHDR:
+      in->fhdr = input_data_ptr[pos++];
+      DBG("MQTT - Read VHDR '%02X'\n", in->fhdr);
+      in->state = MQTT_IN_STATE_REMAINING_LENGTH;
+      break;
+
+    case MQTT_IN_STATE_REMAINING_LENGTH:
+      byte = input_data_ptr[pos++];
+      in->remaining_length_bytes++;
+      in->remaining_length += (byte & 127) * in->remaining_multiplier;
+      in->remaining_multiplier *= 128;
+      if((byte & 128) == 0) {
+        start_packet(conn);
+      } else if(in->remaining_length_bytes == MQTT_MAX_REMAINING_LENGTH_BYTES) {
+        call_event(conn, MQTT_EVENT_ERROR, NULL);
+        DBG("Received more then 4 byte 'remaining lenght'.");
+        /* There is no telling where the next packet starts */
+        in->packet_received = 1;
+        return input_data_len;
+      }
+      break;
+
+    case MQTT_IN_STATE_TOPIC_LENGTH:
+      in->topic_len = (in->topic_len << 8) | input_data_ptr[pos++];
+      in->remaining--;
+      if(++in->field_pos < MQTT_STRING_LEN_SIZE) {
+        break;
+      }
+      DBG("MQTT - Read PUBLISH topic len %i\n", in->topic_len);
+      if(in->topic_len > MQTT_MAX_TOPIC_LENGTH || in->topic_len > in->remaining) {
+        PRINTF("MQTT - Error, PUBLISH topic too long, dropping the message\n");
+        in->state = MQTT_IN_STATE_SKIP;
+      } else if(in->topic_len == 0) {
+        publish_topic_received(conn);
+      } else {
+        in->state = MQTT_IN_STATE_TOPIC;
+      }
+      break;
+
+    case MQTT_IN_STATE_TOPIC:
+      copy_bytes = MIN(input_data_len - pos, in->topic_len - in->topic_pos);
+      memcpy(&conn->in_publish_msg.topic[in->topic_pos],
+             &input_data_ptr[pos], copy_bytes);
+      pos += copy_bytes;
+      in->topic_pos += copy_bytes;
+      in->remaining -= copy_bytes;
+      if(in->topic_pos == in->topic_len) {
+        publish_topic_received(conn);
+      }
+      break;
+
+    case MQTT_IN_STATE_MID:
+      in->mid = (in->mid << 8) | input_data_ptr[pos++];
+      in->remaining--;
+      if(++in->field_pos == MQTT_MID_SIZE) {
+        conn->in_publish_msg.mid = in->mid;
+        start_publish_payload(conn);
+      }
+      break;
+
+    case MQTT_IN_STATE_PAYLOAD:
+      copy_bytes = MIN(input_data_len - pos, in->remaining);
+#if MQTT_STREAM_PAYLOAD
+      /* Straight from the socket's input buffer, no copy */
+      conn->in_publish_msg.payload_chunk = (uint8_t *)&input_data_ptr[pos];
+      conn->in_publish_msg.payload_chunk_length = copy_bytes;
+      pos += copy_bytes;
+      in->remaining -= copy_bytes;
+      conn->in_publish_msg.payload_left = in->remaining;
+      deliver_publish(conn);
+#else
+      copy_bytes = MIN(copy_bytes, MQTT_INPUT_BUFF_SIZE - in->payload_pos);
+      memcpy(&in->payload[in->payload_pos], &input_data_ptr[pos], copy_bytes);
+      pos += copy_bytes;
+      in->payload_pos += copy_bytes;
+      in->remaining -= copy_bytes;
+      /* A full buffer or the end of the message makes a chunk */
+      if(in->payload_pos == MQTT_INPUT_BUFF_SIZE || in->remaining == 0) {
+        conn->in_publish_msg.payload_chunk = in->payload;
+        conn->in_publish_msg.payload_chunk_length = in->payload_pos;
+        conn->in_publish_msg.payload_left = in->remaining;
+        deliver_publish(conn);
+        in->payload_pos = 0;
+      }
+#endif
+      if(in->remaining == 0) {
+        in->packet_received = 1;
+      }
+      break;
+
+    case MQTT_IN_STATE_BODY:
+      copy_bytes = MIN(input_data_len - pos, in->remaining);
+      memcpy(&in->payload[in->payload_pos], &input_data_ptr[pos], copy_bytes);
+      pos += copy_bytes;
+      in->payload_pos += copy_bytes;
+      in->remaining -= copy_bytes;
+      if(in->remaining == 0) {
+        handle_packet(conn);
+      }
+      break;
+
+    case MQTT_IN_STATE_SKIP:
+      copy_bytes = MIN(input_data_len - pos, in->remaining);
+      pos += copy_bytes;
+      in->remaining -= copy_bytes;
+      if(in->remaining == 0) {
+        in->packet_received = 1;
+      }
+      break;
+    }
+  }
+
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tcp_input(struct tcp_socket *s,
+          void *ptr,
+          const uint8_t *input_data_ptr,
+          int input_data_len)
+{
+  struct mqtt_connection *conn = ptr;
+  uint32_t pos = 0;
+
+  DBG("tcp_input with %i bytes of data:\n", input_data_len);
+
+  /* A segment may hold several packets, e.g. the PUBACKs of a burst */
+  while(pos < input_data_len) {
+    pos += input_packet(conn, &input_data_ptr[pos], input_data_len - pos);
+  }
 
   return 0;
 }
@@ -1133,6 +1378,17 @@ tcp_event(struct tcp_socket *s, void *ptr, tcp_socket_event_t event)
     if(conn->socket.output_data_len == 0) {
       conn->out_buffer_sent = 1;
       conn->out_buffer_ptr = conn->out_buffer;
+#if MQTT_MAX_INFLIGHT
+      /* Send what has been queued while the last segment was in flight */
+      if(queue_has_pending(conn)) {
+        post_publish(conn);
+      }
+#else
+      if(conn->out_publish_waiting) {
+        conn->out_publish_waiting = 0;
+        process_post(&mqtt_process, mqtt_do_publish_event, conn);
+      }
+#endif
     }
 
     ctimer_restart(&conn->keep_alive_timer);
@@ -1242,14 +1498,37 @@ PROCESS_THREAD(mqtt_process, ev, data)
       conn = data;
       DBG("MQTT - Got mqtt_do_publish_mqtt_event!\n");
 
+#if MQTT_MAX_INFLIGHT
+      /*
+       * If the output buffer is busy, the TCP_SOCKET_DATA_SENT event posts
+       * this again once it has been sent. Until publish_queue_pt() is done,
+       * out_publish_posted stays set: it picks up messages queued meanwhile
+       * itself, and another event would only bounce in PT_MQTT_WAIT_SEND().
+       */
       if(conn->out_buffer_sent == 1 &&
          conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
         PT_INIT(&conn->out_proto_thread);
-        while(publish_pt(&conn->out_proto_thread, conn) < PT_EXITED &&
+        while(publish_queue_pt(&conn->out_proto_thread, conn) < PT_EXITED &&
               conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
           PT_MQTT_WAIT_SEND();
         }
       }
+      conn->out_publish_posted = 0;
+#else
+      if(conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
+        if(conn->out_buffer_sent == 1) {
+          PT_INIT(&conn->out_proto_thread);
+          while(publish_pt(&conn->out_proto_thread, conn) < PT_EXITED &&
+                conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
+            PT_MQTT_WAIT_SEND();
+          }
+        } else {
+          /* A QoS 0 PUBLISH before this one is still being sent, so
+             TCP_SOCKET_DATA_SENT posts this again once it is */
+          conn->out_publish_waiting = 1;
+        }
+      }
+#endif
     }
   }
   PROCESS_END();
@@ -1292,6 +1571,7 @@ mqtt_register(struct mqtt_connection *conn, struct process *app_process,
 
   /* Set defaults - Set all to zero to begin with */
   memset(conn, 0, sizeof(struct mqtt_connection));
+  LIST_STRUCT_INIT(conn, topic_handlers);
   string_to_mqtt_string(&conn->client_id, client_id);
   conn->event_callback = event_callback;
   conn->app_process = app_process;
@@ -1417,12 +1697,43 @@ mqtt_publish(struct mqtt_connection *conn, uint16_t *mid, char *topic,
              uint8_t *payload, uint32_t payload_size,
              mqtt_qos_level_t qos_level, mqtt_retain_t retain)
 {
+#if MQTT_MAX_INFLIGHT
+  struct mqtt_queued_publish *p;
+#endif
+
   if(conn->state != MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
     return MQTT_STATUS_NOT_CONNECTED_ERROR;
   }
 
   DBG("MQTT - Call to mqtt_publish...\n");
 
+#if MQTT_MAX_INFLIGHT
+  if(conn->out_queue_count == MQTT_MAX_INFLIGHT) {
+    DBG("MQTT - Not accepted!\n");
+    return MQTT_STATUS_OUT_QUEUE_FULL;
+  }
+  DBG("MQTT - Queued!\n");
+
+  p = QUEUED(conn, conn->out_queue_count);
+  p->mid = INCREMENT_MID(conn);
+  p->retain = retain;
+  p->topic = topic;
+  p->topic_length = strlen(topic);
+  p->payload = payload;
+  p->payload_size = payload_size;
+  p->qos = qos_level;
+  p->state = MQTT_QUEUED_PENDING;
+  p->dup = 0;
+  conn->out_queue_count++;
+
+  if(mid != NULL) {
+    *mid = p->mid;
+  }
+
+  post_publish(conn);
+  return MQTT_STATUS_OK;
+#else
+
   /* Currently don't have a queue, so only one item at a time */
   if(conn->out_queue_full) {
     DBG("MQTT - Not accepted!\n");
@@ -1442,6 +1753,7 @@ mqtt_publish(struct mqtt_connection *conn, uint16_t *mid, char *topic,
 
   process_post(&mqtt_process, mqtt_do_publish_event, conn);
   return MQTT_STATUS_OK;
+#endif /* MQTT_MAX_INFLIGHT */
 }
 /*----------------------------------------------------------------------------*/
 void
@@ -1482,4 +1794,64 @@ mqtt_set_last_will(struct mqtt_connection *conn, char *topic, char *message,
   }
 }
 /*----------------------------------------------------------------------------*/
+void
+mqtt_add_topic_handler(struct mqtt_connection *conn,
+                       struct mqtt_topic_handler *handler,
+                       const char *filter, mqtt_topic_callback_t callback)
+{
+  handler->filter = filter;
+  handler->callback = callback;
+  handler->matched = 0;
+  list_add(conn->topic_handlers, handler);
+}
+/*----------------------------------------------------------------------------*/
+void
+mqtt_remove_topic_handler(struct mqtt_connection *conn,
+                          struct mqtt_topic_handler *handler)
+{
+  list_remove(conn->topic_handlers, handler);
+}
+/*----------------------------------------------------------------------------*/
+int
+mqtt_topic_match(const char *filter, const char *topic)
+{
+  /* $SYS and friends are only matched when asked for by name */
+  if(*topic == '$' && (*filter == '+' || *filter == '#')) {
+    return 0;
+  }
+
+  for(;;) {
+    /* One topic level per iteration */
+    if(*filter == '#') {
+      return 1;
+    } else if(*filter == '+') {
+      while(*topic != '\0' && *topic != '/') {
+        topic++;
+      }
+      filter++;
+    } else {
+      while(*filter != '\0' && *filter != '/') {
+        if(*filter != *topic) {
+          return 0;
+        }
+        filter++;
+        topic++;
+      }
+    }
+
+    if(*filter == '\0') {
+      return *topic == '\0';
+    }
+    if(*topic == '\0') {
+      /* "sport/#" also matches "sport" */
+      return strcmp(filter, "/#") == 0;
+    }
+    if(*topic != '/') {
+      return 0;
+    }
+    filter++;
+    topic++;
+  }
+}
+/*----------------------------------------------------------------------------*/
 /** @} */
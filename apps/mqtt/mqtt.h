@@ -108,7 +108,34 @@
 #define MQTT_TCP_INPUT_BUFF_SIZE 512
 #define MQTT_TCP_OUTPUT_BUFF_SIZE 512
 
+/*
+ * Number of PUBLISH messages that may be queued, and for QoS 1 be waiting
+ * for their PUBACK, at the same time. Queued messages are written back to
+ * back into the output buffer, so that a burst leaves in as few TCP segments
+ * as the buffer and the MSS allow. QoS 1 messages that are not acknowledged
+ * when the connection drops are sent again, with the DUP flag, after the
+ * reconnect. 0 allows a single outstanding PUBLISH.
+ */
+#ifdef MQTT_CONF_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT MQTT_CONF_MAX_INFLIGHT
+#else
+#define MQTT_MAX_INFLIGHT 0
+#endif
+
 #define MQTT_INPUT_BUFF_SIZE 512
+
+/*
+ * Hand incoming PUBLISH payloads to the application straight from the TCP
+ * socket's input buffer, in whatever fragments TCP delivers them, instead of
+ * collecting them in chunks of MQTT_INPUT_BUFF_SIZE bytes first. Payloads of
+ * any size then pass through without being buffered.
+ */
+#ifdef MQTT_CONF_STREAM_PAYLOAD
+#define MQTT_STREAM_PAYLOAD MQTT_CONF_STREAM_PAYLOAD
+#else
+#define MQTT_STREAM_PAYLOAD 0
+#endif
+
 #define MQTT_MAX_TOPIC_LENGTH 64
 #define MQTT_MAX_TOPICS_PER_SUBSCRIBE 1
 
@@ -122,7 +149,11 @@
  * Debug configuration, this is similar but not exactly like the Debugging
  * System discussion at https://github.com/contiki-os/contiki/wiki.
  */
+#ifdef MQTT_CONF_DEBUG
+#define DEBUG_MQTT MQTT_CONF_DEBUG
+#else
 #define DEBUG_MQTT 1
+#endif
 
 #if DEBUG_MQTT == 1
 #define DBG(...) printf(__VA_ARGS__)
@@ -224,7 +255,13 @@ struct mqtt_suback_event {
   mqtt_qos_level_t qos_level;
 };
 
-/* This is the MQTT message that is exposed to the end user. */
+/*
+ * This is the MQTT message that is exposed to the end user.
+ *
+ * The payload arrives in one or more chunks: first_chunk is set for the first
+ * of them and payload_left tells how many bytes are still to come after the
+ * current one. A chunk is only valid during the callback.
+ */
 struct mqtt_message {
   uint32_t mid;
   char topic[MQTT_MAX_TOPIC_LENGTH + 1]; /* +1 for string termination */
@@ -233,8 +270,8 @@ struct mqtt_message {
   uint16_t payload_chunk_length;
 
   uint8_t first_chunk;
-  uint16_t payload_length;
-  uint16_t payload_left;
+  uint32_t payload_length;
+  uint32_t payload_left;
 };
 
 /* This struct represents a packet received from the MQTT server. */
@@ -242,31 +279,31 @@ struct mqtt_in_packet {
   /* Used by the list interface, must be first in the struct. */
   struct mqtt_connection *next;
 
-  /* Total bytes read so far. Compared to the remaining length to to decide when
-   * we've read the payload. */
-  uint32_t byte_counter;
+  /* Where the parser is in the packet, see input_packet() in mqtt.c */
+  uint8_t state;
   uint8_t packet_received;
 
   uint8_t fhdr;
-  uint16_t remaining_length;
+  uint32_t remaining_length;
+  /* Bytes of the packet after the Remaining Length field still to be read */
+  uint32_t remaining;
   uint16_t mid;
 
   /* Helper variables needed to decode the remaining_length */
-  uint8_t remaining_multiplier;
-  uint8_t has_remaining_length;
+  uint32_t remaining_multiplier;
   uint8_t remaining_length_bytes;
 
   /* Not the same as payload in the MQTT sense, it also contains the variable
    * header.
    */
-  uint8_t payload_pos;
+  uint16_t payload_pos;
   uint8_t payload[MQTT_INPUT_BUFF_SIZE];
 
   /* Message specific data */
   uint16_t topic_len;
   uint16_t topic_pos;
-  uint8_t topic_len_received;
-  uint8_t topic_received;
+  /* Bytes read of a two byte field */
+  uint8_t field_pos;
 };
 
 /* This struct represents a packet sent to the MQTT server. */
@@ -284,6 +321,27 @@ struct mqtt_out_packet {
   mqtt_qos_state_t qos_state;
   mqtt_retain_t retain;
 };
+
+#if MQTT_MAX_INFLIGHT
+typedef enum {
+  MQTT_QUEUED_PENDING,     /* Still to be written, or to be resent */
+  MQTT_QUEUED_SENT,        /* Written, waiting for the PUBACK */
+  MQTT_QUEUED_DONE,        /* Acknowledged, or written if QoS 0 */
+} mqtt_queued_state_t;
+
+/* A PUBLISH in the outbound queue of a connection. */
+struct mqtt_queued_publish {
+  char *topic;
+  uint8_t *payload;
+  uint32_t payload_size;
+  uint16_t topic_length;
+  uint16_t mid;
+  uint8_t qos;
+  uint8_t retain;
+  uint8_t state;
+  uint8_t dup;
+};
+#endif /* MQTT_MAX_INFLIGHT */
 /*---------------------------------------------------------------------------*/
 /**
  * \brief           MQTT event callback function
@@ -301,6 +359,19 @@ typedef void (*mqtt_event_callback_t)(struct mqtt_connection *m,
 
 typedef void (*mqtt_topic_callback_t)(struct mqtt_connection *m,
                                       struct mqtt_message *msg);
+
+/*
+ * Receives the PUBLISH messages whose topic matches filter, which may use the
+ * + and # wildcards. Messages that no handler matches go to the event
+ * callback as MQTT_EVENT_PUBLISH.
+ */
+struct mqtt_topic_handler {
+  struct mqtt_topic_handler *next;
+  const char *filter;
+  mqtt_topic_callback_t callback;
+  /* Set while the message being received matches */
+  uint8_t matched;
+};
 /*---------------------------------------------------------------------------*/
 struct mqtt_will {
   struct mqtt_string topic;
@@ -346,6 +417,17 @@ struct mqtt_connection {
   uint8_t out_buffer_sent;
   struct mqtt_out_packet out_packet;
   struct pt out_proto_thread;
+#if MQTT_MAX_INFLIGHT
+  /* Outbound PUBLISH queue, oldest first */
+  struct mqtt_queued_publish out_queue[MQTT_MAX_INFLIGHT];
+  uint8_t out_queue_head;
+  uint8_t out_queue_count;
+  uint8_t out_queue_pos;
+  uint8_t out_publish_posted;
+#else
+  /* A PUBLISH waits for TCP_SOCKET_DATA_SENT to free the output buffer */
+  uint8_t out_publish_waiting;
+#endif
   uint32_t out_write_pos;
   uint16_t max_segment_size;
 
@@ -353,6 +435,7 @@ struct mqtt_connection {
   uint8_t in_buffer[MQTT_TCP_INPUT_BUFF_SIZE];
   struct mqtt_in_packet in_packet;
   struct mqtt_message in_publish_msg;
+  LIST_STRUCT(topic_handlers);
 
   /* TCP related information */
   char *server_host;
@@ -451,6 +534,12 @@ mqtt_status_t mqtt_unsubscribe(struct mqtt_connection *conn,
  * \return MQTT_STATUS_OK or some error status
  *
  * This function publishes to a topic on a MQTT broker.
+ *
+ * With MQTT_MAX_INFLIGHT > 0 the message is queued and *mid, if mid is not
+ * NULL, is set to its message ID, which the MQTT_EVENT_PUBACK event carries.
+ * MQTT_STATUS_OUT_QUEUE_FULL is returned while the queue is full. The topic
+ * and the payload are not copied and must stay untouched until the message
+ * has been acknowledged, or for QoS 0 until the next mqtt_update_event.
  */
 mqtt_status_t mqtt_publish(struct mqtt_connection *conn,
                            uint16_t *mid,
@@ -495,11 +584,53 @@ void mqtt_set_last_will(struct mqtt_connection *conn,
                         char *message,
                         mqtt_qos_level_t qos);
 
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Adds a handler for incoming PUBLISH messages.
+ * \param conn A pointer to the MQTT connection.
+ * \param handler A pointer to the handler, which must stay allocated.
+ * \param filter The topic filter, may contain the + and # wildcards.
+ * \param callback Called with every chunk of every matching message.
+ *
+ * The handler does not subscribe to anything, use mqtt_subscribe() for that.
+ * Several handlers may match the same message, each of them gets called.
+ */
+void mqtt_add_topic_handler(struct mqtt_connection *conn,
+                            struct mqtt_topic_handler *handler,
+                            const char *filter,
+                            mqtt_topic_callback_t callback);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Removes a handler added with mqtt_add_topic_handler().
+ * \param conn A pointer to the MQTT connection.
+ * \param handler A pointer to the handler.
+ */
+void mqtt_remove_topic_handler(struct mqtt_connection *conn,
+                               struct mqtt_topic_handler *handler);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Matches a topic name against a topic filter.
+ * \param filter The topic filter, may contain the + and # wildcards.
+ * \param topic The topic name.
+ * \return 1 if the topic matches, else 0
+ *
+ * Follows the rules of the MQTT 3.1.1 specification: + matches one topic
+ * level, a trailing # any number of them, including the parent level, and
+ * topics starting with $ are not matched by a leading wildcard.
+ */
+int mqtt_topic_match(const char *filter, const char *topic);
+
 #define mqtt_connected(conn) \
   ((conn)->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER ? 1 : 0)
 
+#if MQTT_MAX_INFLIGHT
+#define mqtt_ready(conn) \
+  (!(conn)->out_queue_full && \
+   (conn)->out_queue_count < MQTT_MAX_INFLIGHT && mqtt_connected((conn)))
+#else
 #define mqtt_ready(conn) \
   (!(conn)->out_queue_full && mqtt_connected((conn)))
+#endif
 /*---------------------------------------------------------------------------*/
 #endif /* MQTT_H_ */
 /*---------------------------------------------------------------------------*/
@@ -79,6 +79,13 @@
 #define MAX_OBJECTS 10
 #endif /* LWM2M_ENGINE_CONF_MAX_OBJECTS */
 
+/* Largest TLV a callback resource may produce when reading an instance */
+#ifdef LWM2M_ENGINE_CONF_TLV_BUFFER_SIZE
+#define TLV_BUFFER_SIZE LWM2M_ENGINE_CONF_TLV_BUFFER_SIZE
+#else /* LWM2M_ENGINE_CONF_TLV_BUFFER_SIZE */
+#define TLV_BUFFER_SIZE 64
+#endif /* LWM2M_ENGINE_CONF_TLV_BUFFER_SIZE */
+
 #define REMOTE_PORT        UIP_HTONS(COAP_DEFAULT_PORT)
 #define BS_REMOTE_PORT     UIP_HTONS(5685)
 
@@ -743,6 +750,256 @@ write_rd_json_data(const lwm2m_context_t *context,
   return rdlen;
 }
 /*---------------------------------------------------------------------------*/
+/* One block of a TLV payload that may be larger than the block */
+struct tlv_block {
+  uint8_t *buffer;
+  size_t size;
+  size_t len;
+  /* Where the next TLV starts in the whole payload */
+  uint32_t pos;
+  /* Where the block starts in the whole payload */
+  uint32_t offset;
+};
+
+/* For TLVs cut by a block boundary, and what callbacks write themselves */
+static uint8_t tlv_buffer[TLV_BUFFER_SIZE];
+/* The block that tlv_block_writer adds to */
+static struct tlv_block *writer_block;
+/*---------------------------------------------------------------------------*/
+/* Adds the part of data that falls within the block */
+static void
+tlv_block_add(struct tlv_block *b, const uint8_t *data, size_t len)
+{
+  size_t skip;
+  size_t n;
+
+  if(b->pos + len > b->offset && b->len < b->size) {
+    skip = b->pos < b->offset ? b->offset - b->pos : 0;
+    n = MIN(len - skip, b->size - b->len);
+    memcpy(&b->buffer[b->len], &data[skip], n);
+    b->len += n;
+  }
+  b->pos += len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tlv_block_fits(const struct tlv_block *b, size_t len)
+{
+  return b->pos >= b->offset && b->len + len <= b->size;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The writer that callback resources get when an instance is read. What
+ * they write goes to writer_block instead of the buffer they pass, so
+ * their TLVs may be of any size and are the same in every block.
+ */
+static size_t
+block_write_int(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                int32_t value)
+{
+  uint8_t tlv[8];
+  size_t len;
+
+  len = oma_tlv_write_int32(ctx->resource_id, value, tlv, sizeof(tlv));
+  tlv_block_add(writer_block, tlv, len);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+block_write_string(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                   const char *value, size_t stringlen)
+{
+  oma_tlv_t tlv;
+  uint8_t header[8];
+  size_t hlen;
+
+  tlv.type = OMA_TLV_TYPE_RESOURCE;
+  tlv.id = ctx->resource_id;
+  tlv.length = (uint32_t)stringlen;
+  tlv.value = (const uint8_t *)value;
+  hlen = oma_tlv_write_header(&tlv, header, sizeof(header));
+  tlv_block_add(writer_block, header, hlen);
+  tlv_block_add(writer_block, tlv.value, tlv.length);
+  return hlen + tlv.length;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+block_write_float32fix(const lwm2m_context_t *ctx, uint8_t *outbuf,
+                       size_t outlen, int32_t value, int bits)
+{
+  uint8_t tlv[8];
+  size_t len;
+
+  len = oma_tlv_write_float32(ctx->resource_id, value, bits, tlv, sizeof(tlv));
+  tlv_block_add(writer_block, tlv, len);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+block_write_boolean(const lwm2m_context_t *ctx, uint8_t *outbuf,
+                    size_t outlen, int value)
+{
+  return block_write_int(ctx, outbuf, outlen, value != 0);
+}
+/*---------------------------------------------------------------------------*/
+static const lwm2m_writer_t tlv_block_writer = {
+  block_write_int,
+  block_write_string,
+  block_write_float32fix,
+  block_write_boolean
+};
+/*---------------------------------------------------------------------------*/
+/* Returns 0 if the TLV of a callback resource could not be produced */
+static int
+write_resource_tlv(lwm2m_context_t *context, const lwm2m_resource_t *resource,
+                   struct tlv_block *b)
+{
+  oma_tlv_t tlv;
+  size_t len = 0;
+  uint32_t pos;
+  int32_t value;
+  int boolean;
+  int hlen;
+  int n;
+
+  if(lwm2m_object_is_resource_string(resource)) {
+    tlv.type = OMA_TLV_TYPE_RESOURCE;
+    tlv.id = resource->id;
+    tlv.value = lwm2m_object_get_resource_string(resource, context);
+    tlv.length = lwm2m_object_get_resource_strlen(resource, context);
+    if(tlv.value == NULL) {
+      return 1;
+    }
+    if(tlv_block_fits(b, oma_tlv_get_size(&tlv))) {
+      len = oma_tlv_write(&tlv, &b->buffer[b->len], b->size - b->len);
+      b->len += len;
+      b->pos += len;
+    } else {
+      /* Strings may be long, so the value is not copied in between */
+      hlen = oma_tlv_write_header(&tlv, tlv_buffer, sizeof(tlv_buffer));
+      tlv_block_add(b, tlv_buffer, hlen);
+      tlv_block_add(b, tlv.value, tlv.length);
+    }
+    return 1;
+  }
+
+  if(lwm2m_object_is_resource_callback(resource)) {
+    if(resource->value.callback.read == NULL) {
+      return 1;
+    }
+    /* Called once in every block, wherever its TLV falls */
+    pos = b->pos;
+    writer_block = b;
+    n = resource->value.callback.read(context, tlv_buffer, sizeof(tlv_buffer));
+    writer_block = NULL;
+    if(n <= 0) {
+      /* Failed, or did not fit in tlv_buffer without the writer */
+      return 0;
+    }
+    if(b->pos == pos) {
+      /* Written to tlv_buffer without the writer */
+      tlv_block_add(b, tlv_buffer, n);
+    }
+    return 1;
+  }
+
+  /* Integers, floats and booleans make at most 7 bytes */
+  if(b->pos >= b->offset && b->size - b->len >= 7) {
+    len = b->size - b->len;
+    if(lwm2m_object_is_resource_int(resource)) {
+      if(lwm2m_object_get_resource_int(resource, context, &value)) {
+        len = oma_tlv_write_int32(resource->id, value, &b->buffer[b->len], len);
+      } else {
+        len = 0;
+      }
+    } else if(lwm2m_object_is_resource_floatfix(resource)) {
+      if(lwm2m_object_get_resource_floatfix(resource, context, &value)) {
+        len = oma_tlv_write_float32(resource->id, value, LWM2M_FLOAT32_BITS,
+                                    &b->buffer[b->len], len);
+      } else {
+        len = 0;
+      }
+    } else if(lwm2m_object_is_resource_boolean(resource)) {
+      if(lwm2m_object_get_resource_boolean(resource, context, &boolean)) {
+        len = oma_tlv_write_int32(resource->id, boolean != 0,
+                                  &b->buffer[b->len], len);
+      } else {
+        len = 0;
+      }
+    } else {
+      len = 0;
+    }
+    b->len += len;
+    b->pos += len;
+    return 1;
+  }
+
+  if(lwm2m_object_is_resource_int(resource)) {
+    if(lwm2m_object_get_resource_int(resource, context, &value)) {
+      len = oma_tlv_write_int32(resource->id, value, tlv_buffer,
+                                sizeof(tlv_buffer));
+    }
+  } else if(lwm2m_object_is_resource_floatfix(resource)) {
+    if(lwm2m_object_get_resource_floatfix(resource, context, &value)) {
+      len = oma_tlv_write_float32(resource->id, value, LWM2M_FLOAT32_BITS,
+                                  tlv_buffer, sizeof(tlv_buffer));
+    }
+  } else if(lwm2m_object_is_resource_boolean(resource)) {
+    if(lwm2m_object_get_resource_boolean(resource, context, &boolean)) {
+      len = oma_tlv_write_int32(resource->id, boolean != 0, tlv_buffer,
+                                sizeof(tlv_buffer));
+    }
+  }
+  tlv_block_add(b, tlv_buffer, len);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * @brief  Write all resources of an instance as TLV, in one pass
+ *
+ * The TLVs go straight into the response buffer. When they do not fit,
+ * the block starting at *offset is written and *offset is moved to the
+ * next block, or set to -1 for the last one. *offset is left as it is
+ * when it is past the end.
+ *
+ * @return The length of the block, or -1 if a callback resource failed
+ */
+static int
+write_instance_tlv(lwm2m_context_t *context, const lwm2m_instance_t *instance,
+                   uint8_t *buffer, size_t size, int32_t *offset)
+{
+  struct tlv_block b;
+  int i;
+
+  b.buffer = buffer;
+  b.size = size;
+  b.len = 0;
+  b.pos = 0;
+  b.offset = *offset;
+
+  context->writer = &tlv_block_writer;
+  for(i = 0; i < instance->count; i++) {
+    context->resource_id = instance->resources[i].id;
+    context->resource_index = i;
+    if(!write_resource_tlv(context, &instance->resources[i], &b)) {
+      PRINTF("Failed to write TLV of resource %u\n",
+             instance->resources[i].id);
+      return -1;
+    }
+    if(b.pos > b.offset + b.size) {
+      /* There is more after this block */
+      break;
+    }
+  }
+
+  if(b.pos > b.offset + b.len) {
+    *offset += b.len;
+  } else if(b.offset > 0 && b.len > 0) {
+    *offset = -1;
+  }
+  return b.len;
+}
+/*---------------------------------------------------------------------------*/
 /**
  * @brief  Set the writer pointer to the proper writer based on the Accept: header
  *
@@ -1023,10 +1280,17 @@ lwm2m_engine_handler(const lwm2m_object_t *object,
           content_len = context.writer->write_float32fix(&context, buffer,
             preferred_size, value, LWM2M_FLOAT32_BITS);
         }
+      } else if(lwm2m_object_is_resource_boolean(resource)) {
+        int value;
+        if(lwm2m_object_get_resource_boolean(resource, &context, &value)) {
+          content_len = context.writer->write_boolean(&context, buffer,
+                                                      preferred_size, value);
+        }
       } else if(lwm2m_object_is_resource_callback(resource)) {
         if(resource->value.callback.read != NULL) {
-          content_len = resource->value.callback.read(&context,
+          int len = resource->value.callback.read(&context,
                                                  buffer, preferred_size);
+          content_len = len > 0 ? len : 0;
         } else {
           REST.set_response_status(response, METHOD_NOT_ALLOWED_4_05);
           return;
@@ -1067,7 +1331,22 @@ lwm2m_engine_handler(const lwm2m_object_t *object,
       REST.set_response_status(response, NOT_FOUND_4_04);
     } else {
       int rdlen;
-      if(accept == APPLICATION_LINK_FORMAT) {
+      if(accept == LWM2M_TLV) {
+        rdlen = write_instance_tlv(&context, instance,
+                                   buffer, preferred_size, offset);
+        if(rdlen < 0) {
+          REST.set_response_status(response, INTERNAL_SERVER_ERROR_5_00);
+          return;
+        }
+        if(rdlen == 0 && *offset > 0) {
+          /* The block is past the end */
+          REST.set_response_status(response, BAD_OPTION_4_02);
+          return;
+        }
+        REST.set_response_payload(response, buffer, rdlen);
+        REST.set_header_content_type(response, LWM2M_TLV);
+        return;
+      } else if(accept == APPLICATION_LINK_FORMAT) {
         rdlen = write_rd_link_data(object, instance,
                                    (char *)buffer, preferred_size);
       } else {
@@ -74,6 +74,9 @@ size_t oma_tlv_read(oma_tlv_t *tlv, const uint8_t *buffer, size_t len);
 /* write a TLV to the buffer */
 size_t oma_tlv_write(const oma_tlv_t *tlv, uint8_t *buffer, size_t len);
 
+/* write only the type, id and length of a TLV to the buffer */
+size_t oma_tlv_write_header(const oma_tlv_t *tlv, uint8_t *buffer, size_t len);
+
 int32_t oma_tlv_get_int32(const oma_tlv_t *tlv);
 
 /* write a int as a TLV to the buffer */
@@ -59,6 +59,140 @@ PROCESS(rest_engine_process, "REST Engine");
 LIST(restful_services);
 LIST(restful_periodic_services);
 /*---------------------------------------------------------------------------*/
+#if REST_ENGINE_INDEX_SIZE
+#if REST_ENGINE_INDEX_SIZE & (REST_ENGINE_INDEX_SIZE - 1)
+#error "REST_ENGINE_CONF_INDEX_SIZE must be a power of two"
+#endif
+
+/*
+ * Open addressing hash table over the full URL of every activated resource.
+ * A request is looked up once for its whole URL and once for each prefix
+ * ending before a '/', which is where a HAS_SUB_RESOURCES parent may match.
+ * Resources sharing a URL all get an entry; the one activated first wins, as
+ * with the list walk.
+ */
+struct index_entry {
+  resource_t *resource;
+  uint16_t url_len;
+  uint16_t order;
+};
+
+static struct index_entry url_index[REST_ENGINE_INDEX_SIZE];
+static uint16_t index_count;
+/* More resources than the index can hold: walk the list instead */
+static uint8_t index_full;
+
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME  16777619UL
+/*---------------------------------------------------------------------------*/
+static uint32_t
+url_hash(uint32_t hash, const char *url, int len)
+{
+  while(len-- > 0) {
+    hash = (hash ^ (uint8_t)*url++) * FNV_PRIME;
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_add(resource_t *resource)
+{
+  uint16_t len;
+  uint16_t i;
+
+  if(index_full || index_count >= REST_ENGINE_INDEX_SIZE - 1) {
+    index_full = 1;
+    return;
+  }
+
+  len = strlen(resource->url);
+  i = url_hash(FNV_OFFSET, resource->url, len) & (REST_ENGINE_INDEX_SIZE - 1);
+  while(url_index[i].resource != NULL) {
+    i = (i + 1) & (REST_ENGINE_INDEX_SIZE - 1);
+  }
+  url_index[i].resource = resource;
+  url_index[i].url_len = len;
+  url_index[i].order = index_count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_rebuild(void)
+{
+  resource_t *resource;
+
+  memset(url_index, 0, sizeof(url_index));
+  index_count = 0;
+  index_full = 0;
+  for(resource = (resource_t *)list_head(restful_services);
+      resource; resource = resource->next) {
+    index_add(resource);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The earliest activated resource for url[0..len) or NULL; unless whole_url
+   is set, only parents with HAS_SUB_RESOURCES are considered. */
+static struct index_entry *
+index_lookup(const char *url, uint16_t len, uint32_t hash, uint8_t whole_url,
+             struct index_entry *best)
+{
+  struct index_entry *e;
+  uint16_t i;
+
+  i = hash & (REST_ENGINE_INDEX_SIZE - 1);
+  for(e = &url_index[i]; e->resource != NULL; e = &url_index[i]) {
+    if(e->url_len == len
+       && (whole_url || (e->resource->flags & HAS_SUB_RESOURCES))
+       && (best == NULL || e->order < best->order)
+       && strncmp(e->resource->url, url, len) == 0) {
+      best = e;
+    }
+    i = (i + 1) & (REST_ENGINE_INDEX_SIZE - 1);
+  }
+  return best;
+}
+#endif /* REST_ENGINE_INDEX_SIZE */
+/*---------------------------------------------------------------------------*/
+static resource_t *
+find_resource(const char *url, int url_len)
+{
+  resource_t *resource;
+  int res_url_len;
+
+#if REST_ENGINE_INDEX_SIZE
+  if(!index_full) {
+    struct index_entry *best = NULL;
+    uint32_t hash = FNV_OFFSET;
+    int i, start = 0;
+
+    for(i = 0; i < url_len; i++) {
+      if(url[i] == '/') {
+        hash = url_hash(hash, url + start, i - start);
+        best = index_lookup(url, i, hash, 0, best);
+        start = i;
+      }
+    }
+    hash = url_hash(hash, url + start, url_len - start);
+    best = index_lookup(url, url_len, hash, 1, best);
+    return best != NULL ? best->resource : NULL;
+  }
+#endif /* REST_ENGINE_INDEX_SIZE */
+
+  for(resource = (resource_t *)list_head(restful_services);
+      resource; resource = resource->next) {
+
+    /* if the web service handles that kind of requests and urls matches */
+    res_url_len = strlen(resource->url);
+    if((url_len == res_url_len
+        || (url_len > res_url_len
+            && (resource->flags & HAS_SUB_RESOURCES)
+            && url[res_url_len] == '/'))
+       && strncmp(resource->url, url, res_url_len) == 0) {
+      return resource;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 /*- REST Engine API ---------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
 /**
@@ -102,9 +236,28 @@ rest_init_engine(void)
 void
 rest_activate_resource(resource_t *resource, char *path)
 {
+#if REST_ENGINE_INDEX_SIZE
+  resource_t *r;
+
+  for(r = (resource_t *)list_head(restful_services); r; r = r->next) {
+    if(r == resource) {
+      break;
+    }
+  }
+#endif /* REST_ENGINE_INDEX_SIZE */
+
   resource->url = path;
   list_add(restful_services, resource);
 
+#if REST_ENGINE_INDEX_SIZE
+  if(r != NULL) {
+    /* Activated again: it has moved to the end of the list */
+    index_rebuild();
+  } else {
+    index_add(resource);
+  }
+#endif /* REST_ENGINE_INDEX_SIZE */
+
   PRINTF("Activating: %s\n", resource->url);
 
   /* Only add periodic resources with a periodic_handler and a period > 0. */
@@ -141,44 +294,34 @@ rest_invoke_restful_service(void *request, void *response, uint8_t *buffer,
 
   resource_t *resource = NULL;
   const char *url = NULL;
-  int url_len, res_url_len;
+  int url_len;
 
   url_len = REST.get_url(request, &url);
-  for(resource = (resource_t *)list_head(restful_services);
-      resource; resource = resource->next) {
+  resource = find_resource(url, url_len);
+  if(resource != NULL) {
+    found = 1;
+    rest_resource_flags_t method = REST.get_method_type(request);
 
-    /* if the web service handles that kind of requests and urls matches */
-    res_url_len = strlen(resource->url);
-    if((url_len == res_url_len
-        || (url_len > res_url_len
-            && (resource->flags & HAS_SUB_RESOURCES)
-            && url[res_url_len] == '/'))
-       && strncmp(resource->url, url, res_url_len) == 0) {
-      found = 1;
-      rest_resource_flags_t method = REST.get_method_type(request);
-
-      PRINTF("/%s, method %u, resource->flags %u\n", resource->url,
-             (uint16_t)method, resource->flags);
-
-      if((method & METHOD_GET) && resource->get_handler != NULL) {
-        /* call handler function */
-        resource->get_handler(request, response, buffer, buffer_size, offset);
-      } else if((method & METHOD_POST) && resource->post_handler != NULL) {
-        /* call handler function */
-        resource->post_handler(request, response, buffer, buffer_size,
+    PRINTF("/%s, method %u, resource->flags %u\n", resource->url,
+           (uint16_t)method, resource->flags);
+
+    if((method & METHOD_GET) && resource->get_handler != NULL) {
+      /* call handler function */
+      resource->get_handler(request, response, buffer, buffer_size, offset);
+    } else if((method & METHOD_POST) && resource->post_handler != NULL) {
+      /* call handler function */
+      resource->post_handler(request, response, buffer, buffer_size,
+                             offset);
+    } else if((method & METHOD_PUT) && resource->put_handler != NULL) {
+      /* call handler function */
+      resource->put_handler(request, response, buffer, buffer_size, offset);
+    } else if((method & METHOD_DELETE) && resource->delete_handler != NULL) {
+      /* call handler function */
+      resource->delete_handler(request, response, buffer, buffer_size,
                                offset);
-      } else if((method & METHOD_PUT) && resource->put_handler != NULL) {
-        /* call handler function */
-        resource->put_handler(request, response, buffer, buffer_size, offset);
-      } else if((method & METHOD_DELETE) && resource->delete_handler != NULL) {
-        /* call handler function */
-        resource->delete_handler(request, response, buffer, buffer_size,
-                                 offset);
-      } else {
-        allowed = 0;
-        REST.set_response_status(response, REST.status.METHOD_NOT_ALLOWED);
-      }
-      break;
+    } else {
+      allowed = 0;
+      REST.set_response_status(response, REST.status.METHOD_NOT_ALLOWED);
     }
   }
   if(!found) {
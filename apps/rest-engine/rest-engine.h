@@ -107,6 +107,17 @@ struct periodic_resource_s {
 };
 typedef struct periodic_resource_s periodic_resource_t;
 
+/*
+ * Size of the hash index that requests are dispatched through, in entries.
+ * Must be a power of two and should be about twice the number of activated
+ * resources. 0 disables the index and every request walks the resource list.
+ */
+#ifdef REST_ENGINE_CONF_INDEX_SIZE
+#define REST_ENGINE_INDEX_SIZE REST_ENGINE_CONF_INDEX_SIZE
+#else /* REST_ENGINE_CONF_INDEX_SIZE */
+#define REST_ENGINE_INDEX_SIZE 0
+#endif /* REST_ENGINE_CONF_INDEX_SIZE */
+
 /*
  * Macro to define a RESTful resource.
  * Resources are statically defined for the sake of efficiency and better memory management.
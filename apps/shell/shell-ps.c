@@ -53,15 +53,35 @@ SHELL_COMMAND(ps_command,
 PROCESS_THREAD(shell_ps_process, ev, data)
 {
   struct process *p;
+#if PROCESS_COUNTERS
+  struct process_queue_stats stats;
+  char buf[64];
+  int i;
+#endif /* PROCESS_COUNTERS */
   PROCESS_BEGIN();
 
   shell_output_str(&ps_command, "Processes:", "");
   for(p = PROCESS_LIST(); p != NULL; p = p->next) {
     char namebuf[30];
     strncpy(namebuf, PROCESS_NAME_STRING(p), sizeof(namebuf));
+#if PROCESS_COUNTERS
+    snprintf(buf, sizeof(buf), ": %lu events %lu polls %lu dropped",
+             p->nevents, p->npolls, p->ndropped);
+    shell_output_str(&ps_command, namebuf, buf);
+#else /* PROCESS_COUNTERS */
     shell_output_str(&ps_command, namebuf, "");
+#endif /* PROCESS_COUNTERS */
   }
 
+#if PROCESS_COUNTERS
+  for(i = 0; i < PROCESS_PRIORITIES; i++) {
+    process_queue_stats(i, &stats);
+    snprintf(buf, sizeof(buf), "Event queue %d: %u queued %u max %lu dropped",
+             i, stats.nevents, stats.maxevents, stats.dropped);
+    shell_output_str(&ps_command, buf, "");
+  }
+#endif /* PROCESS_COUNTERS */
+
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
@@ -84,6 +84,29 @@
 #define COFFEE_EXTENDED_WEAR_LEVELLING  1
 #endif
 
+/*
+ * Number of flash pages kept in RAM. Reads and writes of partial pages
+ * go through the cache; file data is written back when its page is
+ * evicted, when a file is closed and on cfs_coffee_flush(), so that
+ * many small writes to a page reach the flash as one. File data written
+ * since the last flush may thus reach the flash partly and in another
+ * order, and a power failure may leave a file with some of its latest
+ * writes and not others. File headers and log indices are written
+ * through once everything written before them is in flash, so they
+ * never refer to data that is not.
+ */
+#ifndef COFFEE_PAGE_CACHE_SIZE
+#define COFFEE_PAGE_CACHE_SIZE 0
+#endif
+
+/*
+ * Number of files whose first page is remembered by name, so that
+ * opening a file does not scan the file headers in flash.
+ */
+#ifndef COFFEE_NAME_INDEX_SIZE
+#define COFFEE_NAME_INDEX_SIZE 0
+#endif
+
 #if COFFEE_START & (COFFEE_SECTOR_SIZE - 1)
 #error COFFEE_START must point to the first byte in a sector.
 #endif
@@ -206,18 +229,217 @@ static struct file_desc coffee_fd_set[COFFEE_FD_SET_SIZE];
 static coffee_page_t next_free;
 static char gc_wait;
 
+#if COFFEE_PAGE_CACHE_SIZE > 0
+/* A flash page in the cache. The bytes from dirty_start up to dirty_end
+   have been written in the cache only. */
+struct cached_page {
+  coffee_page_t page;
+  uint16_t dirty_start;
+  uint16_t dirty_end;
+  uint16_t used;
+  uint8_t valid;
+  unsigned char data[COFFEE_PAGE_SIZE];
+};
+
+static struct cached_page page_cache[COFFEE_PAGE_CACHE_SIZE];
+static uint16_t cache_clock;
+
+#define FLASH_READ(buf, size, offset) \
+  cached_read((buf), (size), (offset))
+#define FLASH_WRITE(buf, size, offset) \
+  cached_write((buf), (size), (offset))
+#define FLASH_WRITE_THROUGH(buf, size, offset) \
+  ordered_write((buf), (size), (offset))
+#define FLASH_ERASE(sector) cached_erase(sector)
+#else
+#define FLASH_READ(buf, size, offset) COFFEE_READ(buf, size, offset)
+#define FLASH_WRITE(buf, size, offset) COFFEE_WRITE(buf, size, offset)
+#define FLASH_WRITE_THROUGH(buf, size, offset) COFFEE_WRITE(buf, size, offset)
+#define FLASH_ERASE(sector) COFFEE_ERASE(sector)
+#endif /* COFFEE_PAGE_CACHE_SIZE > 0 */
+
+#if COFFEE_NAME_INDEX_SIZE > 0
+/* Files are found by a hash of their name; the file header confirms
+   a match. The index is built by scanning the flash once, and is
+   partial if more files than COFFEE_NAME_INDEX_SIZE were found. */
+#define INDEX_UNKNOWN   0
+#define INDEX_COMPLETE  1
+#define INDEX_PARTIAL   2
+
+struct name_entry {
+  coffee_page_t page;
+  uint16_t hash;
+};
+
+static struct name_entry name_index[COFFEE_NAME_INDEX_SIZE];
+static uint16_t name_index_count;
+static uint8_t name_index_state;
+#endif /* COFFEE_NAME_INDEX_SIZE > 0 */
+
+/*---------------------------------------------------------------------------*/
+#if COFFEE_PAGE_CACHE_SIZE > 0
+static void
+write_back(struct cached_page *cp)
+{
+  if(cp->dirty_end > cp->dirty_start) {
+    COFFEE_WRITE(&cp->data[cp->dirty_start], cp->dirty_end - cp->dirty_start,
+                 cp->page * COFFEE_PAGE_SIZE + cp->dirty_start);
+    cp->dirty_start = cp->dirty_end = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static struct cached_page *
+find_cached_page(coffee_page_t page)
+{
+  int i;
+
+  for(i = 0; i < COFFEE_PAGE_CACHE_SIZE; i++) {
+    if(page_cache[i].valid && page_cache[i].page == page) {
+      page_cache[i].used = ++cache_clock;
+      return &page_cache[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct cached_page *
+load_cached_page(coffee_page_t page)
+{
+  struct cached_page *cp;
+  int i;
+
+  /* Take a free slot, or else the least recently used page */
+  cp = &page_cache[0];
+  for(i = 0; i < COFFEE_PAGE_CACHE_SIZE; i++) {
+    if(!page_cache[i].valid) {
+      cp = &page_cache[i];
+      break;
+    }
+    if((uint16_t)(cache_clock - page_cache[i].used) >
+       (uint16_t)(cache_clock - cp->used)) {
+      cp = &page_cache[i];
+    }
+  }
+
+  if(cp->valid) {
+    write_back(cp);
+  }
+  cp->valid = 1;
+  cp->page = page;
+  cp->used = ++cache_clock;
+  cp->dirty_start = cp->dirty_end = 0;
+  COFFEE_READ(cp->data, COFFEE_PAGE_SIZE, page * COFFEE_PAGE_SIZE);
+
+  return cp;
+}
+/*---------------------------------------------------------------------------*/
+static void
+cached_read(void *buf, cfs_offset_t size, cfs_offset_t offset)
+{
+  struct cached_page *cp;
+  cfs_offset_t start, n;
+
+  while(size > 0) {
+    start = offset % COFFEE_PAGE_SIZE;
+    n = COFFEE_PAGE_SIZE - start;
+    if(n > size) {
+      n = size;
+    }
+
+    cp = find_cached_page(offset / COFFEE_PAGE_SIZE);
+    if(cp != NULL) {
+      memcpy(buf, &cp->data[start], n);
+    } else if(n == COFFEE_PAGE_SIZE) {
+      /* Whole pages are read past the cache */
+      COFFEE_READ(buf, n, offset);
+    } else {
+      cp = load_cached_page(offset / COFFEE_PAGE_SIZE);
+      memcpy(buf, &cp->data[start], n);
+    }
+
+    buf = (char *)buf + n;
+    offset += n;
+    size -= n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+cached_write(const void *buf, cfs_offset_t size, cfs_offset_t offset)
+{
+  struct cached_page *cp;
+  cfs_offset_t start, n;
+
+  while(size > 0) {
+    start = offset % COFFEE_PAGE_SIZE;
+    n = COFFEE_PAGE_SIZE - start;
+    if(n > size) {
+      n = size;
+    }
+
+    cp = find_cached_page(offset / COFFEE_PAGE_SIZE);
+    if(cp == NULL && n == COFFEE_PAGE_SIZE) {
+      /* Whole pages are written past the cache */
+      COFFEE_WRITE(buf, n, offset);
+    } else {
+      if(cp == NULL) {
+        cp = load_cached_page(offset / COFFEE_PAGE_SIZE);
+      }
+      memcpy(&cp->data[start], buf, n);
+      if(cp->dirty_end == cp->dirty_start) {
+        cp->dirty_start = start;
+        cp->dirty_end = start + n;
+      } else {
+        if(start < cp->dirty_start) {
+          cp->dirty_start = start;
+        }
+        if(start + n > cp->dirty_end) {
+          cp->dirty_end = start + n;
+        }
+      }
+    }
+
+    buf = (const char *)buf + n;
+    offset += n;
+    size -= n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Writes metadata to the flash after all earlier writes */
+static void
+ordered_write(const void *buf, cfs_offset_t size, cfs_offset_t offset)
+{
+  cfs_coffee_flush();
+  cached_write(buf, size, offset);
+  cfs_coffee_flush();
+}
+/*---------------------------------------------------------------------------*/
+static void
+cached_erase(coffee_page_t sector)
+{
+  int i;
+
+  /* Whatever is cached from the sector is erased with it */
+  for(i = 0; i < COFFEE_PAGE_CACHE_SIZE; i++) {
+    if(page_cache[i].valid &&
+       page_cache[i].page / COFFEE_PAGES_PER_SECTOR == sector) {
+      page_cache[i].valid = 0;
+    }
+  }
+  COFFEE_ERASE(sector);
+}
+#endif /* COFFEE_PAGE_CACHE_SIZE > 0 */
 /*---------------------------------------------------------------------------*/
 static void
 write_header(struct file_header *hdr, coffee_page_t page)
 {
   hdr->flags |= HDR_FLAG_VALID;
-  COFFEE_WRITE(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
+  FLASH_WRITE_THROUGH(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
 }
 /*---------------------------------------------------------------------------*/
 static void
 read_header(struct file_header *hdr, coffee_page_t page)
 {
-  COFFEE_READ(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
+  FLASH_READ(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
   if(DEBUG && HDR_ACTIVE(*hdr) && !HDR_VALID(*hdr)) {
     PRINTF("Coffee: Invalid header at page %u!\n", (unsigned)page);
   }
@@ -382,7 +604,7 @@ collect_garbage(int mode)
         isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
       }
 
-      COFFEE_ERASE(sector);
+      FLASH_ERASE(sector);
       PRINTF("Coffee: Erased sector %d!\n", sector);
 
       if(mode == GC_RELUCTANT && isolation_count > 0) {
@@ -452,6 +674,100 @@ load_file(coffee_page_t start, struct file_header *hdr)
   return file;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_NAME_INDEX_SIZE > 0
+static uint16_t
+name_hash(const char *name)
+{
+  uint16_t hash;
+
+  for(hash = 5381; *name != '\0'; name++) {
+    hash = (hash << 5) + hash + (unsigned char)*name;
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static void
+name_index_add(const char *name, coffee_page_t page)
+{
+  if(name_index_state == INDEX_UNKNOWN) {
+    /* The file will be found when the index is built */
+    return;
+  }
+  if(name_index_count == COFFEE_NAME_INDEX_SIZE) {
+    name_index_state = INDEX_PARTIAL;
+    return;
+  }
+  name_index[name_index_count].page = page;
+  name_index[name_index_count].hash = name_hash(name);
+  name_index_count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+name_index_remove(coffee_page_t page)
+{
+  int i;
+
+  for(i = 0; i < name_index_count; i++) {
+    if(name_index[i].page == page) {
+      name_index[i] = name_index[--name_index_count];
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Rebuild the index from the file headers, looking for name as well. */
+static coffee_page_t
+name_index_scan(const char *name, struct file_header *hdr)
+{
+  coffee_page_t page, found;
+
+  name_index_count = 0;
+  name_index_state = INDEX_COMPLETE;
+  found = INVALID_PAGE;
+
+  for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, hdr)) {
+    read_header(hdr, page);
+    if(HDR_ACTIVE(*hdr) && !HDR_LOG(*hdr)) {
+      name_index_add(hdr->name, page);
+      if(found == INVALID_PAGE && strcmp(name, hdr->name) == 0) {
+        found = page;
+      }
+    }
+  }
+
+  if(found != INVALID_PAGE) {
+    read_header(hdr, found);
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static coffee_page_t
+name_index_find(const char *name, struct file_header *hdr)
+{
+  uint16_t hash;
+  int i;
+
+  if(name_index_state != INDEX_UNKNOWN) {
+    hash = name_hash(name);
+    for(i = 0; i < name_index_count; i++) {
+      if(name_index[i].hash == hash) {
+        read_header(hdr, name_index[i].page);
+        if(HDR_ACTIVE(*hdr) && !HDR_LOG(*hdr) &&
+           strcmp(name, hdr->name) == 0) {
+          return name_index[i].page;
+        }
+      }
+    }
+    if(name_index_state == INDEX_COMPLETE) {
+      return INVALID_PAGE;
+    }
+  }
+
+  /* Not indexed, or some files did not fit in the index */
+  return name_index_scan(name, hdr);
+}
+#endif /* COFFEE_NAME_INDEX_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
 static struct file *
 find_file(const char *name)
 {
@@ -459,6 +775,19 @@ find_file(const char *name)
   struct file_header hdr;
   coffee_page_t page;
 
+#if COFFEE_NAME_INDEX_SIZE > 0
+  page = name_index_find(name, &hdr);
+  if(page == INVALID_PAGE) {
+    return NULL;
+  }
+
+  for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
+    if(!FILE_FREE(&coffee_files[i]) && coffee_files[i].page == page) {
+      return &coffee_files[i];
+    }
+  }
+  return load_file(page, &hdr);
+#else
   /* First check if the file metadata is cached. */
   for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
     if(FILE_FREE(&coffee_files[i])) {
@@ -480,6 +809,7 @@ find_file(const char *name)
   }
 
   return NULL;
+#endif /* COFFEE_NAME_INDEX_SIZE > 0 */
 }
 /*---------------------------------------------------------------------------*/
 static cfs_offset_t
@@ -501,7 +831,7 @@ file_end(coffee_page_t start)
    */
 
   for(page = hdr.max_pages - 1; page >= 0; page--) {
-    COFFEE_READ(buf, sizeof(buf), (start + page) * COFFEE_PAGE_SIZE);
+    FLASH_READ(buf, sizeof(buf), (start + page) * COFFEE_PAGE_SIZE);
     for(i = COFFEE_PAGE_SIZE - 1; i >= 0; i--) {
       if(buf[i] != 0) {
         if(page == 0 && i < sizeof(hdr)) {
@@ -572,6 +902,9 @@ remove_by_page(coffee_page_t page, int remove_log,
 
   hdr.flags |= HDR_FLAG_OBSOLETE;
   write_header(&hdr, page);
+#if COFFEE_NAME_INDEX_SIZE > 0
+  name_index_remove(page);
+#endif
 
   gc_wait = 0;
 
@@ -636,6 +969,11 @@ reserve(const char *name, coffee_page_t pages,
   hdr.max_pages = pages;
   hdr.flags = HDR_FLAG_ALLOCATED | flags;
   write_header(&hdr, page);
+#if COFFEE_NAME_INDEX_SIZE > 0
+  if(!HDR_LOG(hdr)) {
+    name_index_add(hdr.name, page);
+  }
+#endif
 
   PRINTF("Coffee: Reserved %u pages starting from %u for file %s\n",
          (unsigned)pages, (unsigned)page, name);
@@ -703,7 +1041,7 @@ get_record_index(coffee_page_t log_page, uint16_t search_records,
       }
 
       base -= batch_size * sizeof(indices[0]);
-      COFFEE_READ(&indices, sizeof(indices[0]) * batch_size, base);
+      FLASH_READ(&indices, sizeof(indices[0]) * batch_size, base);
 
       for(i = batch_size - 1; i >= 0; i--) {
         if(indices[i] - 1 == region) {
@@ -744,7 +1082,7 @@ read_log_page(struct file_header *hdr, int16_t record_count,
   base = absolute_offset(hdr->log_page, log_records * sizeof(region));
   base += (cfs_offset_t)match_index * log_record_size;
   base += lp->offset;
-  COFFEE_READ(lp->buf, lp->size, base);
+  FLASH_READ(lp->buf, lp->size, base);
 
   return lp->size;
 }
@@ -814,7 +1152,7 @@ merge_log(coffee_page_t file_page, int extend)
       cfs_close(fd);
       return -1;
     } else if(n > 0) {
-      COFFEE_WRITE(buf, n, absolute_offset(new_file->page, offset));
+      FLASH_WRITE(buf, n, absolute_offset(new_file->page, offset));
       offset += n;
     }
   } while(n != 0);
@@ -871,7 +1209,7 @@ find_next_record(struct file *file, coffee_page_t log_page,
       batch_size = log_records - processed >= preferred_batch_size ?
         preferred_batch_size : log_records - processed;
 
-      COFFEE_READ(&indices, batch_size * sizeof(indices[0]),
+      FLASH_READ(&indices, batch_size * sizeof(indices[0]),
                   absolute_offset(log_page, processed * sizeof(indices[0])));
       for(log_record = 0; log_record < batch_size; log_record++) {
         if(indices[log_record] == 0) {
@@ -935,24 +1273,25 @@ write_log_page(struct file *file, struct log_param *lp)
 
     if((lp->offset > 0 || lp->size != log_record_size) &&
        read_log_page(&hdr, log_record, &lp_out) < 0) {
-      COFFEE_READ(copy_buf, sizeof(copy_buf),
+      FLASH_READ(copy_buf, sizeof(copy_buf),
                   absolute_offset(file->page, offset));
     }
 
     memcpy(&copy_buf[lp->offset], lp->buf, lp->size);
 
+    offset = absolute_offset(log_page, 0);
+    FLASH_WRITE(copy_buf, sizeof(copy_buf),
+                 offset + log_records * sizeof(region) +
+                 log_record * log_record_size);
+
     /*
-     * Write the region number in the region index table.
+     * Write the region number in the region index table, after the
+     * record that it refers to.
      * The region number is incremented to avoid values of zero.
      */
-    offset = absolute_offset(log_page, 0);
     ++region;
-    COFFEE_WRITE(&region, sizeof(region),
-                 offset + log_record * sizeof(region));
-
-    offset += log_records * sizeof(region);
-    COFFEE_WRITE(copy_buf, sizeof(copy_buf),
-                 offset + log_record * log_record_size);
+    FLASH_WRITE_THROUGH(&region, sizeof(region),
+                        offset + log_record * sizeof(region));
     file->record_count = log_record + 1;
   }
 
@@ -1017,6 +1356,7 @@ cfs_close(int fd)
     coffee_fd_set[fd].flags = COFFEE_FD_FREE;
     coffee_fd_set[fd].file->references--;
     coffee_fd_set[fd].file = NULL;
+    cfs_coffee_flush();
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -1105,7 +1445,7 @@ cfs_read(int fd, void *buf, unsigned size)
 
   /* If the file is not modified, read directly from the file extent. */
   if(!FILE_MODIFIED(file)) {
-    COFFEE_READ(buf, size, absolute_offset(file->page, fdp->offset));
+    FLASH_READ(buf, size, absolute_offset(file->page, fdp->offset));
     fdp->offset += size;
     return size;
   }
@@ -1126,7 +1466,7 @@ cfs_read(int fd, void *buf, unsigned size)
 
     /* Read from the original file if we cannot find the data in the log. */
     if(r < 0) {
-      COFFEE_READ(buf, lp.size, absolute_offset(file->page, fdp->offset));
+      FLASH_READ(buf, lp.size, absolute_offset(file->page, fdp->offset));
       r = lp.size;
     }
     fdp->offset += r;
@@ -1209,7 +1549,7 @@ cfs_write(int fd, const void *buf, unsigned size)
        * corresponding end offset in the original extent to ensure that
        * the correct file size is calculated when opening the file again.
        */
-      COFFEE_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset - 1));
+      FLASH_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset - 1));
     }
   } else {
 #endif /* COFFEE_MICRO_LOGS */
@@ -1217,7 +1557,7 @@ cfs_write(int fd, const void *buf, unsigned size)
       return -1;
     }
 
-    COFFEE_WRITE(buf, size, absolute_offset(file->page, fdp->offset));
+    FLASH_WRITE(buf, size, absolute_offset(file->page, fdp->offset));
     fdp->offset += size;
 #if COFFEE_MICRO_LOGS
   }
@@ -1321,6 +1661,20 @@ cfs_coffee_set_io_semantics(int fd, unsigned flags)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+void
+cfs_coffee_flush(void)
+{
+#if COFFEE_PAGE_CACHE_SIZE > 0
+  int i;
+
+  for(i = 0; i < COFFEE_PAGE_CACHE_SIZE; i++) {
+    if(page_cache[i].valid) {
+      write_back(&page_cache[i]);
+    }
+  }
+#endif /* COFFEE_PAGE_CACHE_SIZE > 0 */
+}
+/*---------------------------------------------------------------------------*/
 int
 cfs_coffee_format(void)
 {
@@ -1329,7 +1683,7 @@ cfs_coffee_format(void)
   PRINTF("Coffee: Formatting %u sectors", (unsigned)COFFEE_SECTOR_COUNT);
 
   for(i = 0; i < COFFEE_SECTOR_COUNT; i++) {
-    COFFEE_ERASE(i);
+    FLASH_ERASE(i);
     PRINTF(".");
   }
 
@@ -1338,6 +1692,10 @@ cfs_coffee_format(void)
   memset(&coffee_fd_set, 0, sizeof(coffee_fd_set));
   next_free = 0;
   gc_wait = 1;
+#if COFFEE_NAME_INDEX_SIZE > 0
+  name_index_count = 0;
+  name_index_state = INDEX_COMPLETE;
+#endif
 
   PRINTF(" done!\n");
 
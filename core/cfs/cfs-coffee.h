@@ -125,6 +125,16 @@ int cfs_coffee_configure_log(const char *file, unsigned log_size,
  */
 int cfs_coffee_set_io_semantics(int fd, unsigned flags);
 
+/**
+ * \brief Write the pages held in the page cache back to the storage.
+ *
+ * With COFFEE_PAGE_CACHE_SIZE set, writes can stay in RAM until their
+ * page is evicted from the cache or a file is closed. Call this function
+ * to be sure that everything written so far is in the storage, e.g.
+ * before going into a deep sleep.
+ */
+void cfs_coffee_flush(void);
+
 /**
  * \brief Format the storage area assigned to Coffee.
  * \return 0 on success, -1 on failure.
@@ -75,6 +75,17 @@ MEMB(routememb, uip_ds6_route_t, UIP_DS6_ROUTE_NB);
 static int num_routes = 0;
 static void rm_routelist_callback(nbr_table_item_t *ptr);
 
+#if UIP_DS6_ROUTE_HASH_SIZE
+/* Routes are also chained into hash buckets by prefix and prefix
+   length. For each prefix length we count the routes that have it,
+   and keep a bitmap of the lengths that are in use, so that a lookup
+   only probes the lengths that can match, longest first. */
+static uip_ds6_route_t *route_hash[UIP_DS6_ROUTE_HASH_SIZE];
+static uint16_t length_routes[129];
+static uint8_t length_map[17];
+static uint32_t lookup_count;
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
+
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
 
 /* Default routes are held on the defaultrouterlist and their
@@ -162,6 +173,11 @@ uip_ds6_route_init(void)
 #if (UIP_CONF_MAX_ROUTES != 0)
   memb_init(&routememb);
   list_init(routelist);
+#if UIP_DS6_ROUTE_HASH_SIZE
+  memset(route_hash, 0, sizeof(route_hash));
+  memset(length_routes, 0, sizeof(length_routes));
+  memset(length_map, 0, sizeof(length_map));
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
@@ -174,6 +190,99 @@ uip_ds6_route_init(void)
 #endif
 }
 #if (UIP_CONF_MAX_ROUTES != 0)
+#if UIP_DS6_ROUTE_HASH_SIZE
+/*---------------------------------------------------------------------------*/
+static uint16_t
+route_hash_index(const uip_ipaddr_t *addr, uint8_t length)
+{
+  uint32_t h;
+  uint8_t i;
+
+  /* FNV-1a over the bytes that uip_ipaddr_prefixcmp() compares */
+  h = 2166136261UL ^ length;
+  for(i = 0; i < (length >> 3); i++) {
+    h = (h ^ addr->u8[i]) * 16777619UL;
+  }
+  return h % UIP_DS6_ROUTE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_hash_add(uip_ds6_route_t *r)
+{
+  uint16_t h;
+
+  h = route_hash_index(&r->ipaddr, r->length);
+  r->hash_next = route_hash[h];
+  route_hash[h] = r;
+  if(length_routes[r->length]++ == 0) {
+    length_map[r->length >> 3] |= 1 << (r->length & 7);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_hash_rm(uip_ds6_route_t *r)
+{
+  uip_ds6_route_t **rp;
+
+  for(rp = &route_hash[route_hash_index(&r->ipaddr, r->length)];
+      *rp != NULL;
+      rp = &(*rp)->hash_next) {
+    if(*rp == r) {
+      *rp = r->hash_next;
+      if(--length_routes[r->length] == 0) {
+        length_map[r->length >> 3] &= ~(1 << (r->length & 7));
+      }
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+route_hash_lookup(const uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r;
+  int8_t i, bit;
+  uint8_t length;
+
+  for(i = sizeof(length_map) - 1; i >= 0; i--) {
+    if(length_map[i] == 0) {
+      continue;
+    }
+    for(bit = 7; bit >= 0; bit--) {
+      if((length_map[i] & (1 << bit)) == 0) {
+        continue;
+      }
+      length = (i << 3) + bit;
+      for(r = route_hash[route_hash_index(addr, length)];
+          r != NULL;
+          r = r->hash_next) {
+        if(r->length == length &&
+           uip_ipaddr_prefixcmp(addr, &r->ipaddr, length)) {
+          return r;
+        }
+      }
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+static uip_ds6_route_t *
+least_recently_used(void)
+{
+  uip_ds6_route_t *r, *oldest;
+
+  oldest = NULL;
+  for(r = list_head(routelist); r != NULL; r = list_item_next(r)) {
+    if(oldest == NULL ||
+       lookup_count - r->last_used > lookup_count - oldest->last_used) {
+      oldest = r;
+    }
+  }
+  return oldest;
+}
+#endif /* UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED */
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 /*---------------------------------------------------------------------------*/
 static uip_lladdr_t *
 uip_ds6_route_nexthop_lladdr(uip_ds6_route_t *route)
@@ -254,15 +363,23 @@ uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
 #if (UIP_CONF_MAX_ROUTES != 0)
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
+#if !UIP_DS6_ROUTE_HASH_SIZE
+  uip_ds6_route_t *r;
   uint8_t longestmatch;
+#endif /* !UIP_DS6_ROUTE_HASH_SIZE */
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n");
 
 
+#if UIP_DS6_ROUTE_HASH_SIZE
+  found_route = route_hash_lookup(addr);
+  if(found_route != NULL) {
+    found_route->last_used = ++lookup_count;
+  }
+#else /* UIP_DS6_ROUTE_HASH_SIZE */
   found_route = NULL;
   longestmatch = 0;
   for(r = uip_ds6_route_head();
@@ -278,6 +395,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       }
     }
   }
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -289,6 +407,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     PRINTF("uip-ds6-route: No route found\n");
   }
 
+#if !UIP_DS6_ROUTE_HASH_SIZE
   if(found_route != NULL && found_route != list_head(routelist)) {
     /* If we found a route, we put it at the start of the routeslist
        list. The list is ordered by how recently we looked them up:
@@ -298,6 +417,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     list_remove(routelist, found_route);
     list_push(routelist, found_route);
   }
+#endif /* !UIP_DS6_ROUTE_HASH_SIZE */
 
   return found_route;
 #else /* (UIP_CONF_MAX_ROUTES != 0) */
@@ -317,6 +437,11 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
   assert_nbr_routes_list_sane();
 #endif /* DEBUG != DEBUG_NONE */
 
+  if(length > 128) {
+    PRINTF("uip_ds6_route_add: invalid prefix length %u\n", length);
+    return NULL;
+  }
+
   /* Get link-layer address of next hop, make sure it is in neighbor table */
   const uip_lladdr_t *nexthop_lladdr = uip_ds6_nbr_lladdr_from_ipaddr(nexthop);
   if(nexthop_lladdr == NULL) {
@@ -355,7 +480,11 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 #if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
       /* Removing the oldest route entry from the route table. The
          least recently used route is the first route on the list. */
+#if UIP_DS6_ROUTE_HASH_SIZE
+      oldest = least_recently_used();
+#else /* UIP_DS6_ROUTE_HASH_SIZE */
       oldest = list_tail(routelist);
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 #endif
       if(oldest == NULL) {
         return NULL;
@@ -436,6 +565,10 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+#if UIP_DS6_ROUTE_HASH_SIZE
+  r->last_used = lookup_count;
+  route_hash_add(r);
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -479,6 +612,9 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
 
     /* Remove the route from the route list */
     list_remove(routelist, route);
+#if UIP_DS6_ROUTE_HASH_SIZE
+    route_hash_rm(route);
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
@@ -88,6 +88,17 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB 4
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/* Number of buckets in the route hash index. With the index, a route
+   lookup takes one hash probe per distinct prefix length in the table
+   instead of a walk over all routes, which is what makes large
+   routing tables (non-storing roots, storing-mode border routers)
+   affordable. 0 (the default) disables the index. */
+#ifdef UIP_DS6_ROUTE_CONF_HASH_SIZE
+#define UIP_DS6_ROUTE_HASH_SIZE UIP_DS6_ROUTE_CONF_HASH_SIZE
+#else /* UIP_DS6_ROUTE_CONF_HASH_SIZE */
+#define UIP_DS6_ROUTE_HASH_SIZE 0
+#endif /* UIP_DS6_ROUTE_CONF_HASH_SIZE */
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -157,6 +168,13 @@ typedef struct uip_ds6_route {
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   UIP_DS6_ROUTE_STATE_TYPE state;
 #endif
+#if UIP_DS6_ROUTE_HASH_SIZE
+  /* Next route in the same hash bucket */
+  struct uip_ds6_route *hash_next;
+  /* Lookup count at the last use of the route. The route list is not
+     kept in most recently used order when the hash index is used. */
+  uint32_t last_used;
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
   uint8_t length;
 } uip_ds6_route_t;
 
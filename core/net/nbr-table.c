@@ -83,6 +83,17 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+#if NBR_TABLE_HASH_SIZE
+#if NBR_TABLE_HASH_SIZE <= NBR_TABLE_MAX_NEIGHBORS || \
+  (NBR_TABLE_HASH_SIZE & (NBR_TABLE_HASH_SIZE - 1)) != 0
+#error NBR_TABLE_CONF_HASH_SIZE must be a power of two larger than NBR_TABLE_CONF_MAX_NEIGHBORS
+#endif
+/* Linear probing hash index over the addresses on nbr_table_keys. A
+   slot holds the neighbor index plus one, or 0 when it is empty. */
+static uint16_t hash_slots[NBR_TABLE_HASH_SIZE];
+#define HASH_MASK (NBR_TABLE_HASH_SIZE - 1)
+#endif /* NBR_TABLE_HASH_SIZE */
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -125,17 +136,81 @@ key_from_item(nbr_table_t *table, const nbr_table_item_t *item)
 {
   return key_from_index(index_from_item(table, item));
 }
+#if NBR_TABLE_HASH_SIZE
+/*---------------------------------------------------------------------------*/
+/* Home slot of a link-layer address */
+static uint16_t
+hash_lladdr(const linkaddr_t *lladdr)
+{
+  uint32_t h = 2166136261UL;
+  int i;
+
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    h = (h ^ lladdr->u8[i]) * 16777619UL;
+  }
+  return (h ^ (h >> 16)) & HASH_MASK;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_add(int index)
+{
+  uint16_t i;
+
+  for(i = hash_lladdr(&key_from_index(index)->lladdr);
+      hash_slots[i] != 0;
+      i = (i + 1) & HASH_MASK);
+  hash_slots[i] = index + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_remove(int index)
+{
+  uint16_t i, j, home;
+
+  for(i = hash_lladdr(&key_from_index(index)->lladdr);
+      hash_slots[i] != index + 1;
+      i = (i + 1) & HASH_MASK) {
+    if(hash_slots[i] == 0) {
+      return;
+    }
+  }
+
+  /* Shift later entries of the probe sequence back into the hole, so
+     that no lookup stops early at it */
+  for(j = (i + 1) & HASH_MASK; hash_slots[j] != 0; j = (j + 1) & HASH_MASK) {
+    home = hash_lladdr(&key_from_index(hash_slots[j] - 1)->lladdr);
+    if(((j - home) & HASH_MASK) >= ((j - i) & HASH_MASK)) {
+      hash_slots[i] = hash_slots[j];
+      i = j;
+    }
+  }
+  hash_slots[i] = 0;
+}
+#endif /* NBR_TABLE_HASH_SIZE */
 /*---------------------------------------------------------------------------*/
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const linkaddr_t *lladdr)
 {
   nbr_table_key_t *key;
+#if NBR_TABLE_HASH_SIZE
+  uint16_t i;
+#endif /* NBR_TABLE_HASH_SIZE */
+
   /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
    * Only one such entry is possible at a time, indexed by linkaddr_null. */
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
   }
+#if NBR_TABLE_HASH_SIZE
+  for(i = hash_lladdr(lladdr); hash_slots[i] != 0; i = (i + 1) & HASH_MASK) {
+    key = key_from_index(hash_slots[i] - 1);
+    if(linkaddr_cmp(lladdr, &key->lladdr)) {
+      return hash_slots[i] - 1;
+    }
+  }
+  return -1;
+#else /* NBR_TABLE_HASH_SIZE */
   key = list_head(nbr_table_keys);
   while(key != NULL) {
     if(lladdr && linkaddr_cmp(lladdr, &key->lladdr)) {
@@ -144,6 +219,7 @@ index_from_lladdr(const linkaddr_t *lladdr)
     key = list_item_next(key);
   }
   return -1;
+#endif /* NBR_TABLE_HASH_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 /* Get bit from "used" or "locked" bitmap */
@@ -193,6 +269,9 @@ remove_key(nbr_table_key_t *least_used_key)
   }
   /* Empty used map */
   used_map[index_from_key(least_used_key)] = 0;
+#if NBR_TABLE_HASH_SIZE
+  hash_remove(index_from_key(least_used_key));
+#endif /* NBR_TABLE_HASH_SIZE */
   /* Remove neighbor from list */
   list_remove(nbr_table_keys, least_used_key);
 }
@@ -359,6 +438,9 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr, nbr_table_rea
 
     /* Set link-layer address */
     linkaddr_copy(&key->lladdr, lladdr);
+#if NBR_TABLE_HASH_SIZE
+    hash_add(index);
+#endif /* NBR_TABLE_HASH_SIZE */
   }
 
   /* Get item in the current table */
@@ -450,7 +532,13 @@ nbr_table_update_lladdr(const linkaddr_t *old_addr, const linkaddr_t *new_addr,
    * Copy the new lladdr into the key - since we know that there is no
    * conflicting entry.
    */
+#if NBR_TABLE_HASH_SIZE
+  hash_remove(index);
+#endif /* NBR_TABLE_HASH_SIZE */
   memcpy(&key->lladdr, new_addr, sizeof(linkaddr_t));
+#if NBR_TABLE_HASH_SIZE
+  hash_add(index);
+#endif /* NBR_TABLE_HASH_SIZE */
   return 1;
 }
 /*---------------------------------------------------------------------------*/
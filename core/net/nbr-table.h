@@ -46,6 +46,18 @@
 #define NBR_TABLE_MAX_NEIGHBORS 8
 #endif /* NBR_TABLE_CONF_MAX_NEIGHBORS */
 
+/* Number of slots in the open-addressing hash index over the neighbor
+   link-layer addresses. When set, looking up a neighbor by address is
+   O(1) instead of a scan over all neighbors, which matters for nodes
+   with many neighbors such as border routers. Must be a power of two
+   larger than NBR_TABLE_MAX_NEIGHBORS; 0 (the default) disables the
+   index. */
+#ifdef NBR_TABLE_CONF_HASH_SIZE
+#define NBR_TABLE_HASH_SIZE NBR_TABLE_CONF_HASH_SIZE
+#else /* NBR_TABLE_CONF_HASH_SIZE */
+#define NBR_TABLE_HASH_SIZE 0
+#endif /* NBR_TABLE_CONF_HASH_SIZE */
+
 /* An item in a neighbor table */
 typedef void nbr_table_item_t;
 
@@ -322,21 +322,130 @@ count_matching_bytes(const void *p1, const void *p2, size_t n)
   return n;
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_NS_SRH_CACHE_SIZE
+/* A source route as last built for one destination node. path_len 0
+ * means the node is a child of the root and gets no SRH. */
+struct srh_cache_entry {
+  const rpl_ns_node_t *node;
+  uint32_t version;
+  uint8_t path_len;
+  uint8_t cmpr;
+  uip_ipaddr_t next_hop;
+  uint8_t addresses[RPL_NS_SRH_CACHE_LEN];
+};
+static struct srh_cache_entry srh_cache[RPL_NS_SRH_CACHE_SIZE];
+/*---------------------------------------------------------------------------*/
+static struct srh_cache_entry *
+srh_cache_entry(const rpl_ns_node_t *node)
+{
+  /* The last bytes of the link identifier differ the most between nodes */
+  return &srh_cache[((node->link_identifier[6] << 8) |
+                     node->link_identifier[7]) % RPL_NS_SRH_CACHE_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static void
+srh_cache_store(struct srh_cache_entry *e, const rpl_ns_node_t *node,
+                uint8_t path_len, uint8_t cmpr, const uint8_t *addresses,
+                const uip_ipaddr_t *next_hop)
+{
+  if(path_len * (16 - cmpr) > RPL_NS_SRH_CACHE_LEN) {
+    e->node = NULL;
+    return;
+  }
+  e->node = node;
+  e->version = rpl_ns_version();
+  e->path_len = path_len;
+  e->cmpr = cmpr;
+  if(path_len > 0) {
+    memcpy(e->addresses, addresses, path_len * (16 - cmpr));
+    uip_ipaddr_copy(&e->next_hop, next_hop);
+  }
+}
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+/*---------------------------------------------------------------------------*/
+/* Makes room for a source routing header of path_len addresses, all
+ * compressed by cmpr bytes, in front of the payload. Returns where the
+ * addresses go, or NULL if the packet has no room for the header. */
+static uint8_t *
+srh_open(uint8_t path_len, uint8_t cmpr)
+{
+  uint8_t ext_len;
+  uint8_t padding;
+
+  /* Extension header length: fixed headers + (n-1) * (16-ComprI) + (16-ComprE)*/
+  ext_len = RPL_RH_LEN + RPL_SRH_LEN
+      + (path_len - 1) * (16 - cmpr)
+      + (16 - cmpr);
+
+  padding = ext_len % 8 == 0 ? 0 : (8 - (ext_len % 8));
+  ext_len += padding;
+
+  PRINTF("RPL: SRH Path len: %u, ComprI %u, ComprE %u, ext len %u (padding %u)\n",
+      path_len, cmpr, cmpr, ext_len, padding);
+
+  /* Check if there is enough space to store the extension header */
+  if(uip_len + ext_len > UIP_BUFSIZE) {
+    PRINTF("RPL: Packet too long: impossible to add source routing header (%u bytes)\n", ext_len);
+    return NULL;
+  }
+
+  /* Move existing ext headers and payload uip_ext_len further */
+  memmove(uip_buf + uip_l2_l3_hdr_len + ext_len,
+      uip_buf + uip_l2_l3_hdr_len, uip_len - UIP_IPH_LEN);
+  memset(uip_buf + uip_l2_l3_hdr_len, 0, ext_len);
+
+  /* Insert source routing header */
+  UIP_RH_BUF->next = UIP_IP_BUF->proto;
+  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+
+  /* Initialize IPv6 Routing Header */
+  UIP_RH_BUF->len = (ext_len - 8) / 8;
+  UIP_RH_BUF->routing_type = RPL_RH_TYPE_SRH;
+  UIP_RH_BUF->seg_left = path_len;
+
+  /* Initialize RPL Source Routing Header */
+  UIP_RPL_SRH_BUF->cmpr = (cmpr << 4) + cmpr;
+  UIP_RPL_SRH_BUF->pad = padding << 4;
+
+  return ((uint8_t *)UIP_RH_BUF) + RPL_RH_LEN + RPL_SRH_LEN;
+}
+/*---------------------------------------------------------------------------*/
+/* Accounts for the header set up by srh_open() in the packet lengths */
+static void
+srh_close(void)
+{
+  uint8_t temp_len;
+  uint8_t ext_len;
+
+  ext_len = UIP_RH_BUF->len * 8 + 8;
+
+  /* In-place update of IPv6 length field */
+  temp_len = UIP_IP_BUF->len[1];
+  UIP_IP_BUF->len[1] += ext_len;
+  if(UIP_IP_BUF->len[1] < temp_len) {
+    UIP_IP_BUF->len[0]++;
+  }
+
+  uip_ext_len += ext_len;
+  uip_len += ext_len;
+}
+/*---------------------------------------------------------------------------*/
 static int
 insert_srh_header(void)
 {
   /* Implementation of RFC6554 */
-  uint8_t temp_len;
   uint8_t path_len;
-  uint8_t ext_len;
-  uint8_t cmpri, cmpre; /* ComprI and ComprE fields of the RPL Source Routing Header */
+  uint8_t cmpri; /* ComprI and ComprE fields of the RPL Source Routing Header */
+  uint8_t *addresses;
   uint8_t *hop_ptr;
-  uint8_t padding;
   rpl_ns_node_t *dest_node;
   rpl_ns_node_t *root_node;
   rpl_ns_node_t *node;
   rpl_dag_t *dag;
   uip_ipaddr_t node_addr;
+#if RPL_NS_SRH_CACHE_SIZE
+  struct srh_cache_entry *cache;
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 
   PRINTF("RPL: SRH creating source routing header with destination ");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
@@ -358,6 +467,24 @@ insert_srh_header(void)
     return 1;
   }
 
+#if RPL_NS_SRH_CACHE_SIZE
+  /* No path has changed since the route was cached: reuse it */
+  cache = srh_cache_entry(dest_node);
+  if(cache->node == dest_node && cache->version == rpl_ns_version()) {
+    PRINTF("RPL: SRH found in cache\n");
+    if(cache->path_len > 0) {
+      addresses = srh_open(cache->path_len, cache->cmpr);
+      if(addresses != NULL) {
+        memcpy(addresses, cache->addresses,
+               cache->path_len * (16 - cache->cmpr));
+        uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &cache->next_hop);
+        srh_close();
+      }
+    }
+    return 1;
+  }
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+
   root_node = rpl_ns_get_node(dag, &dag->dag_id);
   if(root_node == NULL) {
     PRINTF("RPL: SRH root node not found\n");
@@ -374,10 +501,12 @@ insert_srh_header(void)
   node = dest_node->parent;
   /* For simplicity, we use cmpri = cmpre */
   cmpri = 15;
-  cmpre = 15;
 
   if(node == root_node) {
     PRINTF("RPL: SRH no need to insert SRH\n");
+#if RPL_NS_SRH_CACHE_SIZE
+    srh_cache_store(cache, dest_node, 0, cmpri, NULL, NULL);
+#endif /* RPL_NS_SRH_CACHE_SIZE */
     return 1;
   }
 
@@ -387,7 +516,6 @@ insert_srh_header(void)
 
     /* How many bytes in common between all nodes in the path? */
     cmpri = MIN(cmpri, count_matching_bytes(&node_addr, &UIP_IP_BUF->destipaddr, 16));
-    cmpre = cmpri;
 
     PRINTF("RPL: SRH Hop ");
     PRINT6ADDR(&node_addr);
@@ -396,45 +524,15 @@ insert_srh_header(void)
     path_len++;
   }
 
-  /* Extension header length: fixed headers + (n-1) * (16-ComprI) + (16-ComprE)*/
-  ext_len = RPL_RH_LEN + RPL_SRH_LEN
-      + (path_len - 1) * (16 - cmpre)
-      + (16 - cmpri);
-
-  padding = ext_len % 8 == 0 ? 0 : (8 - (ext_len % 8));
-  ext_len += padding;
-
-  PRINTF("RPL: SRH Path len: %u, ComprI %u, ComprE %u, ext len %u (padding %u)\n",
-      path_len, cmpri, cmpre, ext_len, padding);
-
-  /* Check if there is enough space to store the extension header */
-  if(uip_len + ext_len > UIP_BUFSIZE) {
-    PRINTF("RPL: Packet too long: impossible to add source routing header (%u bytes)\n", ext_len);
+  addresses = srh_open(path_len, cmpri);
+  if(addresses == NULL) {
     return 1;
   }
 
-  /* Move existing ext headers and payload uip_ext_len further */
-  memmove(uip_buf + uip_l2_l3_hdr_len + ext_len,
-      uip_buf + uip_l2_l3_hdr_len, uip_len - UIP_IPH_LEN);
-  memset(uip_buf + uip_l2_l3_hdr_len, 0, ext_len);
-
-  /* Insert source routing header */
-  UIP_RH_BUF->next = UIP_IP_BUF->proto;
-  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
-
-  /* Initialize IPv6 Routing Header */
-  UIP_RH_BUF->len = (ext_len - 8) / 8;
-  UIP_RH_BUF->routing_type = RPL_RH_TYPE_SRH;
-  UIP_RH_BUF->seg_left = path_len;
-
-  /* Initialize RPL Source Routing Header */
-  UIP_RPL_SRH_BUF->cmpr = (cmpri << 4) + cmpre;
-  UIP_RPL_SRH_BUF->pad = padding << 4;
-
   /* Initialize addresses field (the actual source route).
    * From last to first. */
   node = dest_node;
-  hop_ptr = ((uint8_t *)UIP_RH_BUF) + ext_len - padding; /* Pointer where to write the next hop compressed address */
+  hop_ptr = addresses + path_len * (16 - cmpri); /* Pointer where to write the next hop compressed address */
 
   while(node != NULL && node->parent != root_node) {
     rpl_ns_get_node_global_addr(&node_addr, node);
@@ -449,15 +547,11 @@ insert_srh_header(void)
   rpl_ns_get_node_global_addr(&node_addr, node);
   uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &node_addr);
 
-  /* In-place update of IPv6 length field */
-  temp_len = UIP_IP_BUF->len[1];
-  UIP_IP_BUF->len[1] += ext_len;
-  if(UIP_IP_BUF->len[1] < temp_len) {
-    UIP_IP_BUF->len[0]++;
-  }
+#if RPL_NS_SRH_CACHE_SIZE
+  srh_cache_store(cache, dest_node, path_len, cmpri, addresses, &node_addr);
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 
-  uip_ext_len += ext_len;
-  uip_len += ext_len;
+  srh_close();
 
   return 1;
 }
@@ -59,10 +59,18 @@
 /* Total number of nodes */
 static int num_nodes;
 
+/* Changes whenever a path through the node table may have changed */
+static uint32_t version;
+
 /* Every known node in the network */
 LIST(nodelist);
 MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
 
+#if RPL_NS_HASH_SIZE
+/* The same nodes, chained by the hash of their link identifier */
+static rpl_ns_node_t *node_hash[RPL_NS_HASH_SIZE];
+#endif /* RPL_NS_HASH_SIZE */
+
 /*---------------------------------------------------------------------------*/
 int
 rpl_ns_num_nodes(void)
@@ -70,6 +78,51 @@ rpl_ns_num_nodes(void)
   return num_nodes;
 }
 /*---------------------------------------------------------------------------*/
+uint32_t
+rpl_ns_version(void)
+{
+  return version;
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_NS_HASH_SIZE
+static uint16_t
+node_hash_index(const unsigned char *link_identifier)
+{
+  uint32_t h;
+  uint8_t i;
+
+  /* FNV-1a over the link identifier */
+  h = 2166136261UL;
+  for(i = 0; i < 8; i++) {
+    h = (h ^ link_identifier[i]) * 16777619UL;
+  }
+  return h % RPL_NS_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_hash_add(rpl_ns_node_t *node)
+{
+  uint16_t h = node_hash_index(node->link_identifier);
+
+  node->hash_next = node_hash[h];
+  node_hash[h] = node;
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_hash_rm(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t **l;
+
+  for(l = &node_hash[node_hash_index(node->link_identifier)];
+      *l != NULL; l = &(*l)->hash_next) {
+    if(*l == node) {
+      *l = node->hash_next;
+      return;
+    }
+  }
+}
+#endif /* RPL_NS_HASH_SIZE */
+/*---------------------------------------------------------------------------*/
 static int
 node_matches_address(const rpl_dag_t *dag, const rpl_ns_node_t *node, const uip_ipaddr_t *addr)
 {
@@ -85,7 +138,15 @@ rpl_ns_node_t *
 rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
 {
   rpl_ns_node_t *l;
+#if RPL_NS_HASH_SIZE
+  if(addr == NULL) {
+    return NULL;
+  }
+  l = node_hash[node_hash_index(((const unsigned char *)addr) + 8)];
+  for(; l != NULL; l = l->hash_next) {
+#else /* RPL_NS_HASH_SIZE */
   for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+#endif /* RPL_NS_HASH_SIZE */
     /* Compare prefix and node identifier */
     if(node_matches_address(dag, l, addr)) {
       return l;
@@ -114,6 +175,7 @@ rpl_ns_expire_parent(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr
   /* Check if parent matches */
   if(l != NULL && node_matches_address(dag, l->parent, parent)) {
     l->lifetime = RPL_NOPATH_REMOVAL_DELAY;
+    version++;
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -142,18 +204,21 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
       return NULL;
     }
     child_node->parent = NULL;
+    memcpy(child_node->link_identifier, ((const unsigned char *)child) + 8, 8);
     list_add(nodelist, child_node);
+#if RPL_NS_HASH_SIZE
+    node_hash_add(child_node);
+#endif /* RPL_NS_HASH_SIZE */
     num_nodes++;
   }
 
   /* Initialize node */
   child_node->dag = dag;
   child_node->lifetime = lifetime;
-  memcpy(child_node->link_identifier, ((const unsigned char *)child) + 8, 8);
+  old_parent_node = child_node->parent;
 
   /* Is the node reachable before the update? */
   if(rpl_ns_is_node_reachable(dag, child)) {
-    old_parent_node = child_node->parent;
     /* Update node */
     child_node->parent = parent_node;
     /* Has the node become unreachable? May happen if we create a loop. */
@@ -167,6 +232,12 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
     child_node->parent = parent_node;
   }
 
+  /* A node without a parent is on no path yet, so only a changed parent
+   * can have moved a path */
+  if(old_parent_node != NULL && child_node->parent != old_parent_node) {
+    version++;
+  }
+
   return child_node;
 }
 /*---------------------------------------------------------------------------*/
@@ -174,8 +245,12 @@ void
 rpl_ns_init(void)
 {
   num_nodes = 0;
+  version++;
   memb_init(&nodememb);
   list_init(nodelist);
+#if RPL_NS_HASH_SIZE
+  memset(node_hash, 0, sizeof(node_hash));
+#endif /* RPL_NS_HASH_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 rpl_ns_node_t *
@@ -203,6 +278,7 @@ void
 rpl_ns_periodic(void)
 {
   rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
   /* First pass, decrement lifetime for all nodes with non-infinite lifetime */
   for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
     /* Don't touch infinite lifetime nodes */
@@ -211,7 +287,8 @@ rpl_ns_periodic(void)
     }
   }
   /* Second pass, for all expire nodes, deallocate them iff no child points to them */
-  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+  for(l = list_head(nodelist); l != NULL; l = next) {
+    next = list_item_next(l);
     if(l->lifetime == 0) {
       rpl_ns_node_t *l2;
       for(l2 = list_head(nodelist); l2 != NULL; l2 = list_item_next(l2)) {
@@ -219,10 +296,16 @@ rpl_ns_periodic(void)
           break;
         }
       }
-      /* No child found, deallocate node */
-      list_remove(nodelist, l);
-      memb_free(&nodememb, l);
-      num_nodes--;
+      if(l2 == NULL) {
+        /* No child found, deallocate node */
+        list_remove(nodelist, l);
+#if RPL_NS_HASH_SIZE
+        node_hash_rm(l);
+#endif /* RPL_NS_HASH_SIZE */
+        memb_free(&nodememb, l);
+        num_nodes--;
+        version++;
+      }
     }
   }
 }
@@ -49,6 +49,34 @@
 #define RPL_NS_LINK_NUM 32
 #endif /* RPL_NS_CONF_LINK_NUM */
 
+/* Number of hash buckets for looking up nodes by link identifier. With
+ * 0 (the default), every lookup scans the whole node list, which is
+ * fine for small networks but dominates downward forwarding at a root
+ * with hundreds of nodes. */
+#ifdef RPL_NS_CONF_HASH_SIZE
+#define RPL_NS_HASH_SIZE RPL_NS_CONF_HASH_SIZE
+#else /* RPL_NS_CONF_HASH_SIZE */
+#define RPL_NS_HASH_SIZE 0
+#endif /* RPL_NS_CONF_HASH_SIZE */
+
+/* Number of source routing headers the root keeps, one per destination
+ * slot, so that downward packets do not walk the parent links of their
+ * destination every time. An entry is dropped as soon as any path in
+ * the node table changes. 0 (the default) disables the cache. */
+#ifdef RPL_NS_CONF_SRH_CACHE_SIZE
+#define RPL_NS_SRH_CACHE_SIZE RPL_NS_CONF_SRH_CACHE_SIZE
+#else /* RPL_NS_CONF_SRH_CACHE_SIZE */
+#define RPL_NS_SRH_CACHE_SIZE 0
+#endif /* RPL_NS_CONF_SRH_CACHE_SIZE */
+
+/* Room for compressed addresses per cached source route. Longer routes
+ * are built every time. */
+#ifdef RPL_NS_CONF_SRH_CACHE_LEN
+#define RPL_NS_SRH_CACHE_LEN RPL_NS_CONF_SRH_CACHE_LEN
+#else /* RPL_NS_CONF_SRH_CACHE_LEN */
+#define RPL_NS_SRH_CACHE_LEN 64
+#endif /* RPL_NS_CONF_SRH_CACHE_LEN */
+
 typedef struct rpl_ns_node {
   struct rpl_ns_node *next;
   uint32_t lifetime;
@@ -56,9 +84,13 @@ typedef struct rpl_ns_node {
   /* Store only IPv6 link identifiers as all nodes in the DAG share the same prefix */
   unsigned char link_identifier[8];
   struct rpl_ns_node *parent;
+#if RPL_NS_HASH_SIZE
+  struct rpl_ns_node *hash_next;
+#endif /* RPL_NS_HASH_SIZE */
 } rpl_ns_node_t;
 
 int rpl_ns_num_nodes(void);
+uint32_t rpl_ns_version(void);
 void rpl_ns_expire_parent(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t *parent);
 rpl_ns_node_t *rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t *parent, uint32_t lifetime);
 void rpl_ns_init(void);
@@ -52,8 +52,92 @@
 static struct etimer *timerlist;
 static clock_time_t next_expiration;
 
+#if ETIMER_HEAP_SIZE
+/* Binary min-heap of timers ordered by expiration time. Each timer
+   knows its own slot, which also tells whether it is on the heap. */
+static struct etimer *heap[ETIMER_HEAP_SIZE];
+static uint16_t heap_count;
+
+#define EXPIRATION(t) ((t)->timer.start + (t)->timer.interval)
+/* Wrap-safe test for a expiring before b */
+#define EXPIRES_BEFORE(a, b) \
+  ((clock_time_t)(EXPIRATION(a) - EXPIRATION(b)) > ((clock_time_t)-1 >> 1))
+#endif /* ETIMER_HEAP_SIZE */
+
 PROCESS(etimer_process, "Event timer");
 /*---------------------------------------------------------------------------*/
+#if ETIMER_HEAP_SIZE
+static void
+heap_place(struct etimer *t, uint16_t i)
+{
+  heap[i] = t;
+  t->heap_index = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_up(uint16_t i)
+{
+  struct etimer *t = heap[i];
+  uint16_t parent;
+
+  while(i > 0) {
+    parent = (i - 1) / 2;
+    if(!EXPIRES_BEFORE(t, heap[parent])) {
+      break;
+    }
+    heap_place(heap[parent], i);
+    i = parent;
+  }
+  heap_place(t, i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_down(uint16_t i)
+{
+  struct etimer *t = heap[i];
+  uint16_t child;
+
+  while((child = 2 * i + 1) < heap_count) {
+    if(child + 1 < heap_count && EXPIRES_BEFORE(heap[child + 1], heap[child])) {
+      child++;
+    }
+    if(!EXPIRES_BEFORE(heap[child], t)) {
+      break;
+    }
+    heap_place(heap[child], i);
+    i = child;
+  }
+  heap_place(t, i);
+}
+/*---------------------------------------------------------------------------*/
+static int
+heap_contains(struct etimer *t)
+{
+  /* heap_index is not initialized until the timer is first added, so
+     check that the slot really holds the timer. */
+  return t->heap_index < heap_count && heap[t->heap_index] == t;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_update(struct etimer *t)
+{
+  heap_up(t->heap_index);
+  heap_down(t->heap_index);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_remove(struct etimer *t)
+{
+  struct etimer *last;
+
+  last = heap[--heap_count];
+  if(last != t) {
+    heap_place(last, t->heap_index);
+    heap_update(last);
+  }
+}
+#endif /* ETIMER_HEAP_SIZE */
+/*---------------------------------------------------------------------------*/
 static void
 update_time(void)
 {
@@ -62,7 +146,11 @@ update_time(void)
   struct etimer *t;
 
   if (timerlist == NULL) {
+#if ETIMER_HEAP_SIZE
+    next_expiration = heap_count > 0 ? EXPIRATION(heap[0]) : 0;
+#else /* ETIMER_HEAP_SIZE */
     next_expiration = 0;
+#endif /* ETIMER_HEAP_SIZE */
   } else {
     now = clock_time();
     t = timerlist;
@@ -73,6 +161,13 @@ update_time(void)
 	tdist = t->timer.start + t->timer.interval - now;
       }
     }
+#if ETIMER_HEAP_SIZE
+    /* Only timers that did not fit in the heap are on the list */
+    if(heap_count > 0 &&
+       (clock_time_t)(EXPIRATION(heap[0]) - now) < tdist) {
+      tdist = EXPIRATION(heap[0]) - now;
+    }
+#endif /* ETIMER_HEAP_SIZE */
     next_expiration = now + tdist;
   }
 }
@@ -91,6 +186,25 @@ PROCESS_THREAD(etimer_process, ev, data)
     if(ev == PROCESS_EVENT_EXITED) {
       struct process *p = data;
 
+#if ETIMER_HEAP_SIZE
+      {
+        uint16_t i, n;
+
+        /* Drop the timers of the process and rebuild the heap */
+        for(i = 0, n = 0; i < heap_count; i++) {
+          if(heap[i]->p != p) {
+            heap_place(heap[i], n++);
+          }
+        }
+        if(n != heap_count) {
+          heap_count = n;
+          for(i = n / 2; i > 0; i--) {
+            heap_down(i - 1);
+          }
+        }
+      }
+#endif /* ETIMER_HEAP_SIZE */
+
       while(timerlist != NULL && timerlist->p == p) {
 	timerlist = timerlist->next;
       }
@@ -109,6 +223,20 @@ PROCESS_THREAD(etimer_process, ev, data)
       continue;
     }
 
+#if ETIMER_HEAP_SIZE
+    while(heap_count > 0 && timer_expired(&heap[0]->timer)) {
+      t = heap[0];
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) != PROCESS_ERR_OK) {
+        /* The event queue is full, try again later */
+        etimer_request_poll();
+        break;
+      }
+      t->p = PROCESS_NONE;
+      heap_remove(t);
+    }
+    update_time();
+#endif /* ETIMER_HEAP_SIZE */
+
   again:
     
     u = NULL;
@@ -155,6 +283,15 @@ add_timer(struct etimer *timer)
   etimer_request_poll();
 
   if(timer->p != PROCESS_NONE) {
+#if ETIMER_HEAP_SIZE
+    if(heap_contains(timer)) {
+      /* Timer already on the heap, move it to its new place. */
+      timer->p = PROCESS_CURRENT();
+      heap_update(timer);
+      update_time();
+      return;
+    }
+#endif /* ETIMER_HEAP_SIZE */
     for(t = timerlist; t != NULL; t = t->next) {
       if(t == timer) {
 	/* Timer already on list, bail out. */
@@ -167,6 +304,14 @@ add_timer(struct etimer *timer)
 
   /* Timer not on list. */
   timer->p = PROCESS_CURRENT();
+#if ETIMER_HEAP_SIZE
+  if(heap_count < ETIMER_HEAP_SIZE) {
+    heap_place(timer, heap_count++);
+    heap_up(timer->heap_index);
+    update_time();
+    return;
+  }
+#endif /* ETIMER_HEAP_SIZE */
   timer->next = timerlist;
   timerlist = timer;
 
@@ -206,6 +351,11 @@ void
 etimer_adjust(struct etimer *et, int timediff)
 {
   et->timer.start += timediff;
+#if ETIMER_HEAP_SIZE
+  if(heap_contains(et)) {
+    heap_update(et);
+  }
+#endif /* ETIMER_HEAP_SIZE */
   update_time();
 }
 /*---------------------------------------------------------------------------*/
@@ -230,6 +380,11 @@ etimer_start_time(struct etimer *et)
 int
 etimer_pending(void)
 {
+#if ETIMER_HEAP_SIZE
+  if(heap_count > 0) {
+    return 1;
+  }
+#endif /* ETIMER_HEAP_SIZE */
   return timerlist != NULL;
 }
 /*---------------------------------------------------------------------------*/
@@ -244,6 +399,16 @@ etimer_stop(struct etimer *et)
 {
   struct etimer *t;
 
+#if ETIMER_HEAP_SIZE
+  if(heap_contains(et)) {
+    heap_remove(et);
+    update_time();
+    et->next = NULL;
+    et->p = PROCESS_NONE;
+    return;
+  }
+#endif /* ETIMER_HEAP_SIZE */
+
   /* First check if et is the first event timer on the list. */
   if(et == timerlist) {
     timerlist = timerlist->next;
@@ -65,6 +65,19 @@
 #include "sys/timer.h"
 #include "sys/process.h"
 
+/**
+ * Number of event timers kept in a binary min-heap ordered by
+ * expiration time. With the heap, setting and stopping a timer is
+ * O(log n) and finding the next expiration is O(1), instead of a scan
+ * of all timers. Timers beyond this number fall back to the unsorted
+ * list. 0 (the default) disables the heap.
+ */
+#ifdef ETIMER_CONF_HEAP_SIZE
+#define ETIMER_HEAP_SIZE ETIMER_CONF_HEAP_SIZE
+#else /* ETIMER_CONF_HEAP_SIZE */
+#define ETIMER_HEAP_SIZE 0
+#endif /* ETIMER_CONF_HEAP_SIZE */
+
 /**
  * A timer.
  *
@@ -77,6 +90,9 @@ struct etimer {
   struct timer timer;
   struct etimer *next;
   struct process *p;
+#if ETIMER_HEAP_SIZE
+  uint16_t heap_index;
+#endif /* ETIMER_HEAP_SIZE */
 };
 
 /**
@@ -44,6 +44,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "sys/process.h"
 #include "sys/arg.h"
@@ -65,8 +66,28 @@ struct event_data {
   struct process *p;
 };
 
-static process_num_events_t nevents, fevent;
-static struct event_data events[PROCESS_CONF_NUMEVENTS];
+/*
+ * One event queue per priority class. nevents is the total number of
+ * events in all of them.
+ */
+struct event_queue {
+  process_num_events_t nevents, fevent;
+  struct event_data events[PROCESS_CONF_NUMEVENTS];
+#if PROCESS_COUNTERS
+  process_num_events_t maxevents;
+  unsigned long dropped;
+#endif /* PROCESS_COUNTERS */
+};
+
+static struct event_queue queues[PROCESS_PRIORITIES];
+static unsigned short nevents;
+
+#if PROCESS_PRIORITIES > 1
+#define EVENT_QUEUE(p) \
+  (&queues[(p) == PROCESS_BROADCAST ? PROCESS_PRIORITY_NORMAL : (p)->priority])
+#else /* PROCESS_PRIORITIES > 1 */
+#define EVENT_QUEUE(p) (&queues[0])
+#endif /* PROCESS_PRIORITIES > 1 */
 
 #if PROCESS_CONF_STATS
 process_num_events_t process_maxevents;
@@ -187,6 +208,13 @@ call_process(struct process *p, process_event_t ev, process_data_t data)
     PRINTF("process: calling process '%s' with event %d\n", PROCESS_NAME_STRING(p), ev);
     process_current = p;
     p->state = PROCESS_STATE_CALLED;
+#if PROCESS_COUNTERS
+    if(ev == PROCESS_EVENT_POLL) {
+      p->npolls++;
+    } else {
+      p->nevents++;
+    }
+#endif /* PROCESS_COUNTERS */
     ret = p->thread(&p->pt, ev, data);
     if(ret == PT_EXITED ||
        ret == PT_ENDED ||
@@ -209,7 +237,8 @@ process_init(void)
 {
   lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  memset(queues, 0, sizeof(queues));
+  nevents = 0;
 #if PROCESS_CONF_STATS
   process_maxevents = 0;
 #endif /* PROCESS_CONF_STATS */
@@ -249,6 +278,7 @@ do_event(void)
   process_data_t data;
   struct process *receiver;
   struct process *p;
+  struct event_queue *q;
   
   /*
    * If there are any events in the queue, take the first one and walk
@@ -259,16 +289,20 @@ do_event(void)
    */
 
   if(nevents > 0) {
-    
+
+    /* Take the event from the highest priority class that has one. */
+    for(q = &queues[PROCESS_PRIORITIES - 1]; q->nevents == 0; q--);
+
     /* There are events that we should deliver. */
-    ev = events[fevent].ev;
+    ev = q->events[q->fevent].ev;
     
-    data = events[fevent].data;
-    receiver = events[fevent].p;
+    data = q->events[q->fevent].data;
+    receiver = q->events[q->fevent].p;
 
     /* Since we have seen the new event, we move pointer upwards
        and decrease the number of events. */
-    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    q->fevent = (q->fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    --q->nevents;
     --nevents;
 
     /* If this is a broadcast event, we deliver it to all events, in
@@ -301,6 +335,20 @@ do_event(void)
 int
 process_run(void)
 {
+#if PROCESS_BATCH > 1
+  int i;
+
+  /* Process up to PROCESS_BATCH events, polling in between */
+  for(i = 0; i < PROCESS_BATCH; i++) {
+    if(poll_requested) {
+      do_poll();
+    }
+    if(nevents == 0) {
+      break;
+    }
+    do_event();
+  }
+#else /* PROCESS_BATCH > 1 */
   /* Process poll events. */
   if(poll_requested) {
     do_poll();
@@ -308,6 +356,7 @@ process_run(void)
 
   /* Process one event from the queue */
   do_event();
+#endif /* PROCESS_BATCH > 1 */
 
   return nevents + poll_requested;
 }
@@ -322,6 +371,7 @@ int
 process_post(struct process *p, process_event_t ev, process_data_t data)
 {
   process_num_events_t snum;
+  struct event_queue *q;
 
   if(PROCESS_CURRENT() == NULL) {
     PRINTF("process_post: NULL process posts event %d to process '%s', nevents %d\n",
@@ -332,7 +382,14 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
 	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
   }
   
-  if(nevents == PROCESS_CONF_NUMEVENTS) {
+  q = EVENT_QUEUE(p);
+  if(q->nevents == PROCESS_CONF_NUMEVENTS) {
+#if PROCESS_COUNTERS
+    q->dropped++;
+    if(p != PROCESS_BROADCAST) {
+      p->ndropped++;
+    }
+#endif /* PROCESS_COUNTERS */
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
       printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_current));
@@ -343,10 +400,11 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
     return PROCESS_ERR_FULL;
   }
   
-  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
-  events[snum].ev = ev;
-  events[snum].data = data;
-  events[snum].p = p;
+  snum = (process_num_events_t)(q->fevent + q->nevents) % PROCESS_CONF_NUMEVENTS;
+  q->events[snum].ev = ev;
+  q->events[snum].data = data;
+  q->events[snum].p = p;
+  ++q->nevents;
   ++nevents;
 
 #if PROCESS_CONF_STATS
@@ -354,11 +412,24 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
     process_maxevents = nevents;
   }
 #endif /* PROCESS_CONF_STATS */
+#if PROCESS_COUNTERS
+  if(q->nevents > q->maxevents) {
+    q->maxevents = q->nevents;
+  }
+#endif /* PROCESS_COUNTERS */
   
   return PROCESS_ERR_OK;
 }
 /*---------------------------------------------------------------------------*/
 void
+process_set_priority(struct process *p, unsigned char priority)
+{
+#if PROCESS_PRIORITIES > 1
+  p->priority = priority < PROCESS_PRIORITIES ? priority : PROCESS_PRIORITY_HIGH;
+#endif /* PROCESS_PRIORITIES > 1 */
+}
+/*---------------------------------------------------------------------------*/
+void
 process_post_synch(struct process *p, process_event_t ev, process_data_t data)
 {
   struct process *caller = process_current;
@@ -385,4 +456,20 @@ process_is_running(struct process *p)
   return p->state != PROCESS_STATE_NONE;
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_COUNTERS
+void
+process_queue_stats(unsigned char priority, struct process_queue_stats *stats)
+{
+  struct event_queue *q;
+
+  memset(stats, 0, sizeof(*stats));
+  if(priority < PROCESS_PRIORITIES) {
+    q = &queues[priority];
+    stats->nevents = q->nevents;
+    stats->maxevents = q->maxevents;
+    stats->dropped = q->dropped;
+  }
+}
+#endif /* PROCESS_COUNTERS */
+/*---------------------------------------------------------------------------*/
 /** @} */
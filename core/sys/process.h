@@ -88,6 +88,43 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/**
+ * Number of event priority classes. Each class has its own queue of
+ * PROCESS_CONF_NUMEVENTS events, and process_run() always delivers
+ * the oldest event of the highest class that has one. An event is
+ * queued in the class of the process it is posted to, see
+ * process_set_priority(); broadcast events are queued as
+ * PROCESS_PRIORITY_NORMAL.
+ */
+#ifdef PROCESS_CONF_PRIORITIES
+#define PROCESS_PRIORITIES PROCESS_CONF_PRIORITIES
+#else /* PROCESS_CONF_PRIORITIES */
+#define PROCESS_PRIORITIES 1
+#endif /* PROCESS_CONF_PRIORITIES */
+
+#define PROCESS_PRIORITY_NORMAL 0
+#define PROCESS_PRIORITY_HIGH   (PROCESS_PRIORITIES - 1)
+
+/**
+ * Maximum number of queued events delivered by one call to
+ * process_run(). Poll handlers still run in between the events.
+ */
+#ifdef PROCESS_CONF_BATCH
+#define PROCESS_BATCH PROCESS_CONF_BATCH
+#else /* PROCESS_CONF_BATCH */
+#define PROCESS_BATCH 1
+#endif /* PROCESS_CONF_BATCH */
+
+/**
+ * Keep per-process dispatch counters and per-class queue high-water
+ * marks, as shown by the shell's ps command.
+ */
+#ifdef PROCESS_CONF_COUNTERS
+#define PROCESS_COUNTERS PROCESS_CONF_COUNTERS
+#else /* PROCESS_CONF_COUNTERS */
+#define PROCESS_COUNTERS 0
+#endif /* PROCESS_CONF_COUNTERS */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -323,6 +360,14 @@ struct process {
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
   unsigned char state, needspoll;
+#if PROCESS_PRIORITIES > 1
+  unsigned char priority;
+#endif /* PROCESS_PRIORITIES > 1 */
+#if PROCESS_COUNTERS
+  /* Events and polls delivered to the process, and events posted to
+     it that were lost because its queue was full */
+  unsigned long nevents, npolls, ndropped;
+#endif /* PROCESS_COUNTERS */
 };
 
 /**
@@ -364,6 +409,17 @@ CCIF void process_start(struct process *p, process_data_t data);
  */
 CCIF int process_post(struct process *p, process_event_t ev, process_data_t data);
 
+/**
+ * Set the priority class of the events posted to a process.
+ *
+ * \param p The process.
+ *
+ * \param priority PROCESS_PRIORITY_NORMAL (the default), up to
+ * PROCESS_PRIORITY_HIGH. Has no effect unless PROCESS_CONF_PRIORITIES
+ * is larger than one.
+ */
+CCIF void process_set_priority(struct process *p, unsigned char priority);
+
 /**
  * Post a synchronous event to a process.
  *
@@ -489,7 +545,8 @@ void process_init(void);
  *
  * This function should be called repeatedly from the main() program
  * to actually run the Contiki system. It calls the necessary poll
- * handlers, and processes one event. The function returns the number
+ * handlers, and processes one event (or up to PROCESS_CONF_BATCH
+ * events). The function returns the number
  * of events that are waiting in the event queue so that the caller
  * may choose to put the CPU to sleep when there are no pending
  * events.
@@ -519,6 +576,21 @@ CCIF int process_is_running(struct process *p);
  */
 int process_nevents(void);
 
+#if PROCESS_COUNTERS
+/**
+ * Queue statistics of each priority class: the number of events
+ * queued, the most that have been queued at once, and the number of
+ * events that were lost because the queue was full.
+ */
+struct process_queue_stats {
+  process_num_events_t nevents, maxevents;
+  unsigned long dropped;
+};
+
+void process_queue_stats(unsigned char priority,
+                         struct process_queue_stats *stats);
+#endif /* PROCESS_COUNTERS */
+
 /** @} */
 
 CCIF extern struct process *process_list;
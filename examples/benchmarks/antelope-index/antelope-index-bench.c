@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Insert rate and range query latency of the Antelope B+-tree
+ *         and MaxHeap indexes, over 5000 rows with random keys and with
+ *         ascending keys. Native only.
+ *
+ *         samples(id LONG, value INT) is indexed on value and stored in
+ *         Coffee on the 1 MB flash emulation of native, which is
+ *         formatted before each run. The flash accesses are counted to
+ *         show what the inserts would write to a real flash. Each range
+ *         query starts at the key of a random row, so that it finds at
+ *         least one row. MaxHeap has no range queries, so Antelope
+ *         emulates them with a lookup per key when the range is narrow
+ *         enough, and otherwise scans the relation. Queries that end
+ *         in an error are counted as failed.
+ *
+ *         make TARGET=native && ./antelope-index-bench.native
+ *         make TARGET=native clean
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+#include "dev/xmem.h"
+#include "antelope.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define FLASH_SIZE (1024UL * 1024UL)
+#define ROWS       5000
+#define BATCH      64
+#define QUERIES    200
+#define KEY_LIMIT  30000
+
+static const char *index_types[] = { "MAXHEAP", "BTREE" };
+static const int widths[] = { 1, 10, 100, 1000 };
+
+static unsigned char flash[FLASH_SIZE];
+static unsigned long flash_reads;
+static unsigned long flash_writes;
+static unsigned long flash_bytes_written;
+
+static int keys[ROWS];
+static attribute_value_t values[BATCH * 2];
+
+PROCESS(antelope_index_bench_process, "Antelope index benchmark");
+AUTOSTART_PROCESSES(&antelope_index_bench_process);
+/*---------------------------------------------------------------------------*/
+int
+xmem_pwrite(const void *buf, int size, unsigned long offset)
+{
+  flash_writes++;
+  flash_bytes_written += size;
+  memcpy(&flash[offset], buf, size);
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_pread(void *buf, int size, unsigned long offset)
+{
+  flash_reads++;
+  memcpy(buf, &flash[offset], size);
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_erase(long nbytes, unsigned long offset)
+{
+  memset(&flash[offset], 0, nbytes);
+  return nbytes;
+}
+/*---------------------------------------------------------------------------*/
+void
+xmem_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+create_samples(const char *type, int ascending)
+{
+  relation_t *rel;
+  double start;
+  unsigned n;
+  int i;
+
+  db_query(NULL, "REMOVE RELATION samples;");
+  cfs_coffee_format();
+
+  db_query(NULL, "CREATE RELATION samples;");
+  db_query(NULL, "CREATE ATTRIBUTE id DOMAIN LONG IN samples;");
+  db_query(NULL, "CREATE ATTRIBUTE value DOMAIN INT IN samples;");
+  if(DB_ERROR(db_query(NULL, "CREATE INDEX samples.value TYPE %s;", type))) {
+    printf("%s: failed to create the index\n", type);
+    return 0;
+  }
+
+  srandom(1);
+  for(i = 0; i < ROWS; i++) {
+    keys[i] = ascending ? i * (KEY_LIMIT / ROWS) : random() % KEY_LIMIT;
+  }
+
+  rel = relation_load("samples");
+  flash_reads = flash_writes = flash_bytes_written = 0;
+  start = now();
+  for(i = 0; i < ROWS; i += n) {
+    for(n = 0; n < BATCH && i + n < ROWS; n++) {
+      values[n * 2].domain = DOMAIN_LONG;
+      VALUE_LONG(&values[n * 2]) = i + n;
+      values[n * 2 + 1].domain = DOMAIN_INT;
+      VALUE_INT(&values[n * 2 + 1]) = keys[i + n];
+    }
+    if(DB_ERROR(relation_insert_batch(rel, values, n))) {
+      printf("%s: insert failed after %d rows\n", type, i);
+      relation_release(rel);
+      return 0;
+    }
+  }
+  printf("%-8s %-10s %-7s %10.0f %12.1f %12.1f\n", type,
+         ascending ? "ascending" : "random", "insert",
+         ROWS / (now() - start), (double)flash_bytes_written / ROWS,
+         (double)flash_writes / ROWS);
+  relation_release(rel);
+
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+query(const char *type, int ascending, int width)
+{
+  static db_handle_t handle;
+  unsigned long results;
+  db_result_t result;
+  int indexed;
+  int failed;
+  double start;
+  int lo;
+  int q;
+
+  results = 0;
+  indexed = failed = 0;
+  srandom(2);
+  flash_reads = 0;
+  start = now();
+  for(q = 0; q < QUERIES; q++) {
+    lo = keys[random() % ROWS];
+    result = db_query(&handle,
+                      "SELECT id FROM samples WHERE value >= %d AND value < %d;",
+                      lo, lo + width);
+    if(DB_ERROR(result)) {
+      printf("%s: %s\n", type, db_get_result_message(result));
+      db_free(&handle);
+      return;
+    }
+    indexed += (handle.flags & DB_HANDLE_FLAG_SEARCH_INDEX) != 0;
+
+    while(db_processing(&handle)) {
+      result = db_process(&handle);
+      if(result == DB_GOT_ROW) {
+        results++;
+      } else if(result == DB_FINISHED) {
+        break;
+      } else if(DB_ERROR(result)) {
+        failed++;
+        break;
+      }
+    }
+    db_free(&handle);
+  }
+
+  printf("%-8s %-10s %-7d %10.1f %12.1f %12lu %s", type,
+         ascending ? "ascending" : "random", width,
+         (now() - start) * 1000000 / QUERIES,
+         (double)flash_reads / QUERIES, results / QUERIES,
+         indexed == QUERIES ? "index" : indexed == 0 ? "scan" : "mixed");
+  if(failed > 0) {
+    printf(", %d failed", failed);
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(antelope_index_bench_process, ev, data)
+{
+  int t, a, w;
+
+  PROCESS_BEGIN();
+
+  db_init();
+
+  printf("%-8s %-10s %-7s %10s %12s %12s\n", "index", "keys", "insert",
+         "inserts/s", "bytes/insert", "writes/insert");
+  printf("%-8s %-10s %-7s %10s %12s %12s\n", "", "", "width",
+         "us/query", "reads/query", "rows/query");
+
+  for(t = 0; t < sizeof(index_types) / sizeof(index_types[0]); t++) {
+    for(a = 0; a < 2; a++) {
+      if(!create_samples(index_types[t], a)) {
+        continue;
+      }
+      for(w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        query(index_types[t], a, widths[w]);
+      }
+    }
+  }
+
+  db_query(NULL, "REMOVE RELATION samples;");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Rows/s of Antelope joins on synthetic sensor tables of 10000
+ *         and 100000 samples, for comparing the join methods that the
+ *         planner picks between. Native only.
+ *
+ *         samples(id LONG, sensor INT, value INT) is sorted on id.
+ *         sensors(sensor INT, room INT) has 100 rows and an inline
+ *         index on sensor, and rooms is the same without an index.
+ *         calib(id LONG, offset INT) has a row for every other sample,
+ *         with an inline index on id, and calibx is the same without
+ *         an index. The relations are files in the current directory,
+ *         through cfs-posix, and are removed at the end.
+ *
+ *         make TARGET=native && ./antelope-join-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=DB_JOIN_HASH_SIZE=0
+ */
+
+#include "contiki.h"
+#include "antelope.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define SENSORS 100
+#define BATCH   64
+
+static const tuple_id_t sizes[] = { 10000, 100000 };
+
+static const struct {
+  const char *name;
+  const char *query;
+} joins[] = {
+  { "small, index",    "JOIN samples, sensors ON sensor PROJECT value, room;" },
+  { "small, no index", "JOIN samples, rooms ON sensor PROJECT value, room;" },
+  { "large, sorted",   "JOIN samples, calib ON id PROJECT value, offset;" },
+  { "large, index",    "JOIN calibx, samples ON id PROJECT value, offset;" },
+  { "large, no index", "JOIN samples, calibx ON id PROJECT value, offset;" },
+};
+
+static attribute_value_t values[BATCH * 3];
+
+PROCESS(antelope_join_bench_process, "Antelope join benchmark");
+AUTOSTART_PROCESSES(&antelope_join_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_relations(void)
+{
+  db_query(NULL, "REMOVE RELATION samples;");
+  db_query(NULL, "REMOVE RELATION sensors;");
+  db_query(NULL, "REMOVE RELATION rooms;");
+  db_query(NULL, "REMOVE RELATION calib;");
+  db_query(NULL, "REMOVE RELATION calibx;");
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_sensors(const char *name, int indexed)
+{
+  int i;
+
+  db_query(NULL, "CREATE RELATION %s;", name);
+  db_query(NULL, "CREATE ATTRIBUTE sensor DOMAIN INT IN %s;", name);
+  db_query(NULL, "CREATE ATTRIBUTE room DOMAIN INT IN %s;", name);
+  if(indexed) {
+    db_query(NULL, "CREATE INDEX %s.sensor TYPE INLINE;", name);
+  }
+  for(i = 0; i < SENSORS; i++) {
+    db_query(NULL, "INSERT (%d, %d) INTO %s;", i, i / 10, name);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert_rows(const char *name, tuple_id_t rows, int attributes)
+{
+  relation_t *rel;
+  attribute_value_t *v;
+  tuple_id_t id;
+  unsigned n;
+
+  rel = relation_load((char *)name);
+  for(id = 0; id < rows; id += n) {
+    for(n = 0; n < BATCH && id + n < rows; n++) {
+      v = &values[n * attributes];
+      v[0].domain = DOMAIN_LONG;
+      if(attributes == 3) {
+        VALUE_LONG(&v[0]) = id + n;
+        v[1].domain = DOMAIN_INT;
+        VALUE_INT(&v[1]) = ((id + n) * 7) % SENSORS;
+        v[2].domain = DOMAIN_INT;
+        VALUE_INT(&v[2]) = ((id + n) * 31) % 1000;
+      } else {
+        VALUE_LONG(&v[0]) = (id + n) * 2;
+        v[1].domain = DOMAIN_INT;
+        VALUE_INT(&v[1]) = (id + n) % 16;
+      }
+    }
+    relation_insert_batch(rel, values, n);
+  }
+  relation_release(rel);
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_tables(tuple_id_t rows)
+{
+  remove_relations();
+
+  db_query(NULL, "CREATE RELATION samples;");
+  db_query(NULL, "CREATE ATTRIBUTE id DOMAIN LONG IN samples;");
+  db_query(NULL, "CREATE ATTRIBUTE sensor DOMAIN INT IN samples;");
+  db_query(NULL, "CREATE ATTRIBUTE value DOMAIN INT IN samples;");
+  db_query(NULL, "CREATE INDEX samples.id TYPE INLINE;");
+  insert_rows("samples", rows, 3);
+
+  create_sensors("sensors", 1);
+  create_sensors("rooms", 0);
+
+  db_query(NULL, "CREATE RELATION calib;");
+  db_query(NULL, "CREATE ATTRIBUTE id DOMAIN LONG IN calib;");
+  db_query(NULL, "CREATE ATTRIBUTE offset DOMAIN INT IN calib;");
+  db_query(NULL, "CREATE INDEX calib.id TYPE INLINE;");
+  insert_rows("calib", rows / 2, 2);
+
+  db_query(NULL, "CREATE RELATION calibx;");
+  db_query(NULL, "CREATE ATTRIBUTE id DOMAIN LONG IN calibx;");
+  db_query(NULL, "CREATE ATTRIBUTE offset DOMAIN INT IN calibx;");
+  insert_rows("calibx", rows / 2, 2);
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *name, const char *query, tuple_id_t rows)
+{
+  static db_handle_t handle;
+  unsigned long results;
+  db_result_t result;
+  double start;
+
+  results = 0;
+  start = now();
+  result = db_query(&handle, query);
+  if(DB_ERROR(result)) {
+    printf("%-16s %8lu %12s %10s  %s\n", name, (unsigned long)rows, "-", "-",
+           db_get_result_message(result));
+    db_free(&handle);
+    return;
+  }
+
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      results++;
+    } else if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("%s: %s\n", query, db_get_result_message(result));
+      break;
+    }
+  }
+  db_free(&handle);
+
+  printf("%-16s %8lu %12.0f %10lu\n", name, (unsigned long)rows,
+         rows / (now() - start), results);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(antelope_join_bench_process, ev, data)
+{
+  int i, s;
+
+  PROCESS_BEGIN();
+
+  db_init();
+
+  printf("hash table %d bytes, %d partitions\n", DB_JOIN_HASH_SIZE,
+         DB_JOIN_PARTITIONS);
+  printf("%-16s %8s %12s %10s\n", "", "samples", "samples/s", "results");
+
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    create_tables(sizes[s]);
+    for(i = 0; i < sizeof(joins) / sizeof(joins[0]); i++) {
+      run(joins[i].name, joins[i].query, sizes[s]);
+    }
+  }
+
+  remove_relations();
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
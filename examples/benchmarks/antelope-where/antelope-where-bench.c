@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Rows/s of Antelope SELECT queries with a WHERE clause over
+ *         10000 and 100000 rows, for comparing compiled predicates
+ *         with the LVM interpreter. Native only.
+ *
+ *         samples(id LONG, sensor INT, value INT) is stored in a file
+ *         in the current directory through cfs-posix, read through the
+ *         row buffers, and removed at the end. With compiled predicates,
+ *         each predicate is also evaluated on rows in memory, one row
+ *         at a time and a block of rows at a time, to show the cost of
+ *         evaluation alone.
+ *
+ *         make TARGET=native && ./antelope-where-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=LVM_PLAN_SIZE=0
+ */
+
+#include "contiki.h"
+#include "antelope.h"
+#include "aql.h"
+#include "lvm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define SENSORS 100
+#define BATCH   64
+#define ROW_LENGTH 8
+#define BLOCK   64
+#define ROUNDS  100
+
+static const tuple_id_t sizes[] = { 10000, 100000 };
+
+static const char *predicates[] = {
+  "value > 900",
+  "value > 100 AND value < 200 AND sensor = 7",
+  "id >= 5000 AND id < 8000",
+  "value > 900 OR sensor = 3",
+  "value <> 500",
+  "value * 2 + 1 > 1801",
+};
+
+static attribute_value_t values[BATCH * 3];
+
+PROCESS(antelope_where_bench_process, "Antelope WHERE benchmark");
+AUTOSTART_PROCESSES(&antelope_where_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_sample(attribute_value_t *v, tuple_id_t id)
+{
+  v[0].domain = DOMAIN_LONG;
+  VALUE_LONG(&v[0]) = id;
+  v[1].domain = DOMAIN_INT;
+  VALUE_INT(&v[1]) = (id * 7) % SENSORS;
+  v[2].domain = DOMAIN_INT;
+  VALUE_INT(&v[2]) = (id * 31) % 1000;
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_samples(tuple_id_t rows)
+{
+  relation_t *rel;
+  tuple_id_t id;
+  unsigned n;
+
+  db_query(NULL, "REMOVE RELATION samples;");
+  db_query(NULL, "CREATE RELATION samples;");
+  db_query(NULL, "CREATE ATTRIBUTE id DOMAIN LONG IN samples;");
+  db_query(NULL, "CREATE ATTRIBUTE sensor DOMAIN INT IN samples;");
+  db_query(NULL, "CREATE ATTRIBUTE value DOMAIN INT IN samples;");
+
+  rel = relation_load("samples");
+  for(id = 0; id < rows; id += n) {
+    for(n = 0; n < BATCH && id + n < rows; n++) {
+      set_sample(&values[n * 3], id + n);
+    }
+    relation_insert_batch(rel, values, n);
+  }
+  relation_release(rel);
+}
+/*---------------------------------------------------------------------------*/
+#if LVM_PLAN_SIZE > 0
+static unsigned char rows[160 * BLOCK * ROW_LENGTH];
+static unsigned char matches[BLOCK];
+
+/* Rows laid out as in samples, for evaluating predicates in memory. */
+static void
+fill_rows(void)
+{
+  unsigned char *row;
+  tuple_id_t id;
+  long v;
+
+  for(id = 0, row = rows; row < rows + sizeof(rows); id++, row += ROW_LENGTH) {
+    row[0] = id >> 24;
+    row[1] = id >> 16;
+    row[2] = id >> 8;
+    row[3] = id;
+    v = (id * 7) % SENSORS;
+    row[4] = v >> 8;
+    row[5] = v;
+    v = (id * 31) % 1000;
+    row[6] = v >> 8;
+    row[7] = v;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+evaluate(lvm_instance_t *lvm)
+{
+  unsigned long results;
+  unsigned long count;
+  double start;
+  unsigned i;
+  int r;
+
+  count = (unsigned long)ROUNDS * sizeof(rows) / ROW_LENGTH;
+
+  results = 0;
+  start = now();
+  for(r = 0; r < ROUNDS; r++) {
+    for(i = 0; i < sizeof(rows); i += ROW_LENGTH) {
+      results += lvm_execute_row(lvm, rows + i) == TRUE;
+    }
+  }
+  printf("  %-42s %7u %12.0f %10lu\n", "in memory, row at a time",
+         (unsigned)(sizeof(rows) / ROW_LENGTH), count / (now() - start),
+         results / ROUNDS);
+
+  results = 0;
+  start = now();
+  for(r = 0; r < ROUNDS; r++) {
+    for(i = 0; i < sizeof(rows); i += BLOCK * ROW_LENGTH) {
+      results += lvm_execute_rows(lvm, rows + i, BLOCK, ROW_LENGTH, matches);
+    }
+  }
+  printf("  %-42s %7u %12.0f %10lu\n", "in memory, block at a time",
+         (unsigned)(sizeof(rows) / ROW_LENGTH), count / (now() - start),
+         results / ROUNDS);
+}
+#endif /* LVM_PLAN_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *predicate, tuple_id_t rows, int in_memory)
+{
+  static db_handle_t handle;
+  unsigned long results;
+  db_result_t result;
+  double start;
+
+  results = 0;
+  start = now();
+  result = db_query(&handle, "SELECT id, value FROM samples WHERE %s;",
+                    predicate);
+  if(DB_ERROR(result)) {
+    printf("%s: %s\n", predicate, db_get_result_message(result));
+    db_free(&handle);
+    return;
+  }
+
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      results++;
+    } else if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("%s: %s\n", predicate, db_get_result_message(result));
+      break;
+    }
+  }
+
+  printf("%-44s %7lu %12.0f %10lu%s\n", predicate, (unsigned long)rows,
+         rows / (now() - start), results,
+         handle.flags & DB_HANDLE_FLAG_LVM_PLAN ? " compiled" : "");
+
+#if LVM_PLAN_SIZE > 0
+  if(in_memory && (handle.flags & DB_HANDLE_FLAG_LVM_PLAN)) {
+    evaluate(((aql_adt_t *)handle.adt)->lvm_instance);
+  }
+#endif
+
+  db_free(&handle);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(antelope_where_bench_process, ev, data)
+{
+  int i, s;
+
+  PROCESS_BEGIN();
+
+  db_init();
+#if LVM_PLAN_SIZE > 0
+  fill_rows();
+#endif
+
+  printf("plan size %d\n", LVM_PLAN_SIZE);
+  printf("%-44s %7s %12s %10s\n", "", "rows", "rows/s", "results");
+
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    create_samples(sizes[s]);
+    for(i = 0; i < sizeof(predicates) / sizeof(predicates[0]); i++) {
+      run(predicates[i], sizes[s], s == 0);
+    }
+  }
+
+  db_query(NULL, "REMOVE RELATION samples;");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Rows/s of Antelope for bulk inserts, a SELECT with a WHERE
+ *         clause and a JOIN, on relations of 10000 and 100000 rows.
+ *         Native only.
+ *
+ *         samples(id LONG, sensor INT, value INT) is joined with
+ *         sensors(sensor INT, room INT), which has 100 rows and an
+ *         inline index on sensor. The relations are stored in files in
+ *         the current directory through cfs-posix, so every cfs_read()
+ *         is a system call; they are removed at the end.
+ *
+ *         make TARGET=native && ./antelope-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=DB_ROW_BUFFER_SIZE=0
+ */
+
+#include "contiki.h"
+#include "antelope.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define SENSORS 100
+#define BATCH   64
+
+static const tuple_id_t sizes[] = { 10000, 100000 };
+
+static attribute_value_t values[BATCH * 3];
+
+PROCESS(antelope_bench_process, "Antelope benchmark");
+AUTOSTART_PROCESSES(&antelope_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, tuple_id_t rows, unsigned long results, double start)
+{
+  double secs = now() - start;
+
+  printf("%-14s %8lu %12.0f %10lu\n", name, (unsigned long)rows,
+         rows / secs, results);
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_samples(const char *name)
+{
+  db_query(NULL, "REMOVE RELATION %s;", name);
+  db_query(NULL, "CREATE RELATION %s;", name);
+  db_query(NULL, "CREATE ATTRIBUTE id DOMAIN LONG IN %s;", name);
+  db_query(NULL, "CREATE ATTRIBUTE sensor DOMAIN INT IN %s;", name);
+  db_query(NULL, "CREATE ATTRIBUTE value DOMAIN INT IN %s;", name);
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_sample(attribute_value_t *v, tuple_id_t id)
+{
+  v[0].domain = DOMAIN_LONG;
+  VALUE_LONG(&v[0]) = id;
+  v[1].domain = DOMAIN_INT;
+  VALUE_INT(&v[1]) = (id * 7) % SENSORS;
+  v[2].domain = DOMAIN_INT;
+  VALUE_INT(&v[2]) = (id * 31) % 1000;
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert_rows(tuple_id_t rows)
+{
+  relation_t *rel;
+  tuple_id_t id;
+  double start;
+
+  create_samples("single");
+  rel = relation_load("single");
+  start = now();
+  for(id = 0; id < rows; id++) {
+    set_sample(values, id);
+    if(DB_ERROR(relation_insert(rel, values))) {
+      printf("insert failed\n");
+      break;
+    }
+  }
+  report("insert", rows, relation_cardinality(rel), start);
+  relation_release(rel);
+  db_query(NULL, "REMOVE RELATION single;");
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert_batch(tuple_id_t rows)
+{
+  relation_t *rel;
+  tuple_id_t id;
+  unsigned n;
+  double start;
+
+  create_samples("samples");
+  rel = relation_load("samples");
+  start = now();
+  for(id = 0; id < rows; id += n) {
+    for(n = 0; n < BATCH && id + n < rows; n++) {
+      set_sample(&values[n * 3], id + n);
+    }
+    if(DB_ERROR(relation_insert_batch(rel, values, n))) {
+      printf("batch insert failed\n");
+      break;
+    }
+  }
+  report("insert batch", rows, relation_cardinality(rel), start);
+  relation_release(rel);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+run(const char *query)
+{
+  static db_handle_t handle;
+  unsigned long results;
+  db_result_t result;
+
+  results = 0;
+  result = db_query(&handle, query);
+  if(DB_ERROR(result)) {
+    printf("%s: %s\n", query, db_get_result_message(result));
+    return 0;
+  }
+
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      results++;
+    } else if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("%s: %s\n", query, db_get_result_message(result));
+      break;
+    }
+  }
+  db_free(&handle);
+
+  return results;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(antelope_bench_process, ev, data)
+{
+  int i, s;
+  double start;
+  unsigned long results;
+
+  PROCESS_BEGIN();
+
+  db_init();
+
+  db_query(NULL, "REMOVE RELATION sensors;");
+  db_query(NULL, "CREATE RELATION sensors;");
+  db_query(NULL, "CREATE ATTRIBUTE sensor DOMAIN INT IN sensors;");
+  db_query(NULL, "CREATE ATTRIBUTE room DOMAIN INT IN sensors;");
+  db_query(NULL, "CREATE INDEX sensors.sensor TYPE INLINE;");
+  for(i = 0; i < SENSORS; i++) {
+    db_query(NULL, "INSERT (%d, %d) INTO sensors;", i, i / 10);
+  }
+
+  printf("row buffer %d bytes\n", DB_ROW_BUFFER_SIZE);
+  printf("%-14s %8s %12s %10s\n", "", "rows", "rows/s", "results");
+
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    insert_rows(sizes[s]);
+    insert_batch(sizes[s]);
+
+    start = now();
+    results = run("SELECT id, value FROM samples WHERE value > 900;");
+    report("select", sizes[s], results, start);
+
+    start = now();
+    results = run("JOIN samples, sensors ON sensor PROJECT value, room;");
+    report("join", sizes[s], results, start);
+  }
+
+  db_query(NULL, "REMOVE RELATION samples;");
+  db_query(NULL, "REMOVE RELATION sensors;");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Block transfers over simulated multi-hop paths, comparing the
+ *         fixed CoAP retransmission timeout with the CoCoA estimators in
+ *         er-coap-congestion.c, with one and with several blocks in
+ *         flight. Native only.
+ *
+ *         Each hop adds 10 ms plus an exponentially distributed MAC
+ *         delay (mean 20 ms) and drops the frame with a fixed
+ *         probability, in each direction. Requests share the channel,
+ *         which takes 10 ms per frame for each of up to three hops in
+ *         mutual interference range. Time is simulated; only the RTO
+ *         decisions come from the CoAP code.
+ *
+ *         make TARGET=native && ./coap-cocoa-bench.native
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "er-coap.h"
+#include "er-coap-congestion.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BLOCKS          200
+#define MAX_WINDOW      8
+#define TICKS(ms)       ((clock_time_t)((ms) * CLOCK_SECOND / 1000))
+#define MS(ticks)       ((double)(ticks) * 1000 / CLOCK_SECOND)
+
+static const struct {
+  int hops;
+  double loss;
+} paths[] = {
+  { 1, 0.01 }, { 4, 0.02 }, { 8, 0.02 }, { 8, 0.05 },
+};
+
+struct exchange {
+  double first;                 /* first transmission */
+  double deadline;              /* retransmission timer */
+  double answer;                /* first answer on its way, or INFINITY */
+  double timeout;
+  int retransmissions;
+  int active;
+};
+
+static uint32_t seed;
+static double channel_free;
+static unsigned long retransmissions, spurious, failures;
+
+PROCESS(coap_cocoa_bench_process, "CoAP congestion control benchmark");
+AUTOSTART_PROCESSES(&coap_cocoa_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+uniform(void)
+{
+  /* xorshift32, so that runs are repeatable */
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return (seed >> 8) / 16777216.0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+transmit(struct exchange *x, double now, int hops, double loss)
+{
+  double depart, arrive;
+  int i;
+
+  depart = now > channel_free ? now : channel_free;
+  channel_free = depart + 10 * (hops < 3 ? hops : 3);
+
+  arrive = depart;
+  for(i = 0; i < 2 * hops; i++) {
+    if(uniform() < loss) {
+      return 0;
+    }
+    arrive += 10 - 20 * log(1 - uniform());
+  }
+  if(arrive < x->answer) {
+    x->answer = arrive;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start(struct exchange *x, double now, int cocoa, uip_ipaddr_t *addr,
+      int hops, double loss)
+{
+  double rto;
+
+  rto = cocoa ? MS(coap_congestion_rto(addr)) : COAP_RESPONSE_TIMEOUT * 1000;
+  x->timeout = rto + uniform() * rto / 2;
+  x->first = now;
+  x->deadline = now + x->timeout;
+  x->answer = INFINITY;
+  x->retransmissions = 0;
+  x->active = 1;
+  transmit(x, now, hops, loss);
+}
+/*---------------------------------------------------------------------------*/
+/* Simulated seconds for BLOCKS blocks with window exchanges in flight */
+static double
+transfer(int cocoa, int window, int p)
+{
+  static struct exchange exchanges[MAX_WINDOW];
+  static int destination;
+  struct exchange *x, *next;
+  uip_ipaddr_t addr;
+  double now = 0;
+  int started = 0, done = 0;
+
+  /* A fresh destination, so that every run starts from the default RTO */
+  destination++;
+  uip_ip6addr(&addr, 0xfd00, 0, 0, 0, 0, 0, 0, destination);
+  seed = 0x2545f491 + p;
+  channel_free = 0;
+
+  for(x = exchanges; x < exchanges + window; x++) {
+    start(x, now, cocoa, &addr, paths[p].hops, paths[p].loss);
+    started++;
+  }
+
+  while(done < BLOCKS) {
+    next = NULL;
+    for(x = exchanges; x < exchanges + window; x++) {
+      if(x->active && (next == NULL
+                       || fmin(x->answer, x->deadline)
+                       < fmin(next->answer, next->deadline))) {
+        next = x;
+      }
+    }
+    x = next;
+
+    if(x->answer <= x->deadline) {
+      now = x->answer;
+      done++;
+      if(cocoa) {
+        coap_congestion_update(&addr, TICKS(now - x->first),
+                               x->retransmissions);
+      }
+      x->active = 0;
+    } else {
+      now = x->deadline;
+      if(x->retransmissions == COAP_MAX_RETRANSMIT) {
+        /* Given up; the client starts over with this block */
+        failures++;
+        x->active = 0;
+        started--;
+      } else {
+        x->retransmissions++;
+        retransmissions++;
+        if(x->answer != INFINITY) {
+          spurious++;
+        }
+        transmit(x, now, paths[p].hops, paths[p].loss);
+        if(cocoa) {
+          x->timeout = MS(coap_congestion_backoff(&addr, TICKS(x->timeout)));
+        } else {
+          x->timeout *= 2;
+        }
+        x->deadline = now + x->timeout;
+      }
+    }
+
+    if(!x->active && started < BLOCKS) {
+      start(x, now, cocoa, &addr, paths[p].hops, paths[p].loss);
+      started++;
+    }
+  }
+
+  return now / 1000;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_cocoa_bench_process, ev, data)
+{
+  static const int windows[] = { 1, 4 };
+  int p, w, cocoa;
+  double secs;
+
+  PROCESS_BEGIN();
+
+  printf("%4s %5s %6s %6s %9s %9s %8s %8s %8s\n", "hops", "loss", "rto",
+         "window", "seconds", "blocks/s", "retrans", "spurious", "failed");
+
+  for(p = 0; p < sizeof(paths) / sizeof(paths[0]); p++) {
+    for(w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+      for(cocoa = 0; cocoa <= 1; cocoa++) {
+        retransmissions = spurious = failures = 0;
+        secs = transfer(cocoa, windows[w], p);
+        printf("%4d %4.0f%% %6s %6d %9.1f %9.2f %8lu %8lu %8lu\n",
+               paths[p].hops, paths[p].loss * 100, cocoa ? "cocoa" : "fixed",
+               windows[w], secs, BLOCKS / secs, retransmissions, spurious,
+               failures);
+      }
+    }
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
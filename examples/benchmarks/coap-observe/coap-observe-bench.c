@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Cost of CoAP observe bookkeeping with 10000 observers from 500
+ *         clients on 1000 resources, for comparing the observer and
+ *         transaction hashes with the plain lists. Native only.
+ *
+ *         Observers are registered through coap_observe_handler(), every
+ *         resource is notified through coap_notify_observers() for 20
+ *         rounds, the confirmable notifications of the last round are
+ *         ACKed by MID, and finally every observer cancels by token.
+ *         A tenth of the resources have sub-resources and are observed
+ *         below their URL. Notifications go to unrouted addresses and
+ *         are dropped by uIP.
+ *
+ *         The fan-out phase then notifies a single resource with a JSON
+ *         payload observed by 1, 10, 100 and 1000 observers, and reports
+ *         the time per notification and per observer notified, for
+ *         comparing the encode-once fan-out with re-running the handler
+ *         for every observer.
+ *
+ *         make TARGET=native && ./coap-observe-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=COAP_OBSERVER_HASH_SIZE=0,COAP_TRANSACTION_HASH_SIZE=0
+ *         make TARGET=native DEFINES=COAP_OBSERVE_FANOUT=0
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "rest-engine.h"
+#include "er-coap.h"
+#include "er-coap-observe.h"
+#include "er-coap-transactions.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define RESOURCES     1000
+#define CLIENTS       500
+#define OBSERVERS     10000
+#define ROUNDS        COAP_OBSERVE_REFRESH_INTERVAL
+#define FANOUT_ROUNDS 200
+
+static const int fanouts[] = { 1, 10, 100, 1000 };
+
+static resource_t resources[RESOURCES];
+static char paths[RESOURCES][24];
+static resource_t hot;
+static unsigned long notified;
+
+PROCESS(coap_bench_process, "CoAP observe benchmark");
+AUTOSTART_PROCESSES(&coap_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+get_handler(void *request, void *response, uint8_t *buffer,
+            uint16_t preferred_size, int32_t *offset)
+{
+  notified++;
+  REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
+  REST.set_response_payload(response, buffer,
+                            snprintf((char *)buffer, preferred_size, "%lu",
+                                     notified));
+}
+/*---------------------------------------------------------------------------*/
+static void
+hot_handler(void *request, void *response, uint8_t *buffer,
+            uint16_t preferred_size, int32_t *offset)
+{
+  notified++;
+  REST.set_header_content_type(response, REST.type.APPLICATION_JSON);
+  REST.set_header_max_age(response, 60);
+  REST.set_response_payload(response, buffer,
+                            snprintf((char *)buffer, preferred_size,
+                                     "{\"n\":%lu,\"temp\":%d.%02d,"
+                                     "\"hum\":%d.%d,\"unit\":\"Cel\"}",
+                                     notified, 21 + (int)(notified % 7),
+                                     (int)(notified % 100),
+                                     40 + (int)(notified % 13),
+                                     (int)(notified % 10)));
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_client(int n)
+{
+  uip_ip6addr(&UIP_IP_BUF->srcipaddr, 0xfd00, 0, 0, 0, 0, 0, n >> 8, n & 0xff);
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  uip_ext_len = 0;
+  UIP_UDP_BUF->srcport = UIP_HTONS(5683);
+}
+/*---------------------------------------------------------------------------*/
+/* Observer n, from client n / (OBSERVERS / CLIENTS), on resource
+   n % RESOURCES */
+static void
+observe(int n, uint32_t observe)
+{
+  static coap_packet_t request[1];
+  static coap_packet_t response[1];
+  static char uri[48];
+  uint8_t token[2];
+  int r = n % RESOURCES;
+
+  if(resources[r].flags & HAS_SUB_RESOURCES) {
+    snprintf(uri, sizeof(uri), "%s/%d", paths[r], n / RESOURCES);
+  } else {
+    snprintf(uri, sizeof(uri), "%s", paths[r]);
+  }
+  token[0] = n >> 8;
+  token[1] = n & 0xff;
+
+  set_client(n / (OBSERVERS / CLIENTS));
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, uri);
+  coap_set_token(request, token, sizeof(token));
+  coap_set_header_observe(request, observe);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+  coap_observe_handler(&resources[r], request, response);
+}
+/*---------------------------------------------------------------------------*/
+/* Observer n of the fan-out resource, each from its own client */
+static void
+observe_hot(int n, uint32_t observe)
+{
+  static coap_packet_t request[1];
+  static coap_packet_t response[1];
+  uint8_t token[4];
+
+  token[0] = 0xf0;
+  token[1] = n >> 8;
+  token[2] = n & 0xff;
+  token[3] = 0x0f;
+
+  set_client(n);
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, "hot/temp");
+  coap_set_token(request, token, sizeof(token));
+  coap_set_header_observe(request, observe);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+  coap_observe_handler(&hot, request, response);
+}
+/*---------------------------------------------------------------------------*/
+/* Drop the n notifications sent after MID last */
+static void
+clear_transactions(uint16_t last, int n)
+{
+  coap_transaction_t *t;
+
+  while(n-- > 0) {
+    t = coap_get_transaction_by_mid(++last);
+    if(t != NULL) {
+      coap_clear_transaction(t);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_bench_process, ev, data)
+{
+  static int i, round, f;
+  static double start, secs;
+  coap_transaction_t *t;
+  unsigned long acked;
+  uint16_t mid;
+
+  PROCESS_BEGIN();
+
+  /* Let the CoAP engine start and take over transactions */
+  rest_init_engine();
+  PROCESS_PAUSE();
+
+  for(i = 0; i < RESOURCES; i++) {
+    if(i % 10 == 0) {
+      snprintf(paths[i], sizeof(paths[i]), "obj%d", i);
+      resources[i].flags = IS_OBSERVABLE | HAS_SUB_RESOURCES;
+    } else {
+      snprintf(paths[i], sizeof(paths[i]), "%d/0/5700", 3000 + i);
+      resources[i].flags = IS_OBSERVABLE;
+    }
+    resources[i].get_handler = get_handler;
+    rest_activate_resource(&resources[i], paths[i]);
+  }
+
+  printf("%-10s %10s %10s %14s\n", "phase", "operations", "seconds",
+         "operations/s");
+
+  start = now();
+  for(i = 0; i < OBSERVERS; i++) {
+    observe(i, 0);
+  }
+  printf("%-10s %10d %10.3f %14.0f\n", "register", OBSERVERS, now() - start,
+         OBSERVERS / (now() - start));
+
+  notified = 0;
+  start = now();
+  for(round = 0; round < ROUNDS; round++) {
+    for(i = 0; i < RESOURCES; i++) {
+      coap_notify_observers(&resources[i]);
+    }
+  }
+  printf("%-10s %10lu %10.3f %14.0f\n", "notify", notified, now() - start,
+         notified / (now() - start));
+
+  /* The last round was confirmable; ACK its transactions by MID */
+  acked = 0;
+  mid = coap_get_mid();
+  start = now();
+  for(i = 1; i <= OBSERVERS; i++) {
+    t = coap_get_transaction_by_mid(mid - i);
+    if(t != NULL) {
+      coap_clear_transaction(t);
+      acked++;
+    }
+  }
+  printf("%-10s %10lu %10.3f %14.0f\n", "ack", acked, now() - start,
+         acked / (now() - start));
+
+  start = now();
+  for(i = 0; i < OBSERVERS; i++) {
+    observe(i, 1);
+  }
+  printf("%-10s %10d %10.3f %14.0f\n", "cancel", OBSERVERS, now() - start,
+         OBSERVERS / (now() - start));
+
+  hot.flags = IS_OBSERVABLE;
+  hot.get_handler = hot_handler;
+  rest_activate_resource(&hot, "hot/temp");
+
+  printf("\n%-10s %10s %10s %14s %14s\n", "fan-out", "observers",
+         "handlers", "us/notify", "us/observer");
+  for(f = 0; f < sizeof(fanouts) / sizeof(fanouts[0]); f++) {
+    for(i = 0; i < fanouts[f]; i++) {
+      observe_hot(i, 0);
+    }
+    notified = 0;
+    secs = 0;
+    for(round = 0; round < FANOUT_ROUNDS; round++) {
+      mid = coap_get_mid();
+      start = now();
+      coap_notify_observers(&hot);
+      secs += now() - start;
+      clear_transactions(mid, fanouts[f]);
+    }
+    printf("%-10s %10d %10lu %14.2f %14.3f\n", "", fanouts[f], notified,
+           secs * 1e6 / FANOUT_ROUNDS,
+           secs * 1e6 / FANOUT_ROUNDS / fanouts[f]);
+    for(i = 0; i < fanouts[f]; i++) {
+      observe_hot(i, 1);
+    }
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
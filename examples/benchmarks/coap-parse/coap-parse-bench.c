@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Cost of coap_parse_message() and coap_serialize_message() on a
+ *         small corpus of typical CoAP traffic: discovery, LWM2M
+ *         registration and observation, blockwise transfers, and the
+ *         matching responses. Native only.
+ *
+ *         Each message is parsed and then read: only its Uri-Path, what
+ *         the engine and the REST engine read to dispatch it, or every
+ *         option. Serialization builds a request with
+ *         a multi-segment path and query and two kinds of response.
+ *
+ *         make TARGET=native && ./coap-parse-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=COAP_LAZY_PARSING=0
+ */
+
+#include "contiki.h"
+#include "er-coap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define ROUNDS 100000
+#define REPEAT 7
+
+static const struct {
+  uint16_t len;
+  const char *bytes;
+} corpus[] = {
+  /* GET /.well-known/core */
+  { 23, "\x42\x01\x1a\x01\x7c\x21\xbb\x2e\x77\x65\x6c\x6c\x2d\x6b\x6e\x6f"
+      "\x77\x6e\x04\x63\x6f\x72\x65" },
+  /* GET /3303/0/5700 Observe */
+  { 21, "\x44\x01\x1a\x02\x4e\x0a\x91\x33\x60\x54\x33\x33\x30\x33\x01\x30"
+      "\x04\x35\x37\x30\x30" },
+  /* POST /rd?ep=..&lt=..&b=U */
+  { 91, "\x44\x02\x1a\x03\x11\x22\x33\x44\xb2\x72\x64\x11\x28\x3c\x65\x70"
+      "\x3d\x6e\x6f\x64\x65\x2d\x30\x30\x31\x32\x06\x6c\x74\x3d\x33\x30"
+      "\x30\x09\x6c\x77\x6d\x32\x6d\x3d\x31\x2e\x30\x03\x62\x3d\x55\xff"
+      "\x3c\x2f\x31\x2f\x30\x3e\x2c\x3c\x2f\x33\x2f\x30\x3e\x2c\x3c\x2f"
+      "\x33\x33\x30\x33\x2f\x30\x3e\x2c\x3c\x2f\x33\x33\x30\x33\x2f\x31"
+      "\x3e\x2c\x3c\x2f\x33\x33\x31\x31\x2f\x30\x3e" },
+  /* GET Accept Block2 */
+  { 30, "\x42\x01\x1a\x04\xa0\xb1\xb7\x73\x65\x6e\x73\x6f\x72\x73\x0b\x74"
+      "\x65\x6d\x70\x65\x72\x61\x74\x75\x72\x65\x61\x32\x61\x22" },
+  /* PUT ?color=r */
+  { 37, "\x41\x03\x1a\x05\x05\xb9\x61\x63\x74\x75\x61\x74\x6f\x72\x73\x04"
+      "\x6c\x65\x64\x73\x10\x37\x63\x6f\x6c\x6f\x72\x3d\x72\xff\x6d\x6f"
+      "\x64\x65\x3d\x6f\x6e" },
+  /* 2.05 Observe notification */
+  { 61, "\x54\x45\x7b\x01\x4e\x0a\x91\x33\x62\x04\xd2\x61\x32\x21\x3c\xff"
+      "\x7b\x22\x62\x6e\x22\x3a\x22\x2f\x33\x33\x30\x33\x2f\x30\x2f\x22"
+      "\x2c\x22\x65\x22\x3a\x5b\x7b\x22\x6e\x22\x3a\x22\x35\x37\x30\x30"
+      "\x22\x2c\x22\x76\x22\x3a\x32\x31\x2e\x35\x7d\x5d\x7d" },
+  /* 2.01 Location-Path */
+  { 16, "\x64\x41\x1a\x03\x11\x22\x33\x44\x82\x72\x64\x04\x35\x61\x33\x66" },
+  /* Empty ACK */
+  { 4, "\x60\x00\x1a\x06" },
+  /* 2.05 ETag Block2 Size2 */
+  { 81, "\x62\x45\x1a\x04\xa0\xb1\x44\x9a\x3c\x01\x7e\x80\xb1\x2a\x51\xe6"
+      "\xff\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78"
+      "\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78"
+      "\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78"
+      "\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78\x78"
+      "\x78" },
+  /* POST Block1 */
+  { 93, "\x43\x02\x1a\x07\x00\x01\x02\xbc\x6c\x61\x72\x67\x65\x2d\x63\x72"
+      "\x65\x61\x74\x65\x10\xd1\x02\x3a\xd2\x14\x02\x00\xff\x79\x79\x79"
+      "\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79"
+      "\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79"
+      "\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79"
+      "\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79\x79" },
+};
+
+#define MESSAGES (sizeof(corpus) / sizeof(corpus[0]))
+
+static uint8_t buffer[COAP_MAX_PACKET_SIZE + 1];
+static coap_packet_t packet[1];
+static unsigned long checksum;
+
+PROCESS(coap_parse_bench_process, "CoAP parse benchmark");
+AUTOSTART_PROCESSES(&coap_parse_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse(int m)
+{
+  /* Parsing works in place, so start from a fresh copy */
+  memcpy(buffer, corpus[m].bytes, corpus[m].len);
+  if(coap_parse_message(packet, buffer, corpus[m].len) != NO_ERROR) {
+    printf("message %d does not parse\n", m);
+    exit(1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_uri_path(void)
+{
+  const char *str;
+
+  checksum += coap_get_header_uri_path(packet, &str);
+}
+/*---------------------------------------------------------------------------*/
+/* What the engine, the REST engine and the observe handler read */
+static void
+read_dispatch(void)
+{
+  const char *str;
+  uint32_t num, observe;
+  uint16_t size;
+
+  checksum += coap_get_header_uri_path(packet, &str);
+  if(coap_get_header_block2(packet, &num, NULL, &size, NULL)) {
+    checksum += num + size;
+  }
+  checksum += IS_OPTION(packet, COAP_OPTION_BLOCK1) ? 1 : 0;
+  if(coap_get_header_observe(packet, &observe)) {
+    checksum += observe;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_all(void)
+{
+  const char *str;
+  const uint8_t *bytes;
+  unsigned int format;
+  uint32_t num;
+  uint16_t size;
+  uint8_t more;
+
+  read_dispatch();
+  checksum += coap_get_header_uri_host(packet, &str);
+  checksum += coap_get_header_uri_query(packet, &str);
+  checksum += coap_get_header_location_path(packet, &str);
+  checksum += coap_get_header_location_query(packet, &str);
+  checksum += coap_get_header_etag(packet, &bytes);
+  checksum += coap_get_header_if_match(packet, &bytes);
+  if(coap_get_header_content_format(packet, &format)) {
+    checksum += format;
+  }
+  if(coap_get_header_accept(packet, &format)) {
+    checksum += format;
+  }
+  coap_get_header_max_age(packet, &num);
+  checksum += num;
+  if(coap_get_header_block1(packet, &num, &more, &size, NULL)) {
+    checksum += num + more + size;
+  }
+  if(coap_get_header_size1(packet, &num)) {
+    checksum += num;
+  }
+  if(coap_get_header_size2(packet, &num)) {
+    checksum += num;
+  }
+  checksum += coap_get_payload(packet, &bytes);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+serialize(int n)
+{
+  static const uint8_t token[] = { 0x4e, 0x0a, 0x91, 0x33 };
+  static const uint8_t etag[] = { 0x9a, 0x3c, 0x01, 0x7e };
+  static const char json[] =
+    "{\"bn\":\"/3303/0/\",\"e\":[{\"n\":\"5700\",\"v\":21.5}]}";
+  static const char links[] = "</1/0>,</3/0>,</3303/0>,</3303/1>,</3311/0>";
+
+  switch(n % 3) {
+  case 0:
+    coap_init_message(packet, COAP_TYPE_CON, COAP_POST, 0x1a03);
+    coap_set_token(packet, token, sizeof(token));
+    coap_set_header_uri_path(packet, "rd");
+    coap_set_header_content_format(packet, APPLICATION_LINK_FORMAT);
+    coap_set_header_uri_query(packet, "ep=node-0012&lt=300&lwm2m=1.0&b=U");
+    coap_set_payload(packet, links, sizeof(links) - 1);
+    break;
+  case 1:
+    coap_init_message(packet, COAP_TYPE_NON, CONTENT_2_05, 0x7b01);
+    coap_set_token(packet, token, sizeof(token));
+    coap_set_header_observe(packet, 1234);
+    coap_set_header_content_format(packet, APPLICATION_JSON);
+    coap_set_header_max_age(packet, 60);
+    coap_set_payload(packet, json, sizeof(json) - 1);
+    break;
+  default:
+    coap_init_message(packet, COAP_TYPE_ACK, CONTENT_2_05, 0x1a04);
+    coap_set_token(packet, token, 2);
+    coap_set_header_etag(packet, etag, sizeof(etag));
+    coap_set_header_uri_path(packet, "sensors/temperature/history");
+    coap_set_header_content_format(packet, TEXT_PLAIN);
+    coap_set_header_block2(packet, 2, 1, 64);
+    coap_set_header_size2(packet, 230);
+    coap_set_payload(packet, json, sizeof(json) - 1);
+    break;
+  }
+  return coap_serialize_message(packet, buffer);
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_parse(void)
+{
+  int r, m;
+
+  for(r = 0; r < ROUNDS; r++) {
+    for(m = 0; m < MESSAGES; m++) {
+      parse(m);
+      checksum += packet->code;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_uri_path(void)
+{
+  int r, m;
+
+  for(r = 0; r < ROUNDS; r++) {
+    for(m = 0; m < MESSAGES; m++) {
+      parse(m);
+      read_uri_path();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_dispatch(void)
+{
+  int r, m;
+
+  for(r = 0; r < ROUNDS; r++) {
+    for(m = 0; m < MESSAGES; m++) {
+      parse(m);
+      read_dispatch();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_all(void)
+{
+  int r, m;
+
+  for(r = 0; r < ROUNDS; r++) {
+    for(m = 0; m < MESSAGES; m++) {
+      parse(m);
+      read_all();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_serialize(void)
+{
+  int r;
+
+  for(r = 0; r < ROUNDS * MESSAGES; r++) {
+    checksum += serialize(r);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Best of REPEAT runs, as the timings of single runs are noisy */
+static void
+measure(const char *name, void (*run)(void))
+{
+  double start, secs, best = 0;
+  unsigned long sum = 0;
+  int i, m;
+
+  for(i = 0; i < REPEAT; i++) {
+    /* Fold the bytes of each kind of serialized message in once */
+    checksum = 0;
+    for(m = 0; run == run_serialize && m < 3; m++) {
+      size_t len = serialize(m);
+      while(len > 0) {
+        checksum = checksum * 31 + buffer[--len];
+      }
+    }
+    start = now();
+    run();
+    secs = now() - start;
+    if(i == 0 || secs < best) {
+      best = secs;
+    }
+    sum = checksum;
+  }
+  printf("%-10s %10lu %10.1f %20lu\n", name,
+         (unsigned long)(ROUNDS * MESSAGES),
+         best * 1e9 / (ROUNDS * MESSAGES), sum);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_parse_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("sizeof(coap_packet_t) %u\n", (unsigned)sizeof(coap_packet_t));
+  printf("%-10s %10s %10s %20s\n", "phase", "messages", "ns/message",
+         "checksum");
+
+  measure("parse", run_parse);
+  measure("uri-path", run_uri_path);
+  measure("dispatch", run_dispatch);
+  measure("all", run_all);
+  measure("serialize", run_serialize);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Operations/s and flash accesses of Coffee for three workloads,
+ *         for comparing the page cache and the name index with plain
+ *         Coffee. Native only.
+ *
+ *         log:   16 byte records appended to an open file
+ *         db:    a 64 kB relation scanned in 32 byte tuples, with every
+ *                eighth operation an 8 byte in-place write at a random
+ *                offset, as Antelope does when processing a relation
+ *         open:  open and close of 30 files in turn
+ *
+ *         The flash is the 1 MB RAM emulation that cfs-coffee-arch.h uses
+ *         on native, with xmem_pwrite() and friends replaced by copies
+ *         that count the accesses. The emulation costs next to nothing,
+ *         so ops/s only shows the CPU time spent in Coffee; on a mote
+ *         the flash reads and writes are what take the time.
+ *
+ *         make TARGET=native && ./coffee-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=COFFEE_PAGE_CACHE_SIZE=0,COFFEE_NAME_INDEX_SIZE=0
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "dev/xmem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define FLASH_SIZE    (1024UL * 1024UL)
+#define LOG_RECORDS   16000
+#define LOG_SIZE      (LOG_RECORDS * 16UL)
+#define DB_SIZE       (64 * 1024UL)
+#define DB_OPS        200000
+#define FILES         30
+#define OPENS         20000
+
+static unsigned char flash[FLASH_SIZE];
+static unsigned long flash_reads;
+static unsigned long flash_writes;
+static unsigned long flash_bytes_written;
+static unsigned long flash_erases;
+static unsigned long checksum;
+
+PROCESS(coffee_bench_process, "Coffee benchmark");
+AUTOSTART_PROCESSES(&coffee_bench_process);
+/*---------------------------------------------------------------------------*/
+int
+xmem_pwrite(const void *buf, int size, unsigned long offset)
+{
+  flash_writes++;
+  flash_bytes_written += size;
+  memcpy(&flash[offset], buf, size);
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_pread(void *buf, int size, unsigned long offset)
+{
+  flash_reads++;
+  memcpy(buf, &flash[offset], size);
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_erase(long nbytes, unsigned long offset)
+{
+  flash_erases++;
+  memset(&flash[offset], 0, nbytes);
+  return nbytes;
+}
+/*---------------------------------------------------------------------------*/
+void
+xmem_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static double start;
+
+static void
+begin(void)
+{
+  flash_reads = flash_writes = flash_bytes_written = flash_erases = 0;
+  start = now();
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, unsigned long ops)
+{
+  double secs = now() - start;
+
+  printf("%-6s %8lu %12.0f %10lu %10lu %12lu\n", name, ops, ops / secs,
+         flash_reads, flash_writes, flash_bytes_written);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_log(void)
+{
+  char record[16];
+  int fd, i;
+
+  cfs_coffee_reserve("log", LOG_SIZE);
+  fd = cfs_open("log", CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    printf("log: cannot open\n");
+    return;
+  }
+
+  begin();
+  for(i = 0; i < LOG_RECORDS; i++) {
+    snprintf(record, sizeof(record), "%08d,%6d", i, i * 7);
+    cfs_write(fd, record, sizeof(record));
+  }
+  cfs_close(fd);
+  report("log", LOG_RECORDS);
+
+  /* Read it back to see that nothing was lost */
+  fd = cfs_open("log", CFS_READ);
+  for(i = 0; i < LOG_RECORDS; i++) {
+    if(cfs_read(fd, record, sizeof(record)) != sizeof(record) ||
+       atoi(record) != i) {
+      printf("log: record %d is wrong\n", i);
+      break;
+    }
+  }
+  cfs_close(fd);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_db(void)
+{
+  static char page[256];
+  char buf[32];
+  int fd, i;
+  unsigned long offset;
+
+  cfs_coffee_reserve("db", DB_SIZE);
+  fd = cfs_open("db", CFS_READ | CFS_WRITE);
+  if(fd < 0) {
+    printf("db: cannot open\n");
+    return;
+  }
+  cfs_coffee_set_io_semantics(fd, CFS_COFFEE_IO_FLASH_AWARE);
+  for(i = 0; i < DB_SIZE / sizeof(page); i++) {
+    memset(page, i + 1, sizeof(page));
+    cfs_write(fd, page, sizeof(page));
+  }
+
+  srandom(1);
+  begin();
+  offset = 0;
+  for(i = 0; i < DB_OPS; i++) {
+    if(i % 8 == 0) {
+      /* Update a tuple somewhere */
+      cfs_seek(fd, (random() % (DB_SIZE / 8)) * 8, CFS_SEEK_SET);
+      cfs_write(fd, &i, 8);
+    } else {
+      /* Scan on through the relation */
+      cfs_seek(fd, offset, CFS_SEEK_SET);
+      cfs_read(fd, buf, sizeof(buf));
+      checksum += buf[0];
+      offset = (offset + sizeof(buf)) % DB_SIZE;
+    }
+  }
+  cfs_close(fd);
+  report("db", DB_OPS);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_open(void)
+{
+  char name[16];
+  int fd, i;
+
+  for(i = 0; i < FILES; i++) {
+    snprintf(name, sizeof(name), "file%d", i);
+    cfs_coffee_reserve(name, 1024);
+    fd = cfs_open(name, CFS_WRITE);
+    cfs_write(fd, name, strlen(name));
+    cfs_close(fd);
+  }
+
+  begin();
+  for(i = 0; i < OPENS; i++) {
+    snprintf(name, sizeof(name), "file%d", (i * 7) % FILES);
+    fd = cfs_open(name, CFS_READ);
+    if(fd < 0) {
+      printf("open: %s not found\n", name);
+      break;
+    }
+    cfs_close(fd);
+  }
+  report("open", OPENS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("page cache %d, name index %d\n",
+         COFFEE_PAGE_CACHE_SIZE, COFFEE_NAME_INDEX_SIZE);
+  printf("%-6s %8s %12s %10s %10s %12s\n", "", "ops", "ops/s",
+         "reads", "writes", "bytes written");
+
+  cfs_coffee_format();
+  bench_log();
+  bench_db();
+  bench_open();
+
+  exit(checksum == 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
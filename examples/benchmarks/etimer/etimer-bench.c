@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Insert, restart and expiry rates of event timers at 10 to
+ *         10,000 active timers, for comparing the etimer heap with the
+ *         plain timer list. Native only.
+ *
+ *         make TARGET=native && ./etimer-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=ETIMER_CONF_HEAP_SIZE=0
+ */
+
+#include "contiki.h"
+#include "sys/etimer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MAX_TIMERS 10000
+#define RESTARTS   10000
+
+static struct etimer timers[MAX_TIMERS];
+static const int sizes[] = { 10, 100, 1000, 10000 };
+static int expired;
+
+PROCESS(etimer_bench_process, "Etimer benchmark");
+PROCESS(timer_sink_process, "Timer sink");
+AUTOSTART_PROCESSES(&etimer_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+far_interval(void)
+{
+  /* Long enough not to expire during the run */
+  return CLOCK_SECOND * 3600 + random() % (CLOCK_SECOND * 60);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(timer_sink_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    expired++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_bench_process, ev, data)
+{
+  static int s, i, n;
+  static double start, insert_time, restart_time;
+
+  PROCESS_BEGIN();
+
+  process_start(&timer_sink_process, NULL);
+
+  printf("etimer heap size %d\n", ETIMER_HEAP_SIZE);
+  printf("%8s %14s %14s %14s\n", "timers", "insert/s", "restart/s",
+         "expire/s");
+
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    n = sizes[s];
+    srandom(n);
+
+    start = now();
+    for(i = 0; i < n; i++) {
+      etimer_set(&timers[i], far_interval());
+    }
+    insert_time = now() - start;
+
+    /* Re-arm timers that are already running, as protocols do */
+    start = now();
+    for(i = 0; i < RESTARTS; i++) {
+      etimer_set(&timers[random() % n], far_interval());
+    }
+    restart_time = now() - start;
+
+    for(i = 0; i < n; i++) {
+      etimer_stop(&timers[i]);
+    }
+
+    /* Let n timers of the sink process come due within a few ticks of
+       each other, then time how fast they are dispatched. The scheduler
+       is run from here so that the select() in the native main loop
+       does not dominate the measurement. */
+    PROCESS_CONTEXT_BEGIN(&timer_sink_process);
+    for(i = 0; i < n; i++) {
+      etimer_set(&timers[i], 1 + random() % 10);
+    }
+    PROCESS_CONTEXT_END(&timer_sink_process);
+    usleep(20 * 1000000 / CLOCK_SECOND);
+    start = now();
+    expired = 0;
+    while(expired < n) {
+      etimer_request_poll();
+      process_run();
+    }
+
+    printf("%8d %14.0f %14.0f %14.0f\n", n, n / insert_time,
+           RESTARTS / restart_time, n / (now() - start));
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
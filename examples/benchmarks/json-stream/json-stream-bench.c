@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         MB/s of JSON parsed and written by jsonparse/jsontree and by
+ *         jsonstream. Native only.
+ *
+ *         The document is an LWM2M JSON (SenML) read of ENTRIES resources,
+ *         about 100 kB. jsonparse needs all of it in memory; jsonstream is
+ *         fed blocks of 64 and 512 bytes as well as the whole of it.
+ *
+ *         For output, a jsontree of TREE_ENTRIES objects is rendered through a
+ *         putchar function into memory, and through a jsonstream writer
+ *         with a 64 byte buffer. The same document is also written with
+ *         the jsonstream_write_ functions directly.
+ *
+ *         make TARGET=native && ./json-stream-bench.native
+ */
+
+#include "contiki.h"
+#include "jsonparse.h"
+#include "jsontree.h"
+#include "jsonstream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define ENTRIES     2500
+#define DOC_SIZE    (ENTRIES * 64)
+#define ROUNDS      50
+/* jsontree arrays hold at most 255 values */
+#define TREE_ENTRIES 250
+#define TREE_ROUNDS 500
+#define BLOCK_SIZE  64
+
+static char doc[DOC_SIZE];
+static int doc_len;
+static char out[DOC_SIZE];
+static int out_len;
+static char ref[DOC_SIZE];
+static int ref_len;
+static unsigned long tokens;
+static unsigned long checksum;
+
+static const char *units = "Cel";
+static int32_t value = 2150;
+static struct jsontree_ptr value_ptr = { JSON_TYPE_S32PTR, &value };
+static struct jsontree_string unit = JSONTREE_STRING("Cel");
+
+JSONTREE_OBJECT(entry,
+                JSONTREE_PAIR("n", &unit),
+                JSONTREE_PAIR("v", &value_ptr),
+                JSONTREE_PAIR("sv", &unit));
+JSONTREE_ARRAY(entries, TREE_ENTRIES);
+JSONTREE_OBJECT(senml,
+                JSONTREE_PAIR("bn", &unit),
+                JSONTREE_PAIR("e", &entries));
+
+PROCESS(json_bench_process, "JSON benchmark");
+AUTOSTART_PROCESSES(&json_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, unsigned long bytes, double secs)
+{
+  printf("%-18s %10lu %8.1f %10lu\n", name, bytes, bytes / secs / 1e6,
+         tokens);
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_doc(void)
+{
+  int i;
+
+  doc_len = sprintf(doc, "{\"bn\":\"/3303/\",\"e\":[");
+  for(i = 0; i < ENTRIES; i++) {
+    doc_len += sprintf(&doc[doc_len],
+                       "%s{\"n\":\"%d/5700\",\"v\":%d.%d},\n"
+                       "{\"n\":\"%d/5701\",\"sv\":\"Cel\"},"
+                       "{\"n\":\"%d/5850\",\"bv\":%s}",
+                       i == 0 ? "" : ",", i, 20 + i % 10, i % 100, i, i,
+                       i % 2 ? "true" : "false");
+    if(doc_len > DOC_SIZE - 200) {
+      break;
+    }
+  }
+  doc_len += sprintf(&doc[doc_len], "]}");
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse_jsonparse(void)
+{
+  struct jsonparse_state js;
+  int type;
+  int i;
+  double start;
+
+  tokens = 0;
+  start = now();
+  for(i = 0; i < ROUNDS; i++) {
+    jsonparse_setup(&js, doc, doc_len);
+    while((type = jsonparse_next(&js)) != 0) {
+      if(type != ',') {
+        tokens++;
+        checksum += jsonparse_get_len(&js);
+      }
+    }
+  }
+  report("jsonparse", (unsigned long)doc_len * ROUNDS, now() - start);
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_token(struct jsonstream_parser *p, int type, const char *value, int len)
+{
+  tokens++;
+  checksum += len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse_jsonstream(const char *name, int block_size)
+{
+  static char buf[64];
+  struct jsonstream_parser p;
+  int i, pos, err;
+  double start;
+
+  tokens = 0;
+  err = 0;
+  start = now();
+  for(i = 0; i < ROUNDS; i++) {
+    jsonstream_parser_init(&p, buf, sizeof(buf), count_token, NULL);
+    for(pos = 0; pos < doc_len && !err; pos += block_size) {
+      err = jsonstream_parse(&p, &doc[pos], MIN(block_size, doc_len - pos));
+    }
+    err = jsonstream_end(&p);
+  }
+  report(name, (unsigned long)doc_len * ROUNDS, now() - start);
+  if(err) {
+    printf("parse error %d\n", err);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+putchar_out(int c)
+{
+  if(out_len < sizeof(out)) {
+    out[out_len++] = c;
+  }
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+static int
+flush_out(struct jsonstream_writer *w, const char *data, int len)
+{
+  if(out_len + len > sizeof(out)) {
+    return -1;
+  }
+  memcpy(&out[out_len], data, len);
+  out_len += len;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_output(const char *name)
+{
+  if(out_len != ref_len || memcmp(out, ref, ref_len) != 0) {
+    printf("%s: output differs\n", name);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_jsontree(void)
+{
+  struct jsontree_context js;
+  int i;
+  double start;
+
+  tokens = 0;
+  start = now();
+  for(i = 0; i < TREE_ROUNDS; i++) {
+    out_len = 0;
+    jsontree_setup(&js, (struct jsontree_value *)&senml, putchar_out);
+    while(jsontree_print_next(&js));
+  }
+  report("jsontree putchar", (unsigned long)out_len * TREE_ROUNDS, now() - start);
+  memcpy(ref, out, out_len);
+  ref_len = out_len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_jsontree_writer(void)
+{
+  static char buf[BLOCK_SIZE];
+  struct jsonstream_writer w;
+  struct jsontree_context js;
+  int i;
+  double start;
+
+  tokens = 0;
+  start = now();
+  for(i = 0; i < TREE_ROUNDS; i++) {
+    out_len = 0;
+    jsonstream_writer_init(&w, buf, sizeof(buf), flush_out, NULL);
+    jsontree_setup_writer(&js, (struct jsontree_value *)&senml, &w);
+    while(jsontree_print_next(&js));
+    jsonstream_writer_flush(&w);
+  }
+  report("jsontree writer", (unsigned long)out_len * TREE_ROUNDS, now() - start);
+  check_output("jsontree writer");
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_jsonstream(void)
+{
+  static char buf[BLOCK_SIZE];
+  struct jsonstream_writer w;
+  int i, e;
+  double start;
+
+  tokens = 0;
+  start = now();
+  for(i = 0; i < TREE_ROUNDS; i++) {
+    out_len = 0;
+    jsonstream_writer_init(&w, buf, sizeof(buf), flush_out, NULL);
+    jsonstream_write_object_start(&w);
+    jsonstream_write_name(&w, "bn");
+    jsonstream_write_string(&w, units);
+    jsonstream_write_name(&w, "e");
+    jsonstream_write_array_start(&w);
+    for(e = 0; e < TREE_ENTRIES; e++) {
+      jsonstream_write_object_start(&w);
+      jsonstream_write_name(&w, "n");
+      jsonstream_write_string(&w, units);
+      jsonstream_write_name(&w, "v");
+      jsonstream_write_int(&w, value);
+      jsonstream_write_name(&w, "sv");
+      jsonstream_write_string(&w, units);
+      jsonstream_write_object_end(&w);
+    }
+    jsonstream_write_array_end(&w);
+    jsonstream_write_object_end(&w);
+    jsonstream_writer_flush(&w);
+  }
+  report("jsonstream write", (unsigned long)out_len * TREE_ROUNDS, now() - start);
+  check_output("jsonstream write");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(json_bench_process, ev, data)
+{
+  int i;
+
+  PROCESS_BEGIN();
+
+  make_doc();
+  for(i = 0; i < TREE_ENTRIES; i++) {
+    entries.values[i] = (struct jsontree_value *)&entry;
+  }
+
+  printf("%-18s %10s %8s %10s\n", "", "bytes", "MB/s", "tokens");
+  parse_jsonparse();
+  parse_jsonstream("jsonstream 64", 64);
+  parse_jsonstream("jsonstream 512", 512);
+  parse_jsonstream("jsonstream whole", doc_len);
+  write_jsontree();
+  write_jsontree_writer();
+  write_jsonstream();
+
+  exit(checksum == 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
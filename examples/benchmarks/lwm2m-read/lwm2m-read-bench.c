@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Reads/s and MB/s of LWM2M object instance reads through
+ *         lwm2m_engine_handler(), per format. Native only.
+ *
+ *         The test object looks like a Device object (/3/0): 20 string,
+ *         integer, float, boolean and callback resources. It is read as a
+ *         whole in TLV and in JSON, and resource by resource in TLV and in
+ *         plain text, the way a server has to when the client cannot read
+ *         whole instances in TLV. The large object has 30 string resources
+ *         and is read block by block, and checked against a read with one
+ *         big enough buffer.
+ *
+ *         make TARGET=native && ./lwm2m-read-bench.native
+ */
+
+#include "contiki.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "er-coap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define READS       200000
+#define BLOCK_SIZE  64
+#define LARGE_COUNT 30
+
+static int32_t battery = 87;
+static int32_t temperature = 22 * LWM2M_FLOAT32_FRAC + 512;
+static int32_t memory_free = 2512;
+static int charging = 1;
+static uint8_t timezone_buf[32] = "Europe/Stockholm";
+static uint16_t timezone_len = 16;
+static uint8_t *timezone = timezone_buf;
+static unsigned long checksum;
+static char large_values[LARGE_COUNT][24];
+static lwm2m_resource_t large_resources[LARGE_COUNT];
+/*---------------------------------------------------------------------------*/
+static int
+read_time(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outsize)
+{
+  return ctx->writer->write_int(ctx, outbuf, outsize, 1500000000);
+}
+/*---------------------------------------------------------------------------*/
+LWM2M_RESOURCES(device_resources,
+                LWM2M_RESOURCE_STRING(0, "Contiki benchmarks"),
+                LWM2M_RESOURCE_STRING(1, "Native model 1"),
+                LWM2M_RESOURCE_STRING(2, "SN-0000-1234-5678"),
+                LWM2M_RESOURCE_STRING(3, "3.0-rc1"),
+                LWM2M_RESOURCE_INTEGER(6, 1),
+                LWM2M_RESOURCE_INTEGER(7, 3300),
+                LWM2M_RESOURCE_INTEGER(8, 120),
+                LWM2M_RESOURCE_INTEGER_VAR(9, &battery),
+                LWM2M_RESOURCE_INTEGER_VAR(10, &memory_free),
+                LWM2M_RESOURCE_INTEGER(11, 0),
+                LWM2M_RESOURCE_CALLBACK(13, { read_time, NULL, NULL }),
+                LWM2M_RESOURCE_STRING(14, "+01:00"),
+                LWM2M_RESOURCE_STRING_VAR(15, sizeof(timezone_buf),
+                                          &timezone_len, &timezone),
+                LWM2M_RESOURCE_STRING(16, "U"),
+                LWM2M_RESOURCE_STRING(17, "Sensor node"),
+                LWM2M_RESOURCE_STRING(18, "HW 2.1"),
+                LWM2M_RESOURCE_STRING(19, "SW 3.0"),
+                LWM2M_RESOURCE_INTEGER(20, 1),
+                LWM2M_RESOURCE_INTEGER(21, 32768),
+                LWM2M_RESOURCE_FLOATFIX_VAR(5700, &temperature),
+                LWM2M_RESOURCE_BOOLEAN_VAR(5850, &charging),
+                );
+LWM2M_INSTANCES(device_instances, LWM2M_INSTANCE(0, device_resources));
+LWM2M_OBJECT(device, 3, device_instances);
+
+static lwm2m_instance_t large_instances[] = {
+  { 0, LARGE_COUNT, LWM2M_INSTANCE_FLAG_USED, large_resources }
+};
+LWM2M_OBJECT(large, 3341, large_instances);
+
+PROCESS(lwm2m_bench_process, "LWM2M read benchmark");
+AUTOSTART_PROCESSES(&lwm2m_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+/* GET of url with the given Accept, returns the payload length */
+static int
+get(const lwm2m_object_t *object, const char *url, unsigned int accept,
+    uint8_t *buffer, uint16_t size, int32_t *offset)
+{
+  static coap_packet_t request[1];
+  static coap_packet_t response[1];
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, url);
+  coap_set_header_accept(request, accept);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+  lwm2m_engine_handler(object, request, response, buffer, size, offset);
+  if(response->code != CONTENT_2_05) {
+    return -1;
+  }
+  checksum += response->payload_len + response->payload[0];
+  return response->payload_len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, unsigned long reads, unsigned long bytes,
+       double secs)
+{
+  printf("%-14s %8lu %10.0f %8.2f %8lu\n", name, reads, reads / secs,
+         bytes / secs / 1e6, bytes / reads);
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_per_resource(const char *name, unsigned int accept)
+{
+  static char urls[21][16];
+  static uint8_t buffer[REST_MAX_CHUNK_SIZE];
+  unsigned long bytes = 0;
+  double start;
+  int32_t offset;
+  int i, r, len;
+
+  for(r = 0; r < device_instances[0].count; r++) {
+    snprintf(urls[r], sizeof(urls[r]), "3/0/%u", device_resources[r].id);
+  }
+
+  start = now();
+  for(i = 0; i < READS; i++) {
+    for(r = 0; r < device_instances[0].count; r++) {
+      offset = 0;
+      len = get(&device, urls[r], accept, buffer, sizeof(buffer), &offset);
+      if(len > 0) {
+        bytes += len;
+      }
+    }
+  }
+  report(name, READS, bytes, now() - start);
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_instance(const char *name, unsigned int accept)
+{
+  static uint8_t buffer[REST_MAX_CHUNK_SIZE];
+  unsigned long bytes = 0;
+  double start;
+  int32_t offset;
+  int i, len;
+
+  start = now();
+  for(i = 0; i < READS; i++) {
+    offset = 0;
+    len = get(&device, "3/0", accept, buffer, sizeof(buffer), &offset);
+    if(len > 0) {
+      bytes += len;
+    }
+  }
+  report(name, READS, bytes, now() - start);
+}
+/*---------------------------------------------------------------------------*/
+/* Reads url block by block and compares with a read of the whole */
+static void
+check_blocks(const lwm2m_object_t *object, const char *url, uint16_t size)
+{
+  static uint8_t whole[REST_MAX_CHUNK_SIZE];
+  static uint8_t blocks[REST_MAX_CHUNK_SIZE];
+  static uint8_t buffer[REST_MAX_CHUNK_SIZE];
+  int32_t offset;
+  int len, whole_len, blocks_len, nblocks;
+
+  offset = 0;
+  whole_len = get(object, url, LWM2M_TLV, whole, sizeof(whole), &offset);
+
+  offset = 0;
+  blocks_len = 0;
+  nblocks = 0;
+  do {
+    len = get(object, url, LWM2M_TLV, buffer, size, &offset);
+    if(len <= 0 || blocks_len + len > sizeof(blocks)) {
+      break;
+    }
+    memcpy(&blocks[blocks_len], buffer, len);
+    blocks_len += len;
+    nblocks++;
+  } while(offset != -1);
+
+  printf("/%s: %d bytes, %d blocks of %u: %s\n", url, whole_len, nblocks,
+         size, blocks_len == whole_len &&
+         memcmp(whole, blocks, whole_len) == 0 ? "ok" : "MISMATCH");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(lwm2m_bench_process, ev, data)
+{
+  int i;
+
+  PROCESS_BEGIN();
+
+  printf("%-14s %8s %10s %8s %8s\n", "read", "reads", "reads/s", "MB/s",
+         "bytes");
+  read_instance("instance tlv", LWM2M_TLV);
+  read_instance("instance json", LWM2M_JSON);
+  read_per_resource("resource tlv", LWM2M_TLV);
+  read_per_resource("resource text", LWM2M_TEXT_PLAIN);
+
+  for(i = 0; i < LARGE_COUNT; i++) {
+    snprintf(large_values[i], sizeof(large_values[i]),
+             "resource %d, %s", i, i % 2 ? "odd" : "even");
+    large_resources[i].id = i;
+    large_resources[i].type = LWM2M_RESOURCE_TYPE_STR_VALUE;
+    large_resources[i].value.string.len = strlen(large_values[i]);
+    large_resources[i].value.string.value = (uint8_t *)large_values[i];
+  }
+
+  check_blocks(&device, "3/0", 16);
+  check_blocks(&large, "3341/0", BLOCK_SIZE);
+
+  exit(checksum == 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
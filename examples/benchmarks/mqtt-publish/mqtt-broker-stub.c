@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Stand-in for tcp-socket.c with a minimal MQTT broker at the
+ *         other end of a simulated link. Only one socket is supported.
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "sys/cc.h"
+#include "sys/ctimer.h"
+#include "tcp-socket.h"
+#include "mqtt-broker-stub.h"
+
+#include <string.h>
+
+/* As uIP with a 1280 byte buffer */
+#define MSS 1220
+
+struct broker_stub_stats broker_stub_stats;
+
+static clock_time_t delay = CLOCK_SECOND / 100;
+static unsigned long drop_after;
+
+static struct tcp_socket *sock;
+static uint8_t connected;
+static struct ctimer up_timer, down_timer;
+
+/* Length of the client segment in flight, 0 if none */
+static uint16_t segment_len;
+
+/* Broker side of the stream */
+static uint8_t rx[2 * MSS];
+static uint16_t rx_len;
+static uint8_t tx[MSS];
+static uint16_t tx_len;
+static uint8_t seen[65536 / 8];
+
+static void segment_arrived(void *ptr);
+/*---------------------------------------------------------------------------*/
+void
+broker_stub_set_delay(clock_time_t d)
+{
+  delay = d;
+}
+/*---------------------------------------------------------------------------*/
+void
+broker_stub_reset(void)
+{
+  memset(&broker_stub_stats, 0, sizeof(broker_stub_stats));
+  memset(seen, 0, sizeof(seen));
+}
+/*---------------------------------------------------------------------------*/
+void
+broker_stub_drop_after(unsigned long publishes)
+{
+  drop_after = publishes;
+}
+/*---------------------------------------------------------------------------*/
+/* Hands a piece of the broker to client stream to the client */
+static void
+deliver(const uint8_t *data, uint32_t len, uint16_t seg_size)
+{
+  uint16_t n;
+
+  while(len > 0 && connected) {
+    n = MIN(MIN(len, seg_size), sock->input_data_maxlen);
+    memcpy(sock->input_data_ptr, data, n);
+    sock->input_callback(sock, sock->ptr, sock->input_data_ptr, n);
+    data += n;
+    len -= n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+broker_stub_publish(const char *topic, const uint8_t *payload, uint32_t len,
+                    uint16_t seg_size)
+{
+  uint8_t hdr[5 + 2 + 256];
+  uint8_t seg[MSS];
+  uint16_t topic_len = strlen(topic);
+  uint32_t remaining = 2 + topic_len + len;
+  uint16_t hdr_len;
+  uint32_t n;
+  uint8_t *p = hdr;
+  uint8_t byte;
+
+  seg_size = MIN(seg_size, MSS);
+  if(sock == NULL || !connected || topic_len > 256 ||
+     seg_size <= 5 + 2 + topic_len) {
+    return;
+  }
+
+  *p++ = 0x30;
+  do {
+    byte = remaining % 128;
+    remaining /= 128;
+    *p++ = byte | (remaining > 0 ? 128 : 0);
+  } while(remaining > 0);
+  *p++ = topic_len >> 8;
+  *p++ = topic_len & 0xff;
+  memcpy(p, topic, topic_len);
+  hdr_len = p + topic_len - hdr;
+
+  /* The payload starts in the segment that carries the header */
+  n = MIN(len, seg_size - hdr_len);
+  memcpy(seg, hdr, hdr_len);
+  memcpy(&seg[hdr_len], payload, n);
+  deliver(seg, hdr_len + n, seg_size);
+  deliver(&payload[n], len - n, seg_size);
+}
+/*---------------------------------------------------------------------------*/
+static void
+reply(uint8_t fhdr, uint16_t mid, uint8_t len)
+{
+  if(tx_len + 2 + len > sizeof(tx)) {
+    return;
+  }
+  tx[tx_len++] = fhdr;
+  tx[tx_len++] = len;
+  if(len >= 2) {
+    tx[tx_len++] = mid >> 8;
+    tx[tx_len++] = mid & 0xff;
+  }
+  if(len == 3) {
+    /* SUBACK granted QoS */
+    tx[tx_len++] = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+broker_packet(uint8_t fhdr, const uint8_t *p, uint32_t len)
+{
+  uint16_t topic_len;
+  uint16_t mid;
+
+  switch(fhdr & 0xf0) {
+  case 0x10:
+    broker_stub_stats.connects++;
+    /* CONNACK, accepted */
+    reply(0x20, 0, 2);
+    break;
+  case 0x30:
+    broker_stub_stats.publishes++;
+    if(fhdr & 0x08) {
+      broker_stub_stats.duplicates++;
+    }
+    topic_len = (p[0] << 8) | p[1];
+    if((fhdr & 0x06) == 0) {
+      broker_stub_stats.unique++;
+      break;
+    }
+    mid = (p[2 + topic_len] << 8) | p[3 + topic_len];
+    if(!(seen[mid / 8] & (1 << (mid % 8)))) {
+      seen[mid / 8] |= 1 << (mid % 8);
+      broker_stub_stats.unique++;
+    }
+    reply(0x40, mid, 2);
+    break;
+  case 0x80:
+    reply(0x90, (p[0] << 8) | p[1], 3);
+    break;
+  case 0xc0:
+    reply(0xd0, 0, 0);
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+broker_input(const uint8_t *data, uint16_t len)
+{
+  uint32_t remaining;
+  uint32_t multiplier;
+  uint16_t pos, hdr;
+
+  if(rx_len + len > sizeof(rx)) {
+    rx_len = 0;
+    return;
+  }
+  memcpy(&rx[rx_len], data, len);
+  rx_len += len;
+
+  pos = 0;
+  while(pos < rx_len) {
+    /* Fixed header and Remaining Length */
+    remaining = 0;
+    multiplier = 1;
+    hdr = 1;
+    do {
+      if(pos + hdr >= rx_len) {
+        goto partial;
+      }
+      remaining += (rx[pos + hdr] & 127) * multiplier;
+      multiplier *= 128;
+    } while(rx[pos + hdr++] & 128);
+    if(pos + hdr + remaining > rx_len) {
+      break;
+    }
+    broker_packet(rx[pos], &rx[pos + hdr], remaining);
+    pos += hdr + remaining;
+  }
+partial:
+  memmove(rx, &rx[pos], rx_len - pos);
+  rx_len -= pos;
+}
+/*---------------------------------------------------------------------------*/
+static void
+transmit(void)
+{
+  segment_len = sock->output_data_len;
+  if(sock->output_data_max_seg > 0 && segment_len > sock->output_data_max_seg) {
+    segment_len = sock->output_data_max_seg;
+  }
+  if(segment_len > MSS) {
+    segment_len = MSS;
+  }
+  broker_stub_stats.segments++;
+  broker_stub_stats.bytes += segment_len;
+  ctimer_set(&up_timer, delay, segment_arrived, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+segment_acked(void *ptr)
+{
+  uint16_t pos, len;
+
+  if(!connected) {
+    return;
+  }
+
+  /* The TCP ACK, handled as in tcp-socket.c */
+  memmove(sock->output_data_ptr, &sock->output_data_ptr[segment_len],
+          sock->output_data_len - segment_len);
+  sock->output_data_len -= segment_len;
+  segment_len = 0;
+  sock->event_callback(sock, sock->ptr, TCP_SOCKET_DATA_SENT);
+
+  /* The broker's replies, in one segment */
+  for(pos = 0; pos < tx_len && connected; pos += len) {
+    len = MIN(tx_len - pos, sock->input_data_maxlen);
+    memcpy(sock->input_data_ptr, &tx[pos], len);
+    sock->input_callback(sock, sock->ptr, sock->input_data_ptr, len);
+  }
+  tx_len = 0;
+
+  if(connected && segment_len == 0 && sock->output_data_len > 0) {
+    transmit();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+segment_arrived(void *ptr)
+{
+  struct tcp_socket *s = sock;
+
+  if(!connected) {
+    return;
+  }
+
+  broker_input(sock->output_data_ptr, segment_len);
+
+  if(drop_after > 0 && broker_stub_stats.publishes >= drop_after) {
+    /* The broker goes away, its replies to this segment are lost */
+    drop_after = 0;
+    connected = 0;
+    segment_len = 0;
+    tx_len = 0;
+    rx_len = 0;
+    sock = NULL;
+    s->event_callback(s, s->ptr, TCP_SOCKET_CLOSED);
+    return;
+  }
+
+  ctimer_set(&down_timer, delay, segment_acked, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+connect_done(void *ptr)
+{
+  connected = 1;
+  sock->event_callback(sock, sock->ptr, TCP_SOCKET_CONNECTED);
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_register(struct tcp_socket *s, void *ptr,
+                    uint8_t *input_databuf, int input_databuf_len,
+                    uint8_t *output_databuf, int output_databuf_len,
+                    tcp_socket_data_callback_t input_callback,
+                    tcp_socket_event_callback_t event_callback)
+{
+  if(s == NULL) {
+    return -1;
+  }
+  s->ptr = ptr;
+  s->input_data_ptr = input_databuf;
+  s->input_data_maxlen = input_databuf_len;
+  s->output_data_len = 0;
+  s->output_data_ptr = output_databuf;
+  s->output_data_maxlen = output_databuf_len;
+  s->input_callback = input_callback;
+  s->event_callback = event_callback;
+  s->listen_port = 0;
+  s->flags = TCP_SOCKET_FLAGS_NONE;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_connect(struct tcp_socket *s, const uip_ipaddr_t *ipaddr,
+                   uint16_t port)
+{
+  sock = s;
+  connected = 0;
+  segment_len = 0;
+  rx_len = 0;
+  tx_len = 0;
+  ctimer_stop(&up_timer);
+  ctimer_set(&down_timer, 2 * delay, connect_done, NULL);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_listen(struct tcp_socket *s, uint16_t port)
+{
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_unlisten(struct tcp_socket *s)
+{
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_send(struct tcp_socket *s, const uint8_t *data, int datalen)
+{
+  int len;
+
+  if(s != sock || !connected) {
+    return -1;
+  }
+
+  len = MIN(datalen, s->output_data_maxlen - s->output_data_len);
+  memmove(&s->output_data_ptr[s->output_data_len], data, len);
+  s->output_data_len += len;
+
+  if(segment_len == 0) {
+    transmit();
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_send_str(struct tcp_socket *s, const char *str)
+{
+  return tcp_socket_send(s, (const uint8_t *)str, strlen(str));
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_close(struct tcp_socket *s)
+{
+  if(s == sock) {
+    ctimer_stop(&up_timer);
+    ctimer_stop(&down_timer);
+    connected = 0;
+    segment_len = 0;
+    sock = NULL;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_unregister(struct tcp_socket *s)
+{
+  return tcp_socket_close(s);
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_max_sendlen(struct tcp_socket *s)
+{
+  return s->output_data_maxlen - s->output_data_len;
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_socket_queuelen(struct tcp_socket *s)
+{
+  return s->output_data_len;
+}
+/*---------------------------------------------------------------------------*/
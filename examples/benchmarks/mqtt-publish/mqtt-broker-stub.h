@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Stand-in for tcp-socket.c that connects an MQTT client to a
+ *         minimal in-process broker over a simulated link, for the MQTT
+ *         publish benchmark.
+ *
+ *         Like uIP, the link carries one unacknowledged segment at a
+ *         time, of at most output_data_max_seg bytes. A segment reaches
+ *         the broker after the one-way delay; the broker's replies and
+ *         the TCP ACK return one delay later. The broker answers CONNECT,
+ *         PUBLISH with QoS 1, SUBSCRIBE and PINGREQ, and can publish to
+ *         the client.
+ */
+
+#ifndef MQTT_BROKER_STUB_H_
+#define MQTT_BROKER_STUB_H_
+
+#include "contiki.h"
+
+struct broker_stub_stats {
+  /* Client to broker */
+  unsigned long segments;
+  unsigned long bytes;
+  /* PUBLISH packets received, those with the DUP flag, and distinct MIDs */
+  unsigned long publishes;
+  unsigned long duplicates;
+  unsigned long unique;
+  unsigned long connects;
+};
+
+extern struct broker_stub_stats broker_stub_stats;
+
+/** Sets the one-way delay of the link */
+void broker_stub_set_delay(clock_time_t delay);
+
+/** Clears the statistics and the MIDs seen */
+void broker_stub_reset(void);
+
+/**
+ * Breaks the connection once the broker has received this many PUBLISH
+ * packets since the last broker_stub_reset(). The replies to the segment
+ * that reaches the limit are lost. 0 disables.
+ */
+void broker_stub_drop_after(unsigned long publishes);
+
+/**
+ * Sends a QoS 0 PUBLISH from the broker to the client right away, in
+ * segments of at most seg_size bytes. Each is copied into the socket's
+ * input buffer and handed to the client as tcp-socket.c does.
+ */
+void broker_stub_publish(const char *topic, const uint8_t *payload,
+                         uint32_t len, uint16_t seg_size);
+
+#endif /* MQTT_BROKER_STUB_H_ */
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Messages/s published by the MQTT client to a stand-in broker
+ *         over simulated links, for comparing one outstanding PUBLISH
+ *         with the outbound queue. Native only.
+ *
+ *         The TCP socket is replaced by mqtt-broker-stub.c, which delays
+ *         each segment by the one-way delay of the phase and answers
+ *         like a broker. Every phase publishes MESSAGES telemetry-sized
+ *         messages as fast as mqtt_ready() allows and ends once all of
+ *         them have been acknowledged (QoS 1) or have reached the broker
+ *         (QoS 0). In the "drop" phase the broker breaks the connection
+ *         halfway through and the client reconnects.
+ *
+ *         make TARGET=native && ./mqtt-publish-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=MQTT_CONF_MAX_INFLIGHT=0
+ */
+
+#include "contiki.h"
+#include "mqtt.h"
+#include "mqtt-broker-stub.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MESSAGES          100
+#define MAX_SEGMENT_SIZE  256
+#define PHASE_TIMEOUT     (CLOCK_SECOND * 30)
+#define TOPIC             "iot-2/evt/status/fmt/json"
+
+struct phase {
+  const char *name;
+  clock_time_t delay;
+  mqtt_qos_level_t qos;
+  unsigned long drop_after;
+};
+
+static const struct phase phases[] = {
+  { "qos1", CLOCK_SECOND / 100, MQTT_QOS_LEVEL_1, 0 },
+  { "qos1", CLOCK_SECOND / 20, MQTT_QOS_LEVEL_1, 0 },
+  { "qos0", CLOCK_SECOND / 20, MQTT_QOS_LEVEL_0, 0 },
+  { "drop", CLOCK_SECOND / 100, MQTT_QOS_LEVEL_1, MESSAGES / 2 },
+};
+
+static struct mqtt_connection conn;
+static char payloads[MESSAGES][40];
+static unsigned long acked;
+static uint8_t disconnected;
+
+PROCESS(mqtt_bench_process, "MQTT publish benchmark");
+AUTOSTART_PROCESSES(&mqtt_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
+{
+  switch(event) {
+  case MQTT_EVENT_PUBACK:
+    acked++;
+    break;
+  case MQTT_EVENT_DISCONNECTED:
+    disconnected = 1;
+    break;
+  default:
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+phase_done(const struct phase *p)
+{
+  if(p->qos == MQTT_QOS_LEVEL_0) {
+    return broker_stub_stats.unique >= MESSAGES;
+  }
+  return acked >= MESSAGES;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mqtt_bench_process, ev, data)
+{
+  static const struct phase *p;
+  static struct timer timeout;
+  static struct etimer reconnect;
+  static int sent;
+  static double start;
+  double secs;
+
+  PROCESS_BEGIN();
+
+  mqtt_register(&conn, &mqtt_bench_process, "bench", mqtt_event,
+                MAX_SEGMENT_SIZE);
+  /* Reconnect from here, as the demos do */
+  conn.auto_reconnect = 0;
+  mqtt_connect(&conn, "fd00::1", 1883, 600);
+  PROCESS_WAIT_EVENT_UNTIL(mqtt_connected(&conn));
+
+  printf("window %d, %d messages per phase\n", MQTT_MAX_INFLIGHT, MESSAGES);
+  printf("%-6s %6s %10s %8s %8s %10s %6s %10s\n", "phase", "rtt ms",
+         "messages/s", "acked", "at broker", "segments", "dups", "reconnects");
+
+  for(p = phases; p < &phases[sizeof(phases) / sizeof(phases[0])]; p++) {
+    broker_stub_set_delay(p->delay);
+    broker_stub_reset();
+    broker_stub_drop_after(p->drop_after);
+    acked = 0;
+    sent = 0;
+    timer_set(&timeout, PHASE_TIMEOUT);
+    start = now();
+
+    while(!phase_done(p) && !timer_expired(&timeout)) {
+      while(sent < MESSAGES && mqtt_ready(&conn)) {
+        snprintf(payloads[sent], sizeof(payloads[sent]),
+                 "{\"seq\":%04d,\"temp\":21.5,\"rh\":40}", sent);
+        if(mqtt_publish(&conn, NULL, TOPIC, (uint8_t *)payloads[sent],
+                        strlen(payloads[sent]), p->qos,
+                        MQTT_RETAIN_OFF) != MQTT_STATUS_OK) {
+          break;
+        }
+        sent++;
+      }
+      if(disconnected) {
+        /* Let the MQTT process finish aborting first */
+        disconnected = 0;
+        etimer_set(&reconnect, CLOCK_SECOND / 10);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&reconnect));
+        mqtt_connect(&conn, "fd00::1", 1883, 600);
+      }
+      PROCESS_PAUSE();
+    }
+    secs = now() - start;
+
+    printf("%-6s %6lu %10.1f %8lu %8lu %10lu %6lu %10lu\n", p->name,
+           (unsigned long)(2 * p->delay * 1000 / CLOCK_SECOND),
+           broker_stub_stats.unique / secs,
+           acked, broker_stub_stats.unique, broker_stub_stats.segments,
+           broker_stub_stats.duplicates, broker_stub_stats.connects);
+
+    /* Let a phase that timed out drain */
+    timer_set(&timeout, PHASE_TIMEOUT);
+    while(!mqtt_ready(&conn) && !timer_expired(&timeout)) {
+      PROCESS_PAUSE();
+    }
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         MB/s of PUBLISH payload received by the MQTT client, for
+ *         comparing payloads handed on straight from the TCP input buffer
+ *         with payloads copied into MQTT_INPUT_BUFF_SIZE chunks first.
+ *         Also checks the topic filter matching. Native only.
+ *
+ *         The TCP socket is replaced by mqtt-broker-stub.c, which hands
+ *         the PUBLISH packets to the client in segments of SEGMENT_SIZE
+ *         bytes. Every message is received by the handlers whose filter
+ *         matches its topic.
+ *
+ *         make TARGET=native && ./mqtt-receive-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=MQTT_CONF_STREAM_PAYLOAD=0
+ */
+
+#include "contiki.h"
+#include "mqtt.h"
+#include "mqtt-broker-stub.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAX_SEGMENT_SIZE  256
+#define SEGMENT_SIZE      512
+#define MAX_PAYLOAD       65536
+#define BYTES_PER_SIZE    (256UL * 1024 * 1024)
+
+static const uint32_t sizes[] = { 32, 1024, 16384, MAX_PAYLOAD };
+
+struct match_case {
+  const char *filter;
+  const char *topic;
+  int match;
+};
+
+static const struct match_case match_cases[] = {
+  { "sport/tennis/player1/#", "sport/tennis/player1", 1 },
+  { "sport/tennis/player1/#", "sport/tennis/player1/ranking", 1 },
+  { "sport/tennis/player1/#", "sport/tennis/player1/score/wimbledon", 1 },
+  { "sport/#", "sport", 1 },
+  { "#", "sport/tennis", 1 },
+  { "sport/tennis/#", "sport/tennis", 1 },
+  { "sport/tennis/#", "sport/tennisplayer", 0 },
+  { "sport/tennis/+", "sport/tennis/player1", 1 },
+  { "sport/tennis/+", "sport/tennis/player1/ranking", 0 },
+  { "sport/+", "sport", 0 },
+  { "sport/+", "sport/", 1 },
+  { "+/+", "/finance", 1 },
+  { "/+", "/finance", 1 },
+  { "+", "/finance", 0 },
+  { "+/tennis/#", "sport/tennis/player1", 1 },
+  { "sport/+/player1", "sport/tennis/player1", 1 },
+  { "sport/+/player1", "sport/tennis/player2", 0 },
+  { "sport", "sport", 1 },
+  { "sport", "sports", 0 },
+  { "sport", "sport/", 0 },
+  { "#", "$SYS/broker", 0 },
+  { "+/monitor/Clients", "$SYS/monitor/Clients", 0 },
+  { "$SYS/#", "$SYS/broker", 1 },
+  { "$SYS/monitor/+", "$SYS/monitor/Clients", 1 },
+};
+
+static struct mqtt_connection conn;
+static struct mqtt_topic_handler fw_handler, temp_handler, all_handler;
+static uint8_t payload[MAX_PAYLOAD];
+static unsigned long fw_messages, temp_messages, all_messages, unmatched;
+static unsigned long received, checksum;
+
+PROCESS(mqtt_bench_process, "MQTT receive benchmark");
+AUTOSTART_PROCESSES(&mqtt_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+consume(struct mqtt_message *msg)
+{
+  uint32_t offset;
+  uint16_t i;
+
+  /* Touch every 64th byte of the payload, wherever the chunks start */
+  offset = msg->payload_length - msg->payload_left - msg->payload_chunk_length;
+  for(i = (64 - offset % 64) % 64; i < msg->payload_chunk_length; i += 64) {
+    checksum += msg->payload_chunk[i];
+  }
+  received += msg->payload_chunk_length;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fw_received(struct mqtt_connection *m, struct mqtt_message *msg)
+{
+  if(msg->first_chunk) {
+    fw_messages++;
+  }
+  consume(msg);
+}
+/*---------------------------------------------------------------------------*/
+static void
+temp_received(struct mqtt_connection *m, struct mqtt_message *msg)
+{
+  if(msg->first_chunk) {
+    temp_messages++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+all_received(struct mqtt_connection *m, struct mqtt_message *msg)
+{
+  if(msg->first_chunk) {
+    all_messages++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
+{
+  struct mqtt_message *msg = data;
+
+  if(event == MQTT_EVENT_PUBLISH && msg->first_chunk) {
+    unmatched++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mqtt_bench_process, ev, data)
+{
+  static double start;
+  double secs;
+  unsigned long messages;
+  unsigned long m;
+  int i, ok;
+
+  PROCESS_BEGIN();
+
+  ok = 0;
+  for(i = 0; i < sizeof(match_cases) / sizeof(match_cases[0]); i++) {
+    if(mqtt_topic_match(match_cases[i].filter, match_cases[i].topic) ==
+       match_cases[i].match) {
+      ok++;
+    } else {
+      printf("mismatch: '%s' '%s'\n", match_cases[i].filter,
+             match_cases[i].topic);
+    }
+  }
+  printf("topic match %d/%d ok\n", ok,
+         (int)(sizeof(match_cases) / sizeof(match_cases[0])));
+
+  mqtt_register(&conn, &mqtt_bench_process, "bench", mqtt_event,
+                MAX_SEGMENT_SIZE);
+  conn.auto_reconnect = 0;
+  mqtt_add_topic_handler(&conn, &fw_handler, "devices/bench/fw/#",
+                         fw_received);
+  mqtt_add_topic_handler(&conn, &temp_handler, "sensors/+/temp",
+                         temp_received);
+  mqtt_add_topic_handler(&conn, &all_handler, "sensors/#", all_received);
+  mqtt_connect(&conn, "fd00::1", 1883, 600);
+  PROCESS_WAIT_EVENT_UNTIL(mqtt_connected(&conn));
+
+  /* One message for each handler combination, and one for none */
+  broker_stub_publish("sensors/kitchen/temp", payload, 4, SEGMENT_SIZE);
+  broker_stub_publish("sensors/kitchen/rh", payload, 4, SEGMENT_SIZE);
+  broker_stub_publish("devices/bench/fw/1.2", payload, 4, SEGMENT_SIZE);
+  broker_stub_publish("devices/other/fw/1.2", payload, 4, SEGMENT_SIZE);
+  printf("handlers fw %lu temp %lu all %lu, unmatched %lu (expect 1 1 2, 1)\n",
+         fw_messages, temp_messages, all_messages, unmatched);
+
+  for(i = 0; i < MAX_PAYLOAD; i++) {
+    payload[i] = random();
+  }
+
+  printf("streaming %d, %d byte segments\n", MQTT_STREAM_PAYLOAD,
+         SEGMENT_SIZE);
+  printf("%8s %10s %10s %8s %12s\n", "payload", "messages", "messages/s",
+         "MB/s", "checksum");
+
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    messages = BYTES_PER_SIZE / sizes[i];
+    fw_messages = 0;
+    received = 0;
+    checksum = 0;
+    start = now();
+    for(m = 0; m < messages; m++) {
+      broker_stub_publish("devices/bench/fw/1.2", payload, sizes[i],
+                          SEGMENT_SIZE);
+    }
+    secs = now() - start;
+
+    if(fw_messages != messages || received != messages * sizes[i]) {
+      printf("lost data: %lu messages, %lu bytes\n", fw_messages, received);
+    }
+    printf("%8lu %10lu %10.0f %8.1f %12lu\n", (unsigned long)sizes[i],
+           messages, messages / secs, received / secs / 1e6, checksum);
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Cost of finding a neighbor by link-layer address with 10,
+ *         100 and 500 neighbors, for comparing the nbr-table hash
+ *         index with the plain key list. Native only.
+ *
+ *         After the timing, neighbors are evicted and re-addressed at
+ *         random, and lookups are checked against a walk of the
+ *         table.
+ *
+ *         make TARGET=native && ./nbr-table-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=NBR_TABLE_CONF_HASH_SIZE=0
+ */
+
+#include "contiki.h"
+#include "net/nbr-table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define LOOKUPS 1000000
+#define CHURN   100000
+
+struct bench_nbr {
+  uint16_t seq;
+};
+
+NBR_TABLE(struct bench_nbr, bench_nbrs);
+
+static const int sizes[] = { 10, 100, NBR_TABLE_MAX_NEIGHBORS };
+static linkaddr_t addrs[NBR_TABLE_MAX_NEIGHBORS];
+
+PROCESS(nbr_bench_process, "Neighbor table benchmark");
+AUTOSTART_PROCESSES(&nbr_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_lladdr(linkaddr_t *addr)
+{
+  int i;
+
+  /* EUI-64 style: a common vendor prefix and a random tail */
+  memset(addr, 0, sizeof(*addr));
+  addr->u8[0] = 0x00;
+  addr->u8[1] = 0x12;
+  for(i = LINKADDR_SIZE / 2; i < LINKADDR_SIZE; i++) {
+    addr->u8[i] = random();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Eviction policy for the full table: any neighbor will do */
+const linkaddr_t *
+bench_find_removable(nbr_table_reason_t reason, void *data)
+{
+  struct bench_nbr *n;
+  int skip;
+
+  for(skip = random() % 16, n = nbr_table_head(bench_nbrs);
+      skip > 0 && nbr_table_next(bench_nbrs, n) != NULL;
+      skip--, n = nbr_table_next(bench_nbrs, n));
+  return n != NULL ? nbr_table_get_lladdr(bench_nbrs, n) : NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Check that every neighbor in the table is found by its address */
+static int
+check_table(void)
+{
+  struct bench_nbr *n;
+  int count = 0;
+
+  for(n = nbr_table_head(bench_nbrs); n != NULL;
+      n = nbr_table_next(bench_nbrs, n)) {
+    if(nbr_table_get_from_lladdr(bench_nbrs,
+                                 nbr_table_get_lladdr(bench_nbrs, n)) != n) {
+      return -1;
+    }
+    count++;
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(nbr_bench_process, ev, data)
+{
+  static int added;
+  struct bench_nbr *n;
+  linkaddr_t addr;
+  double start, hit, miss;
+  int s, i, errors;
+
+  PROCESS_BEGIN();
+
+  nbr_table_register(bench_nbrs, NULL);
+  srandom(1);
+
+  printf("nbr-table hash size %d\n", NBR_TABLE_HASH_SIZE);
+  printf("%10s %14s %14s\n", "neighbors", "hit ns/lookup", "miss ns/lookup");
+
+  added = 0;
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for(; added < sizes[s]; added++) {
+      random_lladdr(&addrs[added]);
+      n = nbr_table_add_lladdr(bench_nbrs, &addrs[added],
+                               NBR_TABLE_REASON_UNDEFINED, NULL);
+      n->seq = added;
+    }
+
+    start = now();
+    for(i = 0; i < LOOKUPS; i++) {
+      n = nbr_table_get_from_lladdr(bench_nbrs, &addrs[random() % added]);
+    }
+    hit = now() - start;
+
+    start = now();
+    for(i = 0; i < LOOKUPS; i++) {
+      random_lladdr(&addr);
+      n = nbr_table_get_from_lladdr(bench_nbrs, &addr);
+    }
+    miss = now() - start;
+
+    printf("%10d %14.0f %14.0f\n", added, hit / LOOKUPS * 1e9,
+           miss / LOOKUPS * 1e9);
+  }
+
+  /* Churn: add new neighbors to the full table so that old ones are
+     evicted, and change some addresses */
+  errors = 0;
+  for(i = 0; i < CHURN; i++) {
+    random_lladdr(&addr);
+    switch(random() % 4) {
+    case 0:
+      nbr_table_update_lladdr(&addrs[random() % added], &addr, 0);
+      break;
+    default:
+      n = nbr_table_add_lladdr(bench_nbrs, &addr,
+                               NBR_TABLE_REASON_UNDEFINED, NULL);
+      if(n == NULL ||
+         nbr_table_get_from_lladdr(bench_nbrs, &addr) != n) {
+        errors++;
+      }
+      linkaddr_copy(&addrs[random() % added], &addr);
+      break;
+    }
+    if(i % 1000 == 0 && check_table() < 0) {
+      errors++;
+    }
+  }
+  printf("churn: %d neighbors, %s\n", check_table(),
+         errors == 0 ? "ok" : "FAILED");
+
+  exit(errors != 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Latency of events to a network process while application
+ *         processes keep the event queue busy. Native only.
+ *
+ *         A stand-in for a radio driver posts a packet event to a
+ *         network process every PACKET_INTERVAL microseconds; NAPPS
+ *         application processes each keep APP_EVENTS events queued
+ *         and spend APP_WORK microseconds on each one. Compare e.g.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=PROCESS_CONF_PRIORITIES=2
+ *         make TARGET=native DEFINES=PROCESS_CONF_BATCH=8
+ *
+ *         (with make TARGET=native clean in between).
+ */
+
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PACKETS         20000
+#define PACKET_INTERVAL 100
+#define NAPPS           6
+#define APP_EVENTS      4
+#define APP_WORK        3
+
+static unsigned long dropped, app_events, loops;
+static unsigned long packets, latency_sum, latency_max;
+static unsigned long latency_hist[8];
+static unsigned long sent_at[PACKETS];
+static process_event_t packet_event, work_event;
+
+PROCESS(bench_process, "Scheduler benchmark");
+PROCESS(net_process, "Net");
+PROCESS(app_process_0, "App 0");
+PROCESS(app_process_1, "App 1");
+PROCESS(app_process_2, "App 2");
+PROCESS(app_process_3, "App 3");
+PROCESS(app_process_4, "App 4");
+PROCESS(app_process_5, "App 5");
+AUTOSTART_PROCESSES(&bench_process);
+
+static struct process *apps[NAPPS] = {
+  &app_process_0, &app_process_1, &app_process_2,
+  &app_process_3, &app_process_4, &app_process_5
+};
+/*---------------------------------------------------------------------------*/
+static unsigned long
+usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(net_process, ev, data)
+{
+  unsigned long latency;
+  int bucket;
+
+  PROCESS_BEGIN();
+
+  process_set_priority(&net_process, PROCESS_PRIORITY_HIGH);
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == packet_event);
+    latency = usec() - sent_at[(uintptr_t)data];
+    packets++;
+    latency_sum += latency;
+    if(latency > latency_max) {
+      latency_max = latency;
+    }
+    /* Buckets of <1, <2, <4 ... <64 and >= 64 times the app work */
+    for(bucket = 0; bucket < 7 && latency >= (APP_WORK << bucket); bucket++);
+    latency_hist[bucket]++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+app_work(void)
+{
+  unsigned long start = usec();
+
+  while(usec() - start < APP_WORK);
+  app_events++;
+  process_post(PROCESS_CURRENT(), work_event, NULL);
+}
+/*---------------------------------------------------------------------------*/
+#define APP_THREAD(name)                                        \
+  PROCESS_THREAD(name, ev, data)                                \
+  {                                                             \
+    static int i;                                               \
+    PROCESS_BEGIN();                                            \
+    for(i = 0; i < APP_EVENTS; i++) {                           \
+      process_post(PROCESS_CURRENT(), work_event, NULL);        \
+    }                                                           \
+    while(1) {                                                  \
+      PROCESS_WAIT_EVENT_UNTIL(ev == work_event);               \
+      app_work();                                               \
+    }                                                           \
+    PROCESS_END();                                              \
+  }
+APP_THREAD(app_process_0)
+APP_THREAD(app_process_1)
+APP_THREAD(app_process_2)
+APP_THREAD(app_process_3)
+APP_THREAD(app_process_4)
+APP_THREAD(app_process_5)
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static unsigned long start, next;
+  static uintptr_t sent;
+  int i;
+
+  PROCESS_BEGIN();
+
+  packet_event = process_alloc_event();
+  work_event = process_alloc_event();
+  process_start(&net_process, NULL);
+  for(i = 0; i < NAPPS; i++) {
+    process_start(apps[i], NULL);
+  }
+
+  /* Run the scheduler from here, with the driver checking for a new
+     packet between calls as a platform main loop would. */
+  start = next = usec();
+  for(sent = 0; sent < PACKETS;) {
+    if(usec() >= next) {
+      sent_at[sent] = usec();
+      if(process_post(&net_process, packet_event, (void *)sent) != PROCESS_ERR_OK) {
+        dropped++;
+      }
+      sent++;
+      next += PACKET_INTERVAL;
+    }
+    process_run();
+    loops++;
+  }
+  while(process_run() > 0 && packets + dropped < PACKETS);
+
+  printf("priorities %d batch %d\n", PROCESS_PRIORITIES, PROCESS_BATCH);
+  printf("packets %lu dropped %lu latency mean %lu us max %lu us\n",
+         packets, dropped, packets ? latency_sum / packets : 0, latency_max);
+  printf("latency <%dus", APP_WORK);
+  for(i = 1; i < 7; i++) {
+    printf(" <%dus", APP_WORK << i);
+  }
+  printf(" more\n       ");
+  for(i = 0; i < 8; i++) {
+    printf(" %5lu", latency_hist[i]);
+  }
+  printf("\napp events %lu (%.0f/s), %lu scheduler calls\n", app_events,
+         app_events / ((usec() - start) / 1000000.0), loops);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
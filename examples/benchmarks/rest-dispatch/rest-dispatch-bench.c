@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Requests/s through rest_invoke_restful_service() with 10, 100
+ *         and 1000 activated resources, for comparing the REST engine's
+ *         URL index with the plain resource list. Native only.
+ *
+ *         The resources are laid out like LWM2M object/instance/resource
+ *         paths, with every tenth one a parent with sub-resources. Of
+ *         the requests, 80% hit a resource, 10% a sub-resource of a
+ *         parent and 10% nothing.
+ *
+ *         make TARGET=native && ./rest-dispatch-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=REST_ENGINE_CONF_INDEX_SIZE=0
+ */
+
+#include "contiki.h"
+#include "rest-engine.h"
+#include "er-coap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define RESOURCES 1000
+#define URLS      1024
+#define REQUESTS  1000000
+
+static const int sizes[] = { 10, 100, RESOURCES };
+
+static resource_t resources[RESOURCES];
+static char paths[RESOURCES][24];
+static char urls[URLS][32];
+static unsigned long checksum;
+
+PROCESS(rest_bench_process, "REST dispatch benchmark");
+AUTOSTART_PROCESSES(&rest_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+get_handler(void *request, void *response, uint8_t *buffer,
+            uint16_t preferred_size, int32_t *offset)
+{
+  const char *url;
+
+  checksum += REST.get_url(request, &url) + url[0];
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_urls(int n)
+{
+  int i, r;
+
+  srandom(n);
+  for(i = 0; i < URLS; i++) {
+    r = random() % n;
+    switch(random() % 10) {
+    case 0:
+      /* Below a parent */
+      r -= r % 10;
+      snprintf(urls[i], sizeof(urls[i]), "%s/%d/%d", paths[r],
+               (int)(random() % 4), (int)(random() % 8));
+      break;
+    case 1:
+      snprintf(urls[i], sizeof(urls[i]), "%d/0/%d", 9000 + r / 8, r % 8);
+      break;
+    default:
+      snprintf(urls[i], sizeof(urls[i]), "%s", paths[r]);
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(rest_bench_process, ev, data)
+{
+  static coap_packet_t request[1];
+  static coap_packet_t response[1];
+  static uint8_t buffer[REST_MAX_CHUNK_SIZE];
+  int32_t offset;
+  double start, secs;
+  int s, i, n;
+
+  PROCESS_BEGIN();
+
+  printf("%9s %12s %14s %12s\n", "resources", "requests", "requests/s",
+         "checksum");
+
+  n = 0;
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for(; n < sizes[s]; n++) {
+      if(n % 10 == 0) {
+        snprintf(paths[n], sizeof(paths[n]), "obj%d", n / 10);
+        resources[n].flags = HAS_SUB_RESOURCES;
+      } else {
+        snprintf(paths[n], sizeof(paths[n]), "%d/%d/%d",
+                 3300 + n / 10, (n / 3) % 4, 5700 + n % 10);
+      }
+      resources[n].get_handler = get_handler;
+      rest_activate_resource(&resources[n], paths[n]);
+    }
+    make_urls(n);
+
+    checksum = 0;
+    start = now();
+    for(i = 0; i < REQUESTS; i++) {
+      coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+      coap_set_header_uri_path(request, urls[i % URLS]);
+      offset = 0;
+      rest_invoke_restful_service(request, response, buffer,
+                                  sizeof(buffer), &offset);
+    }
+    secs = now() - start;
+
+    printf("%9d %12d %14.0f %12lu\n", n, REQUESTS, REQUESTS / secs, checksum);
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Cost of uip_ds6_route_lookup() with 100, 1,000 and 10,000
+ *         routes, for comparing the route hash index with the plain
+ *         route list. Native only.
+ *
+ *         The table holds /128 host routes under fd00::/64 (as a RPL
+ *         root or storing-mode border router would) and a few shorter
+ *         prefixes. Lookups are for known hosts, and for unknown
+ *         hosts that only match a shorter prefix.
+ *
+ *         make TARGET=native && ./route-lookup-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=UIP_DS6_ROUTE_CONF_HASH_SIZE=0
+ */
+
+#include "contiki.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define NEXTHOPS 8
+#define LOOKUPS  100000
+
+static const int sizes[] = { 100, 1000, 10000 };
+static uip_ipaddr_t nexthops[NEXTHOPS];
+static uip_ipaddr_t hosts[10000];
+
+PROCESS(route_bench_process, "Route lookup benchmark");
+AUTOSTART_PROCESSES(&route_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_host(uip_ipaddr_t *addr)
+{
+  int i;
+
+  uip_ip6addr(addr, 0xfd00, 0, 0, 0, 0, 0, 0, 0);
+  for(i = 8; i < 16; i++) {
+    addr->u8[i] = random();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_neighbors(void)
+{
+  uip_lladdr_t lladdr;
+  int i;
+
+  for(i = 0; i < NEXTHOPS; i++) {
+    memset(&lladdr, 0, sizeof(lladdr));
+    lladdr.addr[0] = 0x02;
+    lladdr.addr[sizeof(lladdr) - 1] = i + 1;
+    uip_ip6addr(&nexthops[i], 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+    uip_ds6_set_addr_iid(&nexthops[i], &lladdr);
+    uip_ds6_nbr_add(&nexthops[i], &lladdr, 1, NBR_REACHABLE,
+                    NBR_TABLE_REASON_UNDEFINED, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Time LOOKUPS lookups of known hosts or of random addresses under
+   fd00::/64, and fold the results into a checksum so that the two
+   builds can be compared. */
+static double
+time_lookups(int n, int known, unsigned long *check)
+{
+  uip_ipaddr_t addr;
+  uip_ds6_route_t *r;
+  double start, total;
+  int i;
+
+  total = 0;
+  for(i = 0; i < LOOKUPS; i++) {
+    if(known) {
+      uip_ipaddr_copy(&addr, &hosts[random() % n]);
+    } else {
+      random_host(&addr);
+    }
+    start = now();
+    r = uip_ds6_route_lookup(&addr);
+    total += now() - start;
+    if(r != NULL) {
+      *check = *check * 31 + r->length + uip_ds6_route_nexthop(r)->u8[15];
+    }
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(route_bench_process, ev, data)
+{
+  static uip_ipaddr_t prefix;
+  unsigned long check;
+  double known, unknown;
+  int s, i, n;
+
+  PROCESS_BEGIN();
+
+  add_neighbors();
+
+  printf("route hash size %d\n", UIP_DS6_ROUTE_HASH_SIZE);
+  printf("%8s %16s %16s %10s\n", "routes", "known ns/lookup",
+         "prefix ns/lookup", "check");
+
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    n = sizes[s];
+    srandom(n);
+
+    for(i = 0; i < n - 6; i++) {
+      random_host(&hosts[i]);
+      uip_ds6_route_add(&hosts[i], 128, &nexthops[i % NEXTHOPS]);
+    }
+    n -= 6;
+
+    /* The /64 covering the hosts, a few other /64s and two /48s.
+       They are added last, as uip_ds6_route_add() replaces a
+       covering route with a different next hop. */
+    uip_ip6addr(&prefix, 0xfd00, 0, 0, 0, 0, 0, 0, 0);
+    uip_ds6_route_add(&prefix, 64, &nexthops[0]);
+    for(i = 1; i <= 3; i++) {
+      uip_ip6addr(&prefix, 0xfd00, 0, 0, i, 0, 0, 0, 0);
+      uip_ds6_route_add(&prefix, 64, &nexthops[i]);
+    }
+    for(i = 1; i <= 2; i++) {
+      uip_ip6addr(&prefix, 0xfd00, i, 0, 0, 0, 0, 0, 0);
+      uip_ds6_route_add(&prefix, 48, &nexthops[i]);
+    }
+
+    check = 0;
+    known = time_lookups(n, 1, &check);
+    unknown = time_lookups(n, 0, &check);
+    printf("%8d %16.0f %16.0f %10lx\n", uip_ds6_route_num_routes(),
+           known / LOOKUPS * 1e9, unknown / LOOKUPS * 1e9, check);
+
+    while(uip_ds6_route_head() != NULL) {
+      uip_ds6_route_rm(uip_ds6_route_head());
+    }
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
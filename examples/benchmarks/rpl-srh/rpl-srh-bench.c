@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Downward forwarding rate at a RPL non-storing root with 100
+ *         and 1,000 nodes, for comparing the hashed node table and
+ *         source route cache with the plain node list. Native only.
+ *
+ *         The nodes form a random tree below the root, as registered
+ *         by DAOs through rpl_ns_update_node(). Every packet is a UDP
+ *         datagram from outside the DODAG to a random node, which gets
+ *         its source routing header from rpl_update_header() and its
+ *         next hop from rpl_srh_get_next_hop(), as in tcpip_ipv6_output().
+ *         The last run moves a random node to a new parent every 64
+ *         packets, which invalidates the cached routes.
+ *
+ *         make TARGET=native && ./rpl-srh-bench.native
+ *         make TARGET=native clean
+ *         make TARGET=native DEFINES=RPL_NS_CONF_HASH_SIZE=0,RPL_NS_CONF_SRH_CACHE_SIZE=0
+ */
+
+#include "contiki.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-dag-root.h"
+#include "net/rpl/rpl-ns.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define NODES     1000
+#define PACKETS   200000
+#define PAYLOAD   32
+#define CHURN     64
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+static const int sizes[] = { 100, NODES };
+static uip_ipaddr_t nodes[NODES];
+static int parents[NODES];
+static uip_ipaddr_t root;
+
+PROCESS(rpl_srh_bench_process, "RPL source routing benchmark");
+AUTOSTART_PROCESSES(&rpl_srh_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+/* Node i hangs below the root or below an earlier node, which keeps the
+   tree free of loops however often nodes move */
+static void
+set_parent(int i)
+{
+  parents[i] = i < 8 ? -1 : random() % i;
+  rpl_ns_update_node(rpl_get_any_dag(), &nodes[i],
+                     parents[i] < 0 ? &root : &nodes[parents[i]],
+                     RPL_DEFAULT_LIFETIME);
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_packet(const uip_ipaddr_t *dest)
+{
+  memset(UIP_IP_BUF, 0, UIP_IPH_LEN + UIP_UDPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->len[1] = UIP_UDPH_LEN + PAYLOAD;
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  UIP_IP_BUF->ttl = 64;
+  uip_ip6addr(&UIP_IP_BUF->srcipaddr, 0xfd01, 0, 0, 0, 0, 0, 0, 1);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, dest);
+  uip_ext_len = 0;
+  uip_len = UIP_IPH_LEN + UIP_UDPH_LEN + PAYLOAD;
+}
+/*---------------------------------------------------------------------------*/
+/* Forward PACKETS packets to random nodes among the first n, and fold
+   next hops and header lengths into a checksum so that the two builds
+   can be compared. */
+static double
+forward(int n, int churn, unsigned long *check)
+{
+  uip_ipaddr_t next_hop;
+  double start;
+  int i, found;
+
+  start = now();
+  for(i = 0; i < PACKETS; i++) {
+    if(churn && i % CHURN == 0) {
+      set_parent(random() % n);
+    }
+    make_packet(&nodes[random() % n]);
+    if(!rpl_update_header()) {
+      continue;
+    }
+    found = rpl_srh_get_next_hop(&next_hop);
+    *check = *check * 31 + uip_len + uip_ext_len +
+      (found ? next_hop.u8[15] : 0);
+  }
+  return now() - start;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(rpl_srh_bench_process, ev, data)
+{
+  uip_ds6_addr_t *addr;
+  unsigned long check;
+  double secs;
+  int s, n;
+
+  PROCESS_BEGIN();
+
+  /* Let uIP and RPL start up */
+  PROCESS_PAUSE();
+
+  uip_ip6addr(&root, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&root, &uip_lladdr);
+  addr = uip_ds6_addr_lookup(&root);
+  if(addr == NULL) {
+    addr = uip_ds6_addr_add(&root, 0, ADDR_AUTOCONF);
+  }
+  addr->state = ADDR_PREFERRED;
+  rpl_dag_root_init_dag_immediately();
+
+  printf("node hash size %d, source route cache size %d\n",
+         RPL_NS_HASH_SIZE, RPL_NS_SRH_CACHE_SIZE);
+  printf("%6s %6s %10s %14s %10s\n", "nodes", "churn", "packets",
+         "packets/s", "check");
+
+  srandom(NODES);
+  n = 0;
+  for(s = 0; s <= sizeof(sizes) / sizeof(sizes[0]); s++) {
+    if(s < sizeof(sizes) / sizeof(sizes[0])) {
+      for(; n < sizes[s]; n++) {
+        uip_ip6addr(&nodes[n], UIP_DS6_DEFAULT_PREFIX, 0, 0, 0,
+                    0x0212, 0x4b00, 0, n);
+        set_parent(n);
+      }
+    }
+
+    check = 0;
+    secs = forward(n, s == sizeof(sizes) / sizeof(sizes[0]), &check);
+    printf("%6d %6s %10d %14.0f %10lx\n", rpl_ns_num_nodes() - 1,
+           s == sizeof(sizes) / sizeof(sizes[0]) ? "yes" : "no",
+           PACKETS, PACKETS / secs, check);
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -56,7 +56,8 @@ RESOURCE(res_plugtest_large_create,
 static void
 res_post_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-  coap_packet_t *const coap_req = (coap_packet_t *)request;
+  uint32_t block_num = 0;
+  uint16_t block_size = 0;
 
   uint8_t *incoming = NULL;
   size_t len = 0;
@@ -70,12 +71,14 @@ res_post_handler(void *request, void *response, uint8_t *buffer, uint16_t prefer
     return;
   }
 
+  coap_get_header_block1(request, &block_num, NULL, &block_size, NULL);
+
   if((len = REST.get_request_payload(request, (const uint8_t **)&incoming))) {
-    if(coap_req->block1_num * coap_req->block1_size + len <= 2048) {
+    if(block_num * block_size + len <= 2048) {
       REST.set_response_status(response, REST.status.CREATED);
       REST.set_header_location(response, "/nirvana");
-      coap_set_header_block1(response, coap_req->block1_num, 0,
-                             coap_req->block1_size);
+      coap_set_header_block1(response, block_num, 0,
+                             block_size);
     } else {
       REST.set_response_status(response, REST.status.REQUEST_ENTITY_TOO_LARGE);
       const char *error_msg = "2048B max.";
@@ -85,7 +85,8 @@ res_get_handler(void *request, void *response, uint8_t *buffer, uint16_t preferr
 static void
 res_put_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
-  coap_packet_t *const coap_req = (coap_packet_t *)request;
+  uint32_t block_num = 0;
+  uint16_t block_size = 0;
   uint8_t *incoming = NULL;
   size_t len = 0;
 
@@ -98,17 +99,19 @@ res_put_handler(void *request, void *response, uint8_t *buffer, uint16_t preferr
     return;
   }
 
+  coap_get_header_block1(request, &block_num, NULL, &block_size, NULL);
+
   if((len = REST.get_request_payload(request, (const uint8_t **)&incoming))) {
-    if(coap_req->block1_num * coap_req->block1_size + len <= sizeof(large_update_store)) {
+    if(block_num * block_size + len <= sizeof(large_update_store)) {
       memcpy(
-        large_update_store + coap_req->block1_num * coap_req->block1_size,
+        large_update_store + block_num * block_size,
         incoming, len);
-      large_update_size = coap_req->block1_num * coap_req->block1_size + len;
+      large_update_size = block_num * block_size + len;
       large_update_ct = ct;
 
       REST.set_response_status(response, REST.status.CHANGED);
-      coap_set_header_block1(response, coap_req->block1_num, 0,
-                             coap_req->block1_size);
+      coap_set_header_block1(response, block_num, 0,
+                             block_size);
     } else {
       REST.set_response_status(response,
                                REST.status.REQUEST_ENTITY_TOO_LARGE);
@@ -463,8 +463,12 @@ static int
 set_fd(fd_set *rset, fd_set *wset)
 {
   /* Anything to flush? */
-  if(!slip_empty() && (send_delay == 0 || timer_expired(&send_delay_timer))) {
-    FD_SET(slipfd, wset);
+  if(!slip_empty()) {
+    if(send_delay == 0 || timer_expired(&send_delay_timer)) {
+      FD_SET(slipfd, wset);
+    } else {
+      select_wakeup(timer_remaining(&send_delay_timer));
+    }
   }
 
   FD_SET(slipfd, rset);	/* Read from slip ASAP! */
@@ -234,6 +234,11 @@ typedef unsigned long clock_time_t;
 
 #define CLOCK_CONF_SECOND 1000
 
+/* Ask the main loop to wake up again within delay clock ticks, for
+   drivers that wait on a plain timer. Only valid until the next wait,
+   so it is normally called from a set_fd() callback. */
+void select_wakeup(clock_time_t delay);
+
 #define LOG_CONF_ENABLED 1
 
 #define PROGRAM_HANDLER_CONF_MAX_NUMDSCS 10
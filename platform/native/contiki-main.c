@@ -48,6 +48,23 @@
 #include <sys/select.h>
 #include <errno.h>
 
+#ifdef SELECT_CONF_EPOLL
+#define SELECT_EPOLL SELECT_CONF_EPOLL
+#elif defined(__linux__)
+#define SELECT_EPOLL 1
+#else
+#define SELECT_EPOLL 0
+#endif
+
+#if SELECT_EPOLL
+#include <stdlib.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#endif /* SELECT_EPOLL */
+
 #ifdef __CYGWIN__
 #include "net/wpcap-drv.h"
 #endif /* __CYGWIN__ */
@@ -81,6 +98,21 @@
 static const struct select_callback *select_callback[SELECT_MAX];
 static int select_max = 0;
 
+static clock_time_t wakeup_delay;
+static int wakeup_requested;
+
+#if SELECT_EPOLL
+static int epoll_fd = -1;
+static int timer_fd = -1;
+/* Events each fd is currently registered for with epoll */
+static uint32_t epoll_interest[SELECT_MAX];
+/* Fds that epoll refuses (regular files, /dev/null) are always ready */
+static fd_set epoll_unpollable;
+/* The clock time timer_fd has been armed for */
+static clock_time_t timer_deadline;
+static int timer_armed;
+#endif /* SELECT_EPOLL */
+
 SENSORS(&pir_sensor, &vib_sensor, &button_sensor);
 
 static uint8_t serial_id[] = {0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08};
@@ -140,6 +172,320 @@ const static struct select_callback stdin_fd = {
   stdin_set_fd, stdin_handle_fd
 };
 /*---------------------------------------------------------------------------*/
+void
+select_wakeup(clock_time_t delay)
+{
+  if(!wakeup_requested || delay < wakeup_delay) {
+    wakeup_delay = delay;
+    wakeup_requested = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if SELECT_EPOLL
+/* Move an fd of our own out of the range that drivers can register
+   with select_set_callback() */
+static int
+fd_above_select(int fd)
+{
+  int high;
+
+  if(fd == -1 || fd >= SELECT_MAX) {
+    return fd;
+  }
+  high = fcntl(fd, F_DUPFD_CLOEXEC, SELECT_MAX);
+  close(fd);
+  return high;
+}
+/*---------------------------------------------------------------------------*/
+static void
+select_init(void)
+{
+  struct epoll_event ev;
+
+  epoll_fd = fd_above_select(epoll_create1(EPOLL_CLOEXEC));
+  timer_fd = fd_above_select(timerfd_create(CLOCK_MONOTONIC,
+                                            TFD_NONBLOCK | TFD_CLOEXEC));
+  if(epoll_fd == -1 || timer_fd == -1) {
+    perror("epoll");
+    exit(1);
+  }
+  ev.events = EPOLLIN;
+  ev.data.fd = timer_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+}
+/*---------------------------------------------------------------------------*/
+/* Register fd with epoll for events (none: unregister it). The kernel
+   drops an fd from the epoll set when it is closed, so an fd that a
+   driver closed and reopened is added again whatever the cache says. */
+static void
+epoll_set(int fd, uint32_t events)
+{
+  struct epoll_event ev;
+  int op;
+  int r;
+
+  ev.events = events;
+  ev.data.fd = fd;
+  if(epoll_interest[fd] == 0) {
+    op = EPOLL_CTL_ADD;
+  } else if(events == 0) {
+    op = EPOLL_CTL_DEL;
+  } else {
+    op = EPOLL_CTL_MOD;
+  }
+  r = epoll_ctl(epoll_fd, op, fd, &ev);
+  if(r == -1 && errno == ENOENT && events != 0) {
+    /* Closed, and maybe reopened, since it was added */
+    r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  } else if(r == -1 && errno == EEXIST) {
+    r = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+  }
+  if(r == -1) {
+    if(errno == EPERM) {
+      FD_SET(fd, &epoll_unpollable);
+    }
+    /* EBADF: not open right now; tried again next time */
+    events = 0;
+  }
+  epoll_interest[fd] = events;
+}
+/*---------------------------------------------------------------------------*/
+/* Bring the epoll registrations in line with what the callbacks want
+   to wait for. With verify, registrations that look up to date are
+   renewed too, in case their fd has been closed and reopened. Fds
+   that epoll can not wait on are added to the ready sets right away;
+   returns the number of those. */
+static int
+epoll_update(fd_set *readyr, fd_set *readyw, int verify)
+{
+  fd_set fdr;
+  fd_set fdw;
+  uint32_t events;
+  int ready;
+  int i;
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] != NULL) {
+      select_callback[i]->set_fd(&fdr, &fdw);
+    }
+  }
+
+  ready = 0;
+  for(i = 0; i < SELECT_MAX; i++) {
+    events = (FD_ISSET(i, &fdr) ? EPOLLIN : 0) |
+      (FD_ISSET(i, &fdw) ? EPOLLOUT : 0);
+
+    if(FD_ISSET(i, &epoll_unpollable)) {
+      if(events == 0) {
+        FD_CLR(i, &epoll_unpollable);
+      } else {
+        if(events & EPOLLIN) {
+          FD_SET(i, readyr);
+        }
+        if(events & EPOLLOUT) {
+          FD_SET(i, readyw);
+        }
+        ready++;
+      }
+    } else if(events != epoll_interest[i] || (verify && events != 0)) {
+      epoll_set(i, events);
+    }
+  }
+  return ready;
+}
+/*---------------------------------------------------------------------------*/
+static void
+timer_arm(clock_time_t deadline)
+{
+  struct itimerspec its;
+  struct timeval tv;
+  clock_time_t now;
+  long long ns;
+
+  if(timer_armed && deadline == timer_deadline) {
+    return;
+  }
+
+  /* Same time base as clock_time(), but to the microsecond so that
+     the timer goes off as the clock ticks over to the deadline. */
+  gettimeofday(&tv, NULL);
+  now = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  ns = (long long)(long)(deadline - now) * 1000000 - (tv.tv_usec % 1000) * 1000;
+  if(ns <= 0) {
+    ns = 1;
+  }
+  its.it_interval.tv_sec = its.it_interval.tv_nsec = 0;
+  its.it_value.tv_sec = ns / 1000000000;
+  its.it_value.tv_nsec = ns % 1000000000;
+  timerfd_settime(timer_fd, 0, &its, NULL);
+  timer_deadline = deadline;
+  timer_armed = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+timer_disarm(void)
+{
+  struct itimerspec its;
+
+  if(timer_armed) {
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(timer_fd, 0, &its, NULL);
+    timer_armed = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Sleep until a registered fd is ready, the next etimer is due, or a
+   signal (rtimer) comes in. Does not sleep at all if events_pending. */
+static void
+select_wait(int events_pending)
+{
+  struct epoll_event events[SELECT_MAX + 1];
+  sigset_t alarm_mask;
+  sigset_t old_mask;
+  sigset_t wait_mask;
+  fd_set fdr;
+  fd_set fdw;
+  clock_time_t now;
+  clock_time_t delay;
+  uint64_t expirations;
+  int timeout;
+  int ready;
+  int n;
+  int i;
+
+#if WITH_GUI
+  /* Console resizes are polled */
+  select_wakeup(CLOCK_SECOND / 10);
+#endif /* WITH_GUI */
+
+  /* rtimers run from SIGALRM and may poll processes. Keep the signal
+     out until the wait, so that a poll can not slip in between the
+     check below and going to sleep. It is blocked only here, so that
+     children started with system() or exec do not inherit it blocked. */
+  sigemptyset(&alarm_mask);
+  sigaddset(&alarm_mask, SIGALRM);
+  sigprocmask(SIG_BLOCK, &alarm_mask, &old_mask);
+  wait_mask = old_mask;
+  sigdelset(&wait_mask, SIGALRM);
+  if(process_nevents() > 0) {
+    events_pending = 1;
+  }
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  ready = epoll_update(&fdr, &fdw, !events_pending);
+
+  timeout = -1;
+  if(etimer_pending() || wakeup_requested) {
+    now = clock_time();
+    delay = wakeup_requested ? wakeup_delay : (clock_time_t)-1;
+    if(etimer_pending()) {
+      if((long)(etimer_next_expiration_time() - now) <= 0) {
+        etimer_request_poll();
+        delay = 0;
+      } else if(etimer_next_expiration_time() - now < delay) {
+        delay = etimer_next_expiration_time() - now;
+      }
+    }
+    if(delay == 0) {
+      timeout = 0;
+    } else {
+      timer_arm(now + delay);
+    }
+  } else {
+    timer_disarm();
+  }
+  if(events_pending || ready > 0) {
+    timeout = 0;
+  }
+  wakeup_requested = 0;
+
+  n = epoll_pwait(epoll_fd, events, SELECT_MAX + 1, timeout, &wait_mask);
+  if(n < 0) {
+    if(errno != EINTR) {
+      perror("epoll_wait");
+    }
+    n = 0;
+  }
+  sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+  for(i = 0; i < n; i++) {
+    if(events[i].data.fd == timer_fd) {
+      if(read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+        timer_armed = 0;
+      }
+      etimer_request_poll();
+      continue;
+    }
+    if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      FD_SET(events[i].data.fd, &fdr);
+    }
+    if(events[i].events & (EPOLLOUT | EPOLLERR)) {
+      FD_SET(events[i].data.fd, &fdw);
+    }
+    ready++;
+  }
+
+  if(ready > 0) {
+    for(i = 0; i <= select_max; i++) {
+      if(select_callback[i] != NULL) {
+        select_callback[i]->handle_fd(&fdr, &fdw);
+      }
+    }
+  }
+}
+#else /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
+static void
+select_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+select_wait(int events_pending)
+{
+  fd_set fdr;
+  fd_set fdw;
+  int maxfd;
+  int i;
+  int retval;
+  struct timeval tv;
+
+  /* Timers are checked every millisecond anyway */
+  wakeup_requested = 0;
+
+  tv.tv_sec = 0;
+  tv.tv_usec = events_pending ? 1 : 1000;
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  maxfd = 0;
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
+      maxfd = i;
+    }
+  }
+
+  retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
+  if(retval < 0) {
+    if(errno != EINTR) {
+      perror("select");
+    }
+  } else if(retval > 0) {
+    /* timeout => retval == 0 */
+    for(i = 0; i <= maxfd; i++) {
+      if(select_callback[i] != NULL) {
+        select_callback[i]->handle_fd(&fdr, &fdw);
+      }
+    }
+  }
+
+  etimer_request_poll();
+}
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
 static void
 set_rime_addr(void)
 {
@@ -249,44 +595,10 @@ main(int argc, char **argv)
   /* Make standard output unbuffered. */
   setvbuf(stdout, (char *)NULL, _IONBF, 0);
 
+  select_init();
   select_set_callback(STDIN_FILENO, &stdin_fd);
   while(1) {
-    fd_set fdr;
-    fd_set fdw;
-    int maxfd;
-    int i;
-    int retval;
-    struct timeval tv;
-
-    retval = process_run();
-
-    tv.tv_sec = 0;
-    tv.tv_usec = retval ? 1 : 1000;
-
-    FD_ZERO(&fdr);
-    FD_ZERO(&fdw);
-    maxfd = 0;
-    for(i = 0; i <= select_max; i++) {
-      if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
-        maxfd = i;
-      }
-    }
-
-    retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
-    if(retval < 0) {
-      if(errno != EINTR) {
-        perror("select");
-      }
-    } else if(retval > 0) {
-      /* timeout => retval == 0 */
-      for(i = 0; i <= maxfd; i++) {
-        if(select_callback[i] != NULL) {
-          select_callback[i]->handle_fd(&fdr, &fdw);
-        }
-      }
-    }
-
-    etimer_request_poll();
+    select_wait(process_run());
 
 #if WITH_GUI
     if(console_resize()) {
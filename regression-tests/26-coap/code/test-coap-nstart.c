@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         A response that completes a CoAP exchange while NSTART holds
+ *         back the next transaction to the same peer. The response must
+ *         reach its callback intact, and the held back transaction must
+ *         go out afterwards.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "unit-test.h"
+#include "rest-engine.h"
+#include "er-coap.h"
+#include "er-coap-transactions.h"
+
+PROCESS_NAME(coap_engine);
+PROCESS(test_process, "CoAP NSTART test");
+AUTOSTART_PROCESSES(&test_process);
+
+static uip_ipaddr_t peer;
+static coap_transaction_t *first, *second;
+static uint16_t second_mid;
+static int responses;
+static int response_intact;
+
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+
+static void
+response_handler(void *data, void *response)
+{
+  coap_packet_t *message = response;
+  unsigned int format = 0;
+
+  responses++;
+  response_intact = message != NULL &&
+    uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &peer) &&
+    message->payload_len == 5 && !memcmp(message->payload, "hello", 5) &&
+    coap_get_header_content_format(message, &format) &&
+    format == TEXT_PLAIN;
+}
+
+static coap_transaction_t *
+request(const char *path)
+{
+  static coap_packet_t packet[1];
+  coap_transaction_t *t;
+  uint16_t mid = coap_get_mid();
+
+  t = coap_new_transaction(mid, &peer, UIP_HTONS(COAP_DEFAULT_PORT));
+  if(t != NULL) {
+    coap_init_message(packet, COAP_TYPE_CON, COAP_GET, mid);
+    coap_set_header_uri_path(packet, path);
+    t->callback = response_handler;
+    t->callback_data = NULL;
+    t->packet_len = coap_serialize_message(packet, t->packet);
+    coap_send_transaction(t);
+  }
+  return t;
+}
+
+/* Deliver a piggybacked response from the peer as uIP would */
+static void
+receive_response(uint16_t mid)
+{
+  static coap_packet_t packet[1];
+
+  coap_init_message(packet, COAP_TYPE_ACK, CONTENT_2_05, mid);
+  coap_set_header_content_format(packet, TEXT_PLAIN);
+  coap_set_payload(packet, "hello", 5);
+
+  memset(uip_buf, 0, UIP_LLH_LEN + UIP_IPUDPH_LEN);
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &peer);
+  UIP_UDP_BUF->srcport = UIP_HTONS(COAP_DEFAULT_PORT);
+  uip_appdata = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+  uip_len = coap_serialize_message(packet, uip_appdata);
+  uip_flags = UIP_NEWDATA;
+  process_post_synch(&coap_engine, tcpip_event, NULL);
+  uip_flags = 0;
+}
+
+UNIT_TEST_REGISTER(test_nstart_hold, "Hold back beyond NSTART");
+UNIT_TEST(test_nstart_hold)
+{
+  UNIT_TEST_BEGIN();
+
+  uip_ip6addr(&peer, 0xfd00, 0, 0, 0, 0, 0, 0, 2);
+  first = request("first");
+  second = request("second");
+  UNIT_TEST_ASSERT(first != NULL && second != NULL);
+  second_mid = second->mid;
+  UNIT_TEST_ASSERT(first->started && !first->waiting);
+  UNIT_TEST_ASSERT(!second->started && second->waiting);
+
+  UNIT_TEST_END();
+}
+
+UNIT_TEST_REGISTER(test_nstart_response, "Response intact");
+UNIT_TEST(test_nstart_response)
+{
+  UNIT_TEST_BEGIN();
+
+  receive_response(first->mid);
+  UNIT_TEST_ASSERT(responses == 1);
+  UNIT_TEST_ASSERT(response_intact);
+
+  /* Not sent from within the receive path */
+  UNIT_TEST_ASSERT(coap_get_transaction_by_mid(second_mid) == second);
+  UNIT_TEST_ASSERT(second->waiting);
+
+  UNIT_TEST_END();
+}
+
+UNIT_TEST_REGISTER(test_nstart_release, "Release held back");
+UNIT_TEST(test_nstart_release)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(coap_get_transaction_by_mid(second_mid) == second);
+  UNIT_TEST_ASSERT(second->started && !second->waiting);
+
+  receive_response(second_mid);
+  UNIT_TEST_ASSERT(responses == 2);
+  UNIT_TEST_ASSERT(response_intact);
+  UNIT_TEST_ASSERT(coap_get_transaction_by_mid(second_mid) == NULL);
+
+  UNIT_TEST_END();
+}
+
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  /* Let the CoAP engine start and take over transactions */
+  rest_init_engine();
+  PROCESS_PAUSE();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(test_nstart_hold);
+  UNIT_TEST_RUN(test_nstart_response);
+
+  /* The engine sends the held back transaction when it gets to run */
+  PROCESS_PAUSE();
+
+  UNIT_TEST_RUN(test_nstart_release);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
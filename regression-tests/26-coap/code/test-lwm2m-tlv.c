@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Block-wise TLV reads of an LWM2M object instance with callback
+ *         resources, one of them larger than the engine's TLV buffer.
+ *         Every block must agree with a read of the whole instance.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "er-coap.h"
+
+/* Larger than the default LWM2M_ENGINE_CONF_TLV_BUFFER_SIZE */
+#define LONG_LEN   150
+#define WHOLE_SIZE 256
+
+PROCESS(test_process, "LWM2M TLV test");
+AUTOSTART_PROCESSES(&test_process);
+
+static char long_value[LONG_LEN];
+static int long_reads;
+static int time_reads;
+static int fail_read;
+
+static uint8_t whole[WHOLE_SIZE];
+static int whole_len;
+
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+
+static int
+read_long(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outsize)
+{
+  long_reads++;
+  return ctx->writer->write_string(ctx, outbuf, outsize,
+                                   long_value, sizeof(long_value));
+}
+
+static int
+read_time(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outsize)
+{
+  time_reads++;
+  return ctx->writer->write_int(ctx, outbuf, outsize, 1500000000);
+}
+
+static int
+read_fail(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outsize)
+{
+  return fail_read ? -1 : ctx->writer->write_boolean(ctx, outbuf, outsize, 1);
+}
+
+LWM2M_RESOURCES(test_resources,
+                LWM2M_RESOURCE_STRING(0, "Contiki"),
+                LWM2M_RESOURCE_CALLBACK(1, { read_long, NULL, NULL }),
+                LWM2M_RESOURCE_INTEGER(2, 3300),
+                LWM2M_RESOURCE_CALLBACK(3, { read_time, NULL, NULL }),
+                LWM2M_RESOURCE_STRING(4, "Sensor node"),
+                LWM2M_RESOURCE_CALLBACK(5, { read_fail, NULL, NULL }),
+                );
+LWM2M_INSTANCES(test_instances, LWM2M_INSTANCE(0, test_resources));
+LWM2M_OBJECT(test, 3341, test_instances);
+
+/* TLV GET of the instance, returns the response code */
+static unsigned int
+get(uint8_t *buffer, uint16_t size, int32_t *offset, int *len)
+{
+  static coap_packet_t request[1];
+  static coap_packet_t response[1];
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, "3341/0");
+  coap_set_header_accept(request, LWM2M_TLV);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+  lwm2m_engine_handler(&test, request, response, buffer, size, offset);
+  *len = response->payload_len;
+  return response->code;
+}
+
+/* Reads the instance in blocks of size and compares with the whole */
+static int
+read_blocks(uint16_t size)
+{
+  static uint8_t blocks[WHOLE_SIZE];
+  static uint8_t buffer[WHOLE_SIZE];
+  int32_t offset = 0;
+  int blocks_len = 0;
+  int nblocks = 0;
+  int len;
+
+  do {
+    /* Each callback is read at most once for a block */
+    long_reads = time_reads = 0;
+    if(get(buffer, size, &offset, &len) != CONTENT_2_05 ||
+       blocks_len + len > sizeof(blocks) ||
+       long_reads > 1 || time_reads > 1) {
+      return 0;
+    }
+    memcpy(&blocks[blocks_len], buffer, len);
+    blocks_len += len;
+    nblocks++;
+  } while(offset != -1);
+
+  return nblocks == (whole_len + size - 1) / size &&
+    blocks_len == whole_len && memcmp(blocks, whole, whole_len) == 0;
+}
+
+UNIT_TEST_REGISTER(test_whole, "Whole instance");
+UNIT_TEST(test_whole)
+{
+  int32_t offset = 0;
+
+  UNIT_TEST_BEGIN();
+
+  memset(long_value, 'x', sizeof(long_value));
+  long_reads = time_reads = 0;
+  UNIT_TEST_ASSERT(get(whole, sizeof(whole), &offset, &whole_len) ==
+                   CONTENT_2_05);
+  UNIT_TEST_ASSERT(offset == 0);
+  UNIT_TEST_ASSERT(long_reads == 1 && time_reads == 1);
+  /* Resource 1 follows the 9 bytes of resource 0, with a 3 byte header */
+  UNIT_TEST_ASSERT(whole_len > 9 + 3 + LONG_LEN);
+  UNIT_TEST_ASSERT(whole[9] == 0xc8 && whole[10] == 1 && whole[11] == LONG_LEN);
+  UNIT_TEST_ASSERT(whole[9 + 3] == 'x' && whole[9 + 2 + LONG_LEN] == 'x');
+
+  UNIT_TEST_END();
+}
+
+UNIT_TEST_REGISTER(test_blocks, "Blocks match the whole");
+UNIT_TEST(test_blocks)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(read_blocks(16));
+  UNIT_TEST_ASSERT(read_blocks(32));
+  UNIT_TEST_ASSERT(read_blocks(64));
+
+  UNIT_TEST_END();
+}
+
+UNIT_TEST_REGISTER(test_failure, "Failing callback");
+UNIT_TEST(test_failure)
+{
+  static uint8_t buffer[WHOLE_SIZE];
+  int32_t offset;
+  int len;
+
+  UNIT_TEST_BEGIN();
+
+  fail_read = 1;
+  offset = 0;
+  UNIT_TEST_ASSERT(get(buffer, sizeof(buffer), &offset, &len) ==
+                   INTERNAL_SERVER_ERROR_5_00);
+  /* The last block holds its TLV */
+  offset = (whole_len - 1) / 16 * 16;
+  UNIT_TEST_ASSERT(get(buffer, 16, &offset, &len) ==
+                   INTERNAL_SERVER_ERROR_5_00);
+  fail_read = 0;
+
+  /* Past the end */
+  offset = whole_len + 16;
+  UNIT_TEST_ASSERT(get(buffer, 16, &offset, &len) == BAD_OPTION_4_02);
+
+  UNIT_TEST_END();
+}
+
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(test_whole);
+  UNIT_TEST_RUN(test_blocks);
+  UNIT_TEST_RUN(test_failure);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
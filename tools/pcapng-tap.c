@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Packet capture for the SLIP tools, written as pcapng into a
+ *         memory-mapped ring file.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pcapng-tap.h"
+
+#define BT_SHB          0x0A0D0D0A    /* Section Header Block */
+#define BT_IDB          0x00000001    /* Interface Description Block */
+#define BT_EPB          0x00000006    /* Enhanced Packet Block */
+#define BT_PAD          0x80000001    /* Local use: skipped by readers */
+
+#define SHB_LEN         28
+#define IDB_LEN         20
+#define EPB_FIXED_LEN   (32 + 8 + 4)  /* Header, epb_flags, opt_endofopt */
+#define MIN_BLOCK_LEN   12
+
+#define PAD4(x)         (((x) + 3) & ~3)
+/*---------------------------------------------------------------------------*/
+static unsigned char *
+put32(unsigned char *p, uint32_t v)
+{
+  memcpy(p, &v, 4);             /* pcapng is in the writer's byte order */
+  return p + 4;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned char *
+put16(unsigned char *p, uint16_t v)
+{
+  memcpy(p, &v, 2);
+  return p + 2;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_padding(struct pcapng_tap *tap, size_t at, size_t len)
+{
+  unsigned char *p = tap->map + at;
+  p = put32(p, BT_PAD);
+  put32(p, len);
+  put32(tap->map + at + len - 4, len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+rate_ok(struct pcapng_rate *r, const struct timeval *now)
+{
+  double elapsed;
+
+  if(r->rate == 0) {
+    return 1;
+  }
+  elapsed = (now->tv_sec - r->last.tv_sec) +
+    (now->tv_usec - r->last.tv_usec) / 1000000.0;
+  r->last = *now;
+  r->tokens += elapsed * r->rate;
+  if(r->tokens > r->rate) {
+    r->tokens = r->rate;        /* Bursts of up to one second */
+  }
+  if(r->tokens < 1) {
+    return 0;
+  }
+  r->tokens -= 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Makes room for a block of len bytes at tap->head, wrapping around and
+   retiring old blocks as needed. */
+static void
+make_room(struct pcapng_tap *tap, size_t len)
+{
+  size_t end;
+
+  if(tap->head + len != tap->size &&
+     tap->head + len + MIN_BLOCK_LEN > tap->size) {
+    /* Does not fit before the end of the file: pad and start over */
+    if(tap->head < tap->size) {
+      put_padding(tap, tap->head, tap->size - tap->head);
+    }
+    tap->head = tap->start;
+    tap->tail = tap->start;
+    tap->wrapped = 1;
+    tap->wraps++;
+  }
+
+  if(!tap->wrapped) {
+    return;
+  }
+
+  /* Retire old blocks until the new one fits and whatever is left of the
+     gap before the next intact block can hold a padding block. */
+  end = tap->head + len;
+  while(tap->tail < tap->size &&
+        (tap->tail < end ||
+         (tap->tail > end && tap->tail - end < MIN_BLOCK_LEN))) {
+    tap->tail += get32(tap->map + tap->tail + 4);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+pcapng_tap_open(struct pcapng_tap *tap, const char *spec)
+{
+  char path[1024];
+  const char *opt;
+  unsigned char *p;
+  uint32_t rate = 0;
+  size_t len;
+
+  memset(tap, 0, sizeof(*tap));
+  tap->fd = -1;
+  tap->size = PCAPNG_TAP_DEFAULT_SIZE;
+  tap->snaplen = PCAPNG_TAP_DEFAULT_SNAPLEN;
+  tap->linktype = PCAPNG_LINKTYPE_RAW;
+
+  len = strcspn(spec, ",");
+  if(len == 0 || len >= sizeof(path)) {
+    warnx("bad capture file ``%s''", spec);
+    return -1;
+  }
+  memcpy(path, spec, len);
+  path[len] = '\0';
+  for(opt = spec + len; *opt == ','; opt += strcspn(opt + 1, ",") + 1) {
+    if(strncmp(opt, ",size=", 6) == 0) {
+      tap->size = (size_t)atoi(opt + 6) * 1024 * 1024;
+    } else if(strncmp(opt, ",snap=", 6) == 0) {
+      tap->snaplen = atoi(opt + 6);
+    } else if(strncmp(opt, ",rate=", 6) == 0) {
+      rate = atoi(opt + 6);
+    } else if(strncmp(opt, ",wpan", 5) == 0) {
+      tap->linktype = PCAPNG_LINKTYPE_IEEE802_15_4;
+    } else {
+      warnx("unknown capture option ``%s''", opt + 1);
+      return -1;
+    }
+  }
+  tap->size &= ~(size_t)3;
+  if(tap->size < 64 * 1024 || tap->snaplen == 0) {
+    warnx("capture file too small or snaplen 0");
+    return -1;
+  }
+  tap->limit[PCAPNG_TAP_IN].rate = tap->limit[PCAPNG_TAP_OUT].rate = rate;
+  tap->limit[PCAPNG_TAP_IN].tokens = tap->limit[PCAPNG_TAP_OUT].tokens = rate;
+  gettimeofday(&tap->limit[PCAPNG_TAP_IN].last, NULL);
+  tap->limit[PCAPNG_TAP_OUT].last = tap->limit[PCAPNG_TAP_IN].last;
+
+  tap->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(tap->fd == -1) {
+    warn("can't open capture file ``%s''", path);
+    return -1;
+  }
+  if(ftruncate(tap->fd, tap->size) == -1) {
+    warn("can't size capture file ``%s''", path);
+    close(tap->fd);
+    return -1;
+  }
+  tap->map = mmap(NULL, tap->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  tap->fd, 0);
+  if(tap->map == MAP_FAILED) {
+    warn("can't map capture file ``%s''", path);
+    close(tap->fd);
+    return -1;
+  }
+
+  /* Section Header Block */
+  p = tap->map;
+  p = put32(p, BT_SHB);
+  p = put32(p, SHB_LEN);
+  p = put32(p, 0x1A2B3C4D);     /* Byte-order magic */
+  p = put16(p, 1);              /* Version 1.0 */
+  p = put16(p, 0);
+  p = put32(p, 0xffffffff);     /* Section length not specified */
+  p = put32(p, 0xffffffff);
+  p = put32(p, SHB_LEN);
+
+  /* Interface Description Block, microsecond timestamps by default */
+  p = put32(p, BT_IDB);
+  p = put32(p, IDB_LEN);
+  p = put16(p, tap->linktype);
+  p = put16(p, 0);
+  p = put32(p, tap->snaplen);
+  p = put32(p, IDB_LEN);
+
+  tap->start = tap->head = p - tap->map;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+pcapng_tap_packet(struct pcapng_tap *tap, int dir, const void *data, int len)
+{
+  struct timeval now;
+  uint64_t usec;
+  uint32_t caplen, blocklen;
+  unsigned char *p;
+
+  if(tap == NULL || tap->map == NULL) {
+    return;
+  }
+  gettimeofday(&now, NULL);
+  if(!rate_ok(&tap->limit[dir], &now)) {
+    tap->limited[dir]++;
+    return;
+  }
+
+  caplen = len;
+  if(caplen > tap->snaplen) {
+    caplen = tap->snaplen;
+    tap->truncated++;
+  }
+  blocklen = EPB_FIXED_LEN + PAD4(caplen);
+  make_room(tap, blocklen);
+
+  usec = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+  p = tap->map + tap->head;
+  p = put32(p, BT_EPB);
+  p = put32(p, blocklen);
+  p = put32(p, 0);              /* Interface ID */
+  p = put32(p, usec >> 32);
+  p = put32(p, usec);
+  p = put32(p, caplen);
+  p = put32(p, len);
+  memcpy(p, data, caplen);
+  memset(p + caplen, 0, PAD4(caplen) - caplen);
+  p += PAD4(caplen);
+  p = put16(p, 2);              /* epb_flags: inbound or outbound */
+  p = put16(p, 4);
+  p = put32(p, dir == PCAPNG_TAP_IN ? 1 : 2);
+  p = put32(p, 0);              /* opt_endofopt */
+  put32(p, blocklen);
+
+  tap->head += blocklen;
+  if(tap->wrapped && tap->tail > tap->head && tap->tail <= tap->size) {
+    /* Cover what is left of the block(s) that were overwritten */
+    put_padding(tap, tap->head, tap->tail - tap->head);
+  }
+  tap->captured[dir]++;
+}
+/*---------------------------------------------------------------------------*/
+void
+pcapng_tap_close(struct pcapng_tap *tap)
+{
+  if(tap == NULL || tap->map == NULL) {
+    return;
+  }
+  msync(tap->map, tap->size, MS_SYNC);
+  munmap(tap->map, tap->size);
+  tap->map = NULL;
+  if(!tap->wrapped) {
+    if(ftruncate(tap->fd, tap->head) == -1) {
+      warn("can't truncate capture file");
+    }
+  }
+  close(tap->fd);
+  tap->fd = -1;
+}
+/*---------------------------------------------------------------------------*/
+void
+pcapng_tap_print_stats(struct pcapng_tap *tap, FILE *stream)
+{
+  fprintf(stream, "capture: in %lu (%lu over rate) out %lu (%lu over rate) "
+          "truncated %lu wraps %lu\n",
+          tap->captured[PCAPNG_TAP_IN], tap->limited[PCAPNG_TAP_IN],
+          tap->captured[PCAPNG_TAP_OUT], tap->limited[PCAPNG_TAP_OUT],
+          tap->truncated, tap->wraps);
+}
+/*---------------------------------------------------------------------------*/
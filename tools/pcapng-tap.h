@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Packet capture for the SLIP tools, written as pcapng into a
+ *         memory-mapped ring file.
+ *
+ *         The capture file is created at its full size and mapped into
+ *         memory once. Capturing a packet is a memcpy() into the map;
+ *         the kernel writes the pages back in the background, so the
+ *         forwarding path never waits for the disk. When the file is
+ *         full, writing continues after the pcapng headers and the old
+ *         packets that get overwritten are covered with a padding block
+ *         that readers skip, so the file stays readable at any moment.
+ *         After a wrap the newest packets are at the start of the file.
+ *
+ *         Every direction has its own packets-per-second limit, and
+ *         packets are cut at the snaplen.
+ */
+
+#ifndef PCAPNG_TAP_H
+#define PCAPNG_TAP_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define PCAPNG_LINKTYPE_RAW             101   /* Raw IPv4/IPv6 */
+#define PCAPNG_LINKTYPE_IEEE802_15_4    230   /* 802.15.4 without FCS */
+
+#define PCAPNG_TAP_IN                   0     /* From the serial line */
+#define PCAPNG_TAP_OUT                  1     /* To the serial line */
+
+#ifndef PCAPNG_TAP_DEFAULT_SIZE
+#define PCAPNG_TAP_DEFAULT_SIZE         (16 * 1024 * 1024)
+#endif
+
+#ifndef PCAPNG_TAP_DEFAULT_SNAPLEN
+#define PCAPNG_TAP_DEFAULT_SNAPLEN      2000
+#endif
+
+struct pcapng_rate {
+  uint32_t rate;                /* Packets per second, 0 for no limit */
+  double tokens;
+  struct timeval last;
+};
+
+struct pcapng_tap {
+  int fd;
+  unsigned char *map;
+  size_t size;
+  size_t start;                 /* First byte after the headers */
+  size_t head;                  /* Where the next block goes */
+  size_t tail;                  /* Oldest intact block, once wrapped */
+  int wrapped;
+  uint32_t snaplen;
+  uint16_t linktype;
+  struct pcapng_rate limit[2];
+
+  /* Statistics, per direction */
+  unsigned long captured[2];
+  unsigned long limited[2];
+  unsigned long truncated;
+  unsigned long wraps;
+};
+
+/**
+ * \brief      Start capturing
+ * \param tap  The tap
+ * \param spec file[,size=MB][,snap=BYTES][,rate=PPS][,wpan], where
+ *             rate limits each direction and wpan sets the link type
+ *             to IEEE 802.15.4 instead of raw IP
+ * \return     0 on success, -1 with a warning printed on failure
+ */
+int pcapng_tap_open(struct pcapng_tap *tap, const char *spec);
+
+/**
+ * \brief      Capture a packet
+ * \param tap  The tap, or NULL when capturing is off
+ * \param dir  PCAPNG_TAP_IN or PCAPNG_TAP_OUT
+ * \param data The packet
+ * \param len  Length of the packet
+ */
+void pcapng_tap_packet(struct pcapng_tap *tap, int dir,
+                       const void *data, int len);
+
+/**
+ * \brief      Stop capturing and release the file
+ *
+ *             A capture that never wrapped is truncated to the data
+ *             actually written.
+ */
+void pcapng_tap_close(struct pcapng_tap *tap);
+
+/**
+ * \brief      Print the capture counters to a stdio stream
+ */
+void pcapng_tap_print_stats(struct pcapng_tap *tap, FILE *stream);
+
+#endif /* PCAPNG_TAP_H */
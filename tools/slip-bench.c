@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Micro-benchmark for the SLIP decoder used by the SLIP tools.
+ *
+ *         Replays a captured SLIP byte stream (or a synthesized one) and
+ *         decodes it both with the block decoder in slip-decode.c and
+ *         with the one-fread()-per-byte loop the tools used before,
+ *         reporting frames/s and bytes/s for each.
+ *
+ *         With -c the block decoder also feeds every frame to a
+ *         pcapng capture tap, to see what capturing costs.
+ *
+ *         A capture can be made with e.g.
+ *             cat /dev/ttyUSB0 > capture.slip
+ *         while the border router is under load.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "slip-decode.h"
+#include "pcapng-tap.h"
+
+#define BUFSIZE 2000
+
+static unsigned long legacy_frames;
+static unsigned long legacy_bytes;
+
+static struct pcapng_tap tap;
+static struct pcapng_tap *tapp = NULL;
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_frame(struct slip_decoder *d, unsigned char *frame, int len)
+{
+  /* Touch the data like a write() to the tunnel would */
+  *(unsigned long *)d->ptr += frame[0] + frame[len - 1];
+  pcapng_tap_packet(tapp, PCAPNG_TAP_IN, frame, len);
+}
+/*---------------------------------------------------------------------------*/
+/* The per-byte decoder loop as used by tunslip6 and simplerSlip. */
+static void
+legacy_decode(FILE *inslip)
+{
+  static unsigned char inbuf[BUFSIZE];
+  static int inbufptr = 0;
+  unsigned char c;
+
+  while(fread(&c, 1, 1, inslip) == 1) {
+    legacy_bytes++;
+    if(inbufptr >= (int)sizeof(inbuf)) {
+      inbufptr = 0;
+    }
+    switch(c) {
+    case SLIP_END:
+      if(inbufptr > 0) {
+        legacy_frames++;
+        inbufptr = 0;
+      }
+      break;
+    case SLIP_ESC:
+      if(fread(&c, 1, 1, inslip) != 1) {
+        return;
+      }
+      legacy_bytes++;
+      switch(c) {
+      case SLIP_ESC_END:
+        c = SLIP_END;
+        break;
+      case SLIP_ESC_ESC:
+        c = SLIP_ESC;
+        break;
+      }
+      /* FALLTHROUGH */
+    default:
+      inbuf[inbufptr++] = c;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned char *
+synthesize(int frames, int size, size_t *len)
+{
+  unsigned char *stream, *p;
+  int i, j;
+
+  /* Worst case every byte is escaped */
+  stream = malloc((size_t)frames * (2 * size + 1) + 1);
+  if(stream == NULL) {
+    err(1, "malloc");
+  }
+  p = stream;
+  *p++ = SLIP_END;
+  srandom(1);
+  for(i = 0; i < frames; i++) {
+    for(j = 0; j < size; j++) {
+      /* IPv6 header first, then payload with some bytes to escape */
+      unsigned char c = j == 0 ? 0x60 : random() & 0xff;
+      if(c == SLIP_END) {
+        *p++ = SLIP_ESC;
+        *p++ = SLIP_ESC_END;
+      } else if(c == SLIP_ESC) {
+        *p++ = SLIP_ESC;
+        *p++ = SLIP_ESC_ESC;
+      } else {
+        *p++ = c;
+      }
+    }
+    *p++ = SLIP_END;
+  }
+  *len = p - stream;
+  return stream;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, unsigned long frames, unsigned long bytes,
+       double secs)
+{
+  printf("%-9s %10lu frames %12lu bytes %8.3f s %12.0f frames/s %8.1f MB/s\n",
+         name, frames, bytes, secs, frames / secs, bytes / secs / 1e6);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  const char *capture = NULL;
+  const char *save = NULL;
+  char tmpname[] = "/tmp/slip-bench-XXXXXX";
+  int frames = 100000, size = 127, iterations = 10;
+  unsigned char *stream = NULL;
+  unsigned char frame_buf[BUFSIZE];
+  unsigned long sink = 0;
+  struct slip_decoder dec;
+  size_t len = 0;
+  double start;
+  int c, i, fd;
+
+  while((c = getopt(argc, argv, "r:w:c:n:s:i:h")) != -1) {
+    switch(c) {
+    case 'r':
+      capture = optarg;
+      break;
+    case 'w':
+      save = optarg;
+      break;
+    case 'c':
+      if(pcapng_tap_open(&tap, optarg) == -1) {
+        exit(1);
+      }
+      tapp = &tap;
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 's':
+      size = atoi(optarg);
+      break;
+    case 'i':
+      iterations = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-r capture] [-w save] [-n frames] "
+              "[-s frame size] [-i iterations] [-c pcapng]\n", argv[0]);
+      fprintf(stderr, " -r capture   Replay a captured SLIP byte stream\n");
+      fprintf(stderr, " -w save      Save the synthesized stream\n");
+      fprintf(stderr, " -c pcapng    Capture decoded frames, as with tunslip6 -w\n");
+      fprintf(stderr, " -n frames    Frames to synthesize (default 100000)\n");
+      fprintf(stderr, " -s size      Size of synthesized frames (default 127)\n");
+      fprintf(stderr, " -i count     Replay the stream count times (default 10)\n");
+      exit(1);
+    }
+  }
+
+  if(capture == NULL) {
+    stream = synthesize(frames, size, &len);
+    if(save != NULL) {
+      capture = save;
+    } else {
+      capture = tmpname;
+      fd = mkstemp(tmpname);
+      if(fd == -1) {
+        err(1, "mkstemp");
+      }
+      close(fd);
+    }
+    fd = open(capture, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1 || write(fd, stream, len) != (ssize_t)len) {
+      err(1, "can't write ``%s''", capture);
+    }
+    close(fd);
+    free(stream);
+  }
+
+  /* Block decoder: read() straight into the decoder */
+  slip_decoder_init(&dec, frame_buf, sizeof(frame_buf), count_frame, &sink);
+  start = now();
+  for(i = 0; i < iterations; i++) {
+    fd = open(capture, O_RDONLY);
+    if(fd == -1) {
+      err(1, "can't open ``%s''", capture);
+    }
+    while(slip_decoder_read(&dec, fd) > 0);
+    close(fd);
+  }
+  report(tapp != NULL ? "block+cap" : "block", dec.frames, dec.bytes,
+         now() - start);
+  if(tapp != NULL) {
+    pcapng_tap_print_stats(tapp, stdout);
+    pcapng_tap_close(tapp);
+  }
+
+  /* Legacy decoder: one fread() per byte */
+  start = now();
+  for(i = 0; i < iterations; i++) {
+    FILE *f = fopen(capture, "r");
+    if(f == NULL) {
+      err(1, "can't open ``%s''", capture);
+    }
+    legacy_decode(f);
+    fclose(f);
+  }
+  report("fread", legacy_frames, legacy_bytes, now() - start);
+
+  if(dec.frames != legacy_frames) {
+    fprintf(stderr, "frame count mismatch: %lu != %lu\n",
+            dec.frames, legacy_frames);
+  }
+
+  if(capture == tmpname) {
+    unlink(tmpname);
+  }
+  return sink == 0xdeadbeef;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Block-oriented SLIP decoder for the host-side SLIP tools.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "slip-decode.h"
+
+/*---------------------------------------------------------------------------*/
+/* Word-at-a-time helpers: a byte of x is zero iff the matching bit of
+   HASZERO(x) is set (the classic "determine if a word has a zero byte"). */
+#define ONES    ((uint64_t)0x0101010101010101ULL)
+#define HIGHS   ((uint64_t)0x8080808080808080ULL)
+#define HASZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+/*---------------------------------------------------------------------------*/
+const unsigned char *
+slip_scan(const unsigned char *p, const unsigned char *end)
+{
+#ifdef __SSE2__
+  const __m128i v_end = _mm_set1_epi8((char)SLIP_END);
+  const __m128i v_esc = _mm_set1_epi8((char)SLIP_ESC);
+
+  while(end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, v_end),
+                                              _mm_cmpeq_epi8(v, v_esc)));
+    if(mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#else
+  const uint64_t w_end = ONES * SLIP_END;
+  const uint64_t w_esc = ONES * SLIP_ESC;
+
+  while(end - p >= 8) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    if(HASZERO(w ^ w_end) | HASZERO(w ^ w_esc)) {
+      /* Somewhere in this word; let the byte loop below pin it down. */
+      break;
+    }
+    p += 8;
+  }
+#endif
+  while(p < end && *p != SLIP_END && *p != SLIP_ESC) {
+    p++;
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_printable(const unsigned char *s, int len)
+{
+  int i;
+  for(i = 1; i < len; i++) {
+    if(s[i] == 0 || s[i] == '\r' || s[i] == '\n' || s[i] == '\t') {
+      continue;
+    } else if(s[i] < ' ' || '~' < s[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+append(struct slip_decoder *d, const unsigned char *p, int n)
+{
+  if(d->overflow) {
+    return;
+  }
+  if(d->len + n > d->size) {
+    /* Too large for the frame buffer: discard up to the next SLIP_END */
+    d->overflow = 1;
+    d->dropped++;
+    return;
+  }
+  memcpy(d->buf + d->len, p, n);
+  d->len += n;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned char
+unescape(struct slip_decoder *d, unsigned char c)
+{
+  switch(c) {
+  case SLIP_ESC_END:
+    return SLIP_END;
+  case SLIP_ESC_ESC:
+    return SLIP_ESC;
+  case SLIP_ESC_XON:
+    return (d->flags & SLIP_DECODE_XONXOFF) ? XON : c;
+  case SLIP_ESC_XOFF:
+    return (d->flags & SLIP_DECODE_XONXOFF) ? XOFF : c;
+  }
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_decoder_init(struct slip_decoder *d, unsigned char *buf, int size,
+                  slip_frame_callback_t frame, void *ptr)
+{
+  memset(d, 0, sizeof(*d));
+  d->buf = buf;
+  d->size = size;
+  d->frame = frame;
+  d->ptr = ptr;
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_decoder_input(struct slip_decoder *d,
+                   const unsigned char *data, size_t len)
+{
+  const unsigned char *p = data;
+  const unsigned char *end = data + len;
+  const unsigned char *run;
+
+  d->bytes += len;
+
+  if(d->esc && p < end) {
+    /* The previous block ended in the middle of an escape sequence */
+    unsigned char c = unescape(d, *p++);
+    d->esc = 0;
+    append(d, &c, 1);
+  }
+
+  while(p < end) {
+    run = slip_scan(p, end);
+
+    if((d->flags & SLIP_DECODE_LINES) && d->line != NULL) {
+      /* Serial debug output is not always SLIP framed; echo each
+         complete line as soon as its newline has been seen. */
+      const unsigned char *nl = memchr(p, '\n', run - p);
+      if(nl != NULL) {
+        append(d, p, nl + 1 - p);
+        p = nl + 1;
+        if(!d->overflow && is_printable(d->buf, d->len)) {
+          d->line(d, d->buf, d->len);
+          d->len = 0;
+        }
+        continue;
+      }
+    }
+
+    if(run > p) {
+      append(d, p, run - p);
+      p = run;
+    }
+    if(p == end) {
+      break;
+    }
+
+    if(*p == SLIP_END) {
+      p++;
+      if(d->overflow) {
+        d->overflow = 0;
+      } else if(d->len > 0) {
+        d->frames++;
+        d->frame(d, d->buf, d->len);
+      }
+      d->len = 0;
+    } else {
+      /* SLIP_ESC */
+      p++;
+      if(p == end) {
+        d->esc = 1;
+        break;
+      } else {
+        unsigned char c = unescape(d, *p++);
+        append(d, &c, 1);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+ssize_t
+slip_decoder_read(struct slip_decoder *d, int fd)
+{
+  unsigned char block[SLIP_DECODE_READ_SIZE];
+  ssize_t total = 0;
+  ssize_t n;
+
+  for(;;) {
+    n = read(fd, block, sizeof(block));
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      if(errno == EAGAIN && total > 0) {
+        break;
+      }
+      return -1;
+    }
+    d->reads++;
+    slip_decoder_input(d, block, n);
+    total += n;
+    if(n < (ssize_t)sizeof(block)) {
+      /* A short read means the kernel buffer has been drained */
+      break;
+    }
+  }
+
+  return total;
+}
+/*---------------------------------------------------------------------------*/
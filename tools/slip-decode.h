@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Block-oriented SLIP decoder for the host-side SLIP tools.
+ *
+ *         Input is pulled from the serial file descriptor in blocks of
+ *         SLIP_DECODE_READ_SIZE bytes and decoded a run at a time: the scanner
+ *         looks for the next SLIP_END or SLIP_ESC byte a machine word
+ *         (or SSE2 register) at a time, and everything in between is
+ *         copied into the frame buffer with a single memcpy(). The
+ *         decoder keeps its partial frame and a pending escape across
+ *         calls, so frames may be split over any number of reads.
+ */
+
+#ifndef SLIP_DECODE_H
+#define SLIP_DECODE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SLIP_END      0300
+#define SLIP_ESC      0333
+#define SLIP_ESC_END  0334
+#define SLIP_ESC_ESC  0335
+
+#define SLIP_ESC_XON  0336
+#define SLIP_ESC_XOFF 0337
+#define XON           17
+#define XOFF          19
+
+#ifndef SLIP_DECODE_READ_SIZE
+#define SLIP_DECODE_READ_SIZE 4096
+#endif
+
+/* Decoder flags */
+/* Translate SLIP_ESC_XON and SLIP_ESC_XOFF as tunslip6 -X does */
+#define SLIP_DECODE_XONXOFF   0x01
+/* Hand '\n'-terminated printable text to the line callback */
+#define SLIP_DECODE_LINES     0x02
+
+struct slip_decoder;
+
+typedef void (* slip_frame_callback_t)(struct slip_decoder *d,
+                                       unsigned char *frame, int len);
+
+struct slip_decoder {
+  unsigned char *buf;
+  int size;
+  int len;
+  unsigned char esc;
+  unsigned char overflow;
+  unsigned char flags;
+
+  slip_frame_callback_t frame;
+  slip_frame_callback_t line;
+  void *ptr;
+
+  /* Statistics */
+  unsigned long bytes;
+  unsigned long frames;
+  unsigned long dropped;
+  unsigned long reads;
+};
+
+/**
+ * \brief      Initialize a decoder
+ * \param d    The decoder
+ * \param buf  Frame buffer, must hold the largest frame accepted
+ * \param size Size of buf
+ * \param frame Called once for each complete, unescaped frame
+ * \param ptr  Opaque pointer for the caller, stored in d->ptr
+ */
+void slip_decoder_init(struct slip_decoder *d, unsigned char *buf, int size,
+                       slip_frame_callback_t frame, void *ptr);
+
+/**
+ * \brief      Decode a block of raw SLIP bytes
+ * \param d    The decoder
+ * \param data Raw bytes as received from the serial line
+ * \param len  Number of bytes in data
+ *
+ *             Complete frames are handed to the frame callback. A
+ *             partial frame is kept in the decoder until the rest of
+ *             it is passed in by a later call.
+ */
+void slip_decoder_input(struct slip_decoder *d,
+                        const unsigned char *data, size_t len);
+
+/**
+ * \brief      Read everything available on fd and decode it
+ * \param d    The decoder
+ * \param fd   A file descriptor in non-blocking mode
+ * \return     Number of bytes consumed, 0 on end of file, or -1
+ *             with errno set. EAGAIN is only reported when
+ *             nothing at all could be read.
+ */
+ssize_t slip_decoder_read(struct slip_decoder *d, int fd);
+
+/**
+ * \brief      Find the next SLIP_END or SLIP_ESC byte
+ * \param p    Start of the block to scan
+ * \param end  End of the block to scan
+ * \return     Pointer to the first special byte, or end if there is none
+ */
+const unsigned char *slip_scan(const unsigned char *p,
+                               const unsigned char *end);
+
+#endif /* SLIP_DECODE_H */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Serial and tun device setup shared by the SLIP tools.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "slip-dev.h"
+
+/*---------------------------------------------------------------------------*/
+int
+devopen(const char *dev, int flags)
+{
+  char t[1024];
+  strcpy(t, "/dev/");
+  strncat(t, dev, sizeof(t) - 6);
+  return open(t, flags);
+}
+/*---------------------------------------------------------------------------*/
+int
+stty_telos(int fd, speed_t speed, int flags)
+{
+  struct termios tty;
+  int i;
+
+  if(tcflush(fd, TCIOFLUSH) == -1) {
+    warn("tcflush");
+    return -1;
+  }
+
+  if(tcgetattr(fd, &tty) == -1) {
+    warn("tcgetattr");
+    return -1;
+  }
+
+  cfmakeraw(&tty);
+
+  /* Nonblocking read. */
+  tty.c_cc[VTIME] = 0;
+  tty.c_cc[VMIN] = 0;
+  if(flags & STTY_CRTSCTS) {
+    tty.c_cflag |= CRTSCTS;
+  } else {
+    tty.c_cflag &= ~CRTSCTS;
+  }
+  tty.c_iflag &= ~IXON;
+  if(flags & STTY_XONXOFF) {
+    tty.c_iflag |= IXOFF | IXANY;
+  } else {
+    tty.c_iflag &= ~IXOFF & ~IXANY;
+  }
+  tty.c_cflag &= ~HUPCL;
+  tty.c_cflag &= ~CLOCAL;
+
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+
+  if(tcsetattr(fd, TCSAFLUSH, &tty) == -1) {
+    warn("tcsetattr");
+    return -1;
+  }
+
+  tty.c_cflag |= CLOCAL;
+  if(tcsetattr(fd, TCSAFLUSH, &tty) == -1) {
+    warn("tcsetattr");
+    return -1;
+  }
+
+  i = TIOCM_DTR;
+  if(ioctl(fd, TIOCMBIS, &i) == -1) {
+    warn("ioctl");
+    return -1;
+  }
+
+  usleep(10*1000);		/* Wait for hardware 10ms. */
+
+  /* Flush input and output buffers. */
+  if(tcflush(fd, TCIOFLUSH) == -1) {
+    warn("tcflush");
+    return -1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+#ifdef linux
+#include <linux/if.h>
+#include <linux/if_tun.h>
+
+int
+tun_alloc(char *dev, int tap)
+{
+  struct ifreq ifr;
+  int fd, err;
+
+  if( (fd = open("/dev/net/tun", O_RDWR)) < 0 ) {
+    perror("can not open /dev/net/tun");
+    return -1;
+  }
+
+  memset(&ifr, 0, sizeof(ifr));
+
+  /* Flags: IFF_TUN   - TUN device (no Ethernet headers)
+   *        IFF_TAP   - TAP device
+   *
+   *        IFF_NO_PI - Do not provide packet information
+   */
+  ifr.ifr_flags = (tap ? IFF_TAP : IFF_TUN) | IFF_NO_PI;
+  if(*dev != 0)
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+
+  if((err = ioctl(fd, TUNSETIFF, (void *) &ifr)) < 0 ) {
+    close(fd);
+    fprintf(stderr, "can not tunsetiff to %s (flags=%08x): %s\n", dev, ifr.ifr_flags,
+            strerror(errno));
+    return err;
+  }
+
+  /* get resulting tunnel name */
+  strcpy(dev, ifr.ifr_name);
+  return fd;
+}
+#else
+int
+tun_alloc(char *dev, int tap)
+{
+  return devopen(dev, O_RDWR);
+}
+#endif
+/*---------------------------------------------------------------------------*/
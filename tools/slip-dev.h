@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Serial and tun device setup shared by the SLIP tools.
+ */
+
+#ifndef SLIP_DEV_H
+#define SLIP_DEV_H
+
+#include <termios.h>
+
+/* Flags for stty_telos() */
+#define STTY_CRTSCTS 0x01     /* Hardware CTS/RTS flow control */
+#define STTY_XONXOFF 0x02     /* Software XON/XOFF flow control */
+
+/**
+ * \brief      Open a device relative to /dev
+ */
+int devopen(const char *dev, int flags);
+
+/**
+ * \brief      Put a serial line in raw, non-blocking mode
+ * \param fd   The serial line
+ * \param speed The baudrate, as returned by select_baudrate()
+ * \param flags STTY_CRTSCTS and/or STTY_XONXOFF
+ * \return     0 on success, -1 with a warning printed on failure
+ */
+int stty_telos(int fd, speed_t speed, int flags);
+
+/**
+ * \brief      Create or attach to a tun or tap interface
+ * \param dev  Interface name, or "" to let the kernel pick one.
+ *             Must be large enough to hold IFNAMSIZ bytes: the
+ *             name of the interface is returned in it.
+ * \param tap  Non-zero for a tap interface
+ * \return     The file descriptor, or -1 on failure
+ */
+int tun_alloc(char *dev, int tap);
+
+#endif /* SLIP_DEV_H */
@@ -0,0 +1,1215 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Multi-radio SLIP gateway.
+ *
+ *         One process that does the job of a tunslip6 per radio: it
+ *         drives any number of links, each made of a serial device (or
+ *         a serial line exported over TCP) and a network endpoint (a
+ *         tun/tap interface, or a TCP connection carrying SLIP), from a
+ *         single epoll loop.
+ *
+ *         Links are given with -l on the command line and can be added
+ *         and removed while the gateway runs through a UNIX control
+ *         socket, without disturbing the other links:
+ *
+ *             echo "add name=r3,serial=ttyUSB3,tun=tun3,addr=fd03::1/64" \
+ *               | socat - UNIX-CONNECT:/tmp/slip-gateway.sock
+ *             echo "remove r3" | socat - UNIX-CONNECT:/tmp/slip-gateway.sock
+ *             echo "stats" | socat - UNIX-CONNECT:/tmp/slip-gateway.sock
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "tools-utils.h"
+#include "slip-decode.h"
+#include "slip-queue.h"
+#include "slip-dev.h"
+
+#ifndef BAUDRATE
+#define BAUDRATE B115200
+#endif
+
+#define BUFSIZE             2000
+#define MIN_DEVMTU          1500
+#define MAX_LINKS           64
+#define MAX_CONTROL_CLIENTS 8
+#define MAX_EVENTS          64
+#define RETRY_INTERVAL      2     /* Seconds between attempts to reopen */
+#define DEBUG_LINE_MARKER   '\r'
+
+enum {
+  EP_SERIAL,
+  EP_NET,
+  EP_LISTEN,
+  EP_CONTROL,
+  EP_CONTROL_CLIENT,
+};
+
+enum {
+  NET_TUN,
+  NET_TCP_CONNECT,
+  NET_TCP_LISTEN,
+};
+
+struct link;
+
+struct endpoint {
+  int type;
+  int fd;
+  uint32_t events;
+  struct link *link;
+};
+
+struct link {
+  char name[32];
+
+  /* Serial side */
+  char siodev[64];
+  char sio_host[64];
+  char sio_port[16];
+  speed_t speed;
+  int stty_flags;
+  struct endpoint serial;
+  struct slip_decoder serial_dec;
+  struct slip_queue serial_q;
+  unsigned char serial_buf[BUFSIZE];
+
+  /* Network side */
+  int net_type;
+  char tundev[64];
+  char ipaddr[64];
+  int tap;
+  char net_host[64];
+  char net_port[16];
+  struct endpoint net;
+  struct endpoint listen;
+  struct slip_decoder net_dec;
+  struct slip_queue net_q;
+  unsigned char net_buf[BUFSIZE];
+
+  time_t retry;
+
+  /* Statistics */
+  time_t started;
+  unsigned long to_net_frames;
+  unsigned long to_net_bytes;
+  unsigned long to_serial_frames;
+  unsigned long to_serial_bytes;
+  unsigned long net_drops;
+  unsigned long debug_lines;
+  unsigned long reopens;
+};
+
+struct control_client {
+  struct endpoint ep;
+  char buf[512];
+  int len;
+};
+
+static struct link *links[MAX_LINKS];
+static struct control_client clients[MAX_CONTROL_CLIENTS];
+static struct endpoint control;
+static const char *control_path;
+static int epfd;
+static int verbose = 1;
+static int timestamp;
+static int devmtu = MIN_DEVMTU;
+static volatile sig_atomic_t got_sigusr1;
+static volatile sig_atomic_t got_exit;
+
+static void remove_link(struct link *l);
+/*---------------------------------------------------------------------------*/
+static int
+ssystem(const char *fmt, ...)
+{
+  char cmd[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(cmd, sizeof(cmd), fmt, ap);
+  va_end(ap);
+  if(verbose > 1) {
+    printf("%s\n", cmd);
+    fflush(stdout);
+  }
+  return system(cmd);
+}
+/*---------------------------------------------------------------------------*/
+static void
+stamptime(void)
+{
+  struct timeval tv;
+  struct tm *tmp;
+  char timec[20];
+
+  gettimeofday(&tv, NULL);
+  tmp = localtime(&tv.tv_sec);
+  strftime(timec, sizeof(timec), "%T", tmp);
+  fprintf(stderr, "%s.%03ld ", timec, (long)tv.tv_usec / 1000);
+}
+/*---------------------------------------------------------------------------*/
+static void
+log_link(struct link *l, const char *fmt, ...)
+{
+  va_list ap;
+
+  if(timestamp) stamptime();
+  if(l != NULL) {
+    fprintf(stderr, "[%s] ", l->name);
+  }
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  fputc('\n', stderr);
+}
+/*---------------------------------------------------------------------------*/
+/* Keeps the epoll registration of an endpoint in line with ep->events */
+static void
+ep_update(struct endpoint *ep, uint32_t events)
+{
+  struct epoll_event ev;
+
+  if(ep->fd < 0 || ep->events == events) {
+    return;
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.ptr = ep;
+  if(epoll_ctl(epfd, EPOLL_CTL_MOD, ep->fd, &ev) == -1) {
+    err(1, "epoll_ctl MOD");
+  }
+  ep->events = events;
+}
+/*---------------------------------------------------------------------------*/
+static void
+ep_add(struct endpoint *ep, int type, int fd, struct link *l)
+{
+  struct epoll_event ev;
+
+  ep->type = type;
+  ep->fd = fd;
+  ep->link = l;
+  ep->events = EPOLLIN;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = ep;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    err(1, "epoll_ctl ADD");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+ep_close(struct endpoint *ep)
+{
+  if(ep->fd >= 0) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, ep->fd, NULL);
+    close(ep->fd);
+    ep->fd = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Recomputes which events each endpoint of a link is interested in:
+   output when there is something queued, and network input only as long
+   as the serial queue accepts more frames. */
+static void
+update_link(struct link *l)
+{
+  uint32_t ev;
+
+  if(l->serial.fd >= 0) {
+    ev = EPOLLIN;
+    if(!slip_queue_empty(&l->serial_q)) {
+      ev |= EPOLLOUT;
+    }
+    ep_update(&l->serial, ev);
+  }
+  if(l->net.fd >= 0) {
+    ev = 0;
+    if(slip_queue_accepting(&l->serial_q)) {
+      ev |= EPOLLIN;
+    }
+    if(l->net_type != NET_TUN && !slip_queue_empty(&l->net_q)) {
+      ev |= EPOLLOUT;
+    }
+    ep_update(&l->net, ev);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const char *
+serial_name(struct link *l)
+{
+  static char name[128];
+  if(l->sio_host[0] != '\0') {
+    snprintf(name, sizeof(name), "%s:%s", l->sio_host, l->sio_port);
+  } else {
+    snprintf(name, sizeof(name), "/dev/%s", l->siodev);
+  }
+  return name;
+}
+/*---------------------------------------------------------------------------*/
+static const char *
+net_name(struct link *l)
+{
+  static char name[128];
+  switch(l->net_type) {
+  case NET_TUN:
+    snprintf(name, sizeof(name), "%s %s", l->tap ? "tap" : "tun", l->tundev);
+    break;
+  case NET_TCP_CONNECT:
+    snprintf(name, sizeof(name), "tcp %s:%s", l->net_host, l->net_port);
+    break;
+  case NET_TCP_LISTEN:
+    snprintf(name, sizeof(name), "tcp listen %s", l->net_port);
+    break;
+  }
+  return name;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tcp_connect(const char *host, const char *port)
+{
+  struct addrinfo hints, *servinfo, *p;
+  int fd = -1;
+  int rv;
+
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if((rv = getaddrinfo(host, port, &hints, &servinfo)) != 0) {
+    warnx("getaddrinfo: %s", gai_strerror(rv));
+    return -1;
+  }
+  for(p = servinfo; p != NULL; p = p->ai_next) {
+    if((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+      continue;
+    }
+    if(connect(fd, p->ai_addr, p->ai_addrlen) == -1) {
+      close(fd);
+      fd = -1;
+      continue;
+    }
+    break;
+  }
+  freeaddrinfo(servinfo);
+  if(fd >= 0) {
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+  }
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tcp_listen(const char *port)
+{
+  struct sockaddr_in6 addr;
+  int fd, on = 1;
+
+  fd = socket(AF_INET6, SOCK_STREAM, 0);
+  if(fd == -1) {
+    warn("socket");
+    return -1;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_any;
+  addr.sin6_port = htons(atoi(port));
+  if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+     listen(fd, 1) == -1) {
+    warn("can't listen on port %s", port);
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_serial(struct link *l)
+{
+  int fd;
+
+  if(l->sio_host[0] != '\0') {
+    fd = tcp_connect(l->sio_host, l->sio_port);
+    if(fd == -1) {
+      log_link(l, "can't connect to ``%s:%s''", l->sio_host, l->sio_port);
+      return -1;
+    }
+  } else {
+    fd = devopen(l->siodev, O_RDWR | O_NONBLOCK);
+    if(fd == -1) {
+      log_link(l, "can't open siodev ``/dev/%s'': %s", l->siodev,
+               strerror(errno));
+      return -1;
+    }
+    if(stty_telos(fd, l->speed, l->stty_flags) == -1) {
+      close(fd);
+      return -1;
+    }
+  }
+  ep_add(&l->serial, EP_SERIAL, fd, l);
+
+  /* Start with a clean slate on the serial line */
+  slip_queue_reset(&l->serial_q);
+  slip_queue_put_raw(&l->serial_q, "\300", 1);
+  l->serial_dec.len = 0;
+  l->serial_dec.esc = 0;
+  l->serial_dec.overflow = 0;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_net(struct link *l)
+{
+  int fd;
+
+  switch(l->net_type) {
+  case NET_TUN:
+    fd = tun_alloc(l->tundev, l->tap);
+    if(fd < 0) {
+      log_link(l, "can't open tun device ``%s''", l->tundev);
+      return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    ep_add(&l->net, EP_NET, fd, l);
+    ssystem("ifconfig %s mtu %d up", l->tundev, devmtu);
+    if(l->ipaddr[0] != '\0') {
+      ssystem("ifconfig %s add %s", l->tundev, l->ipaddr);
+    }
+    break;
+  case NET_TCP_CONNECT:
+    fd = tcp_connect(l->net_host, l->net_port);
+    if(fd == -1) {
+      log_link(l, "can't connect to ``%s:%s''", l->net_host, l->net_port);
+      return -1;
+    }
+    ep_add(&l->net, EP_NET, fd, l);
+    break;
+  case NET_TCP_LISTEN:
+    fd = tcp_listen(l->net_port);
+    if(fd == -1) {
+      return -1;
+    }
+    ep_add(&l->listen, EP_LISTEN, fd, l);
+    break;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+close_serial(struct link *l, const char *why)
+{
+  log_link(l, "serial line closed: %s", why);
+  ep_close(&l->serial);
+  slip_queue_reset(&l->serial_q);
+  l->retry = time(NULL) + RETRY_INTERVAL;
+  update_link(l);
+}
+/*---------------------------------------------------------------------------*/
+static void
+close_net(struct link *l, const char *why)
+{
+  log_link(l, "network side closed: %s", why);
+  ep_close(&l->net);
+  slip_queue_reset(&l->net_q);
+  l->net_dec.len = 0;
+  l->net_dec.esc = 0;
+  l->net_dec.overflow = 0;
+  if(l->net_type == NET_TCP_CONNECT) {
+    l->retry = time(NULL) + RETRY_INTERVAL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A frame from the radio: forward it to the network side */
+static void
+serial_frame(struct slip_decoder *d, unsigned char *frame, int len)
+{
+  struct link *l = d->ptr;
+
+  if(frame[0] == DEBUG_LINE_MARKER) {
+    l->debug_lines++;
+    if(verbose > 0) {
+      if(timestamp) stamptime();
+      fprintf(stderr, "[%s] %.*s", l->name, len - 1, frame + 1);
+    }
+    return;
+  }
+  if(frame[0] == '?' && len > 1 && frame[1] == 'P' && l->ipaddr[0] != '\0') {
+    /* Prefix info requested */
+    struct in6_addr addr;
+    unsigned char reply[2 + 8];
+    char ip[64], *s;
+
+    strcpy(ip, l->ipaddr);
+    if((s = strchr(ip, '/')) != NULL) {
+      *s = '\0';
+    }
+    if(inet_pton(AF_INET6, ip, &addr) == 1) {
+      reply[0] = '!';
+      reply[1] = 'P';
+      memcpy(&reply[2], addr.s6_addr, 8);
+      slip_queue_put(&l->serial_q, reply, sizeof(reply),
+                     (l->stty_flags & STTY_XONXOFF) ? SLIP_QUEUE_XONXOFF : 0);
+    }
+    return;
+  }
+  if(frame[0] == '!' || frame[0] == '?') {
+    if(verbose > 2) {
+      log_link(l, "command %.*s", len, frame);
+    }
+    return;
+  }
+
+  if(l->net.fd < 0) {
+    l->net_drops++;
+    return;
+  }
+  if(l->net_type == NET_TUN) {
+    if(write(l->net.fd, frame, len) != len) {
+      l->net_drops++;
+      return;
+    }
+  } else if(slip_queue_count(&l->net_q) == l->net_q.depth &&
+            slip_queue_flush(&l->net_q, l->net.fd, 0) == -1) {
+    close_net(l, strerror(errno));
+    return;
+  } else if(slip_queue_put(&l->net_q, frame, len, 0) == -1) {
+    l->net_drops++;
+    return;
+  }
+  l->to_net_frames++;
+  l->to_net_bytes += len;
+  if(verbose > 3) {
+    log_link(l, "%d bytes from serial", len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+to_serial(struct link *l, unsigned char *frame, int len)
+{
+  if(slip_queue_count(&l->serial_q) == l->serial_q.depth &&
+     l->serial.fd >= 0) {
+    /* Make room before the queue has to drop anything */
+    slip_queue_flush(&l->serial_q, l->serial.fd, 0);
+  }
+  if(slip_queue_put(&l->serial_q, frame, len,
+                    (l->stty_flags & STTY_XONXOFF) ? SLIP_QUEUE_XONXOFF : 0) == 0) {
+    l->to_serial_frames++;
+    l->to_serial_bytes += len;
+    if(verbose > 3) {
+      log_link(l, "%d bytes to serial", len);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A SLIP frame from a TCP network endpoint */
+static void
+net_frame(struct slip_decoder *d, unsigned char *frame, int len)
+{
+  to_serial(d->ptr, frame, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+serial_event(struct link *l, uint32_t events)
+{
+  ssize_t n;
+
+  if(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+    unsigned long dropped = l->serial_dec.dropped;
+    n = slip_decoder_read(&l->serial_dec, l->serial.fd);
+    if(n == 0 || (n == -1 && errno != EAGAIN)) {
+      close_serial(l, n == 0 ? "end of file" : strerror(errno));
+      return;
+    }
+    if(l->serial_dec.dropped != dropped && verbose > 0) {
+      log_link(l, "dropping large packet from serial");
+    }
+  }
+  if(events & EPOLLOUT) {
+    if(slip_queue_flush(&l->serial_q, l->serial.fd, 0) == -1) {
+      close_serial(l, strerror(errno));
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+net_event(struct link *l, uint32_t events)
+{
+  unsigned char buf[BUFSIZE];
+  ssize_t n;
+
+  if(l->net_type == NET_TUN) {
+    if(events & EPOLLIN) {
+      /* Drain the tunnel while the serial queue accepts packets */
+      while(slip_queue_accepting(&l->serial_q)) {
+        n = read(l->net.fd, buf, sizeof(buf));
+        if(n <= 0) {
+          if(n == -1 && errno != EAGAIN && errno != EINTR) {
+            close_net(l, strerror(errno));
+            return;
+          }
+          break;
+        }
+        to_serial(l, buf, n);
+      }
+    }
+  } else {
+    if(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      n = slip_decoder_read(&l->net_dec, l->net.fd);
+      if(n == 0 || (n == -1 && errno != EAGAIN)) {
+        close_net(l, n == 0 ? "connection closed" : strerror(errno));
+        return;
+      }
+    }
+    if((events & EPOLLOUT) &&
+       slip_queue_flush(&l->net_q, l->net.fd, 0) == -1) {
+      close_net(l, strerror(errno));
+      return;
+    }
+  }
+
+  /* Push out what was just queued without another trip through epoll */
+  if(l->serial.fd >= 0 && !slip_queue_empty(&l->serial_q) &&
+     slip_queue_flush(&l->serial_q, l->serial.fd, 0) == -1) {
+    close_serial(l, strerror(errno));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+listen_event(struct link *l)
+{
+  int fd = accept(l->listen.fd, NULL, NULL);
+
+  if(fd == -1) {
+    return;
+  }
+  if(l->net.fd >= 0) {
+    /* One peer per link */
+    log_link(l, "refusing second connection");
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  ep_add(&l->net, EP_NET, fd, l);
+  log_link(l, "accepted connection");
+}
+/*---------------------------------------------------------------------------*/
+static struct link *
+find_link(const char *name)
+{
+  int i;
+  for(i = 0; i < MAX_LINKS; i++) {
+    if(links[i] != NULL && strcmp(links[i]->name, name) == 0) {
+      return links[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+split_host_port(const char *s, char *host, int hostlen, char *port, int portlen)
+{
+  const char *sep = strrchr(s, ':');
+  if(sep == NULL || sep - s >= hostlen || strlen(sep + 1) >= (size_t)portlen) {
+    return -1;
+  }
+  memcpy(host, s, sep - s);
+  host[sep - s] = '\0';
+  strcpy(port, sep + 1);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+#define COPY(dst, src) do {                                     \
+    if(strlen(src) >= sizeof(dst)) {                            \
+      snprintf(error, errlen, "value too long: %s", src);       \
+      goto fail;                                                \
+    }                                                           \
+    strcpy(dst, src);                                           \
+  } while(0)
+/*
+ * Parses a link specification: a comma separated list of key=value.
+ *
+ *   name=NAME           Name of the link (default: the serial device)
+ *   serial=DEV          Serial device, relative to /dev
+ *   serial=HOST:PORT    Serial line exported over TCP
+ *   baud=RATE           Baudrate (default 115200)
+ *   flow=hw|xonxoff     Flow control
+ *   tun=DEV, tap=DEV    Network side is a tun or tap interface
+ *   addr=PREFIX/LEN     Address for the interface, answers ?P requests
+ *   tcp=HOST:PORT       Network side is a TCP connection carrying SLIP
+ *   listen=PORT         As tcp=, but wait for the peer to connect
+ *   queue=D[,LOW,HIGH]  Serial output queue depth and watermarks
+ *   drop=oldest         Drop instead of pausing the network side
+ */
+static struct link *
+parse_link(char *spec, char *error, int errlen)
+{
+  struct link *l;
+  char *tok, *save = NULL;
+  int depth = SLIP_QUEUE_DEFAULT_DEPTH, low = -1, high = -1;
+  int policy = SLIP_QUEUE_BACKPRESSURE;
+  int have_net = 0;
+
+  l = calloc(1, sizeof(*l));
+  if(l == NULL) {
+    snprintf(error, errlen, "out of memory");
+    return NULL;
+  }
+  l->speed = BAUDRATE;
+  l->net_type = NET_TUN;
+  l->serial.fd = l->net.fd = l->listen.fd = -1;
+
+  for(tok = strtok_r(spec, ", \t\r\n", &save); tok != NULL;
+      tok = strtok_r(NULL, ", \t\r\n", &save)) {
+    char *val = strchr(tok, '=');
+    if(val == NULL) {
+      snprintf(error, errlen, "expected key=value: %s", tok);
+      goto fail;
+    }
+    *val++ = '\0';
+    if(strcmp(tok, "name") == 0) {
+      COPY(l->name, val);
+    } else if(strcmp(tok, "serial") == 0) {
+      if(strchr(val, ':') != NULL) {
+        if(split_host_port(val, l->sio_host, sizeof(l->sio_host),
+                           l->sio_port, sizeof(l->sio_port)) == -1) {
+          snprintf(error, errlen, "bad serial address: %s", val);
+          goto fail;
+        }
+      } else {
+        COPY(l->siodev, strncmp(val, "/dev/", 5) == 0 ? val + 5 : val);
+      }
+    } else if(strcmp(tok, "baud") == 0) {
+      l->speed = select_baudrate(atoi(val));
+      if(l->speed == 0) {
+        snprintf(error, errlen, "unknown baudrate %s", val);
+        goto fail;
+      }
+    } else if(strcmp(tok, "flow") == 0) {
+      if(strcmp(val, "hw") == 0) {
+        l->stty_flags |= STTY_CRTSCTS;
+      } else if(strcmp(val, "xonxoff") == 0) {
+        l->stty_flags |= STTY_XONXOFF;
+      }
+    } else if(strcmp(tok, "tun") == 0 || strcmp(tok, "tap") == 0) {
+      l->net_type = NET_TUN;
+      l->tap = tok[1] == 'a';
+      COPY(l->tundev, val);
+      have_net = 1;
+    } else if(strcmp(tok, "addr") == 0) {
+      COPY(l->ipaddr, val);
+    } else if(strcmp(tok, "tcp") == 0) {
+      l->net_type = NET_TCP_CONNECT;
+      if(split_host_port(val, l->net_host, sizeof(l->net_host),
+                         l->net_port, sizeof(l->net_port)) == -1) {
+        snprintf(error, errlen, "bad address: %s", val);
+        goto fail;
+      }
+      have_net = 1;
+    } else if(strcmp(tok, "listen") == 0) {
+      l->net_type = NET_TCP_LISTEN;
+      COPY(l->net_port, val);
+      have_net = 1;
+    } else if(strcmp(tok, "queue") == 0) {
+      sscanf(val, "%d,%d,%d", &depth, &low, &high);
+    } else if(strcmp(tok, "drop") == 0) {
+      policy = strcmp(val, "oldest") == 0 ?
+        SLIP_QUEUE_DROP_OLDEST : SLIP_QUEUE_BACKPRESSURE;
+    } else {
+      snprintf(error, errlen, "unknown key: %s", tok);
+      goto fail;
+    }
+  }
+
+  if(l->siodev[0] == '\0' && l->sio_host[0] == '\0') {
+    snprintf(error, errlen, "no serial= given");
+    goto fail;
+  }
+  if(!have_net) {
+    snprintf(error, errlen, "no tun=, tap=, tcp= or listen= given");
+    goto fail;
+  }
+  if(l->name[0] == '\0') {
+    snprintf(l->name, sizeof(l->name), "%.31s",
+             l->siodev[0] != '\0' ? l->siodev : l->sio_port);
+  }
+
+  slip_decoder_init(&l->serial_dec, l->serial_buf, sizeof(l->serial_buf),
+                    serial_frame, l);
+  if(l->stty_flags & STTY_XONXOFF) {
+    l->serial_dec.flags |= SLIP_DECODE_XONXOFF;
+  }
+  slip_decoder_init(&l->net_dec, l->net_buf, sizeof(l->net_buf),
+                    net_frame, l);
+  slip_queue_init(&l->serial_q, depth, BUFSIZE, low, high, policy);
+  slip_queue_init(&l->net_q, depth, BUFSIZE, -1, -1, SLIP_QUEUE_DROP_OLDEST);
+  return l;
+
+fail:
+  free(l);
+  return NULL;
+}
+#undef COPY
+/*---------------------------------------------------------------------------*/
+static int
+add_link(char *spec, char *error, int errlen)
+{
+  struct link *l;
+  int i, slot = -1;
+
+  for(i = 0; i < MAX_LINKS; i++) {
+    if(links[i] == NULL) {
+      slot = i;
+      break;
+    }
+  }
+  if(slot == -1) {
+    snprintf(error, errlen, "too many links");
+    return -1;
+  }
+
+  l = parse_link(spec, error, errlen);
+  if(l == NULL) {
+    return -1;
+  }
+  if(find_link(l->name) != NULL) {
+    snprintf(error, errlen, "link %s exists", l->name);
+    free(l->serial_q.frames);
+    free(l->serial_q.mem);
+    free(l->net_q.frames);
+    free(l->net_q.mem);
+    free(l);
+    return -1;
+  }
+
+  links[slot] = l;
+  l->started = time(NULL);
+  if(open_net(l) == -1 && l->net_type != NET_TCP_CONNECT) {
+    snprintf(error, errlen, "can't open network side");
+    remove_link(l);
+    return -1;
+  }
+  if(open_serial(l) == -1) {
+    /* Radios come and go; keep trying */
+    l->retry = time(NULL) + RETRY_INTERVAL;
+  }
+  update_link(l);
+  log_link(l, "added: serial %s", serial_name(l));
+  log_link(l, "added: %s", net_name(l));
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_link(struct link *l)
+{
+  int i;
+
+  for(i = 0; i < MAX_LINKS; i++) {
+    if(links[i] == l) {
+      links[i] = NULL;
+    }
+  }
+  ep_close(&l->serial);
+  ep_close(&l->net);
+  ep_close(&l->listen);
+  if(l->net_type == NET_TUN && l->tundev[0] != '\0') {
+    ssystem("ifconfig %s down", l->tundev);
+  }
+  log_link(l, "removed");
+  free(l->serial_q.frames);
+  free(l->serial_q.mem);
+  free(l->net_q.frames);
+  free(l->net_q.mem);
+  free(l);
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_link(struct link *l, FILE *f)
+{
+  fprintf(f, "%s: up %lds\n", l->name, (long)(time(NULL) - l->started));
+  fprintf(f, "  serial %s (%s)\n", serial_name(l),
+          l->serial.fd >= 0 ? "open" : "closed");
+  fprintf(f, "  %s (%s)\n", net_name(l), l->net.fd >= 0 ? "open" : "closed");
+  fprintf(f, "  serial->net %lu frames %lu bytes, net->serial %lu frames "
+          "%lu bytes\n", l->to_net_frames, l->to_net_bytes,
+          l->to_serial_frames, l->to_serial_bytes);
+  fprintf(f, "  serial in %lu bytes %lu reads, oversized %lu, "
+          "debug lines %lu, net drops %lu, reopens %lu\n",
+          l->serial_dec.bytes, l->serial_dec.reads, l->serial_dec.dropped,
+          l->debug_lines, l->net_drops, l->reopens);
+  fprintf(f, "  ");
+  slip_queue_print_stats(&l->serial_q, "serial queue", f);
+  if(l->net_type != NET_TUN) {
+    fprintf(f, "  ");
+    slip_queue_print_stats(&l->net_q, "net queue", f);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_stats(FILE *f)
+{
+  int i;
+  for(i = 0; i < MAX_LINKS; i++) {
+    if(links[i] != NULL) {
+      print_link(links[i], f);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+control_command(struct control_client *c, char *line)
+{
+  char error[128];
+  char *arg;
+  FILE *out;
+  struct link *l;
+
+  out = fdopen(dup(c->ep.fd), "w");
+  if(out == NULL) {
+    return;
+  }
+  arg = strchr(line, ' ');
+  if(arg != NULL) {
+    *arg++ = '\0';
+  }
+
+  if(strcmp(line, "add") == 0 && arg != NULL) {
+    if(add_link(arg, error, sizeof(error)) == 0) {
+      fprintf(out, "ok\n");
+    } else {
+      fprintf(out, "error: %s\n", error);
+    }
+  } else if(strcmp(line, "remove") == 0 && arg != NULL) {
+    l = find_link(arg);
+    if(l != NULL) {
+      remove_link(l);
+      fprintf(out, "ok\n");
+    } else {
+      fprintf(out, "error: no link %s\n", arg);
+    }
+  } else if(strcmp(line, "stats") == 0 || strcmp(line, "list") == 0) {
+    if(arg != NULL && (l = find_link(arg)) != NULL) {
+      print_link(l, out);
+    } else {
+      print_stats(out);
+    }
+    fprintf(out, "ok\n");
+  } else if(line[0] != '\0') {
+    fprintf(out, "error: commands are add SPEC, remove NAME, stats [NAME]\n");
+  }
+  fclose(out);
+}
+/*---------------------------------------------------------------------------*/
+static void
+control_client_event(struct control_client *c)
+{
+  char *nl;
+  ssize_t n;
+
+  n = read(c->ep.fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len);
+  if(n <= 0) {
+    if(n == -1 && errno == EAGAIN) {
+      return;
+    }
+    ep_close(&c->ep);
+    return;
+  }
+  c->len += n;
+  c->buf[c->len] = '\0';
+  while((nl = strchr(c->buf, '\n')) != NULL) {
+    *nl = '\0';
+    if(nl > c->buf && nl[-1] == '\r') {
+      nl[-1] = '\0';
+    }
+    control_command(c, c->buf);
+    c->len -= nl + 1 - c->buf;
+    memmove(c->buf, nl + 1, c->len + 1);
+  }
+  if(c->len == sizeof(c->buf) - 1) {
+    /* Line too long */
+    ep_close(&c->ep);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+control_event(void)
+{
+  int fd, i;
+
+  fd = accept(control.fd, NULL, NULL);
+  if(fd == -1) {
+    return;
+  }
+  for(i = 0; i < MAX_CONTROL_CLIENTS; i++) {
+    if(clients[i].ep.fd < 0) {
+      clients[i].len = 0;
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      ep_add(&clients[i].ep, EP_CONTROL_CLIENT, fd, NULL);
+      return;
+    }
+  }
+  close(fd);
+}
+/*---------------------------------------------------------------------------*/
+static void
+open_control(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd == -1) {
+    err(1, "socket");
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+  if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+     listen(fd, 4) == -1) {
+    err(1, "can't bind control socket ``%s''", path);
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  ep_add(&control, EP_CONTROL, fd, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Once a second: reopen serial lines and reconnect TCP endpoints that
+   went away. */
+static void
+periodic(void)
+{
+  time_t now = time(NULL);
+  int i;
+
+  for(i = 0; i < MAX_LINKS; i++) {
+    struct link *l = links[i];
+    if(l == NULL || l->retry == 0 || now < l->retry) {
+      continue;
+    }
+    l->retry = 0;
+    if(l->serial.fd < 0) {
+      if(open_serial(l) == 0) {
+        l->reopens++;
+        log_link(l, "serial line reopened");
+      } else {
+        l->retry = now + RETRY_INTERVAL;
+      }
+    }
+    if(l->net_type == NET_TCP_CONNECT && l->net.fd < 0) {
+      if(open_net(l) == 0) {
+        log_link(l, "reconnected");
+      } else {
+        l->retry = now + RETRY_INTERVAL;
+      }
+    }
+    update_link(l);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+sigexit(int signo)
+{
+  got_exit = signo;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sigusr1(int signo)
+{
+  (void)signo;
+  got_sigusr1 = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [options] -l linkspec [-l linkspec ...]\n", prog);
+  fprintf(stderr, "example: %s -c /tmp/slip-gateway.sock \\\n"
+          "           -l name=r0,serial=ttyUSB0,baud=921600,tun=tun0,addr=fd00::1/64 \\\n"
+          "           -l name=r1,serial=ttyUSB1,baud=921600,tun=tun1,addr=fd01::1/64\n",
+          prog);
+  fprintf(stderr, "Options are:\n");
+  fprintf(stderr, " -l linkspec    Add a link, a comma separated list of:\n");
+  fprintf(stderr, "                name=NAME, serial=DEV or serial=HOST:PORT,\n");
+  fprintf(stderr, "                baud=RATE, flow=hw|xonxoff, tun=DEV or tap=DEV,\n");
+  fprintf(stderr, "                addr=PREFIX/LEN, tcp=HOST:PORT or listen=PORT,\n");
+  fprintf(stderr, "                queue=DEPTH[,LOW,HIGH], drop=oldest\n");
+  fprintf(stderr, " -c path        Control socket: add SPEC, remove NAME, stats [NAME]\n");
+  fprintf(stderr, " -M mtu         Interface MTU (default and min: %d)\n", MIN_DEVMTU);
+  fprintf(stderr, " -L             Log output format (adds time stamps)\n");
+  fprintf(stderr, " -v[level]      Verbosity level (default 1)\n");
+  fprintf(stderr, "Send SIGUSR1 to print the statistics of all links.\n");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  struct epoll_event events[MAX_EVENTS];
+  char error[128];
+  int c, i, n, nlinks = 0;
+  time_t last = 0;
+
+  setvbuf(stdout, NULL, _IOLBF, 0); /* Line buffered output. */
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(epfd == -1) {
+    err(1, "epoll_create1");
+  }
+  control.fd = -1;
+  for(i = 0; i < MAX_CONTROL_CLIENTS; i++) {
+    clients[i].ep.fd = -1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGHUP, sigexit);
+  signal(SIGTERM, sigexit);
+  signal(SIGINT, sigexit);
+  signal(SIGUSR1, sigusr1);
+
+  while((c = getopt(argc, argv, "l:c:M:Lv::h")) != -1) {
+    switch(c) {
+    case 'l':
+      if(add_link(optarg, error, sizeof(error)) == -1) {
+        errx(1, "%s", error);
+      }
+      nlinks++;
+      break;
+    case 'c':
+      control_path = optarg;
+      break;
+    case 'M':
+      devmtu = atoi(optarg);
+      if(devmtu < MIN_DEVMTU) {
+        devmtu = MIN_DEVMTU;
+      }
+      break;
+    case 'L':
+      timestamp = 1;
+      break;
+    case 'v':
+      verbose = 2;
+      if(optarg) verbose = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if(nlinks == 0 && control_path == NULL) {
+    usage(argv[0]);
+  }
+  if(control_path != NULL) {
+    open_control(control_path);
+  }
+
+  while(!got_exit) {
+    n = epoll_wait(epfd, events, MAX_EVENTS, 1000);
+    if(n == -1 && errno != EINTR) {
+      err(1, "epoll_wait");
+    }
+    for(i = 0; i < n; i++) {
+      struct endpoint *ep = events[i].data.ptr;
+      switch(ep->type) {
+      case EP_SERIAL:
+        if(ep->fd >= 0) {
+          serial_event(ep->link, events[i].events);
+        }
+        break;
+      case EP_NET:
+        if(ep->fd >= 0) {
+          net_event(ep->link, events[i].events);
+        }
+        break;
+      case EP_LISTEN:
+        listen_event(ep->link);
+        break;
+      case EP_CONTROL:
+        control_event();
+        break;
+      case EP_CONTROL_CLIENT:
+        if(ep->fd >= 0) {
+          control_client_event((struct control_client *)ep);
+        }
+        break;
+      }
+      /* A control command may have removed links; later events in this
+         batch can point to freed links, so start over with a new batch. */
+      if(ep->type == EP_CONTROL_CLIENT) {
+        break;
+      }
+      if(ep->link != NULL) {
+        update_link(ep->link);
+      }
+    }
+
+    if(got_sigusr1) {
+      got_sigusr1 = 0;
+      print_stats(stderr);
+    }
+    if(time(NULL) != last) {
+      last = time(NULL);
+      periodic();
+    }
+  }
+
+  for(i = 0; i < MAX_LINKS; i++) {
+    if(links[i] != NULL) {
+      if(verbose > 0) {
+        print_link(links[i], stderr);
+      }
+      remove_link(links[i]);
+    }
+  }
+  if(control_path != NULL) {
+    unlink(control_path);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
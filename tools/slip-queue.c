@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Bounded queue of pre-escaped SLIP frames for the host-side
+ *         SLIP tools.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "slip-queue.h"
+#include "slip-decode.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#define SLOT(q, i) (&(q)->frames[((q)->head + (i)) % (q)->depth])
+/*---------------------------------------------------------------------------*/
+void
+slip_queue_init(struct slip_queue *q, int depth, int mtu,
+                int low, int high, int policy)
+{
+  int i;
+
+  memset(q, 0, sizeof(*q));
+  if(depth < 1) {
+    depth = SLIP_QUEUE_DEFAULT_DEPTH;
+  }
+  if(high <= 0 || high > depth) {
+    high = (3 * depth + 3) / 4;
+  }
+  if(low < 0 || low >= high) {
+    low = depth / 4 < high ? depth / 4 : high - 1;
+  }
+  q->depth = depth;
+  q->mtu = mtu;
+  q->low = low;
+  q->high = high;
+  q->policy = policy;
+
+  /* Worst case every byte is escaped, plus the SLIP_END */
+  q->frames = calloc(depth, sizeof(struct slip_queue_frame));
+  q->mem = malloc((size_t)depth * (2 * mtu + 1));
+  if(q->frames == NULL || q->mem == NULL) {
+    err(1, "slip_queue_init: malloc");
+  }
+  for(i = 0; i < depth; i++) {
+    q->frames[i].data = q->mem + (size_t)i * (2 * mtu + 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_watermarks(struct slip_queue *q)
+{
+  if(q->count > q->max_count) {
+    q->max_count = q->count;
+  }
+  if(q->count >= q->high) {
+    q->blocked = 1;
+  } else if(q->count <= q->low) {
+    q->blocked = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns a free slot at the tail of the queue, or NULL if the frame
+   has to be dropped. */
+static struct slip_queue_frame *
+tail_slot(struct slip_queue *q)
+{
+  int i;
+
+  if(q->count < q->depth) {
+    return SLOT(q, q->count);
+  }
+  if(q->policy != SLIP_QUEUE_DROP_OLDEST ||
+     (q->offset > 0 && q->count == 1)) {
+    q->dropped++;
+    return NULL;
+  }
+
+  /* Drop the oldest frame that has not been started: a partially
+     written head frame has to be completed or the peer loses sync. */
+  if(q->offset == 0) {
+    q->head = (q->head + 1) % q->depth;
+  } else {
+    /* Rotate the dropped slot from behind the head to the tail */
+    for(i = 1; i < q->count - 1; i++) {
+      struct slip_queue_frame tmp = *SLOT(q, i);
+      *SLOT(q, i) = *SLOT(q, i + 1);
+      *SLOT(q, i + 1) = tmp;
+    }
+  }
+  q->count--;
+  q->dropped++;
+  return SLOT(q, q->count);
+}
+/*---------------------------------------------------------------------------*/
+int
+slip_queue_put(struct slip_queue *q, const void *data, int len, int flags)
+{
+  const unsigned char *p = data;
+  struct slip_queue_frame *f;
+  unsigned char *d;
+  int i;
+
+  if(len > q->mtu) {
+    q->dropped++;
+    return -1;
+  }
+  f = tail_slot(q);
+  if(f == NULL) {
+    return -1;
+  }
+
+  d = f->data;
+  for(i = 0; i < len; i++) {
+    switch(p[i]) {
+    case SLIP_END:
+      *d++ = SLIP_ESC;
+      *d++ = SLIP_ESC_END;
+      break;
+    case SLIP_ESC:
+      *d++ = SLIP_ESC;
+      *d++ = SLIP_ESC_ESC;
+      break;
+    case XON:
+      if(flags & SLIP_QUEUE_XONXOFF) {
+        *d++ = SLIP_ESC;
+        *d++ = SLIP_ESC_XON;
+      } else {
+        *d++ = p[i];
+      }
+      break;
+    case XOFF:
+      if(flags & SLIP_QUEUE_XONXOFF) {
+        *d++ = SLIP_ESC;
+        *d++ = SLIP_ESC_XOFF;
+      } else {
+        *d++ = p[i];
+      }
+      break;
+    default:
+      *d++ = p[i];
+      break;
+    }
+  }
+  *d++ = SLIP_END;
+  f->len = d - f->data;
+
+  q->count++;
+  q->queued++;
+  update_watermarks(q);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+slip_queue_put_raw(struct slip_queue *q, const void *data, int len)
+{
+  struct slip_queue_frame *f;
+
+  if(len > 2 * q->mtu + 1) {
+    q->dropped++;
+    return -1;
+  }
+  f = tail_slot(q);
+  if(f == NULL) {
+    return -1;
+  }
+  memcpy(f->data, data, len);
+  f->len = len;
+
+  q->count++;
+  q->queued++;
+  update_watermarks(q);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+ssize_t
+slip_queue_flush(struct slip_queue *q, int fd, int max)
+{
+  struct iovec iov[IOV_MAX < 64 ? IOV_MAX : 64];
+  int iovcnt, i;
+  ssize_t n, left;
+
+  if(q->count == 0) {
+    return 0;
+  }
+
+  iovcnt = q->count;
+  if(iovcnt > (int)(sizeof(iov) / sizeof(iov[0]))) {
+    iovcnt = sizeof(iov) / sizeof(iov[0]);
+  }
+  if(max > 0 && iovcnt > max) {
+    iovcnt = max;
+  }
+  for(i = 0; i < iovcnt; i++) {
+    struct slip_queue_frame *f = SLOT(q, i);
+    iov[i].iov_base = f->data;
+    iov[i].iov_len = f->len;
+  }
+  iov[0].iov_base = (unsigned char *)iov[0].iov_base + q->offset;
+  iov[0].iov_len -= q->offset;
+
+  n = writev(fd, iov, iovcnt);
+  if(n == -1) {
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+  }
+  q->writes++;
+  q->bytes += n;
+
+  /* Retire the frames that were written completely */
+  left = n;
+  for(i = 0; i < iovcnt && left >= (ssize_t)iov[i].iov_len; i++) {
+    left -= iov[i].iov_len;
+    q->head = (q->head + 1) % q->depth;
+    q->count--;
+    q->sent++;
+    q->offset = 0;
+  }
+  if(left > 0) {
+    q->offset += left;
+  }
+  update_watermarks(q);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_queue_reset(struct slip_queue *q)
+{
+  q->dropped += q->count;
+  q->head = 0;
+  q->count = 0;
+  q->offset = 0;
+  update_watermarks(q);
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_queue_rewind(struct slip_queue *q)
+{
+  q->offset = 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+slip_queue_accepting(struct slip_queue *q)
+{
+  if(q->policy == SLIP_QUEUE_DROP_OLDEST) {
+    return 1;
+  }
+  return !q->blocked && q->count < q->depth;
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_queue_print_stats(struct slip_queue *q, const char *name, FILE *stream)
+{
+  fprintf(stream, "%s: depth %d/%d (max %d, low %d, high %d) "
+          "queued %lu sent %lu dropped %lu writes %lu bytes %lu\n",
+          name, q->count, q->depth, q->max_count, q->low, q->high,
+          q->queued, q->sent, q->dropped, q->writes, q->bytes);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Bounded queue of pre-escaped SLIP frames for the host-side
+ *         SLIP tools.
+ *
+ *         Frames read from the tunnel are SLIP-escaped once when they
+ *         are queued and later written to the serial line several at a
+ *         time with writev(). The queue has a high and a low watermark:
+ *         with SLIP_QUEUE_BACKPRESSURE the caller stops reading from the
+ *         tunnel between reaching the high watermark and draining to the
+ *         low one, with SLIP_QUEUE_DROP_OLDEST the tunnel is always read
+ *         and the oldest frame that has not been started is dropped to
+ *         make room.
+ */
+
+#ifndef SLIP_QUEUE_H
+#define SLIP_QUEUE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifndef SLIP_QUEUE_DEFAULT_DEPTH
+#define SLIP_QUEUE_DEFAULT_DEPTH 32
+#endif
+
+/* Overload policies */
+#define SLIP_QUEUE_BACKPRESSURE 0
+#define SLIP_QUEUE_DROP_OLDEST  1
+
+/* Flags for slip_queue_put() */
+#define SLIP_QUEUE_XONXOFF      0x01
+
+struct slip_queue_frame {
+  unsigned char *data;
+  int len;
+};
+
+struct slip_queue {
+  struct slip_queue_frame *frames;
+  unsigned char *mem;
+  int depth;
+  int mtu;
+  int low;
+  int high;
+  int policy;
+
+  int head;
+  int count;
+  int offset;     /* Bytes of the head frame already written */
+  int blocked;    /* Above the high watermark, not yet back at the low one */
+
+  /* Statistics */
+  unsigned long queued;
+  unsigned long sent;
+  unsigned long dropped;
+  unsigned long writes;
+  unsigned long bytes;
+  int max_count;
+};
+
+/**
+ * \brief      Allocate and initialize a queue
+ * \param q    The queue
+ * \param depth Maximum number of frames queued
+ * \param mtu  Largest unescaped frame accepted
+ * \param low  Low watermark, in frames
+ * \param high High watermark, in frames
+ * \param policy SLIP_QUEUE_BACKPRESSURE or SLIP_QUEUE_DROP_OLDEST
+ *
+ *             Watermarks out of range are replaced by depth / 4 and
+ *             3 * depth / 4. The function calls err() if memory can
+ *             not be allocated, as the tools do for any setup error.
+ */
+void slip_queue_init(struct slip_queue *q, int depth, int mtu,
+                     int low, int high, int policy);
+
+/**
+ * \brief      SLIP-escape a frame and append it to the queue
+ * \param q    The queue
+ * \param data The unescaped frame
+ * \param len  Length of the frame
+ * \param flags SLIP_QUEUE_XONXOFF to escape XON/XOFF as well
+ * \return     0 if the frame was queued, -1 if it was dropped
+ */
+int slip_queue_put(struct slip_queue *q, const void *data, int len,
+                   int flags);
+
+/**
+ * \brief      Append bytes that are already SLIP encoded
+ * \param q    The queue
+ * \param data The encoded bytes, including any SLIP_END
+ * \param len  Number of bytes
+ * \return     0 if the bytes were queued, -1 if they were dropped
+ */
+int slip_queue_put_raw(struct slip_queue *q, const void *data, int len);
+
+/**
+ * \brief      Write queued frames with a single writev()
+ * \param q    The queue
+ * \param fd   The serial file descriptor
+ * \param max  Maximum number of frames to write, 0 for no limit
+ * \return     Number of bytes written, or -1 on an error other
+ *             than EAGAIN
+ */
+ssize_t slip_queue_flush(struct slip_queue *q, int fd, int max);
+
+/**
+ * \brief      Drop everything in the queue
+ *
+ *             Used when the serial line goes away: a frame that was
+ *             partially written can not be completed on a new one.
+ */
+void slip_queue_reset(struct slip_queue *q);
+
+/**
+ * \brief      Start the head frame over from its first byte
+ *
+ *             Used when a stream connection is replaced by a new one:
+ *             the peer discards what it got of a partial frame, so the
+ *             whole frame is sent again.
+ */
+void slip_queue_rewind(struct slip_queue *q);
+
+/**
+ * \brief      Whether more input should be accepted into the queue
+ *
+ *             Always true with SLIP_QUEUE_DROP_OLDEST. With
+ *             SLIP_QUEUE_BACKPRESSURE, false from the moment the
+ *             high watermark is reached until the queue has drained
+ *             to the low watermark.
+ */
+int slip_queue_accepting(struct slip_queue *q);
+
+#define slip_queue_empty(q) ((q)->count == 0)
+#define slip_queue_count(q) ((q)->count)
+
+/**
+ * \brief      Print the queue counters to a stdio stream
+ */
+void slip_queue_print_stats(struct slip_queue *q, const char *name,
+                            FILE *stream);
+
+#endif /* SLIP_QUEUE_H */
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Length-prefixed framing for packets carried over a TCP stream.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include "tcp-framing.h"
+
+#ifndef TCP_FRAME_READ_SIZE
+#define TCP_FRAME_READ_SIZE 4096
+#endif
+
+/*---------------------------------------------------------------------------*/
+static int
+header_len(uint8_t flags)
+{
+  return TCP_FRAME_HDR_MIN +
+    ((flags & TCP_FRAME_SEQ) ? 4 : 0) + ((flags & TCP_FRAME_TIME) ? 8 : 0);
+}
+/*---------------------------------------------------------------------------*/
+int
+tcp_frame_encode(unsigned char *dst, const void *packet, int len,
+                 int flags, uint32_t seq)
+{
+  unsigned char *p = dst;
+
+  *p++ = len >> 8;
+  *p++ = len & 0xff;
+  *p++ = flags & TCP_FRAME_FLAGS;
+  if(flags & TCP_FRAME_SEQ) {
+    *p++ = seq >> 24;
+    *p++ = seq >> 16;
+    *p++ = seq >> 8;
+    *p++ = seq;
+  }
+  if(flags & TCP_FRAME_TIME) {
+    struct timeval tv;
+    uint64_t usec;
+    int i;
+
+    gettimeofday(&tv, NULL);
+    usec = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    for(i = 7; i >= 0; i--) {
+      *p++ = usec >> (8 * i);
+    }
+  }
+  memcpy(p, packet, len);
+  return p + len - dst;
+}
+/*---------------------------------------------------------------------------*/
+void
+tcp_frame_decoder_init(struct tcp_frame_decoder *d, unsigned char *buf,
+                       int size, tcp_frame_callback_t packet, void *ptr)
+{
+  memset(d, 0, sizeof(*d));
+  d->buf = buf;
+  d->size = size;
+  d->packet = packet;
+  d->ptr = ptr;
+}
+/*---------------------------------------------------------------------------*/
+void
+tcp_frame_decoder_reset(struct tcp_frame_decoder *d)
+{
+  d->len = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Hands all complete frames in the buffer to the callback, returns -1 if
+   the buffer does not start with a valid frame header. */
+static int
+deliver(struct tcp_frame_decoder *d)
+{
+  unsigned char *p = d->buf;
+  int left = d->len;
+
+  while(left >= TCP_FRAME_HDR_MIN) {
+    int len = (p[0] << 8) | p[1];
+    uint8_t flags = p[2];
+    int hlen;
+    int i;
+
+    if(flags & ~TCP_FRAME_FLAGS) {
+      return -1;
+    }
+    hlen = header_len(flags);
+    if(hlen + len > d->size) {
+      return -1;
+    }
+    if(left < hlen + len) {
+      break;
+    }
+
+    d->flags = flags;
+    if(flags & TCP_FRAME_SEQ) {
+      d->seq = ((uint32_t)p[3] << 24) | ((uint32_t)p[4] << 16) |
+        ((uint32_t)p[5] << 8) | p[6];
+      if(d->have_seq) {
+        int32_t diff = (int32_t)(d->seq - d->next_seq);
+        if(diff < 0) {
+          /* Already seen before the connection was re-established */
+          d->duplicates++;
+          goto next;
+        }
+        d->lost += diff;
+      }
+      d->have_seq = 1;
+      d->next_seq = d->seq + 1;
+    }
+    if(flags & TCP_FRAME_TIME) {
+      unsigned char *t = p + hlen - 8;
+      d->usec = 0;
+      for(i = 0; i < 8; i++) {
+        d->usec = (d->usec << 8) | t[i];
+      }
+    }
+    d->frames++;
+    d->bytes += len;
+    if(len > 0) {
+      d->packet(d, p + hlen, len);
+    }
+  next:
+    p += hlen + len;
+    left -= hlen + len;
+  }
+
+  if(left > 0 && p != d->buf) {
+    memmove(d->buf, p, left);
+  }
+  d->len = left;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+ssize_t
+tcp_frame_decoder_read(struct tcp_frame_decoder *d, int fd)
+{
+  ssize_t total = 0;
+  ssize_t n;
+
+  for(;;) {
+    int room = d->size - d->len;
+    if(room > TCP_FRAME_READ_SIZE) {
+      room = TCP_FRAME_READ_SIZE;
+    }
+    n = read(fd, d->buf + d->len, room);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      if(errno == EAGAIN && total > 0) {
+        break;
+      }
+      return -1;
+    }
+    if(n == 0) {
+      return total;
+    }
+    d->len += n;
+    total += n;
+    if(deliver(d) == -1) {
+      return -2;
+    }
+    if(n < room) {
+      break;
+    }
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+void
+tcp_frame_cork(int fd, int cork)
+{
+  int on = 1;
+#ifdef TCP_CORK
+  setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+#endif
+  if(!cork) {
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+}
+/*---------------------------------------------------------------------------*/
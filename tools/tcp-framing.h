@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2017, CompuMetalGeek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Length-prefixed framing for packets carried over a TCP stream.
+ *
+ *         Every packet is preceded by a small header so the receiver
+ *         can find packet boundaries no matter how TCP splits or merges
+ *         the stream:
+ *
+ *           0      2      3
+ *           +------+------+-----------+---------------+--------------
+ *           | len  |flags | seq (opt) | usec (opt)    | len bytes ...
+ *           +------+------+-----------+---------------+--------------
+ *
+ *         len is the length of the packet in network byte order, seq a
+ *         32-bit sequence number present when flags has TCP_FRAME_SEQ,
+ *         and usec a 64-bit send time in microseconds since the epoch
+ *         present when flags has TCP_FRAME_TIME. Each frame describes
+ *         its own header, so the receiver needs no configuration.
+ */
+
+#ifndef TCP_FRAMING_H
+#define TCP_FRAMING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TCP_FRAME_SEQ        0x01
+#define TCP_FRAME_TIME       0x02
+#define TCP_FRAME_FLAGS      (TCP_FRAME_SEQ | TCP_FRAME_TIME)
+
+#define TCP_FRAME_HDR_MIN    3
+#define TCP_FRAME_HDR_MAX    (TCP_FRAME_HDR_MIN + 4 + 8)
+
+struct tcp_frame_decoder;
+
+typedef void (* tcp_frame_callback_t)(struct tcp_frame_decoder *d,
+                                      unsigned char *packet, int len);
+
+struct tcp_frame_decoder {
+  unsigned char *buf;
+  int size;
+  int len;
+  tcp_frame_callback_t packet;
+  void *ptr;
+
+  /* Header of the last packet handed to the callback */
+  uint8_t flags;
+  uint32_t seq;
+  uint64_t usec;
+
+  /* Statistics */
+  uint32_t next_seq;
+  unsigned char have_seq;
+  unsigned long frames;
+  unsigned long bytes;
+  unsigned long lost;
+  unsigned long duplicates;
+};
+
+/**
+ * \brief      Build a frame
+ * \param dst  Output, at least TCP_FRAME_HDR_MAX + len bytes
+ * \param packet The packet
+ * \param len  Length of the packet, at most 65535
+ * \param flags TCP_FRAME_SEQ and/or TCP_FRAME_TIME
+ * \param seq  Sequence number, used with TCP_FRAME_SEQ
+ * \return     Length of the frame
+ */
+int tcp_frame_encode(unsigned char *dst, const void *packet, int len,
+                     int flags, uint32_t seq);
+
+/**
+ * \brief      Initialize a decoder
+ * \param buf  Reassembly buffer, TCP_FRAME_HDR_MAX plus the largest
+ *             packet accepted
+ */
+void tcp_frame_decoder_init(struct tcp_frame_decoder *d,
+                            unsigned char *buf, int size,
+                            tcp_frame_callback_t packet, void *ptr);
+
+/**
+ * \brief      Forget a partially received frame, e.g. after a reconnect
+ *
+ *             Sequence number tracking is kept, so packets lost while
+ *             the connection was down are still counted.
+ */
+void tcp_frame_decoder_reset(struct tcp_frame_decoder *d);
+
+/**
+ * \brief      Read everything available on fd and decode it
+ * \return     Number of bytes read, 0 on end of file, -1 with errno
+ *             set on error, or -2 if the stream is not valid framing
+ */
+ssize_t tcp_frame_decoder_read(struct tcp_frame_decoder *d, int fd);
+
+/**
+ * \brief      Control coalescing of small frames on a TCP socket
+ * \param fd   The socket
+ * \param cork Non-zero to hold back partial segments (TCP_CORK), zero to
+ *             push out what is pending and send immediately from then on
+ *             (TCP_NODELAY)
+ */
+void tcp_frame_cork(int fd, int cork);
+
+#endif /* TCP_FRAMING_H */
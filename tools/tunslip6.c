@@ -57,6 +57,9 @@
 #include <err.h>
 
 #include "tools-utils.h"
+#include "slip-queue.h"
+#include "slip-dev.h"
+#include "pcapng-tap.h"
 
 #ifndef BAUDRATE
 #define BAUDRATE B115200
@@ -73,10 +76,17 @@ int timestamp = 0, flowcontrol=0, showprogress=0, flowcontrol_xonxoff=0;
 
 int ssystem(const char *fmt, ...)
      __attribute__((__format__ (__printf__, 1, 2)));
-void write_to_serial(int outfd, void *inbuf, int len);
+void write_to_serial(void *inbuf, int len);
 
-void slip_send(int fd, unsigned char c);
-void slip_send_char(int fd, unsigned char c);
+void slip_flushbuf(int fd);
+
+struct slip_queue slip_queue;
+int queue_depth = SLIP_QUEUE_DEFAULT_DEPTH;
+int queue_low = -1, queue_high = -1;
+int queue_policy = SLIP_QUEUE_BACKPRESSURE;
+
+struct pcapng_tap capture;
+struct pcapng_tap *capture_tap = NULL;
 
 #define PROGRESS(s) if(showprogress) fprintf(stderr, s)
 
@@ -231,7 +241,7 @@ serial_to_tun(FILE *inslip, int outfd)
 	if(uip.inbuf[1] == 'P') {
           /* Prefix info requested */
           struct in6_addr addr;
-	  int i;
+	  unsigned char reply[2 + 8];
 	  char *s = strchr(ipaddr, '/');
 	  if(s != NULL) {
 	    *s = '\0';
@@ -244,13 +254,12 @@ serial_to_tun(FILE *inslip, int outfd)
 		 addr.s6_addr[2], addr.s6_addr[3],
 		 addr.s6_addr[4], addr.s6_addr[5],
 		 addr.s6_addr[6], addr.s6_addr[7]);
-	  slip_send(slipfd, '!');
-	  slip_send(slipfd, 'P');
-	  for(i = 0; i < 8; i++) {
-	    /* need to call the slip_send_char for stuffing */
-	    slip_send_char(slipfd, addr.s6_addr[i]);
-	  }
-	  slip_send(slipfd, SLIP_END);
+	  reply[0] = '!';
+	  reply[1] = 'P';
+	  memcpy(&reply[2], addr.s6_addr, 8);
+	  /* the queue does the stuffing */
+	  slip_queue_put(&slip_queue, reply, sizeof(reply),
+	                 flowcontrol_xonxoff ? SLIP_QUEUE_XONXOFF : 0);
         }
 #define DEBUG_LINE_MARKER '\r'
       } else if(uip.inbuf[0] == DEBUG_LINE_MARKER) {
@@ -279,6 +288,7 @@ serial_to_tun(FILE *inslip, int outfd)
             printf("\n");
           }
         }
+	pcapng_tap_packet(capture_tap, PCAPNG_TAP_IN, uip.inbuf, inbufptr);
 	if(write(outfd, uip.inbuf, inbufptr) != inbufptr) {
 	  err(1, "serial_to_tun: write");
 	}
@@ -336,84 +346,41 @@ serial_to_tun(FILE *inslip, int outfd)
   goto read_more;
 }
 
-unsigned char slip_buf[2000];
-int slip_end, slip_begin;
-
-void
-slip_send_char(int fd, unsigned char c)
-{
-  switch(c) {
-  case SLIP_END:
-    slip_send(fd, SLIP_ESC);
-    slip_send(fd, SLIP_ESC_END);
-    break;
-  case SLIP_ESC:
-    slip_send(fd, SLIP_ESC);
-    slip_send(fd, SLIP_ESC_ESC);
-    break;
-  case XON:
-    if(flowcontrol_xonxoff) {
-      slip_send(fd, SLIP_ESC);
-      slip_send(fd, SLIP_ESC_XON);
-    } else {
-      slip_send(fd, c);
-    }
-    break;
-  case XOFF:
-    if(flowcontrol_xonxoff) {
-      slip_send(fd, SLIP_ESC);
-      slip_send(fd, SLIP_ESC_XOFF);
-    } else {
-      slip_send(fd, c);
-    }
-    break;
-  default:
-    slip_send(fd, c);
-    break;
-  }
-}
-
-void
-slip_send(int fd, unsigned char c)
-{
-  if(slip_end >= sizeof(slip_buf)) {
-    err(1, "slip_send overflow");
-  }
-  slip_buf[slip_end] = c;
-  slip_end++;
-}
-
 int
 slip_empty()
 {
-  return slip_end == 0;
+  return slip_queue_empty(&slip_queue);
 }
 
 void
 slip_flushbuf(int fd)
 {
-  int n;
+  unsigned long sent = slip_queue.sent;
+  ssize_t n;
 
   if(slip_empty()) {
     return;
   }
 
-  n = write(fd, slip_buf + slip_begin, (slip_end - slip_begin));
+  /* With a delay between packets, write one packet at a time */
+  n = slip_queue_flush(&slip_queue, fd, basedelay ? 1 : 0);
 
-  if(n == -1 && errno != EAGAIN) {
+  if(n == -1) {
     err(1, "slip_flushbuf write failed");
-  } else if(n == -1) {
-    PROGRESS("Q");		/* Outqueueis full! */
-  } else {
-    slip_begin += n;
-    if(slip_begin == slip_end) {
-      slip_begin = slip_end = 0;
-    }
+  } else if(n == 0) {
+    PROGRESS("Q");		/* Outqueue is full! */
+  } else if(basedelay && slip_queue.sent != sent) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL) ;
+ // delaymsec=basedelay*(1+(size/120));//multiply by # of 6lowpan packets?
+    delaymsec=basedelay;
+    delaystartsec =tv.tv_sec;
+    delaystartmsec=tv.tv_usec/1000;
   }
 }
 
 void
-write_to_serial(int outfd, void *inbuf, int len)
+write_to_serial(void *inbuf, int len)
 {
   u_int8_t *p = inbuf;
   int i;
@@ -437,43 +404,17 @@ write_to_serial(int outfd, void *inbuf, int len)
     }
   }
 
+  pcapng_tap_packet(capture_tap, PCAPNG_TAP_OUT, p, len);
+
   /* It would be ``nice'' to send a SLIP_END here but it's not
    * really necessary.
    */
-  /* slip_send(outfd, SLIP_END); */
 
-  for(i = 0; i < len; i++) {
-    switch(p[i]) {
-    case SLIP_END:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_END);
-      break;
-    case SLIP_ESC:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_ESC);
-      break;
-    case XON:
-      if(flowcontrol_xonxoff) {
-        slip_send(outfd, SLIP_ESC);
-        slip_send(outfd, SLIP_ESC_XON);
-      } else {
-        slip_send(outfd, p[i]);
-      }
-      break;
-    case XOFF:
-      if(flowcontrol_xonxoff) {
-        slip_send(outfd, SLIP_ESC);
-        slip_send(outfd, SLIP_ESC_XOFF);
-      } else {
-        slip_send(outfd, p[i]);
-      }
-      break;
-    default:
-      slip_send(outfd, p[i]);
-      break;
-    }
+  if(slip_queue_put(&slip_queue, p, len,
+                    flowcontrol_xonxoff ? SLIP_QUEUE_XONXOFF : 0) == -1) {
+    PROGRESS("D");
+    return;
   }
-  slip_send(outfd, SLIP_END);
   PROGRESS("t");
 }
 
@@ -482,7 +423,7 @@ write_to_serial(int outfd, void *inbuf, int len)
  * Read from tun, write to slip.
  */
 int
-tun_to_serial(int infd, int outfd)
+tun_to_serial(int infd)
 {
   struct {
     unsigned char inbuf[2000];
@@ -491,119 +432,21 @@ tun_to_serial(int infd, int outfd)
 
   if((size = read(infd, uip.inbuf, 2000)) == -1) err(1, "tun_to_serial: read");
 
-  write_to_serial(outfd, uip.inbuf, size);
+  write_to_serial(uip.inbuf, size);
   return size;
 }
 
-void
-stty_telos(int fd)
-{
-  struct termios tty;
-  speed_t speed = b_rate;
-  int i;
-
-  if(tcflush(fd, TCIOFLUSH) == -1) err(1, "tcflush");
-
-  if(tcgetattr(fd, &tty) == -1) err(1, "tcgetattr");
-
-  cfmakeraw(&tty);
-
-  /* Nonblocking read. */
-  tty.c_cc[VTIME] = 0;
-  tty.c_cc[VMIN] = 0;
-  if (flowcontrol)
-    tty.c_cflag |= CRTSCTS;
-  else
-    tty.c_cflag &= ~CRTSCTS;
-  tty.c_iflag &= ~IXON;
-  if(flowcontrol_xonxoff) {
-    tty.c_iflag |= IXOFF | IXANY;
-  } else {
-    tty.c_iflag &= ~IXOFF & ~IXANY;
-  }
-  tty.c_cflag &= ~HUPCL;
-  tty.c_cflag &= ~CLOCAL;
-
-  cfsetispeed(&tty, speed);
-  cfsetospeed(&tty, speed);
-
-  if(tcsetattr(fd, TCSAFLUSH, &tty) == -1) err(1, "tcsetattr");
-
-#if 1
-  /* Nonblocking read and write. */
-  /* if(fcntl(fd, F_SETFL, O_NONBLOCK) == -1) err(1, "fcntl"); */
-
-  tty.c_cflag |= CLOCAL;
-  if(tcsetattr(fd, TCSAFLUSH, &tty) == -1) err(1, "tcsetattr");
-
-  i = TIOCM_DTR;
-  if(ioctl(fd, TIOCMBIS, &i) == -1) err(1, "ioctl");
-#endif
-
-  usleep(10*1000);		/* Wait for hardware 10ms. */
-
-  /* Flush input and output buffers. */
-  if(tcflush(fd, TCIOFLUSH) == -1) err(1, "tcflush");
-}
-
-int
-devopen(const char *dev, int flags)
-{
-  char t[1024];
-  strcpy(t, "/dev/");
-  strncat(t, dev, sizeof(t) - 5);
-  return open(t, flags);
-}
-
-#ifdef linux
-#include <linux/if.h>
-#include <linux/if_tun.h>
-
-int
-tun_alloc(char *dev, int tap)
-{
-  struct ifreq ifr;
-  int fd, err;
-
-  if( (fd = open("/dev/net/tun", O_RDWR)) < 0 ) {
-    perror("can not open /dev/net/tun");
-    return -1;
-  }
-
-  memset(&ifr, 0, sizeof(ifr));
-
-  /* Flags: IFF_TUN   - TUN device (no Ethernet headers)
-   *        IFF_TAP   - TAP device
-   *
-   *        IFF_NO_PI - Do not provide packet information
-   */
-  ifr.ifr_flags = (tap ? IFF_TAP : IFF_TUN) | IFF_NO_PI;
-  if(*dev != 0)
-    strncpy(ifr.ifr_name, dev, IFNAMSIZ);
-
-  if((err = ioctl(fd, TUNSETIFF, (void *) &ifr)) < 0 ) {
-    close(fd);
-    fprintf(stderr, "can not tunsetiff to %s (flags=%08x): %s\n", dev, ifr.ifr_flags,
-            strerror(errno));
-    return err;
-  }
-
-  /* get resulting tunnel name */
-  strcpy(dev, ifr.ifr_name);
-  return fd;
-}
-#else
-int
-tun_alloc(char *dev, int tap)
-{
-  return devopen(dev, O_RDWR);
-}
-#endif
-
 void
 cleanup(void)
 {
 #ifndef __APPLE__
+  if(verbose>2) {
+    slip_queue_print_stats(&slip_queue, "slip queue", stderr);
+    if(capture_tap != NULL) {
+      pcapng_tap_print_stats(capture_tap, stderr);
+    }
+  }
+  pcapng_tap_close(capture_tap);
   if (timestamp) stamptime();
   ssystem("ifconfig %s down", tundev);
 #ifndef linux
@@ -638,6 +481,14 @@ sigcleanup(int signo)
 }
 
 static int got_sigalarm;
+static int got_sigusr1;
+
+void
+sigusr1(int signo)
+{
+  (void)signo;
+  got_sigusr1 = 1;
+}
 
 void
 sigalarm(int signo)
@@ -762,7 +613,7 @@ main(int argc, char **argv)
   prog = argv[0];
   setvbuf(stdout, NULL, _IOLBF, 0); /* Line buffered output. */
 
-  while((c = getopt(argc, argv, "B:HILPhXM:s:t:v::d::a:p:T")) != -1) {
+  while((c = getopt(argc, argv, "B:HILPhXM:s:t:v::d::a:p:Tq:Dw:")) != -1) {
     switch(c) {
     case 'B':
       baudrate = atoi(optarg);
@@ -833,6 +684,23 @@ main(int argc, char **argv)
       tap = 1;
       break;
 
+    case 'q':
+      if(sscanf(optarg, "%d,%d,%d", &queue_depth, &queue_low, &queue_high) < 1) {
+        err(1, "bad queue size ``%s''", optarg);
+      }
+      break;
+
+    case 'D':
+      queue_policy = SLIP_QUEUE_DROP_OLDEST;
+      break;
+
+    case 'w':
+      if(pcapng_tap_open(&capture, optarg) == -1) {
+        exit(1);
+      }
+      capture_tap = &capture;
+      break;
+
     case '?':
     case 'h':
     default:
@@ -865,6 +733,15 @@ fprintf(stderr,"                Actual delay is basedelay*(#6LowPAN fragments) m
 fprintf(stderr,"                -d is equivalent to -d10.\n");
 fprintf(stderr," -a serveraddr  \n");
 fprintf(stderr," -p serverport  \n");
+fprintf(stderr," -q depth[,low,high]\n");
+fprintf(stderr,"                Packets queued for the serial line (default %d) and the\n", SLIP_QUEUE_DEFAULT_DEPTH);
+fprintf(stderr,"                watermarks between which reading from tun pauses.\n");
+fprintf(stderr," -D             Drop the oldest queued packet when the queue is full\n");
+fprintf(stderr,"                instead of pausing tun. Send SIGUSR1 for queue counters.\n");
+fprintf(stderr," -w file[,size=MB][,snap=bytes][,rate=pps][,wpan]\n");
+fprintf(stderr,"                Capture packets to and from tun in a pcapng ring file\n");
+fprintf(stderr,"                (default 16 MB), cut at snap bytes, at most pps packets/s\n");
+fprintf(stderr,"                per direction, as raw IPv6 or as IEEE 802.15.4 frames.\n");
 exit(1);
       break;
     }
@@ -954,9 +831,14 @@ exit(1);
     }
     if (timestamp) stamptime();
     fprintf(stderr, "********SLIP started on ``/dev/%s''\n", siodev);
-    stty_telos(slipfd);
+    if(stty_telos(slipfd, b_rate, (flowcontrol ? STTY_CRTSCTS : 0) |
+                  (flowcontrol_xonxoff ? STTY_XONXOFF : 0)) == -1) {
+      exit(1);
+    }
   }
-  slip_send(slipfd, SLIP_END);
+  slip_queue_init(&slip_queue, queue_depth, 2000, queue_low, queue_high,
+                  queue_policy);
+  slip_queue_put_raw(&slip_queue, "\300", 1); /* SLIP_END */
   inslip = fdopen(slipfd, "r");
   if(inslip == NULL) err(1, "main: fdopen");
 
@@ -971,37 +853,60 @@ exit(1);
   signal(SIGTERM, sigcleanup);
   signal(SIGINT, sigcleanup);
   signal(SIGALRM, sigalarm);
+  signal(SIGUSR1, sigusr1);
   ifconf(tundev, ipaddr);
 
   while(1) {
+    struct timeval timeout, *tvp = NULL;
     maxfd = 0;
     FD_ZERO(&rset);
     FD_ZERO(&wset);
 
     if(got_sigalarm && ipa_enable) {
       /* Send "?IPA". */
-      slip_send(slipfd, '?');
-      slip_send(slipfd, 'I');
-      slip_send(slipfd, 'P');
-      slip_send(slipfd, 'A');
-      slip_send(slipfd, SLIP_END);
+      slip_queue_put(&slip_queue, "?IPA", 4, 0);
       got_sigalarm = 0;
     }
 
-    if(!slip_empty()) {		/* Anything to flush? */
+    if(got_sigusr1) {
+      slip_queue_print_stats(&slip_queue, "slip queue", stderr);
+      if(capture_tap != NULL) {
+        pcapng_tap_print_stats(capture_tap, stderr);
+      }
+      got_sigusr1 = 0;
+    }
+
+    /* Optional delay between outgoing packets */
+    /* Base delay times number of 6lowpan fragments to be sent */
+    if(delaymsec) {
+      struct timeval tv;
+      int dmsec;
+      gettimeofday(&tv, NULL) ;
+      dmsec=(tv.tv_sec-delaystartsec)*1000+tv.tv_usec/1000-delaystartmsec;
+      if(dmsec<0) delaymsec=0;
+      if(dmsec>delaymsec) delaymsec=0;
+      if(delaymsec) {
+        /* Wake up when the delay has passed */
+        timeout.tv_sec = (delaymsec - dmsec) / 1000;
+        timeout.tv_usec = ((delaymsec - dmsec) % 1000) * 1000;
+        tvp = &timeout;
+      }
+    }
+
+    if(!slip_empty() && delaymsec == 0) {	/* Anything to flush? */
       FD_SET(slipfd, &wset);
     }
 
     FD_SET(slipfd, &rset);	/* Read from slip ASAP! */
     if(slipfd > maxfd) maxfd = slipfd;
 
-    /* We only have one packet at a time queued for slip output. */
-    if(slip_empty()) {
+    /* Read from tun as long as the slip queue accepts packets. */
+    if(slip_queue_accepting(&slip_queue)) {
       FD_SET(tunfd, &rset);
       if(tunfd > maxfd) maxfd = tunfd;
     }
 
-    ret = select(maxfd + 1, &rset, &wset, NULL, NULL);
+    ret = select(maxfd + 1, &rset, &wset, NULL, tvp);
     if(ret == -1 && errno != EINTR) {
       err(1, "select");
     } else if(ret > 0) {
@@ -1014,30 +919,11 @@ exit(1);
 	if(ipa_enable) sigalarm_reset();
       }
 
-      /* Optional delay between outgoing packets */
-      /* Base delay times number of 6lowpan fragments to be sent */
-      if(delaymsec) {
-       struct timeval tv;
-       int dmsec;
-       gettimeofday(&tv, NULL) ;
-       dmsec=(tv.tv_sec-delaystartsec)*1000+tv.tv_usec/1000-delaystartmsec;
-       if(dmsec<0) delaymsec=0;
-       if(dmsec>delaymsec) delaymsec=0;
-      }
-      if(delaymsec==0) {
-        int size;
-        if(slip_empty() && FD_ISSET(tunfd, &rset)) {
-          size=tun_to_serial(tunfd, slipfd);
+      if(slip_queue_accepting(&slip_queue) && FD_ISSET(tunfd, &rset)) {
+        tun_to_serial(tunfd);
+        if(delaymsec==0) {
           slip_flushbuf(slipfd);
           if(ipa_enable) sigalarm_reset();
-          if(basedelay) {
-            struct timeval tv;
-            gettimeofday(&tv, NULL) ;
- //         delaymsec=basedelay*(1+(size/120));//multiply by # of 6lowpan packets?
-            delaymsec=basedelay;
-            delaystartsec =tv.tv_sec;
-            delaystartmsec=tv.tv_usec/1000;
-          }
         }
       }
     }